@@ -6,6 +6,7 @@
  
 
 #include "functions.h"
+#include <vector>
 // Define sleep duration (5 minutes) in microseconds
 const uint64_t sleepTime = 5 * 60 * 1000000;  // 5 minutes in microseconds
 const char *serverName= "https://detect.roboflow.com/xxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
@@ -279,6 +280,35 @@ float json_data(String response) {
   return ripeness_json;
 }
 
+// Deletes a file, or a directory together with everything inside it
+// (rmdir only removes empty directories)
+static bool removeRecursive(const String& path) {
+  File entry = SD_MMC.open(path);
+  if (!entry) {
+    return false;
+  }
+  if (!entry.isDirectory()) {
+    entry.close();
+    return SD_MMC.remove(path);
+  }
+
+  // Collect the children first, the directory is not modified while it is being listed
+  std::vector<String> children;
+  File child = entry.openNextFile();
+  while (child) {
+    children.push_back(child.path());
+    child.close();
+    child = entry.openNextFile();
+  }
+  entry.close();
+
+  bool ok = true;
+  for (const String& childPath : children) {
+    ok = removeRecursive(childPath) && ok;
+  }
+  return SD_MMC.rmdir(path) && ok;
+}
+
 void clearSDCardContent() {
   File root = SD_MMC.open("/");  // Open the root directory of the SD card
   if (!root) {
@@ -293,20 +323,23 @@ void clearSDCardContent() {
 
   Serial.println("Deleting all content on the SD card...");
 
-  // Iterate through all files and folders on the SD card
+  // Collect the top-level entries, then delete each one with its contents
+  std::vector<String> entries;
   File file = root.openNextFile();
   while (file) {
-    String fileName = String("/") + file.name();
-    if (file.isDirectory()) {
-      SD_MMC.rmdir(fileName.c_str());  // Delete the directory
-      Serial.print("Deleted directory: ");
+    entries.push_back(file.path());
+    file.close();
+    file = root.openNextFile();  // Open the next file
+  }
+  root.close();
+
+  for (const String& fileName : entries) {
+    if (removeRecursive(fileName)) {
+      Serial.print("Deleted: ");
     } else {
-      SD_MMC.remove(fileName.c_str());  // Delete the file
-      Serial.print("Deleted file: ");
+      Serial.print("Failed to delete: ");
     }
     Serial.println(fileName);
-
-    file = root.openNextFile();  // Open the next file
   }
 
   Serial.println("All content on the SD card has been deleted.");
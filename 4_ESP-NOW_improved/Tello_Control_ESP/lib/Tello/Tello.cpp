@@ -11,29 +11,40 @@ static const char *TELLOIPADDRESS = "192.168.10.1";
 static const int COMMAND_PORT = 8889;
 static const int STATUS_PORT = 8890;
 
-#define MAXBUFFSIZE 512
-
 using namespace std;
 
 Tello::Tello()
 {
 	isInitialised = false;
+	udpclient = nullptr;
+	udpLock = nullptr;
+	replyOwner = nullptr;
 }
 
 Tello::~Tello()
 {
 }
 
+// Called again by setup() after a reconnect: the socket and lock are reused
 void Tello::init()
 {
-	udpclient = new WiFiUDP();
+	if (udpclient == nullptr)
+	{
+		udpclient = new WiFiUDP();
+		udpLock = xSemaphoreCreateMutex();
+	}
+	else
+	{
+		udpclient->stop();
+	}
+	replyOwner = nullptr;
 	// This initializes udp and transfer buffer
 	udpclient->begin(COMMAND_PORT);
 	isInitialised = true;
 	string response = sendCommand("command");
 
 	// if response is other than "ok" then we consider as error
-	if (!response.compare("ok"))
+	if (response.compare("ok") != 0)
 	{
 		isInitialised = false;
 	}
@@ -44,293 +55,251 @@ string Tello::sendCommand(string command)
 	if (!isInitialised)
 		return "error";
 
-	udpclient->beginPacket(TELLOIPADDRESS, COMMAND_PORT);
-	udpclient->write((const unsigned char *)command.c_str(), command.length());
-	udpclient->endPacket();
+	char buffer[TELLO_REPLY_MAX];
+	waitForReply(command.c_str(), nullptr, buffer, sizeof(buffer));
+	return string(buffer);
+}
 
-	char buffer[MAXBUFFSIZE] = {0};
-	udpclient->parsePacket();
-	int n = udpclient->read(buffer, MAXBUFFSIZE);
-	if (n > 0)
+// Sends the command once and waits for its reply (empty on timeout); true if the reply is
+// the expected one, or any reply when expected is null
+bool Tello::waitForReply(const char *command, const char *expected, char *response, size_t responseSize)
+{
+	TelloRequest request;
+	if (!request.begin(*this, command, expected))
 	{
-		buffer[n] = '\0';
+		response[0] = '\0';
+		return false;
 	}
-	printf("sendCommand: %s response=%s\n", command.c_str(), buffer);
+	bool done = request.wait();
+	snprintf(response, responseSize, "%s", request.reply());
+	printf("sendCommand: %s response=%s\n", command, response);
+	return done;
+}
 
-	return string(buffer);
+// A request may take the channel when no other request is waiting for a reply
+bool Tello::claimChannel(TelloRequest *request)
+{
+	xSemaphoreTake(udpLock, portMAX_DELAY);
+	bool claimed = replyOwner == nullptr || replyOwner == request;
+	if (claimed)
+	{
+		replyOwner = request;
+	}
+	xSemaphoreGive(udpLock);
+	return claimed;
 }
 
-bool Tello::sendTelloCommandWithRetry(String command, int maxRetries, int delayBetweenRetries)
+void Tello::releaseChannel(TelloRequest *request)
 {
-    struct CommandState {
-        int currentAttempt = 0;
-        unsigned long lastAttemptTime = 0;
-        bool commandSent = false;
-    };
-    static CommandState state;
-    if (!isInitialised) {
-        printf("Tello is not initialized.");
-        return false;
-    }
-    if (state.currentAttempt >= maxRetries) {
-        printf("Failed to execute command: %s after max retries\n", command.c_str());
-        state = CommandState(); 
-        return false;
-    }
-
-    if (!state.commandSent || millis() - state.lastAttemptTime >= delayBetweenRetries) {
-        udpclient->beginPacket(TELLOIPADDRESS, COMMAND_PORT);
-        udpclient->write((const unsigned char *)command.c_str(), command.length());
-        udpclient->endPacket();
-
-        char buffer[MAXBUFFSIZE] = {0};
-        udpclient->parsePacket();
-        int n = udpclient->read(buffer, MAXBUFFSIZE);
-        if (n > 0) {
-            buffer[n] = '\0';
-        }
-
-        if (String(buffer) == "ok") {
-            printf("Command: %s Response: %s\n", command.c_str(), buffer);
-            state = CommandState();
-            return true;
-        }
-        state.lastAttemptTime = millis();
-        state.currentAttempt++;
-        state.commandSent = true;
-    }
-    return false;
+	xSemaphoreTake(udpLock, portMAX_DELAY);
+	if (replyOwner == request)
+	{
+		replyOwner = nullptr;
+	}
+	xSemaphoreGive(udpLock);
 }
 
+// Works on caller buffers only, so the rc path does not allocate
+void Tello::writePacket(const char *command, size_t length)
+{
+	xSemaphoreTake(udpLock, portMAX_DELAY);
+	udpclient->beginPacket(TELLOIPADDRESS, COMMAND_PORT);
+	udpclient->write((const unsigned char *)command, length);
+	udpclient->endPacket();
+	xSemaphoreGive(udpLock);
+}
 
-bool Tello::takeoff()
+// Reads a waiting reply without blocking; 0 if none has arrived
+int Tello::readReply(char *reply, size_t replySize)
 {
-	string response = sendCommand("takeoff");
-	if (!response.compare("ok"))
+	xSemaphoreTake(udpLock, portMAX_DELAY);
+	int n = 0;
+	if (udpclient->parsePacket() > 0)
 	{
-		return true;
+		n = udpclient->read(reply, replySize - 1);
 	}
-	return false;
+	xSemaphoreGive(udpLock);
+	reply[n > 0 ? n : 0] = '\0';
+	return n;
 }
 
-bool Tello::land()
+void Tello::discardReplies()
 {
-	string response = sendCommand("land");
-	if (!response.compare("ok"))
+	xSemaphoreTake(udpLock, portMAX_DELAY);
+	while (udpclient->parsePacket() > 0)
 	{
-		return true;
+		udpclient->flush();
 	}
-	return false;
+	xSemaphoreGive(udpLock);
 }
 
-bool Tello::startVideoStream()
+// Formats a command from TELLO_COMMANDS on the stack (arguments clamped to the table's range)
+// and checks the reply against the table's expected response
+bool Tello::sendTableCommand(TelloCommandId id, const int *args, uint8_t argCount)
 {
-	string response = sendCommand("streamon");
-	if (!response.compare("ok"))
+	if (!isInitialised)
+		return false;
+
+	char command[TELLO_COMMAND_MAX];
+	size_t length = telloFormatCommand(command, sizeof(command), id, args, argCount);
+	if (length == 0)
 	{
+		return false;
+	}
+	const char *expected = telloCommand(id).expected;
+	if (expected == nullptr)
+	{
+		writePacket(command, length);
 		return true;
 	}
-	return false;
+	char response[TELLO_REPLY_MAX];
+	return waitForReply(command, expected, response, sizeof(response));
 }
 
-bool Tello::stopVideoStream()
+bool Tello::sendTableCommand(TelloCommandId id, const char *word)
 {
-	string response = sendCommand("streamoff");
-	if (!response.compare("ok"))
+	if (!isInitialised)
+		return false;
+
+	char command[TELLO_COMMAND_MAX];
+	size_t length = telloFormatCommand(command, sizeof(command), id, word);
+	if (length == 0)
 	{
-		return true;
+		return false;
 	}
-	return false;
+	char response[TELLO_REPLY_MAX];
+	return waitForReply(command, telloCommand(id).expected, response, sizeof(response));
 }
 
-bool Tello::turnOff()
+// Each call has its own TelloRequest, so concurrent callers do not share attempt counts
+bool Tello::sendTelloCommandWithRetry(String command, int maxRetries, int delayBetweenRetries)
 {
-	string response = sendCommand("emergency");
-	if (!response.compare("ok"))
+	if (!isInitialised) {
+		printf("Tello is not initialized.");
+		return false;
+	}
+	TelloRequest request;
+	if (!request.begin(*this, command.c_str(), "ok", maxRetries, delayBetweenRetries))
 	{
-		return true;
+		return false;
 	}
-	return false;
+	if (!request.wait())
+	{
+		printf("Failed to execute command: %s after max retries\n", command.c_str());
+		return false;
+	}
+	printf("Command: %s Response: %s\n", command.c_str(), request.reply());
+	return true;
+}
+
+
+bool Tello::takeoff()
+{
+	return sendTableCommand(TELLO_TAKEOFF);
+}
+
+bool Tello::land()
+{
+	return sendTableCommand(TELLO_LAND);
+}
+
+bool Tello::startVideoStream()
+{
+	return sendTableCommand(TELLO_STREAMON);
+}
+
+bool Tello::stopVideoStream()
+{
+	return sendTableCommand(TELLO_STREAMOFF);
+}
+
+bool Tello::turnOff()
+{
+	return sendTableCommand(TELLO_EMERGENCY);
 }
 
 bool Tello::up(int x)
 {
-	char buff[10];
-	string command = "up " + string(itoa(x, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_UP, &x, 1);
 }
 
 bool Tello::down(int x)
 {
-	char buff[10];
-	string command = "down " + string(itoa(x, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_DOWN, &x, 1);
 }
 
 bool Tello::left(int x)
 {
-	char buff[10];
-	string command = "left " + string(itoa(x, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_LEFT, &x, 1);
 }
 
 bool Tello::right(int x)
 {
-	char buff[10];
-	string command = "right " + string(itoa(x, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_RIGHT, &x, 1);
 }
 
 bool Tello::forward(int x)
 {
-	char buff[10];
-	string command = "forward " + string(itoa(x, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_FORWARD, &x, 1);
 }
 
 bool Tello::back(int x)
 {
-	char buff[10];
-	string command = "back " + string(itoa(x, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_BACK, &x, 1);
 }
 
 bool Tello::rotate_clockwise(int deg)
 {
-	char buff[10];
-	string command = "cw " + string(itoa(deg, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_CW, &deg, 1);
 }
 
 bool Tello::rotate_anticlockwise(int deg)
 {
-	char buff[10];
-	string command = "ccw " + string(itoa(deg, buff, 10));
-	string response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_CCW, &deg, 1);
 }
 
 bool Tello::flip_front()
 {
-	string response = sendCommand("flip f");
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_FLIP, "f");
 }
 
 bool Tello::flip_right()
 {
-	string response = sendCommand("flip r");
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_FLIP, "r");
 }
 
 bool Tello::flip_left()
 {
-	string response = sendCommand("flip l");
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_FLIP, "l");
 }
 
 bool Tello::flip_back()
 {
-	string response = sendCommand("flip b");
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_FLIP, "b");
 }
 
 bool Tello::setSpeed(int x)
 {
-	char buff[10];
-	string command = "speed " + string(itoa(x, buff, 10));
-	string response;
-	if ((x < 10) || (x > 100))
+	if (!telloArgInRange(TELLO_SPEED, x))
 	{
-		// cout << "speed out of range " << endl;
 		return false;
 	}
-
-	response = sendCommand(command);
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	return sendTableCommand(TELLO_SPEED, &x, 1);
 }
 
 // “a” = left/right (-100-100)
 // “b” = forward/backward (-100-100)
 // “c” = up/down (-100-100)
 // “d” = yaw (-100-100)
+// The drone does not reply to rc, so the command is sent without waiting
 bool Tello::sendRCcontrol(int a, int b, int c, int d)
 {
-	if (!(check_range(a, -100, 100)) || !(check_range(b, -100, 100)) || !(check_range(c, -100, 100)) || !(check_range(d, -100, 100)))
+	if (!telloArgInRange(TELLO_RC, a) || !telloArgInRange(TELLO_RC, b) || !telloArgInRange(TELLO_RC, c) || !telloArgInRange(TELLO_RC, d))
 	{
 		return false;
 	}
-	char buff[10];
-	string _a = string(itoa(a, buff, 10));
-	string _b = string(itoa(b, buff, 10));
-	string _c = string(itoa(c, buff, 10));
-	string _d = string(itoa(d, buff, 10));
-	string command = "rc " + _a.append(" ") + _b.append(" ") + _c.append(" ") + _d;
-	string response = sendCommand(command);
-
-	if (!response.compare("ok"))
-	{
-		return true;
-	}
-	return false;
+	int sticks[4] = {a, b, c, d};
+	return sendTableCommand(TELLO_RC, sticks, 4);
 }
 
 bool Tello::changeWifi(string ssid, string password)
@@ -422,9 +391,4 @@ int Tello::getWifiSnr()
 	string response = sendCommand(command);
 	int x = atoi(response.c_str());
 	return x;
-}
-
-bool Tello::check_range(int x, int min, int max)
-{
-	return (min < x && x < max);
 }
\ No newline at end of file
@@ -12,6 +12,10 @@
 #include <WiFi.h>
 #include <WiFiUdp.h>
 #include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "TelloCommands.h"
+#include "TelloRequest.h"
 
 using namespace std;
 class Tello
@@ -19,13 +23,27 @@ class Tello
 private :
 	
 	WiFiUDP* udpclient;
-	bool check_range(int x, int min, int max);
+	SemaphoreHandle_t udpLock;    // WiFiUDP is not thread-safe; held only around socket calls
+	TelloRequest *replyOwner;     // The request waiting for a reply, guarded by udpLock
+
+	// Command channel for TelloRequest
+	friend class TelloRequest;
+	bool claimChannel(TelloRequest *request);
+	void releaseChannel(TelloRequest *request);
+	void writePacket(const char *command, size_t length);
+	int readReply(char *reply, size_t replySize);
+	void discardReplies();
+	bool waitForReply(const char *command, const char *expected, char *response, size_t responseSize);
+	bool sendTableCommand(TelloCommandId id, const int *args = nullptr, uint8_t argCount = 0);
+	bool sendTableCommand(TelloCommandId id, const char *word);
 
 public:
 	Tello();
 	~Tello();
 	bool isInitialised ;
 	void init();
+	// Blocks until the reply is "ok" or maxRetries attempts failed. Safe to call from several
+	// tasks; for a non-blocking send use a TelloRequest.
 	bool sendTelloCommandWithRetry(String command, int maxRetries = 15, int delayBetweenRetries = 100); // updated by Sagar
 	string sendCommand(string command);
 	bool takeoff();
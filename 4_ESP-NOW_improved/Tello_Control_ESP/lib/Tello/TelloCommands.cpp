@@ -0,0 +1,54 @@
+#include "TelloCommands.h"
+#include <stdio.h>
+#include <string.h>
+
+size_t telloFormatCommand(char *buffer, size_t size, TelloCommandId id, const int *args, uint8_t argCount)
+{
+	const TelloCommandSpec &spec = TELLO_COMMANDS[id];
+	if (argCount != spec.argCount || spec.words != nullptr)
+	{
+		return 0;
+	}
+	int len = snprintf(buffer, size, "%s", spec.name);
+	for (uint8_t i = 0; i < argCount && len > 0 && (size_t)len < size; i++)
+	{
+		int value = args[i];
+		if (value < spec.minValue)
+		{
+			value = spec.minValue;
+		}
+		else if (value > spec.maxValue)
+		{
+			value = spec.maxValue;
+		}
+		len += snprintf(buffer + len, size - len, " %d", value);
+	}
+	return len > 0 && (size_t)len < size ? len : 0;
+}
+
+size_t telloFormatCommand(char *buffer, size_t size, TelloCommandId id, const char *word)
+{
+	const TelloCommandSpec &spec = TELLO_COMMANDS[id];
+	if (spec.words == nullptr || word == nullptr)
+	{
+		return 0;
+	}
+
+	// Match word against the space separated list of allowed words
+	size_t wordLength = strlen(word);
+	const char *allowed = spec.words;
+	bool found = false;
+	while (*allowed != '\0' && !found)
+	{
+		const char *next = strchr(allowed, ' ');
+		size_t allowedLength = next ? (size_t)(next - allowed) : strlen(allowed);
+		found = allowedLength == wordLength && strncmp(allowed, word, wordLength) == 0;
+		allowed += allowedLength + (next ? 1 : 0);
+	}
+	if (!found)
+	{
+		return 0;
+	}
+	int len = snprintf(buffer, size, "%s %s", spec.name, word);
+	return len > 0 && (size_t)len < size ? len : 0;
+}
@@ -0,0 +1,97 @@
+#ifndef TELLOCOMMANDS_H
+#define TELLOCOMMANDS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Tello SDK commands as a compile-time table: name, argument count and range, and the
+// reply that means success. Commands are formatted into caller-provided (stack) buffers,
+// so sending one, including rc at 20-50 Hz, does not touch the heap.
+
+#define TELLO_COMMAND_MAX 48   // Longest formatted command ("rc -100 -100 -100 -100" is 22)
+
+enum TelloCommandId : uint8_t
+{
+	TELLO_COMMAND,
+	TELLO_TAKEOFF,
+	TELLO_LAND,
+	TELLO_EMERGENCY,
+	TELLO_STREAMON,
+	TELLO_STREAMOFF,
+	TELLO_UP,
+	TELLO_DOWN,
+	TELLO_LEFT,
+	TELLO_RIGHT,
+	TELLO_FORWARD,
+	TELLO_BACK,
+	TELLO_CW,
+	TELLO_CCW,
+	TELLO_GO,
+	TELLO_FLIP,
+	TELLO_SPEED,
+	TELLO_RC,
+	TELLO_SETBITRATE,
+	TELLO_SETFPS,
+	TELLO_SETRESOLUTION,
+	TELLO_COMMAND_COUNT
+};
+
+struct TelloCommandSpec
+{
+	TelloCommandId id;
+	const char *name;
+	uint8_t argCount;      // Numeric arguments, all sharing one range
+	int16_t minValue;
+	int16_t maxValue;
+	const char *words;     // Allowed word argument ("f b l r"), nullptr for numeric commands
+	const char *expected;  // Reply on success, nullptr if the drone does not reply
+};
+
+constexpr TelloCommandSpec TELLO_COMMANDS[] = {
+	{TELLO_COMMAND, "command", 0, 0, 0, nullptr, "ok"},
+	{TELLO_TAKEOFF, "takeoff", 0, 0, 0, nullptr, "ok"},
+	{TELLO_LAND, "land", 0, 0, 0, nullptr, "ok"},
+	{TELLO_EMERGENCY, "emergency", 0, 0, 0, nullptr, "ok"},
+	{TELLO_STREAMON, "streamon", 0, 0, 0, nullptr, "ok"},
+	{TELLO_STREAMOFF, "streamoff", 0, 0, 0, nullptr, "ok"},
+	{TELLO_UP, "up", 1, 20, 500, nullptr, "ok"},
+	{TELLO_DOWN, "down", 1, 20, 500, nullptr, "ok"},
+	{TELLO_LEFT, "left", 1, 20, 500, nullptr, "ok"},
+	{TELLO_RIGHT, "right", 1, 20, 500, nullptr, "ok"},
+	{TELLO_FORWARD, "forward", 1, 20, 500, nullptr, "ok"},
+	{TELLO_BACK, "back", 1, 20, 500, nullptr, "ok"},
+	{TELLO_CW, "cw", 1, 1, 360, nullptr, "ok"},
+	{TELLO_CCW, "ccw", 1, 1, 360, nullptr, "ok"},
+	{TELLO_GO, "go", 4, -500, 500, nullptr, "ok"}, // x y z speed; speed is clamped by the caller to TELLO_SPEED's range
+	{TELLO_FLIP, "flip", 0, 0, 0, "f b l r", "ok"},
+	{TELLO_SPEED, "speed", 1, 10, 100, nullptr, "ok"},
+	{TELLO_RC, "rc", 4, -100, 100, nullptr, nullptr},
+	{TELLO_SETBITRATE, "setbitrate", 1, 0, 5, nullptr, "ok"},
+	{TELLO_SETFPS, "setfps", 0, 0, 0, "low middle high", "ok"},
+	{TELLO_SETRESOLUTION, "setresolution", 0, 0, 0, "low high", "ok"},
+};
+
+constexpr bool telloTableInOrder(size_t index = 0)
+{
+	return index == TELLO_COMMAND_COUNT ||
+		   (TELLO_COMMANDS[index].id == index && TELLO_COMMANDS[index].argCount <= 4 && telloTableInOrder(index + 1));
+}
+static_assert(sizeof(TELLO_COMMANDS) / sizeof(TELLO_COMMANDS[0]) == TELLO_COMMAND_COUNT, "one entry per TelloCommandId");
+static_assert(telloTableInOrder(), "TELLO_COMMANDS must be indexed by TelloCommandId");
+
+inline const TelloCommandSpec &telloCommand(TelloCommandId id) { return TELLO_COMMANDS[id]; }
+
+// True if value is inside the command's argument range
+inline bool telloArgInRange(TelloCommandId id, int value)
+{
+	return value >= TELLO_COMMANDS[id].minValue && value <= TELLO_COMMANDS[id].maxValue;
+}
+
+// Formats "<name> <args...>" into buffer, clamping every argument to the command's range.
+// Returns the length, or 0 if the argument count is wrong or the buffer is too small.
+size_t telloFormatCommand(char *buffer, size_t size, TelloCommandId id, const int *args = nullptr, uint8_t argCount = 0);
+
+// Formats "<name> <word>" for commands taking a word; 0 if the word is not allowed
+size_t telloFormatCommand(char *buffer, size_t size, TelloCommandId id, const char *word);
+
+#endif // TELLOCOMMANDS_H
@@ -0,0 +1,140 @@
+#include "TelloRequest.h"
+#include "Tello.h"
+
+// Commands acknowledged only after the drone has flown them
+static const TelloCommandId MOTION_COMMANDS[] = {TELLO_TAKEOFF, TELLO_LAND, TELLO_UP, TELLO_DOWN, TELLO_LEFT, TELLO_RIGHT,
+												 TELLO_FORWARD, TELLO_BACK, TELLO_CW, TELLO_CCW, TELLO_GO, TELLO_FLIP};
+
+TelloRequest::TelloRequest()
+	: _tello(nullptr),
+	  _command(),
+	  _expected(nullptr),
+	  _maxAttempts(1),
+	  _retryDelayMs(0),
+	  _timeoutMs(0),
+	  _attempt(0),
+	  _awaitingReply(false),
+	  _sentMs(0),
+	  _retryAt(0),
+	  _reply(),
+	  _status(TELLO_REQUEST_IDLE)
+{
+}
+
+TelloRequest::~TelloRequest()
+{
+	cancel();
+}
+
+bool TelloRequest::isMotion(const char *command)
+{
+	for (TelloCommandId id : MOTION_COMMANDS)
+	{
+		const char *name = telloCommand(id).name;
+		size_t length = strlen(name);
+		if (strncmp(command, name, length) == 0 && (command[length] == ' ' || command[length] == '\0'))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool TelloRequest::begin(Tello &tello, const char *command, const char *expected, int maxAttempts,
+						 uint32_t retryDelayMs, uint32_t timeoutMs)
+{
+	if (_status == TELLO_REQUEST_PENDING || strlen(command) >= sizeof(_command))
+	{
+		return false;
+	}
+	_tello = &tello;
+	snprintf(_command, sizeof(_command), "%s", command);
+	_expected = expected;
+	_maxAttempts = maxAttempts < 1 ? 1 : maxAttempts;
+	_retryDelayMs = retryDelayMs;
+	_timeoutMs = timeoutMs != 0 ? timeoutMs : isMotion(command) ? MOTION_TIMEOUT_MS : QUERY_TIMEOUT_MS;
+	_attempt = 0;
+	_awaitingReply = false;
+	_retryAt = millis();
+	_reply[0] = '\0';
+	_status = TELLO_REQUEST_PENDING;
+	return true;
+}
+
+TelloRequestStatus TelloRequest::poll()
+{
+	if (_status != TELLO_REQUEST_PENDING)
+	{
+		return _status;
+	}
+
+	if (!_awaitingReply)
+	{
+		// Retry pause, or another request is waiting for its reply
+		if ((long)(millis() - _retryAt) < 0 || !_tello->claimChannel(this))
+		{
+			return _status;
+		}
+		_tello->discardReplies(); // Late replies to earlier requests
+		_tello->writePacket(_command, strlen(_command));
+		_attempt++;
+		_sentMs = millis();
+		_awaitingReply = true;
+		return _status;
+	}
+
+	if (_tello->readReply(_reply, sizeof(_reply)) > 0)
+	{
+		_awaitingReply = false;
+		_tello->releaseChannel(this);
+		if (_expected == nullptr || strcmp(_reply, _expected) == 0)
+		{
+			_status = TELLO_REQUEST_DONE;
+			return _status;
+		}
+		printf("TelloRequest: %s attempt %d response=%s\n", _command, _attempt, _reply);
+	}
+	else if (millis() - _sentMs < _timeoutMs)
+	{
+		return _status;
+	}
+	else
+	{
+		_awaitingReply = false;
+		_tello->releaseChannel(this);
+		printf("TelloRequest: %s attempt %d timed out\n", _command, _attempt);
+	}
+
+	if (_attempt >= _maxAttempts)
+	{
+		_status = TELLO_REQUEST_FAILED;
+	}
+	else
+	{
+		_retryAt = millis() + _retryDelayMs;
+	}
+	return _status;
+}
+
+bool TelloRequest::wait()
+{
+	while (poll() == TELLO_REQUEST_PENDING)
+	{
+		vTaskDelay(pdMS_TO_TICKS(5)); // Lets the other tasks run, including the one holding the channel
+	}
+	return _status == TELLO_REQUEST_DONE;
+}
+
+void TelloRequest::cancel()
+{
+	if (_status != TELLO_REQUEST_PENDING)
+	{
+		return;
+	}
+	if (_awaitingReply)
+	{
+		_awaitingReply = false;
+		_tello->releaseChannel(this);
+	}
+	_status = TELLO_REQUEST_FAILED;
+}
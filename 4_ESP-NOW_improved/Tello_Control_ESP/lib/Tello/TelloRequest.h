@@ -0,0 +1,67 @@
+#ifndef TELLOREQUEST_H
+#define TELLOREQUEST_H
+
+#include <Arduino.h>
+
+// One Tello command with its own retry state. poll() never blocks: it sends the command
+// once the command channel is free, then checks for the reply, re-sending after a timeout
+// or an unexpected reply until maxAttempts is used up. wait() polls until the request is
+// done. The drone's replies carry no request ID, so only one request at a time waits for
+// a reply; requests from other tasks stay pending until the channel is theirs. Every task
+// keeps its own TelloRequest, so the control and video tasks cannot corrupt each other's
+// attempts.
+
+class Tello;
+
+#define TELLO_REQUEST_COMMAND_MAX 112  // "wifi <ssid> <password>" with the longest SSID and password
+#define TELLO_REPLY_MAX 64
+
+enum TelloRequestStatus : uint8_t
+{
+	TELLO_REQUEST_IDLE,      // Not begun
+	TELLO_REQUEST_PENDING,   // Waiting for the channel, for the reply or to retry
+	TELLO_REQUEST_DONE,      // The expected reply arrived
+	TELLO_REQUEST_FAILED     // No attempt got the expected reply
+};
+
+class TelloRequest
+{
+public:
+	static const uint32_t QUERY_TIMEOUT_MS = 1000;   // Queries and settings are answered at once
+	static const uint32_t MOTION_TIMEOUT_MS = 10000; // Moves are acknowledged once flown
+
+	TelloRequest();
+	~TelloRequest();
+
+	// expected is the reply that means success, nullptr to accept any reply (queries).
+	// timeoutMs 0 picks QUERY_TIMEOUT_MS or MOTION_TIMEOUT_MS from the command.
+	bool begin(Tello &tello, const char *command, const char *expected = "ok", int maxAttempts = 1,
+			   uint32_t retryDelayMs = 100, uint32_t timeoutMs = 0);
+	TelloRequestStatus poll();
+	// Blocks the calling task until the request is done or failed; true if done
+	bool wait();
+	// Gives up a pending request and frees the channel
+	void cancel();
+
+	TelloRequestStatus status() const { return _status; }
+	const char *reply() const { return _reply; }
+	int attempts() const { return _attempt; }
+
+	static bool isMotion(const char *command);
+
+private:
+	Tello *_tello;
+	char _command[TELLO_REQUEST_COMMAND_MAX];
+	const char *_expected;
+	int _maxAttempts;
+	uint32_t _retryDelayMs;
+	uint32_t _timeoutMs;
+	int _attempt;
+	bool _awaitingReply;
+	unsigned long _sentMs;
+	unsigned long _retryAt;
+	char _reply[TELLO_REPLY_MAX];
+	TelloRequestStatus _status;
+};
+
+#endif // TELLOREQUEST_H
@@ -19,6 +19,7 @@
 #include <WiFiUdp.h>
 #include <SD_MMC.h>
 #include <freertos/semphr.h>
+#include <VideoWriter.h>
 
 const char *networkSSID = "TELLO-xxxxxxxxxxxxxx";
 const char *networkPswd = "";
@@ -28,7 +29,7 @@ const int maxPacketSize = 5120;
 
 Tello tello;
 WiFiUDP videoUdp;
-File videoFile;
+VideoWriter videoWriter;
 
 TaskHandle_t controlTaskHandle = NULL;
 TaskHandle_t videoTaskHandle = NULL;
@@ -38,12 +39,12 @@ int recordCount = 0;
 unsigned long recordUntil = 0;
 
 #define recordDuration 10000
+#define videoPreallocateBytes (2 * 1024 * 1024) // recordDuration at 1 Mbps, with margin
 
 void generateNewVideoFile()
 {
-    String videoPath = "/telloVid_" + String(recordCount++) + ".h264";
-    videoFile = SD_MMC.open(videoPath, FILE_WRITE);
-    if (!videoFile)
+    String videoPath = "/sdcard/telloVid_" + String(recordCount++) + ".h264";
+    if (!videoWriter.open(videoPath.c_str(), videoPreallocateBytes))
     {
         Serial.println("Failed to open file for writing");
     }
@@ -147,14 +148,7 @@ void videoTask(void *pvParameters)
                 int packetSize = videoUdp.read(videoBuffer, maxPacketSize);
                 if (packetSize > 0)
                 {
-                    if (videoFile.write(videoBuffer, packetSize) != packetSize)
-                    {
-                        Serial.println("Error writing to SD card!");
-                    }
-                    else
-                    {
-                        Serial.print("*");
-                    }
+                    videoWriter.write(videoBuffer, packetSize);
                 }
             }
         }
@@ -165,7 +159,11 @@ void videoTask(void *pvParameters)
                 Serial.println("\nStopping video recording.");
                 tello.stopVideoStream();
                 videoUdp.stop();
-                videoFile.close();
+                if (!videoWriter.close())
+                {
+                    Serial.println("Error writing to SD card!");
+                }
+                videoWriter.printStats();
                 currentlyRecording = false;
             }
         }
@@ -213,11 +211,17 @@ void setup()
         while (1);
     }
     Serial.println("SD card initialized.");
+    if (!videoWriter.begin())
+    {
+        Serial.println("Video writer initialization failed. Stopping.");
+        while (1);
+    }
     Serial.print("Connecting to Tello ");
     initializeNetworkAndTello(0);
-    // Retry command with reinitialization if it fails
+    // sendTelloCommandWithRetry waits for the reply through all its attempts, so the
+    // network is reinitialised only when the drone stopped answering
     Serial.print("Setting stream fps to 5");
-    while(!tello.sendTelloCommandWithRetry("setfps 5")){
+    while(!tello.sendTelloCommandWithRetry("setfps low")){ // SDK 3.0: low = 5 fps
         delay(500);
         initializeNetworkAndTello(1); // Reinitialize on failure
     }
@@ -232,6 +236,7 @@ void setup()
 
     recordFlagMutex = xSemaphoreCreateMutex();
 
+    // Both tasks send commands; the Tello library serialises them (see TelloRequest.h)
     xTaskCreatePinnedToCore(controlTask, "Control Task", 4096, NULL, 1, &controlTaskHandle, 0);
     xTaskCreatePinnedToCore(videoTask, "Video Task", 8192, NULL, 1, &videoTaskHandle, 1);
 }
@@ -7,20 +7,52 @@
  * Description: This program sets up an ESP32 device as a Wi-Fi Access Point and ESP-NOW 
  *              receiver. It receives JSON-encoded fruit ripeness data from another ESP32 
  *              device, parses the data, and displays the ripeness values on the serial monitor.
+ *              During a Tello flight it also receives the keyframes captured at the mission
+ *              stops and relays them to the inference server over the greenhouse Wi-Fi.
  * =======================================================================================
  */
 
 #include <esp_now.h>
 #include <WiFi.h>
 #include <ArduinoJson.h>
+#include "InferenceHandler.h"
+#include "KeyframeLink.h"
 
 // ====== Global Variables ======
 // Credentials for the receiver Access Point
 const char* RECEIVER_SSID = "ESP32_RECEIVER";
 const char* RECEIVER_PASSWORD = "123456789";
 
+// Local network credentials, the Tello has to be set to the same channel as this network
+// for the controller to reach the receiver while it flies
+const char* WIFI_SSID = "xxxxxxxxxxxxxx";
+const char* WIFI_PASSWORD = "x";
+
+// GCP server details
+const char* host = "xxxxxxxxxxxxxxxx";
+const int httpsPort = 443;
+const float CONFIDENCE_THRESHOLD = 45.0;
+const float OVERLAP_THRESHOLD = 25.0;
+
+InferenceHandler inferenceHandler(WIFI_SSID, WIFI_PASSWORD, host, httpsPort);
+
+// Keyframes from the controller, assembled from the ESP-NOW chunks
+const size_t KEYFRAME_SLOTS = 3;
+KeyframeAssembler keyframes(KEYFRAME_MAX_FRAME_SIZE, KEYFRAME_SLOTS);
+
+void relayKeyframe(const KeyframeAssembler::Frame& frame);
+
 // ====== Callback Function for Receiving Data ======
 void OnDataRecv(const esp_now_recv_info_t *esp_now_info, const uint8_t *incomingData, int len) {
+    // Keyframe chunks are assembled here and uploaded from the loop
+    KeyframeChunkResult chunk = keyframes.push(incomingData, len);
+    if (chunk == KEYFRAME_FRAME_COMPLETE) {
+        keyframes.acknowledge(esp_now_info->src_addr);
+    }
+    if (chunk != KEYFRAME_NOT_A_CHUNK) {
+        return;
+    }
+
     // Buffer to store the incoming JSON string
     char jsonString[len + 1];
     memcpy(jsonString, incomingData, len);
@@ -58,6 +90,16 @@ void setup() {
     Serial.print("AP MAC: ");
     Serial.println(WiFi.softAPmacAddress());
 
+    if (!keyframes.begin()) {
+        Serial.println("Keyframe assembler initialization failed");
+    }
+
+    // Connects the station to the greenhouse network, the AP moves to its channel
+    if (!inferenceHandler.begin()) {
+        Serial.println("InferenceHandler initialization failed, keyframes will be retried");
+    }
+    Serial.printf("Receiver on channel %d\n", WiFi.channel());
+
     // Initialize ESP-NOW protocol
     if (esp_now_init() != ESP_OK) {
         Serial.println("Error initializing ESP-NOW");
@@ -70,5 +112,30 @@ void setup() {
 
 // ====== Main Loop ======
 void loop() {
+    KeyframeAssembler::Frame frame;
+    if (keyframes.take(frame)) {
+        relayKeyframe(frame);
+        keyframes.release(frame);
+    }
     delay(10);
 }
+
+// Uploads a keyframe to the inference server, reconnecting once if the connection was lost
+void relayKeyframe(const KeyframeAssembler::Frame& frame) {
+    char name[40];
+    snprintf(name, sizeof(name), "keyframe_wp%d_%u.h264", frame.waypoint, frame.frameId);
+    Serial.printf("\nKeyframe of waypoint %d received (%u bytes)\n", frame.waypoint, frame.size);
+
+    InferenceResult result;
+    bool processed = inferenceHandler.requestInference(name, frame.data, frame.size, CONFIDENCE_THRESHOLD, OVERLAP_THRESHOLD, result);
+    if (!processed) {
+        inferenceHandler.end();
+        processed = inferenceHandler.begin() &&
+                    inferenceHandler.requestInference(name, frame.data, frame.size, CONFIDENCE_THRESHOLD, OVERLAP_THRESHOLD, result);
+    }
+    if (!processed) {
+        Serial.printf("Failed to process keyframe of waypoint %d\n", frame.waypoint);
+        return;
+    }
+    Serial.printf("Waypoint %d keyframe: %d objects, ripeness %.2f%%\n", frame.waypoint, result.totalObjects, result.ripenessPercentage);
+}
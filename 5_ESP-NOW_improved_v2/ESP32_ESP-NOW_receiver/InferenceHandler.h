@@ -0,0 +1,44 @@
+#ifndef InferenceHandler_h
+#define InferenceHandler_h
+
+#include <WiFi.h> 
+#include <WiFiClientSecure.h>
+#include "FS.h"
+#include "SD_MMC.h"
+#include <ArduinoJson.h>
+#include <functional>
+
+struct InferenceResult {
+    float ripenessPercentage;
+    int totalObjects;
+    int ripeCount;
+    int unripeCount;
+    int greenCount;
+    int frameCount;
+};
+
+class InferenceHandler {
+public:
+    InferenceHandler(const char* ssid, const char* password, const char* host, int httpsPort);
+    bool begin();
+    bool requestInference(const char* filename, float confidence, float overlap, InferenceResult& result);
+    // Same for a file held in memory, e.g. a keyframe; name is the filename the server sees
+    // (its extension selects image or video processing)
+    bool requestInference(const char* name, const uint8_t* data, size_t size, float confidence, float overlap, InferenceResult& result);
+    void end();
+
+private:
+    const int requestTimeout = 50000;
+    const char* _ssid;
+    const char* _password;
+    const char* _host;
+    const int _httpsPort;
+    WiFiClientSecure _client;
+
+    bool connectToServer();
+    String makeMultipartRequest(const char* filename, size_t size, std::function<size_t(uint8_t*, size_t)> read, float confidence, float overlap);
+    bool parseResponse(const String& response, InferenceResult& result);
+    float calculateRipenessPercentage(const JsonObject& predictions, int totalObjects);
+};
+
+#endif
\ No newline at end of file
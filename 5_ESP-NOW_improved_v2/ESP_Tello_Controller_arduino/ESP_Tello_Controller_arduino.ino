@@ -21,8 +21,17 @@
 #include <Arduino.h>
 #include <SD_MMC.h>
 #include "camFunctions.h"
+#include "fileIndex.h"
 #include "InferenceHandler.h"
 #include "TelloESP32.h"
+#include "VideoWriter.h"
+#include "H264Reassembler.h"
+#include "Fmp4Muxer.h"
+#include "VideoQuality.h"
+#include "RetentionManager.h"
+#include "MissionRunner.h"
+#include "KeyframeForwarder.h"
+#include "KeyframeLink.h"
 #include <esp_now.h>
 #include <vector>
 
@@ -45,6 +54,12 @@ const int httpsPort = 443;                                 // Server port
 const float CONFIDENCE_THRESHOLD = 45.0; // Confidence threshold for object detection
 const float OVERLAP_THRESHOLD = 25.0;    // Overlap threshold for object detection
 
+// ====== SD Card Retention ======
+const uint64_t CAM_IMAGES_QUOTA = 512ULL * 1024 * 1024;     // Camera images kept on the card
+const uint64_t TELLO_VIDEOS_QUOTA = 2048ULL * 1024 * 1024;  // Tello videos kept on the card
+const uint64_t TELLO_FRAMES_QUOTA = 256ULL * 1024 * 1024;   // Keyframes captured at mission stops
+const uint64_t SD_FREE_RESERVE = 256ULL * 1024 * 1024;      // Evict from any folder below this
+
 // Global variables for timing
 unsigned long lastRunTime = 0;
 const unsigned long RUN_INTERVAL = 60000; // Run every 1 minutes
@@ -54,8 +69,36 @@ InferenceHandler inferenceHandler(WIFI_SSID, WIFI_PASSWORD, host, httpsPort);
 
 // Instance of the TelloESP32 library
 TelloESP32 tello;
-// Video file instance for saving tello video stream
-File videoFile;
+// Buffered writer for saving tello video stream (32 KB PSRAM blocks written by a background task)
+VideoWriter videoWriter;
+// Joins the video datagrams into whole H.264 frames before they are written
+H264Reassembler videoReassembler;
+// Writes the frames as fragmented MP4: seekable, and readable up to the last fragment after a power cut
+Fmp4Muxer videoMuxer;
+uint32_t lastVideoPacketsDropped = 0;
+// Steps the bitrate and frame rate up while the stream arrives clean and down when it does not
+VideoQualityController videoQuality(tello, videoReassembler);
+
+// Evicts old images and videos from a background task, oldest uploaded files first
+RetentionManager retention(SD_MMC);
+const size_t VIDEO_PREALLOCATE_BYTES = 1024 * 1024; // ~8 s at the 1 Mbps starting bitrate
+
+// Flight plan, copy missions/mission.json to the card (two hovering recordings without it)
+const char *MISSION_PATH = "/missions/mission.json";
+const unsigned long MISSION_TICK_MS = 20;
+MissionRunner mission(tello);
+volatile bool keyframeRequested = false; // Set by a capture stop, cleared when the keyframe is taken
+volatile int keyframeWaypoint = 0;       // Waypoint of the requested keyframe
+
+// Keyframes are relayed to the inference server by the receiver during the flight (over
+// ESP-NOW, which needs the receiver's Wi-Fi channel to be the Tello's); the ones it could
+// not take are uploaded after landing. Frames larger than the receiver assembles are dropped.
+KeyframeForwarder keyframeForwarder(KEYFRAME_MAX_FRAME_SIZE);
+KeyframeSender keyframeSender;
+
+// The video task only copies a captured keyframe; loop(), which holds the retention lock for
+// the whole cycle, writes it to the card. A forwarder without a task carries it across.
+KeyframeForwarder keyframeSaves(KEYFRAME_MAX_FRAME_SIZE, 2);
 
 std::vector<String> recordedVideoPaths; // Store paths of recorded videos
 String currentVideoPath;
@@ -66,19 +109,64 @@ std::vector<std::pair<String, float>> ripenessResults; // Store <filename, ripen
 // SSID and MAC addresses array for receiver (Auto find receiver MAC address using SSID)
 const char *RECEIVER_SSID = "ESP32_RECEIVER";
 uint8_t receiverMacAddress[6];
+int receiverChannel = 0; // Wi-Fi channel the receiver was found on
 
 // helper functions prototypes
-String getNextFilePath(const String &folderName, const String &prefix, const String &extension);
 void handleVideoData(const uint8_t *buffer, size_t size);
+void handleVideoFrame(const H264Frame &frame);
+void handleMissionEvent(MissionEvent event, int waypoint);
+bool saveKeyframe(const ForwardedKeyframe &frame);
+void loadDefaultMission();
 void startNewVideoRecording(const String &videoPath);
 void stopVideoRecording();
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
 bool findReceiverMac();
 void initEspNow();
+void startKeyframeForwarding();
+void stopKeyframeForwarding();
+void uploadPendingKeyframes();
+bool uploadKeyframe(const ForwardedKeyframe &frame);
+void sendRipenessResults();
 
 void setup()
 {
     Serial.begin(115200);
+    if (!videoWriter.begin())
+    {
+        Serial.println("Video writer initialization failed");
+    }
+    if (!videoReassembler.begin())
+    {
+        Serial.println("Video reassembler initialization failed");
+    }
+    if (!videoMuxer.begin())
+    {
+        Serial.println("Video muxer initialization failed");
+    }
+    videoReassembler.onFrame(handleVideoFrame);
+    videoQuality.setSinkProbe([]()
+                              { return VideoSinkLoad{(uint32_t)videoWriter.blocksQueued(), (uint32_t)videoWriter.blockCount(),
+                                                     videoWriter.stats().packetsDropped}; });
+    mission.onEvent(handleMissionEvent);
+    if (!keyframeForwarder.begin())
+    {
+        Serial.println("Keyframe forwarder initialization failed");
+    }
+    keyframeForwarder.setTransport([](const ForwardedKeyframe &frame)
+                                   { return keyframeSender.send(frame.id, frame.waypoint, frame.data, frame.size); });
+    if (!keyframeSaves.begin(false))
+    {
+        Serial.println("Keyframe save queue initialization failed");
+    }
+
+    retention.addFolder("/camImages", CAM_IMAGES_QUOTA);
+    retention.addFolder("/telloVideos", TELLO_VIDEOS_QUOTA);
+    retention.addFolder("/telloFrames", TELLO_FRAMES_QUOTA);
+    retention.setFreeSpaceReserve(SD_FREE_RESERVE);
+    if (!retention.begin())
+    {
+        Serial.println("Retention manager initialization failed");
+    }
 }
 
 void loop()
@@ -89,6 +177,7 @@ void loop()
     if (currentTime - lastRunTime >= RUN_INTERVAL)
     {
         Serial.println("Starting operation...");
+        RetentionPause retentionPause(retention); // No deletions while this cycle uses the card
         // Initialize SD Card
         if (!SD_MMC.begin("/sdcard", true))
         {
@@ -111,6 +200,7 @@ void loop()
             if (captureAndSaveImage(imagePath))
             {
                 Serial.println("Image captured and saved to: " + imagePath);
+                retention.addFile(imagePath);
                 // deinit camera
                 deinitCamera();
 
@@ -136,6 +226,7 @@ void loop()
                     Serial.printf("Ripeness Percentage: %.2f%%\n", imageResult.ripenessPercentage);
 
                     ripenessResults.push_back({imagePath, imageResult.ripenessPercentage}); // Store ripeness result (will be used for esp-now transmission)
+                    retention.markUploaded(imagePath);
 
                     // Check ripeness threshold
                     if (imageResult.ripenessPercentage <= 30.0)
@@ -163,45 +254,59 @@ void loop()
         }
 
         /************* Tello operations ******************/
+        // Look for the receiver first: the scan also tells its channel
+        if (!findReceiverMac())
+        {
+            Serial.println("Receiver not found, keyframes are uploaded after landing");
+        }
+
         // Connect to Tello drone
         if (tello.connect(TELLO_SSID, TELLO_PASSWORD, 10000))
         {
             Serial.print("Battery: ");
             Serial.print(tello.getBattery());
+            startKeyframeForwarding();
 
             // setting video stream settings
             tello.onVideoStreamData(handleVideoData);
-            if(!tello.setVideoBitrate(TelloESP32::BITRATE_1MBPS)) // Set video bitrate to 1 Mbps
+            if (!videoQuality.begin()) // 1 Mbps at 5 fps, adapted during the flight
             {
-                Serial.println("Failed to set video bitrate");
+                Serial.println("Failed to set video bitrate and fps");
             }
-            if(!tello.setVideoFPS(TelloESP32::FPS_5))             // Set video fps to 5
+
+            if (!mission.load(SD_MMC, MISSION_PATH))
             {
-                Serial.println("Failed to set video fps");
+                loadDefaultMission();
             }
 
+            // The stream runs for the whole flight, recordings and captures are taken from it
+            videoReassembler.reset();
+            lastVideoPacketsDropped = 0;
+            if (!tello.startVideoStream())
+            {
+                Serial.println("Failed to start video stream");
+            }
+
+            // Each command is sent as soon as the previous one is acknowledged
             Serial.println("Starting flight sequence...");
-            // tello.takeoff();
-
-            // Record first video
-            currentVideoPath = getNextFilePath("/telloVideos", "telloVideo_", ".h264");
-            recordedVideoPaths.push_back(currentVideoPath); // Store path
-            startNewVideoRecording(currentVideoPath);
-            // tello.right(50);
-            delay(5000);
-            stopVideoRecording();
-            delay(3000);
-            // tello.rotateClockwise(90);
-            // Move drone and record second video
-            // tello.up(50);
-            currentVideoPath = getNextFilePath("/telloVideos", "telloVideo_", ".h264");
-            recordedVideoPaths.push_back(currentVideoPath); // Store path
-            startNewVideoRecording(currentVideoPath);
-            // tello.right(50);
-            delay(5000);
-            stopVideoRecording();
-            // tello.land();
+            mission.start();
+            while (mission.update())
+            {
+                videoQuality.update(); // Begins or polls one setting, never waits for the drone
+                keyframeSaves.drain(saveKeyframe);
+                delay(MISSION_TICK_MS);
+            }
+            mission.printSummary();
+
+            videoQuality.end();
+            tello.stopVideoStream();
+            keyframeSaves.drain(saveKeyframe); // Taken at the last stop
+            videoQuality.printSummary();
+            videoReassembler.printStats();
+            Serial.printf("Video packets: %u received, %u overwritten in the receive ring\n",
+                          tello.getVideoPacketsReceived(), tello.getVideoPacketsDropped());
             Serial.println("Flight sequence completed.");
+            stopKeyframeForwarding();
             // Disconnect from Tello drone
             tello.disconnect();
 
@@ -215,6 +320,9 @@ void loop()
             }
             Serial.println("InferenceHandler initialized.");
 
+            // Keyframes first: they are small and the receiver did not relay them
+            uploadPendingKeyframes();
+
             // Process each recorded video
             for (const String &videoPath : recordedVideoPaths)
             {
@@ -231,6 +339,7 @@ void loop()
                     Serial.printf("Green Tomatoes: %d\n", videoResult.greenCount);
                     Serial.printf("Overall Ripeness: %.2f%%\n", videoResult.ripenessPercentage);
                     ripenessResults.push_back({videoPath, videoResult.ripenessPercentage}); // Store ripeness result
+                    retention.markUploaded(videoPath);
                 }
                 else
                 {
@@ -252,58 +361,17 @@ void loop()
         if (ripenessResults.empty())
         {
             Serial.println("No ripeness results to send");
-            return;
-        }
-
-        // Create JSON array from results
-        StaticJsonDocument<1024> doc;
-        JsonArray array = doc.to<JsonArray>();
-
-        // Only add valid results
-        for (const auto &result : ripenessResults)
-        {
-            // Check for empty filename or invalid ripeness value
-            if (!result.first.isEmpty() && result.second >= 0.0)
-            {
-                JsonObject obj = array.createNestedObject();
-                obj["file"] = result.first;
-                obj["ripeness"] = result.second;
-            }
-            else
-            {
-                Serial.printf("Skipping invalid result: file='%s', ripeness=%.2f\n",
-                              result.first.c_str(), result.second);
-            }
-        }
-
-        // Only send if we have valid results
-        if (array.size() > 0)
-        {
-            String jsonString;
-            serializeJson(doc, jsonString);
-
-            esp_err_t result = esp_now_send(receiverMacAddress,
-                                            (uint8_t *)jsonString.c_str(),
-                                            jsonString.length());
-
-            if (result == ESP_OK)
-            {
-                Serial.println("Results sent successfully");
-                
-                // Clear vectors after successful transmission
-                ripenessResults.clear();
-                recordedVideoPaths.clear();
-                Serial.println("Cleared results and video paths");
-            }
-            else
-            {
-                Serial.println("Error sending results");
-            }
         }
         else
         {
-            Serial.println("No valid results to send");
+            sendRipenessResults();
         }
+
+        // Cleared whether or not the report got through: results of a failed report would
+        // otherwise pile up and be re-sent with every later cycle's
+        ripenessResults.clear();
+        recordedVideoPaths.clear();
+        retention.printStatus();
         Serial.println("Operation Complete, Waiting for next runtime...\n\n");
         lastRunTime = currentTime;
     }
@@ -311,85 +379,255 @@ void loop()
 
 }
 
-// Helper function to get next file path with auto-incrementing number
-String getNextFilePath(const String &folderName, const String &prefix, const String &extension)
+// Function to start a new Tello stream recording
+void startNewVideoRecording(const String &videoPath)
 {
-    if (!SD_MMC.exists(folderName))
+    Serial.print("Creating video file: ");
+    Serial.println(videoPath);
+
+    // Create directory if it doesn't exist
+    String dir = videoPath.substring(0, videoPath.lastIndexOf('/'));
+    if (!SD_MMC.exists(dir))
+    {
+        SD_MMC.mkdir(dir);
+    }
+
+    if (!videoWriter.open(("/sdcard" + videoPath).c_str(), VIDEO_PREALLOCATE_BYTES))
+    {
+        Serial.println("Failed to open video file for writing");
+        return;
+    }
+    videoMuxer.start([](const uint8_t *data, size_t size)
+                     { return videoWriter.write(data, size); });
+}
+
+// Function to stop the video recording
+void stopVideoRecording()
+{
+    // Last fragment and the keyframe index, before the file is closed
+    if (!videoMuxer.finish())
+    {
+        Serial.println("Video recording has no keyframe or its index was not written");
+    }
+    videoMuxer.printStats();
+    if (!videoWriter.close())
     {
-        SD_MMC.mkdir(folderName);
-        return folderName + "/" + prefix + "1" + extension;
+        Serial.println("Error writing video to SD card!");
     }
+    videoWriter.printStats();
+    retention.addFile(currentVideoPath);
+}
 
-    File root = SD_MMC.open(folderName);
-    if (!root || !root.isDirectory())
+// Callback to handle video data stream
+void handleVideoData(const uint8_t *buffer, size_t size)
+{
+    // Packets overwritten in TelloESP32's video ring damage the frame being assembled
+    uint32_t dropped = tello.getVideoPacketsDropped();
+    if (dropped != lastVideoPacketsDropped)
     {
-        return folderName + "/" + prefix + "1" + extension;
+        lastVideoPacketsDropped = dropped;
+        videoReassembler.markLoss();
     }
+    videoQuality.recordPacket(size);
+    videoReassembler.push(buffer, size, millis());
+}
 
-    int maxNumber = 0;
-    File file = root.openNextFile();
+// Called with every complete access unit, incomplete ones are kept for the decoder to conceal
+void handleVideoFrame(const H264Frame &frame)
+{
+    // SPS/PPS for a keyframe that does not carry them
+    uint8_t parameterSets[2 * H264Reassembler::MAX_PARAMETER_SET_SIZE];
+    size_t parameterSetsSize = 0;
+    if (frame.keyframe && !frame.hasParameterSets)
+    {
+        parameterSetsSize = videoReassembler.copyParameterSets(parameterSets, sizeof(parameterSets));
+    }
 
-    while (file)
+    if (keyframeRequested && frame.keyframe && frame.complete)
     {
-        String fileName = String(file.name());
-        if (fileName.startsWith(prefix) && fileName.endsWith(extension))
+        keyframeRequested = false;
+        if (!keyframeSaves.offer(frame, parameterSets, parameterSetsSize, keyframeWaypoint))
         {
-            int startIdx = prefix.length();
-            int endIdx = fileName.indexOf(extension);
-            String numStr = fileName.substring(startIdx, endIdx);
-            int currentNum = numStr.toInt();
-            maxNumber = max(maxNumber, currentNum);
+            Serial.println("Keyframe not queued for saving to the card");
+        }
+        if (!keyframeForwarder.offer(frame, parameterSets, parameterSetsSize, keyframeWaypoint))
+        {
+            Serial.println("Keyframe not queued for forwarding (queue full or frame too large)");
         }
-        file = root.openNextFile();
     }
+    // Only copies into the current fragment (nothing while no recording is open)
+    videoMuxer.addFrame(frame, parameterSets, parameterSetsSize);
+}
 
-    return folderName + "/" + prefix + String(maxNumber + 1) + extension;
+// Saves a keyframe as a one-frame .h264 file; the copy already has the SPS/PPS a decoder needs
+bool saveKeyframe(const ForwardedKeyframe &frame)
+{
+    String framePath = getNextFilePath("/telloFrames", "telloFrame_", ".h264");
+    File file = SD_MMC.open(framePath, FILE_WRITE);
+    if (!file)
+    {
+        Serial.println("Failed to open keyframe file for writing");
+        return false;
+    }
+    bool written = file.write(frame.data, frame.size) == frame.size;
+    file.close();
+    retention.addFile(framePath);
+    Serial.println("Keyframe saved to: " + framePath);
+    return written;
 }
 
-// Function to start a new Tello stream recording
-void startNewVideoRecording(const String &videoPath)
+// Actions at mission stops
+void handleMissionEvent(MissionEvent event, int waypoint)
 {
-    Serial.print("Creating video file: ");
-    Serial.println(videoPath);
+    switch (event)
+    {
+    case MISSION_RECORD_START:
+        currentVideoPath = getNextFilePath("/telloVideos", "telloVideo_", ".mp4");
+        recordedVideoPaths.push_back(currentVideoPath); // Store path
+        startNewVideoRecording(currentVideoPath);
+        break;
+    case MISSION_RECORD_STOP:
+        stopVideoRecording();
+        break;
+    case MISSION_CAPTURE:
+        keyframeWaypoint = waypoint;
+        keyframeRequested = true;
+        break;
+    }
+}
 
-    // Create directory if it doesn't exist
-    String dir = videoPath.substring(0, videoPath.lastIndexOf('/'));
-    if (!SD_MMC.exists(dir))
+// Used when the card has no mission file: two 5 s recordings without taking off
+void loadDefaultMission()
+{
+    mission.clear();
+    mission.setTakeoff(false);
+    MissionWaypoint stop = {0, 0, 0, 0, false, 5000, 0};
+    mission.addWaypoint(stop);
+    mission.addWaypoint(stop);
+}
+
+// Forwards keyframes to the receiver during the flight when it shares the Tello's channel
+void startKeyframeForwarding()
+{
+    if (receiverChannel == 0)
     {
-        SD_MMC.mkdir(dir);
+        return;
+    }
+    if (WiFi.channel() != receiverChannel)
+    {
+        Serial.printf("Receiver on channel %d, Tello on channel %d: keyframes are uploaded after landing\n",
+                      receiverChannel, WiFi.channel());
+        return;
+    }
+    if (!keyframeSender.begin(receiverMacAddress))
+    {
+        Serial.println("Keyframe link initialization failed, keyframes are uploaded after landing");
+        return;
+    }
+    keyframeForwarder.setEnabled(true);
+    Serial.printf("Forwarding keyframes to the receiver on channel %d\n", receiverChannel);
+}
+
+void stopKeyframeForwarding()
+{
+    keyframeForwarder.setEnabled(false); // Waits for a frame being sent
+    if (keyframeSender.active())
+    {
+        Serial.printf("Keyframe link: %u chunks sent, %u resent\n", keyframeSender.chunksSent(), keyframeSender.chunkRetries());
+        keyframeSender.end();
     }
+    keyframeForwarder.printStats();
+}
 
-    videoFile = SD_MMC.open(videoPath.c_str(), FILE_WRITE);
-    if (!videoFile)
+// Uploads the keyframes the receiver did not get, needs the inference handler connected
+void uploadPendingKeyframes()
+{
+    if (keyframeForwarder.pending() == 0)
     {
-        Serial.println("Failed to open video file for writing");
         return;
     }
-    delay(500); // Wait before starting new stream
-    tello.startVideoStream();
+    Serial.printf("\nUploading %u keyframes\n", (unsigned)keyframeForwarder.pending());
+    keyframeForwarder.drain(uploadKeyframe);
 }
 
-// Function to stop the video recording
-void stopVideoRecording()
+bool uploadKeyframe(const ForwardedKeyframe &frame)
 {
-    tello.stopVideoStream();
-    videoFile.close();
-    delay(500); // Wait for file to close
+    char name[40];
+    snprintf(name, sizeof(name), "keyframe_wp%d_%u.h264", frame.waypoint, frame.id);
+    InferenceResult frameResult;
+    if (!inferenceHandler.requestInference(name, frame.data, frame.size, CONFIDENCE_THRESHOLD, OVERLAP_THRESHOLD, frameResult))
+    {
+        Serial.printf("Failed to process keyframe of waypoint %d\n", frame.waypoint);
+        return false;
+    }
+    Serial.printf("Waypoint %d keyframe: %d objects, ripeness %.2f%%\n", frame.waypoint, frameResult.totalObjects,
+                  frameResult.ripenessPercentage);
+    ripenessResults.push_back({String(name), frameResult.ripenessPercentage});
+    return true;
 }
 
-// Callback to handle video data stream
-void handleVideoData(const uint8_t *buffer, size_t size)
+// Sends the results as JSON arrays of at most ESP_NOW_MAX_DATA_LEN bytes, as many as they need
+void sendRipenessResults()
 {
-    if (videoFile)
+    size_t next = 0;
+    int packets = 0, failed = 0;
+    while (next < ripenessResults.size())
     {
-        if (videoFile.write(buffer, size) != size)
+        StaticJsonDocument<1024> doc;
+        JsonArray array = doc.to<JsonArray>();
+        for (; next < ripenessResults.size(); next++)
         {
-            Serial.println("Error writing to SD card!");
+            const auto &result = ripenessResults[next];
+            // Check for empty filename or invalid ripeness value
+            if (result.first.isEmpty() || result.second < 0.0)
+            {
+                Serial.printf("Skipping invalid result: file='%s', ripeness=%.2f\n",
+                              result.first.c_str(), result.second);
+                continue;
+            }
+            JsonObject obj = array.createNestedObject();
+            obj["file"] = result.first;
+            obj["ripeness"] = result.second;
+            if (measureJson(doc) > ESP_NOW_MAX_DATA_LEN)
+            {
+                array.remove(array.size() - 1);
+                if (array.size() == 0)
+                {
+                    Serial.printf("Skipping result too large for a packet: file='%s'\n", result.first.c_str());
+                    next++;
+                }
+                break; // This result starts the next packet
+            }
+        }
+        if (array.size() == 0)
+        {
+            continue;
+        }
+
+        String jsonString;
+        serializeJson(doc, jsonString);
+        if (esp_now_send(receiverMacAddress, (uint8_t *)jsonString.c_str(), jsonString.length()) == ESP_OK)
+        {
+            packets++;
         }
         else
         {
-            Serial.print("*");
+            failed++;
         }
+        delay(20); // Let the previous packet leave before queueing the next
+    }
+
+    if (packets + failed == 0)
+    {
+        Serial.println("No valid results to send");
+    }
+    else if (failed == 0)
+    {
+        Serial.printf("Results sent successfully in %d packets\n", packets);
+    }
+    else
+    {
+        Serial.printf("Error sending results: %d of %d packets failed\n", failed, packets + failed);
     }
 }
 
@@ -448,6 +686,7 @@ void initEspNow()
 bool findReceiverMac()
 {
     Serial.println("Scanning for receiver...");
+    receiverChannel = 0;
 
     WiFi.disconnect();
     WiFi.mode(WIFI_STA);
@@ -465,8 +704,10 @@ bool findReceiverMac()
         if (String(RECEIVER_SSID).equals(WiFi.SSID(i)))
         {
             String bssid = WiFi.BSSIDstr(i);
+            receiverChannel = WiFi.channel(i);
             Serial.print("Receiver found! MAC: ");
-            Serial.println(bssid);
+            Serial.print(bssid);
+            Serial.printf(", channel %d\n", receiverChannel);
 
             // Convert BSSID string to bytes
             int values[6];
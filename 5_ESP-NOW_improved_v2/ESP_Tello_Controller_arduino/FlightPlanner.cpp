@@ -0,0 +1,298 @@
+#include "FlightPlanner.h"
+#include <math.h>
+#include <stdlib.h>
+
+static const PlanTimings DEFAULT_TIMINGS = {50, 90, 1500};
+
+FlightPlanner::FlightPlanner()
+    : _timings(DEFAULT_TIMINGS)
+{
+}
+
+FlightPlanner::FlightPlanner(const PlanTimings &timings)
+    : _timings(timings)
+{
+}
+
+float FlightPlanner::distance(const PlanPoint &a, const PlanPoint &b)
+{
+    float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+// b lies on the segment from a to c (within 1 cm)
+bool FlightPlanner::collinear(const PlanPoint &a, const PlanPoint &b, const PlanPoint &c)
+{
+    float abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+    float acx = c.x - a.x, acy = c.y - a.y, acz = c.z - a.z;
+    float length = sqrtf(acx * acx + acy * acy + acz * acz);
+    if (length < 1.0f)
+    {
+        return false;
+    }
+    float cx = aby * acz - abz * acy, cy = abz * acx - abx * acz, cz = abx * acy - aby * acx;
+    float offLine = sqrtf(cx * cx + cy * cy + cz * cz) / length;
+    float along = (abx * acx + aby * acy + abz * acz) / length;
+    return offLine <= 1.0f && along >= 0.0f && along <= length;
+}
+
+// Flight time between two points as distance: the turn is charged at the cm it would take to fly
+float FlightPlanner::cost(const PlanPoint &a, const PlanPoint &b) const
+{
+    float cost = distance(a, b);
+    if (a.hasHeading && b.hasHeading)
+    {
+        int turn = abs(((b.heading - a.heading) % 360 + 540) % 360 - 180);
+        cost += (float)turn * _timings.speed / _timings.yawRate;
+    }
+    return cost;
+}
+
+std::vector<int> FlightPlanner::order(const std::vector<PlanPoint> &points) const
+{
+    const PlanPoint origin = {0, 0, 0, 0, true, false};
+    size_t n = points.size();
+    std::vector<int> path;
+    path.reserve(n);
+
+    // Nearest neighbour from the takeoff point
+    std::vector<bool> visited(n, false);
+    const PlanPoint *current = &origin;
+    for (size_t step = 0; step < n; step++)
+    {
+        int best = -1;
+        float bestDistance = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            float d = cost(*current, points[i]);
+            if (!visited[i] && (best < 0 || d < bestDistance))
+            {
+                best = i;
+                bestDistance = d;
+            }
+        }
+        visited[best] = true;
+        path.push_back(best);
+        current = &points[best];
+    }
+
+    // 2-opt on the open path: reverse path[i..j] while that shortens it
+    auto at = [&](int index) -> const PlanPoint & { return index < 0 ? origin : points[path[index]]; };
+    bool improved = true;
+    for (int pass = 0; improved && pass < 100; pass++)
+    {
+        improved = false;
+        for (int i = 0; i < (int)n - 1; i++)
+        {
+            for (int j = i + 1; j < (int)n; j++)
+            {
+                float before = cost(at(i - 1), at(i));
+                float after = cost(at(i - 1), at(j));
+                if (j + 1 < (int)n)
+                {
+                    before += cost(at(j), at(j + 1));
+                    after += cost(at(i), at(j + 1));
+                }
+                if (after < before - 0.5f)
+                {
+                    for (int a = i, b = j; a < b; a++, b--)
+                    {
+                        int swap = path[a];
+                        path[a] = path[b];
+                        path[b] = swap;
+                    }
+                    improved = true;
+                }
+            }
+        }
+    }
+    return path;
+}
+
+std::vector<int> FlightPlanner::mergePassThrough(const std::vector<PlanPoint> &points, const std::vector<int> &order) const
+{
+    const PlanPoint origin = {0, 0, 0, 0, false, false};
+    std::vector<int> merged;
+    merged.reserve(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const PlanPoint &point = points[order[i]];
+        if (!point.stop && !point.hasHeading && i + 1 < order.size())
+        {
+            const PlanPoint &previous = merged.empty() ? origin : points[merged.back()];
+            if (collinear(previous, point, points[order[i + 1]]))
+            {
+                continue;
+            }
+        }
+        merged.push_back(order[i]);
+    }
+    return merged;
+}
+
+void FlightPlanner::addTurn(std::vector<PlanCommand> &out, int degrees, int point)
+{
+    PlanCommand command = {degrees > 0 ? TELLO_CW : TELLO_CCW, {abs(degrees)}, 1, point};
+    out.push_back(command);
+}
+
+// One command per leg: an axis move when only one body axis changes, "go" otherwise
+void FlightPlanner::addMove(std::vector<PlanCommand> &out, int bx, int by, int bz, int point) const
+{
+    int longest = abs(bx) > abs(by) ? abs(bx) : abs(by);
+    longest = abs(bz) > longest ? abs(bz) : longest;
+    int legs = (longest + MAX_MOVE - 1) / MAX_MOVE;
+    int doneX = 0, doneY = 0, doneZ = 0;
+    for (int leg = 1; leg <= legs; leg++)
+    {
+        int x = bx * leg / legs - doneX;
+        int y = by * leg / legs - doneY;
+        int z = bz * leg / legs - doneZ;
+        doneX += x;
+        doneY += y;
+        doneZ += z;
+
+        PlanCommand command = {};
+        command.point = leg == legs ? point : -1;
+        int axes = (x != 0) + (y != 0) + (z != 0);
+        if (axes == 1)
+        {
+            command.id = x > 0 ? TELLO_FORWARD : x < 0 ? TELLO_BACK : y > 0 ? TELLO_LEFT : y < 0 ? TELLO_RIGHT : z > 0 ? TELLO_UP : TELLO_DOWN;
+            command.args[0] = abs(x + y + z);
+            command.argCount = 1;
+        }
+        else
+        {
+            command.id = TELLO_GO;
+            command.args[0] = x;
+            command.args[1] = y;
+            command.args[2] = z;
+            command.args[3] = _timings.speed;
+            command.argCount = 4;
+        }
+        out.push_back(command);
+    }
+}
+
+std::vector<PlanCommand> FlightPlanner::commands(const std::vector<PlanPoint> &points, const std::vector<int> &order) const
+{
+    std::vector<PlanCommand> out;
+    int x = 0, y = 0, z = 0, heading = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const PlanPoint &point = points[order[i]];
+        int dx = point.x - x, dy = point.y - y, dz = point.z - z;
+        float yaw = heading * (float)M_PI / 180.0f;
+        int bx = lroundf(dx * cosf(yaw) - dy * sinf(yaw));
+        int by = lroundf(dx * sinf(yaw) + dy * cosf(yaw));
+        // Moves the Tello cannot make are carried into the next leg
+        if (abs(bx) >= MIN_MOVE || abs(by) >= MIN_MOVE || abs(dz) >= MIN_MOVE)
+        {
+            addMove(out, bx, by, dz, order[i]);
+            x = point.x;
+            y = point.y;
+            z = point.z;
+        }
+        if (point.hasHeading)
+        {
+            int turn = ((point.heading - heading) % 360 + 540) % 360 - 180;
+            if (turn != 0)
+            {
+                addTurn(out, turn, order[i]);
+                heading = ((point.heading % 360) + 360) % 360;
+            }
+        }
+        if (!out.empty() && out.back().point < 0)
+        {
+            out.back().point = order[i];
+        }
+    }
+    return out;
+}
+
+std::vector<PlanCommand> FlightPlanner::plan(const std::vector<PlanPoint> &points) const
+{
+    return commands(points, mergePassThrough(points, order(points)));
+}
+
+PlanEstimate FlightPlanner::estimate(const std::vector<PlanCommand> &commands) const
+{
+    PlanEstimate estimate = {};
+    float flightMs = 0;
+    for (const PlanCommand &command : commands)
+    {
+        estimate.commands++;
+        flightMs += _timings.commandOverheadMs;
+        float length = 0;
+        switch (command.id)
+        {
+        case TELLO_GO:
+            length = sqrtf((float)command.args[0] * command.args[0] + (float)command.args[1] * command.args[1] +
+                           (float)command.args[2] * command.args[2]);
+            flightMs += length * 1000.0f / command.args[3];
+            break;
+        case TELLO_CW:
+        case TELLO_CCW:
+            estimate.turnDegrees += command.args[0];
+            flightMs += command.args[0] * 1000.0f / _timings.yawRate;
+            break;
+        default:
+            length = command.args[0];
+            flightMs += length * 1000.0f / _timings.speed;
+            break;
+        }
+        estimate.distanceCm += length;
+    }
+    estimate.flightMs = flightMs;
+    return estimate;
+}
+
+std::vector<PlanCommand> FlightPlanner::axisByAxis(const std::vector<PlanPoint> &points) const
+{
+    std::vector<PlanCommand> out;
+    int x = 0, y = 0, z = 0, heading = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        const PlanPoint &point = points[i];
+        int deltas[3] = {point.x - x, point.y - y, point.z - z};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int delta = deltas[axis];
+            if (abs(delta) < MIN_MOVE)
+            {
+                continue;
+            }
+            if (axis == 2)
+            {
+                addMove(out, 0, 0, delta, -1);
+                continue;
+            }
+            // Face the direction of travel, then fly forward
+            int target = axis == 0 ? (delta > 0 ? 0 : 180) : (delta > 0 ? 270 : 90);
+            int turn = ((target - heading) % 360 + 540) % 360 - 180;
+            if (turn != 0)
+            {
+                addTurn(out, turn, -1);
+                heading = target;
+            }
+            addMove(out, abs(delta), 0, 0, -1);
+        }
+        x += abs(deltas[0]) >= MIN_MOVE ? deltas[0] : 0;
+        y += abs(deltas[1]) >= MIN_MOVE ? deltas[1] : 0;
+        z += abs(deltas[2]) >= MIN_MOVE ? deltas[2] : 0;
+        if (point.hasHeading)
+        {
+            int turn = ((point.heading - heading) % 360 + 540) % 360 - 180;
+            if (turn != 0)
+            {
+                addTurn(out, turn, -1);
+                heading = ((point.heading % 360) + 360) % 360;
+            }
+        }
+        if (!out.empty())
+        {
+            out.back().point = i;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,93 @@
+#ifndef FLIGHTPLANNER_H
+#define FLIGHTPLANNER_H
+
+#include <stdint.h>
+#include <vector>
+#include "TelloCommands.h"
+
+// Turns a set of inspection points into a short Tello command sequence:
+//  - the visiting order starts at the takeoff point and is built nearest-neighbour first,
+//    then improved with 2-opt until no reversal shortens the path (turns between required
+//    headings count as the distance flown in the same time)
+//  - pass-through points (no stop) lying on a straight line between their neighbours are
+//    merged away, so a row sampled every few cm is flown as one move
+//  - every leg is a single command: forward/back/left/right/up/down when it runs along one
+//    axis of the drone, "go" otherwise, split only where the SDK's 500 cm limit requires
+//  - the drone only turns where a point asks for a heading, "go" flies sideways otherwise
+// Coordinates are cm in the takeoff frame (x forward, y left, z up), headings are degrees
+// clockwise from the takeoff heading, as in MissionRunner.
+//
+// Plain C++ without Arduino dependencies, so it runs (and is benchmarked) on the host.
+struct PlanPoint
+{
+    int x;
+    int y;
+    int z;
+    int heading;       // Only used when hasHeading is set
+    bool hasHeading;
+    bool stop;         // The drone stops here (capture, record, hover); false for pass-through points
+};
+
+struct PlanCommand
+{
+    TelloCommandId id;
+    int args[4];
+    uint8_t argCount;
+    int point;         // Index of the point reached once this command completes, -1 on the way
+};
+
+struct PlanTimings
+{
+    int speed;              // cm/s, for "go" and the axis moves (set with "speed")
+    int yawRate;            // Degrees per second
+    int commandOverheadMs;  // Acceleration, braking and the acknowledgement of every command
+};
+
+struct PlanEstimate
+{
+    int commands;
+    float distanceCm;
+    int turnDegrees;
+    uint32_t flightMs;
+};
+
+class FlightPlanner
+{
+public:
+    static const int MIN_MOVE = 20;   // The Tello rejects shorter moves
+    static const int MAX_MOVE = 500;
+
+    FlightPlanner();
+    explicit FlightPlanner(const PlanTimings &timings);
+
+    const PlanTimings &timings() const { return _timings; }
+
+    // Visiting order of all points, starting from the takeoff point
+    std::vector<int> order(const std::vector<PlanPoint> &points) const;
+
+    // The order without pass-through points that sit on a straight line between their neighbours
+    std::vector<int> mergePassThrough(const std::vector<PlanPoint> &points, const std::vector<int> &order) const;
+
+    // Commands flying the points in the given order, from the takeoff point and heading
+    std::vector<PlanCommand> commands(const std::vector<PlanPoint> &points, const std::vector<int> &order) const;
+
+    // order(), mergePassThrough() and commands() in one go
+    std::vector<PlanCommand> plan(const std::vector<PlanPoint> &points) const;
+
+    PlanEstimate estimate(const std::vector<PlanCommand> &commands) const;
+
+    // Reference plan: points in the given order, one axis at a time, facing every move
+    // (how hand-written sequences of forward/right/cw commands fly)
+    std::vector<PlanCommand> axisByAxis(const std::vector<PlanPoint> &points) const;
+
+private:
+    PlanTimings _timings;
+
+    static float distance(const PlanPoint &a, const PlanPoint &b);
+    float cost(const PlanPoint &a, const PlanPoint &b) const;
+    static bool collinear(const PlanPoint &a, const PlanPoint &b, const PlanPoint &c);
+    void addMove(std::vector<PlanCommand> &out, int bx, int by, int bz, int point) const;
+    static void addTurn(std::vector<PlanCommand> &out, int degrees, int point);
+};
+
+#endif
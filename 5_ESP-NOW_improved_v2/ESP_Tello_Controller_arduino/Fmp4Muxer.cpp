@@ -0,0 +1,786 @@
+#include "Fmp4Muxer.h"
+
+static const uint8_t NAL_SPS = 7;
+static const uint8_t NAL_PPS = 8;
+static const uint8_t NAL_AUD = 9;
+
+static const uint32_t TRACK_ID = 1;
+static const size_t HEADER_CAPACITY = 1024;
+// moof with mfhd, traf, tfhd, tfdt (64-bit) and a trun without its entries
+static const size_t MOOF_FIXED_SIZE = 8 + 16 + 8 + 16 + 20 + 20;
+static const size_t TRUN_ENTRY_SIZE = 12;
+
+// sample_flags of ISO/IEC 14496-12 8.8.3.1
+static const uint32_t SYNC_SAMPLE_FLAGS = 0x02000000;     // Depends on no other sample
+static const uint32_t NON_SYNC_SAMPLE_FLAGS = 0x01010000; // Depends on others, not a sync sample
+
+// Big-endian writer for ISO-BMFF boxes into a fixed buffer
+class BoxWriter
+{
+public:
+    BoxWriter(uint8_t *buffer, size_t capacity) : _buffer(buffer), _capacity(capacity), _length(0), _overflow(false) {}
+
+    void u8(uint8_t value)
+    {
+        if (_length < _capacity)
+        {
+            _buffer[_length++] = value;
+        }
+        else
+        {
+            _overflow = true;
+        }
+    }
+    void u16(uint16_t value)
+    {
+        u8(value >> 8);
+        u8(value);
+    }
+    void u32(uint32_t value)
+    {
+        u16(value >> 16);
+        u16(value);
+    }
+    void u64(uint64_t value)
+    {
+        u32(value >> 32);
+        u32(value);
+    }
+    void bytes(const void *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            u8(((const uint8_t *)data)[i]);
+        }
+    }
+    void zeros(size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            u8(0);
+        }
+    }
+    void fourcc(const char *type) { bytes(type, 4); }
+
+    // Returns the box offset, for end()
+    size_t box(const char *type)
+    {
+        size_t start = _length;
+        u32(0);
+        fourcc(type);
+        return start;
+    }
+    size_t fullBox(const char *type, uint8_t version, uint32_t flags)
+    {
+        size_t start = box(type);
+        u32((uint32_t)version << 24 | flags);
+        return start;
+    }
+    void end(size_t start)
+    {
+        if (start + 4 <= _length)
+        {
+            uint32_t size = _length - start;
+            _buffer[start] = size >> 24;
+            _buffer[start + 1] = size >> 16;
+            _buffer[start + 2] = size >> 8;
+            _buffer[start + 3] = size;
+        }
+    }
+    void matrix()
+    {
+        static const uint32_t unity[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+        for (uint32_t value : unity)
+        {
+            u32(value);
+        }
+    }
+
+    size_t length() const { return _length; }
+    bool overflow() const { return _overflow; }
+
+private:
+    uint8_t *_buffer;
+    size_t _capacity;
+    size_t _length;
+    bool _overflow;
+};
+
+// Exp-Golomb reader over an SPS, skipping emulation prevention bytes
+class SpsReader
+{
+public:
+    SpsReader(const uint8_t *data, size_t size) : _data(data), _size(size), _byte(0), _bit(0), _zeros(0), _overrun(false) {}
+
+    uint32_t bit()
+    {
+        if (_bit == 0)
+        {
+            // 0x000003: the 03 was inserted by the encoder
+            if (_zeros >= 2 && _byte < _size && _data[_byte] == 3)
+            {
+                _byte++;
+                _zeros = 0;
+            }
+            if (_byte >= _size)
+            {
+                _overrun = true;
+                return 0;
+            }
+            _zeros = _data[_byte] == 0 ? _zeros + 1 : 0;
+        }
+        uint32_t value = (_data[_byte] >> (7 - _bit)) & 1;
+        if (++_bit == 8)
+        {
+            _bit = 0;
+            _byte++;
+        }
+        return value;
+    }
+    uint32_t bits(int count)
+    {
+        uint32_t value = 0;
+        while (count-- > 0)
+        {
+            value = value << 1 | bit();
+        }
+        return value;
+    }
+    uint32_t ue()
+    {
+        int leadingZeros = 0;
+        while (bit() == 0 && !_overrun && leadingZeros < 31)
+        {
+            leadingZeros++;
+        }
+        return ((1u << leadingZeros) - 1) + bits(leadingZeros);
+    }
+    int32_t se()
+    {
+        uint32_t value = ue();
+        return value & 1 ? (int32_t)((value + 1) / 2) : -(int32_t)(value / 2);
+    }
+    bool overrun() const { return _overrun; }
+
+private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _byte;
+    int _bit;
+    int _zeros;
+    bool _overrun;
+};
+
+struct SpsInfo
+{
+    uint8_t profile;
+    uint8_t chromaFormat;
+    uint8_t bitDepthLuma;
+    uint8_t bitDepthChroma;
+    uint16_t width;
+    uint16_t height;
+};
+
+// H.264 7.3.2.1.1, up to the frame cropping; sps starts with the NAL header
+static bool parseSps(const uint8_t *sps, size_t size, SpsInfo &info)
+{
+    if (size < 4)
+    {
+        return false;
+    }
+    SpsReader reader(sps + 4, size - 4); // NAL header, profile, constraint flags, level
+    info.profile = sps[1];
+    info.chromaFormat = 1;
+    info.bitDepthLuma = 8;
+    info.bitDepthChroma = 8;
+    reader.ue(); // seq_parameter_set_id
+
+    static const uint8_t HIGH_PROFILES[] = {100, 110, 122, 244, 44, 83, 86, 118, 128, 138, 139, 134, 135};
+    if (memchr(HIGH_PROFILES, info.profile, sizeof(HIGH_PROFILES)) != nullptr)
+    {
+        info.chromaFormat = reader.ue();
+        if (info.chromaFormat == 3)
+        {
+            reader.bit(); // separate_colour_plane_flag
+        }
+        info.bitDepthLuma = reader.ue() + 8;
+        info.bitDepthChroma = reader.ue() + 8;
+        reader.bit(); // qpprime_y_zero_transform_bypass_flag
+        if (reader.bit()) // seq_scaling_matrix_present_flag
+        {
+            for (int i = 0; i < (info.chromaFormat != 3 ? 8 : 12); i++)
+            {
+                if (!reader.bit())
+                {
+                    continue;
+                }
+                int lastScale = 8;
+                int nextScale = 8;
+                for (int j = 0; j < (i < 6 ? 16 : 64) && nextScale != 0; j++)
+                {
+                    nextScale = (lastScale + reader.se() + 256) % 256;
+                    lastScale = nextScale == 0 ? lastScale : nextScale;
+                }
+            }
+        }
+    }
+
+    reader.ue(); // log2_max_frame_num_minus4
+    uint32_t pocType = reader.ue();
+    if (pocType == 0)
+    {
+        reader.ue(); // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if (pocType == 1)
+    {
+        reader.bit();
+        reader.se();
+        reader.se();
+        uint32_t cycle = reader.ue();
+        for (uint32_t i = 0; i < cycle && !reader.overrun(); i++)
+        {
+            reader.se();
+        }
+    }
+    reader.ue(); // max_num_ref_frames
+    reader.bit(); // gaps_in_frame_num_value_allowed_flag
+    uint32_t widthInMbs = reader.ue() + 1;
+    uint32_t heightInMapUnits = reader.ue() + 1;
+    uint32_t frameMbsOnly = reader.bit();
+    if (!frameMbsOnly)
+    {
+        reader.bit(); // mb_adaptive_frame_field_flag
+    }
+    reader.bit(); // direct_8x8_inference_flag
+
+    uint32_t width = widthInMbs * 16;
+    uint32_t height = (2 - frameMbsOnly) * heightInMapUnits * 16;
+    if (reader.bit()) // frame_cropping_flag
+    {
+        uint32_t cropX = info.chromaFormat == 1 || info.chromaFormat == 2 ? 2 : 1;
+        uint32_t cropY = (info.chromaFormat == 1 ? 2 : 1) * (2 - frameMbsOnly);
+        uint32_t left = reader.ue(), right = reader.ue(), top = reader.ue(), bottom = reader.ue();
+        width -= cropX * (left + right);
+        height -= cropY * (top + bottom);
+    }
+    if (reader.overrun() || width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF)
+    {
+        return false;
+    }
+    info.width = width;
+    info.height = height;
+    return true;
+}
+
+// Calls handler with each NAL unit of an Annex-B buffer, without its start code
+template <typename Handler>
+static void forEachNal(const uint8_t *data, size_t size, Handler handler)
+{
+    size_t start = SIZE_MAX;
+    size_t i = 0;
+    while (i + 3 <= size)
+    {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+        {
+            if (start != SIZE_MAX)
+            {
+                size_t end = i;
+                while (end > start && data[end - 1] == 0)
+                {
+                    end--; // Zero byte of a four-byte start code, or trailing zeros
+                }
+                handler(data + start, end - start);
+            }
+            i += 3;
+            start = i;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    if (start != SIZE_MAX && start < size)
+    {
+        handler(data + start, size - start);
+    }
+}
+
+Fmp4Muxer::Fmp4Muxer(size_t fragmentSize)
+    : _fragmentSize(fragmentSize), _buffer(nullptr), _dataStart(0), _length(0), _sampleCount(0), _started(false),
+      _inAddFrame(false), _headerWritten(false), _spsSize(0), _ppsSize(0), _sequence(0), _decodeTime(0), _lastDuration(0), _fileOffset(0),
+      _stats()
+{
+}
+
+Fmp4Muxer::~Fmp4Muxer()
+{
+    free(_buffer);
+}
+
+bool Fmp4Muxer::begin()
+{
+    if (_buffer != nullptr)
+    {
+        return true;
+    }
+    if (!psramFound())
+    {
+        _fragmentSize = min(_fragmentSize, (size_t)48 * 1024); // Matches the reassembler's frames
+    }
+    _buffer = (uint8_t *)(psramFound() ? ps_malloc(_fragmentSize) : malloc(_fragmentSize));
+    if (!_buffer)
+    {
+        Serial.println("Fmp4Muxer: out of memory");
+        return false;
+    }
+    _dataStart = MOOF_FIXED_SIZE + MAX_FRAGMENT_SAMPLES * TRUN_ENTRY_SIZE + 8;
+    _index.reserve(64);
+    return true;
+}
+
+void Fmp4Muxer::start(Sink sink)
+{
+    if (_buffer == nullptr || _started)
+    {
+        return;
+    }
+    _sink = sink;
+    _headerWritten = false;
+    _spsSize = 0;
+    _ppsSize = 0;
+    _length = _dataStart;
+    _sampleCount = 0;
+    _sequence = 0;
+    _decodeTime = 0;
+    _lastDuration = TIMESCALE / 30;
+    _fileOffset = 0;
+    _index.clear();
+    _stats = Fmp4MuxerStats();
+    _started = true;
+}
+
+size_t Fmp4Muxer::write(const uint8_t *data, size_t size)
+{
+    size_t written = _sink ? _sink(data, size) : 0;
+    _fileOffset += written;
+    _stats.bytesWritten += written;
+    return written;
+}
+
+void Fmp4Muxer::findParameterSets(const uint8_t *data, size_t size)
+{
+    forEachNal(data, size, [this](const uint8_t *nal, size_t length) {
+        uint8_t type = nal[0] & 0x1F;
+        if (type == NAL_SPS && length <= sizeof(_sps))
+        {
+            memcpy(_sps, nal, length);
+            _spsSize = length;
+        }
+        else if (type == NAL_PPS && length <= sizeof(_pps))
+        {
+            memcpy(_pps, nal, length);
+            _ppsSize = length;
+        }
+    });
+}
+
+// ftyp and a moov describing one H.264 track whose samples are all in fragments
+bool Fmp4Muxer::writeHeader()
+{
+    SpsInfo sps;
+    if (!parseSps(_sps, _spsSize, sps))
+    {
+        Serial.println("Fmp4Muxer: unsupported SPS");
+        return false;
+    }
+
+    uint8_t *header = (uint8_t *)malloc(HEADER_CAPACITY);
+    if (!header)
+    {
+        return false;
+    }
+    BoxWriter w(header, HEADER_CAPACITY);
+
+    size_t ftyp = w.box("ftyp");
+    w.fourcc("iso6");
+    w.u32(0);
+    w.fourcc("iso6");
+    w.fourcc("isom");
+    w.fourcc("avc1");
+    w.fourcc("mp41");
+    w.end(ftyp);
+
+    size_t moov = w.box("moov");
+    size_t mvhd = w.fullBox("mvhd", 0, 0);
+    w.u32(0); // creation_time
+    w.u32(0); // modification_time
+    w.u32(1000);
+    w.u32(0); // duration, unknown while recording
+    w.u32(0x00010000); // rate 1.0
+    w.u16(0x0100);     // volume 1.0
+    w.zeros(10);
+    w.matrix();
+    w.zeros(24);
+    w.u32(TRACK_ID + 1); // next_track_ID
+    w.end(mvhd);
+
+    size_t trak = w.box("trak");
+    size_t tkhd = w.fullBox("tkhd", 0, 0x000003); // Enabled, in movie
+    w.u32(0);
+    w.u32(0);
+    w.u32(TRACK_ID);
+    w.u32(0);
+    w.u32(0); // duration
+    w.zeros(8);
+    w.u16(0); // layer
+    w.u16(0); // alternate_group
+    w.u16(0); // volume
+    w.u16(0);
+    w.matrix();
+    w.u32((uint32_t)sps.width << 16);
+    w.u32((uint32_t)sps.height << 16);
+    w.end(tkhd);
+
+    size_t mdia = w.box("mdia");
+    size_t mdhd = w.fullBox("mdhd", 0, 0);
+    w.u32(0);
+    w.u32(0);
+    w.u32(TIMESCALE);
+    w.u32(0);
+    w.u16(0x55C4); // "und"
+    w.u16(0);
+    w.end(mdhd);
+    size_t hdlr = w.fullBox("hdlr", 0, 0);
+    w.u32(0);
+    w.fourcc("vide");
+    w.zeros(12);
+    w.bytes("Tello\0", 6);
+    w.end(hdlr);
+
+    size_t minf = w.box("minf");
+    size_t vmhd = w.fullBox("vmhd", 0, 1);
+    w.zeros(8); // graphicsmode, opcolor
+    w.end(vmhd);
+    size_t dinf = w.box("dinf");
+    size_t dref = w.fullBox("dref", 0, 0);
+    w.u32(1);
+    size_t url = w.fullBox("url ", 0, 1); // Media data in this file
+    w.end(url);
+    w.end(dref);
+    w.end(dinf);
+
+    size_t stbl = w.box("stbl");
+    size_t stsd = w.fullBox("stsd", 0, 0);
+    w.u32(1);
+    size_t avc1 = w.box("avc1");
+    w.zeros(6);
+    w.u16(1); // data_reference_index
+    w.zeros(16);
+    w.u16(sps.width);
+    w.u16(sps.height);
+    w.u32(0x00480000); // 72 dpi
+    w.u32(0x00480000);
+    w.u32(0);
+    w.u16(1); // frame_count
+    w.zeros(32); // compressorname
+    w.u16(0x0018); // depth
+    w.u16(0xFFFF);
+    size_t avcC = w.box("avcC");
+    w.u8(1); // configurationVersion
+    w.u8(_sps[1]); // AVCProfileIndication
+    w.u8(_sps[2]); // profile_compatibility
+    w.u8(_sps[3]); // AVCLevelIndication
+    w.u8(0xFF);    // 4-byte NAL unit lengths
+    w.u8(0xE1);    // One SPS
+    w.u16(_spsSize);
+    w.bytes(_sps, _spsSize);
+    w.u8(1);       // One PPS
+    w.u16(_ppsSize);
+    w.bytes(_pps, _ppsSize);
+    if (sps.profile != 66 && sps.profile != 77 && sps.profile != 88)
+    {
+        w.u8(0xFC | sps.chromaFormat);
+        w.u8(0xF8 | (sps.bitDepthLuma - 8));
+        w.u8(0xF8 | (sps.bitDepthChroma - 8));
+        w.u8(0); // numOfSequenceParameterSetExt
+    }
+    w.end(avcC);
+    w.end(avc1);
+    w.end(stsd);
+    // Empty sample tables, the samples are described by the fragments
+    const char *emptyTables[] = {"stts", "stsc", "stco"};
+    for (const char *type : emptyTables)
+    {
+        size_t table = w.fullBox(type, 0, 0);
+        w.u32(0);
+        w.end(table);
+    }
+    size_t stsz = w.fullBox("stsz", 0, 0);
+    w.u32(0);
+    w.u32(0);
+    w.end(stsz);
+    w.end(stbl);
+    w.end(minf);
+    w.end(mdia);
+    w.end(trak);
+
+    size_t mvex = w.box("mvex");
+    size_t trex = w.fullBox("trex", 0, 0);
+    w.u32(TRACK_ID);
+    w.u32(1); // default_sample_description_index
+    w.u32(0);
+    w.u32(0);
+    w.u32(0);
+    w.end(trex);
+    w.end(mvex);
+    w.end(moov);
+
+    bool written = !w.overflow() && write(header, w.length()) == w.length();
+    free(header);
+    if (written)
+    {
+        Serial.printf("Fmp4Muxer: %ux%u, profile %u\n", sps.width, sps.height, sps.profile);
+    }
+    return written;
+}
+
+void Fmp4Muxer::addFrame(const H264Frame &frame, const uint8_t *parameterSets, size_t parameterSetsSize)
+{
+    _inAddFrame = true;
+    if (_started)
+    {
+        addSample(frame, parameterSets, parameterSetsSize);
+    }
+    _inAddFrame = false;
+}
+
+void Fmp4Muxer::addSample(const H264Frame &frame, const uint8_t *parameterSets, size_t parameterSetsSize)
+{
+    if (!_headerWritten)
+    {
+        if (!frame.keyframe)
+        {
+            _stats.framesSkipped++;
+            return;
+        }
+        findParameterSets(frame.data, frame.size);
+        if ((_spsSize == 0 || _ppsSize == 0) && parameterSets != nullptr)
+        {
+            findParameterSets(parameterSets, parameterSetsSize);
+        }
+        if (_spsSize == 0 || _ppsSize == 0 || !writeHeader())
+        {
+            _stats.framesSkipped++;
+            return;
+        }
+        _headerWritten = true;
+    }
+
+    uint32_t age = _sampleCount > 0 ? frame.receivedMs - _samples[0].receivedMs : 0;
+    // Each start code becomes a 4-byte length, one byte more at most
+    bool fits = frame.size + frame.nalCount <= _fragmentSize - _length;
+    if (_sampleCount > 0 && (frame.keyframe || _sampleCount == MAX_FRAGMENT_SAMPLES || age >= MAX_FRAGMENT_MS || !fits))
+    {
+        flushFragment(true, frame.receivedMs);
+    }
+    if (appendSample(frame))
+    {
+        _stats.frames++;
+        _stats.keyframes += frame.keyframe;
+    }
+    else
+    {
+        _stats.framesDropped++;
+    }
+}
+
+// Copies the frame's NAL units into the fragment with length prefixes instead of start codes
+bool Fmp4Muxer::appendSample(const H264Frame &frame)
+{
+    size_t start = _length;
+    bool overflow = false;
+    forEachNal(frame.data, frame.size, [&](const uint8_t *nal, size_t length) {
+        uint8_t type = nal[0] & 0x1F;
+        // The parameter sets are in the sample description; ones that differ from it (the
+        // bitrate or frame rate changed during the recording) stay in the sample
+        bool described = (type == NAL_SPS && length == _spsSize && memcmp(nal, _sps, length) == 0) ||
+                         (type == NAL_PPS && length == _ppsSize && memcmp(nal, _pps, length) == 0);
+        if (described || type == NAL_AUD || overflow)
+        {
+            return;
+        }
+        if (_length + 4 + length > _fragmentSize)
+        {
+            overflow = true;
+            return;
+        }
+        uint8_t *out = _buffer + _length;
+        out[0] = length >> 24;
+        out[1] = length >> 16;
+        out[2] = length >> 8;
+        out[3] = length;
+        memcpy(out + 4, nal, length);
+        _length += 4 + length;
+    });
+    if (overflow || _length == start)
+    {
+        _length = start;
+        return false;
+    }
+
+    // An incomplete IDR is no place to start decoding from
+    Sample &sample = _samples[_sampleCount++];
+    sample.size = _length - start;
+    sample.receivedMs = frame.receivedMs;
+    sample.sync = frame.keyframe && frame.complete;
+    return true;
+}
+
+// Builds the moof in front of the samples and writes moof and mdat in one piece. The last
+// sample lasts until nextMs, the arrival of the frame after it (or as long as the one before
+// at the end of the file).
+void Fmp4Muxer::flushFragment(bool hasNext, uint32_t nextMs)
+{
+    if (_sampleCount == 0)
+    {
+        return;
+    }
+
+    uint32_t durations[MAX_FRAGMENT_SAMPLES];
+    uint64_t fragmentDuration = 0;
+    uint64_t syncTime = 0;
+    int syncSample = -1;
+    for (size_t i = 0; i < _sampleCount; i++)
+    {
+        bool last = i + 1 == _sampleCount;
+        if (!last || hasNext)
+        {
+            uint32_t endMs = last ? nextMs : _samples[i + 1].receivedMs;
+            // Frames arriving in a burst still get a tick each, so the timeline keeps increasing
+            _lastDuration = max((uint32_t)1, (endMs - _samples[i].receivedMs) * (TIMESCALE / 1000));
+        }
+        durations[i] = _lastDuration;
+        if (_samples[i].sync && syncSample < 0)
+        {
+            syncSample = i;
+            syncTime = _decodeTime + fragmentDuration;
+        }
+        fragmentDuration += durations[i];
+    }
+
+    size_t moofSize = MOOF_FIXED_SIZE + _sampleCount * TRUN_ENTRY_SIZE;
+    size_t fragmentStart = _dataStart - 8 - moofSize;
+    size_t fragmentSize = _length - fragmentStart;
+    BoxWriter w(_buffer + fragmentStart, moofSize + 8);
+    _sequence++;
+
+    size_t moof = w.box("moof");
+    size_t mfhd = w.fullBox("mfhd", 0, 0);
+    w.u32(_sequence);
+    w.end(mfhd);
+    size_t traf = w.box("traf");
+    size_t tfhd = w.fullBox("tfhd", 0, 0x020000); // default-base-is-moof
+    w.u32(TRACK_ID);
+    w.end(tfhd);
+    size_t tfdt = w.fullBox("tfdt", 1, 0);
+    w.u64(_decodeTime);
+    w.end(tfdt);
+    size_t trun = w.fullBox("trun", 0, 0x000701); // data-offset, then duration, size and flags per sample
+    w.u32(_sampleCount);
+    w.u32(moofSize + 8); // Samples start right after the mdat header
+    for (size_t i = 0; i < _sampleCount; i++)
+    {
+        w.u32(durations[i]);
+        w.u32(_samples[i].size);
+        w.u32(_samples[i].sync ? SYNC_SAMPLE_FLAGS : NON_SYNC_SAMPLE_FLAGS);
+    }
+    w.end(trun);
+    w.end(traf);
+    w.end(moof);
+    w.u32(fragmentSize - moofSize);
+    w.fourcc("mdat");
+
+    uint64_t moofOffset = _fileOffset;
+    if (write(_buffer + fragmentStart, fragmentSize) == fragmentSize)
+    {
+        _stats.fragments++;
+        _stats.maxFragmentSize = max(_stats.maxFragmentSize, (uint32_t)fragmentSize);
+        if (syncSample >= 0 && _index.size() < MAX_INDEX_ENTRIES)
+        {
+            _index.push_back({syncTime, moofOffset, (uint8_t)(syncSample + 1)});
+        }
+    }
+    else
+    {
+        _stats.fragmentsDropped++;
+    }
+
+    // A dropped fragment leaves a gap in the timeline, the next tfdt starts after it
+    _decodeTime += fragmentDuration;
+    _sampleCount = 0;
+    _length = _dataStart;
+}
+
+// mfra with one tfra entry per fragment that holds a keyframe, found through the mfro at the end of the file
+bool Fmp4Muxer::writeIndex()
+{
+    size_t capacity = 8 + 24 + _index.size() * 19 + 16;
+    uint8_t *buffer = (uint8_t *)malloc(capacity);
+    if (!buffer)
+    {
+        return false;
+    }
+    BoxWriter w(buffer, capacity);
+    size_t mfra = w.box("mfra");
+    size_t tfra = w.fullBox("tfra", 1, 0);
+    w.u32(TRACK_ID);
+    w.u32(0); // One byte each for traf, trun and sample numbers
+    w.u32(_index.size());
+    for (const IndexEntry &entry : _index)
+    {
+        w.u64(entry.time);
+        w.u64(entry.moofOffset);
+        w.u8(1);
+        w.u8(1);
+        w.u8(entry.sampleNumber);
+    }
+    w.end(tfra);
+    size_t mfro = w.fullBox("mfro", 0, 0);
+    w.u32(w.length() + 4); // Size of the whole mfra
+    w.end(mfro);
+    w.end(mfra);
+
+    bool written = !w.overflow() && write(buffer, w.length()) == w.length();
+    free(buffer);
+    return written;
+}
+
+bool Fmp4Muxer::finish()
+{
+    if (!_started)
+    {
+        return false;
+    }
+    _started = false;
+
+    // Let a frame that is being added finish (the video task may also have been deleted)
+    unsigned long start = millis();
+    while (_inAddFrame && millis() - start < 100)
+    {
+        delay(1);
+    }
+    if (!_headerWritten)
+    {
+        return false;
+    }
+    flushFragment(false, 0);
+    return writeIndex();
+}
+
+void Fmp4Muxer::printStats() const
+{
+    Serial.printf("MP4: %u frames (%u keyframes) in %u fragments, %u fragments dropped, %u frames skipped before the "
+                  "first keyframe, %u too large, largest fragment %u bytes\n",
+                  _stats.frames, _stats.keyframes, _stats.fragments, _stats.fragmentsDropped, _stats.framesSkipped,
+                  _stats.framesDropped, _stats.maxFragmentSize);
+}
@@ -0,0 +1,114 @@
+#ifndef FMP4MUXER_H
+#define FMP4MUXER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "H264Reassembler.h"
+
+// Writes the access units from H264Reassembler as fragmented MP4 (ISO/IEC 14496-12 and -15).
+// The file opens with ftyp and a moov without samples, then every fragment is a moof with
+// the sample table (duration, size and sync flag of each frame) followed by its mdat, so a
+// player can seek to keyframes and times without scanning the stream. A recording cut short
+// (power loss) is readable up to its last complete fragment; finish() adds an mfra index of
+// the keyframes for seeking in a closed file.
+//
+// A fragment is collected in a PSRAM buffer and starts at a keyframe, or when it reaches
+// MAX_FRAGMENT_MS, MAX_FRAGMENT_SAMPLES or the buffer size. The whole fragment goes to the
+// sink in one write; a sink that cannot take it (VideoWriter with every block queued) drops
+// the fragment, and the timeline continues after the gap.
+//
+// The Tello stream carries no timestamps, so frames are timed by their arrival. Frames
+// before the first keyframe with SPS/PPS are skipped, as the sample description needs them;
+// AUD NAL units and repeats of the described SPS/PPS are taken out of the samples.
+//
+// addFrame() is called from the video task; start() and finish() may be called from another
+// task, as for VideoWriter's open() and close().
+struct Fmp4MuxerStats
+{
+    uint32_t frames;
+    uint32_t keyframes;
+    uint32_t fragments;
+    uint32_t framesSkipped;     // Before the first keyframe
+    uint32_t framesDropped;     // Larger than the fragment buffer
+    uint32_t fragmentsDropped;  // Refused by the sink
+    uint32_t maxFragmentSize;
+    uint64_t bytesWritten;
+};
+
+class Fmp4Muxer
+{
+public:
+    // Writes all of data or nothing, returns the bytes written
+    typedef std::function<size_t(const uint8_t *data, size_t size)> Sink;
+
+    static const size_t DEFAULT_FRAGMENT_SIZE = 160 * 1024; // Below VideoWriter's free blocks
+    static const size_t MAX_FRAGMENT_SAMPLES = 64;
+    static const uint32_t MAX_FRAGMENT_MS = 1000;
+    static const uint32_t TIMESCALE = 90000;                // Ticks per second, as in RTP video
+    static const size_t MAX_INDEX_ENTRIES = 2048;
+
+    Fmp4Muxer(size_t fragmentSize = DEFAULT_FRAGMENT_SIZE);
+    ~Fmp4Muxer();
+
+    bool begin();
+    // Starts a new file written through sink
+    void start(Sink sink);
+    // parameterSets (Annex-B SPS and PPS) are used when the first keyframe has none
+    void addFrame(const H264Frame &frame, const uint8_t *parameterSets = nullptr, size_t parameterSetsSize = 0);
+    // Writes the last fragment and the index
+    bool finish();
+    bool isStarted() const { return _started; }
+
+    Fmp4MuxerStats stats() const { return _stats; }
+    void printStats() const;
+
+private:
+    struct Sample
+    {
+        uint32_t size;
+        uint32_t receivedMs;
+        bool sync;
+    };
+    struct IndexEntry
+    {
+        uint64_t time;
+        uint64_t moofOffset;
+        uint8_t sampleNumber;
+    };
+
+    size_t _fragmentSize;
+    uint8_t *_buffer;           // moof space, mdat header, then the samples
+    size_t _dataStart;
+    size_t _length;
+    Sample _samples[MAX_FRAGMENT_SAMPLES];
+    size_t _sampleCount;
+
+    Sink _sink;
+    std::atomic<bool> _started;
+    std::atomic<bool> _inAddFrame;
+    bool _headerWritten;
+    uint8_t _sps[H264Reassembler::MAX_PARAMETER_SET_SIZE];
+    uint8_t _pps[H264Reassembler::MAX_PARAMETER_SET_SIZE];
+    size_t _spsSize;
+    size_t _ppsSize;
+
+    uint32_t _sequence;
+    uint64_t _decodeTime;       // Of the fragment being collected, in TIMESCALE ticks
+    uint32_t _lastDuration;
+    uint64_t _fileOffset;
+    std::vector<IndexEntry> _index;
+
+    Fmp4MuxerStats _stats;
+
+    void findParameterSets(const uint8_t *data, size_t size);
+    bool writeHeader();
+    void addSample(const H264Frame &frame, const uint8_t *parameterSets, size_t parameterSetsSize);
+    bool appendSample(const H264Frame &frame);
+    void flushFragment(bool hasNext, uint32_t nextMs);
+    bool writeIndex();
+    size_t write(const uint8_t *data, size_t size);
+};
+
+#endif
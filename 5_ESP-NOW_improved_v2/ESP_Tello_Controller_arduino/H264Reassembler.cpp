@@ -0,0 +1,303 @@
+#include "H264Reassembler.h"
+
+H264Reassembler::H264Reassembler(size_t maxFrameSize)
+    : _maxFrameSize(maxFrameSize), _buffer(nullptr), _length(0), _zeros(0), _syncing(true), _expectStart(false),
+      _lastPacketFull(false), _nalStart(0), _nalType(0), _pendingHeader(false), _pendingFirstMb(false),
+      _nalAtPacketStart(false), _packetMs(0), _sequence(0), _spsSize(0), _ppsSize(0), _stats()
+{
+    clearUnit();
+}
+
+H264Reassembler::~H264Reassembler()
+{
+    free(_buffer);
+}
+
+bool H264Reassembler::begin()
+{
+    if (_buffer != nullptr)
+    {
+        return true;
+    }
+    if (!psramFound())
+    {
+        _maxFrameSize = min(_maxFrameSize, (size_t)48 * 1024); // 480p frames still fit
+    }
+    _buffer = (uint8_t *)(psramFound() ? ps_malloc(_maxFrameSize) : malloc(_maxFrameSize));
+    if (!_buffer)
+    {
+        Serial.println("H264Reassembler: out of memory");
+        return false;
+    }
+    return true;
+}
+
+void H264Reassembler::onFrame(std::function<void(const H264Frame &frame)> callback)
+{
+    _callback = callback;
+}
+
+void H264Reassembler::reset()
+{
+    _length = 0;
+    _zeros = 0;
+    _syncing = true;
+    _expectStart = false;
+    _lastPacketFull = false;
+    _pendingHeader = false;
+    _pendingFirstMb = false;
+    _sequence = 0;
+    _stats = H264ReassemblerStats();
+    clearUnit();
+}
+
+void H264Reassembler::clearUnit()
+{
+    _hasSlice = false;
+    _keyframe = false;
+    _hasSps = false;
+    _hasPps = false;
+    _complete = true;
+    _nalCount = 0;
+    _firstMs = 0;
+}
+
+void H264Reassembler::markLoss()
+{
+    if (_length > 0)
+    {
+        _complete = false;
+    }
+}
+
+void H264Reassembler::push(const uint8_t *data, size_t size, uint32_t nowMs)
+{
+    if (_buffer == nullptr || size == 0)
+    {
+        return;
+    }
+    _stats.datagrams++;
+    _packetMs = nowMs;
+
+    // After a frame end the next datagram opens with a start code; anything else is the
+    // remainder of a frame whose first datagrams were lost
+    if (_expectStart)
+    {
+        _expectStart = false;
+        bool opensWithStartCode = size >= 4 && data[0] == 0 && data[1] == 0 &&
+                                  (data[2] == 1 || (data[2] == 0 && data[3] == 1));
+        if (!opensWithStartCode)
+        {
+            _stats.gaps++;
+            _syncing = true;
+            _zeros = 0;
+        }
+    }
+    if (_length == 0 && !_syncing)
+    {
+        _firstMs = nowMs;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t value = data[i];
+        if (_syncing)
+        {
+            if (value == 1 && _zeros >= 2)
+            {
+                // Keep the start code, the frame begins here
+                uint8_t zeros = _zeros > 3 ? 3 : _zeros;
+                _stats.bytesDiscarded -= zeros;
+                memset(_buffer, 0, zeros);
+                _buffer[zeros] = 1;
+                _length = zeros + 1;
+                _syncing = false;
+                _firstMs = nowMs;
+                _zeros = 0;
+                _nalStart = 0;
+                _pendingHeader = true;
+                _nalAtPacketStart = i == zeros;
+                continue;
+            }
+            _zeros = value == 0 ? _zeros + 1 : 0;
+            _stats.bytesDiscarded++;
+            continue;
+        }
+
+        if (_length >= _maxFrameSize)
+        {
+            // Cannot hold the frame, skip to the next start code
+            _stats.oversizeFrames++;
+            _stats.bytesDiscarded += _length;
+            _length = 0;
+            _syncing = true;
+            _zeros = value == 0 ? 1 : 0;
+            _pendingHeader = false;
+            _pendingFirstMb = false;
+            clearUnit();
+            continue;
+        }
+        _buffer[_length++] = value;
+
+        if (_pendingHeader)
+        {
+            nalHeader(value);
+        }
+        else if (_pendingFirstMb)
+        {
+            firstMbByte(value);
+        }
+
+        if (value == 0)
+        {
+            _zeros++;
+        }
+        else if (value == 1 && _zeros >= 2)
+        {
+            uint8_t zeros = _zeros > 3 ? 3 : _zeros;
+            _zeros = 0;
+            finishNal(_length - 1 - zeros);
+            _nalStart = _length - 1 - zeros;
+            _pendingHeader = true;
+            _pendingFirstMb = false;
+            _nalAtPacketStart = i == zeros;
+        }
+        else
+        {
+            _zeros = 0;
+        }
+    }
+
+    // The Tello ends every frame with a datagram shorter than the rest
+    bool full = size >= TELLO_PACKET_SIZE;
+    if (!full && !_syncing && _hasSlice && !_pendingHeader && !_pendingFirstMb)
+    {
+        finishNal(_length);
+        emit(_length, false);
+        _expectStart = true;
+        _zeros = 0;
+    }
+    _lastPacketFull = full;
+}
+
+void H264Reassembler::nalHeader(uint8_t header)
+{
+    _pendingHeader = false;
+    _nalType = header & 0x1F;
+    if (header & 0x80)
+    {
+        _complete = false; // forbidden_zero_bit, the NAL was damaged
+    }
+
+    if (_nalType == NAL_SLICE || _nalType == NAL_IDR)
+    {
+        _pendingFirstMb = true;
+        return;
+    }
+    if (_hasSlice && (_nalType == NAL_SEI || _nalType == NAL_SPS || _nalType == NAL_PPS || _nalType == NAL_AUD))
+    {
+        emit(_nalStart, _nalAtPacketStart && _lastPacketFull);
+    }
+    _nalCount++;
+    _hasSps |= _nalType == NAL_SPS;
+    _hasPps |= _nalType == NAL_PPS;
+}
+
+void H264Reassembler::firstMbByte(uint8_t value)
+{
+    _pendingFirstMb = false;
+    // first_mb_in_slice is ue(v), coded as a single 1 bit when it is 0
+    if ((value & 0x80) && _hasSlice)
+    {
+        emit(_nalStart, _nalAtPacketStart && _lastPacketFull);
+    }
+    _nalCount++;
+    _hasSlice = true;
+    _keyframe |= _nalType == NAL_IDR;
+}
+
+// Keeps a copy of parameter sets as they complete
+void H264Reassembler::finishNal(size_t end)
+{
+    if ((_nalType != NAL_SPS && _nalType != NAL_PPS) || _pendingHeader || end <= _nalStart)
+    {
+        return;
+    }
+    while (end > _nalStart && _buffer[end - 1] == 0)
+    {
+        end--; // trailing_zero_8bits
+    }
+    size_t size = end - _nalStart;
+    if (size > MAX_PARAMETER_SET_SIZE)
+    {
+        return;
+    }
+    if (_nalType == NAL_SPS)
+    {
+        memcpy(_sps, _buffer + _nalStart, size);
+        _spsSize = size;
+    }
+    else
+    {
+        memcpy(_pps, _buffer + _nalStart, size);
+        _ppsSize = size;
+    }
+}
+
+// Delivers _buffer[0, end) and moves the bytes after it (the next NAL so far) to the front
+void H264Reassembler::emit(size_t end, bool truncated)
+{
+    if (truncated)
+    {
+        _complete = false;
+        _stats.truncatedFrames++;
+    }
+
+    H264Frame frame;
+    frame.data = _buffer;
+    frame.size = end;
+    frame.sequence = _sequence++;
+    frame.receivedMs = _firstMs;
+    frame.nalCount = _nalCount;
+    frame.keyframe = _keyframe;
+    frame.hasParameterSets = _hasSps && _hasPps;
+    frame.complete = _complete;
+
+    _stats.frames++;
+    _stats.keyframes += _keyframe;
+    _stats.incompleteFrames += !_complete;
+    if (end > _stats.maxFrameSize)
+    {
+        _stats.maxFrameSize = end;
+    }
+    if (_callback)
+    {
+        _callback(frame);
+    }
+
+    memmove(_buffer, _buffer + end, _length - end);
+    _length -= end;
+    _nalStart -= end;
+    clearUnit();
+    _firstMs = _packetMs;
+}
+
+size_t H264Reassembler::copyParameterSets(uint8_t *out, size_t size) const
+{
+    if (_spsSize == 0 || _ppsSize == 0 || _spsSize + _ppsSize > size)
+    {
+        return 0;
+    }
+    memcpy(out, _sps, _spsSize);
+    memcpy(out + _spsSize, _pps, _ppsSize);
+    return _spsSize + _ppsSize;
+}
+
+void H264Reassembler::printStats() const
+{
+    Serial.printf("H264Reassembler: %u datagrams -> %u frames (%u keyframes, largest %u bytes)\n",
+                  _stats.datagrams, _stats.frames, _stats.keyframes, _stats.maxFrameSize);
+    Serial.printf("H264Reassembler: %u incomplete frames, %u gaps, %u truncated, %u oversize, %u bytes discarded\n",
+                  _stats.incompleteFrames, _stats.gaps, _stats.truncatedFrames, _stats.oversizeFrames,
+                  _stats.bytesDiscarded);
+}
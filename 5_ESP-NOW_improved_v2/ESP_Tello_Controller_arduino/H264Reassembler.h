@@ -0,0 +1,124 @@
+#ifndef H264REASSEMBLER_H
+#define H264REASSEMBLER_H
+
+#include <Arduino.h>
+#include <functional>
+
+// Joins the Tello's H.264 datagrams into access units (one coded frame each).
+// The stream is Annex-B split into 1460-byte datagrams, the last one of a frame shorter.
+// NAL units are found by their start codes, also when a start code spans two datagrams,
+// and a new access unit begins at the first SPS/PPS/SEI/AUD or first slice
+// (first_mb_in_slice == 0) after a slice, as in H.264 7.4.1.2.3. A short datagram ends
+// the frame at once, so frames are delivered without waiting for the next one.
+//
+// The Tello sends no sequence numbers, so loss is inferred:
+//  - a datagram after a frame end that does not open with a start code lost its head,
+//    its bytes are dropped up to the next start code (a gap)
+//  - a frame followed by a new one without a short datagram lost its tail (truncated)
+//  - markLoss() reports datagrams dropped before push(), e.g. in a full receive buffer
+// Such frames are still delivered, with complete == false. A datagram lost on the air from
+// the middle of a frame leaves no trace in the stream and goes unnoticed.
+//
+// Not thread safe: push(), markLoss() and reset() are called from the one video task.
+struct H264Frame
+{
+    const uint8_t *data;    // Annex-B bytes, start codes included; valid during the callback
+    size_t size;
+    uint32_t sequence;      // Frames delivered since reset()
+    uint32_t receivedMs;    // Arrival of the frame's first datagram
+    uint8_t nalCount;
+    bool keyframe;          // Contains an IDR slice
+    bool hasParameterSets;  // SPS and PPS are part of the frame (the Tello sends them before IDRs)
+    bool complete;          // No loss was detected while assembling
+};
+
+struct H264ReassemblerStats
+{
+    uint32_t datagrams;
+    uint32_t frames;
+    uint32_t keyframes;
+    uint32_t incompleteFrames;
+    uint32_t gaps;             // Datagrams that did not continue the stream
+    uint32_t truncatedFrames;  // Frames whose last datagram was missing
+    uint32_t oversizeFrames;   // Frames larger than the buffer, dropped
+    uint32_t bytesDiscarded;
+    uint32_t maxFrameSize;
+};
+
+class H264Reassembler
+{
+public:
+    static const size_t DEFAULT_MAX_FRAME_SIZE = 128 * 1024; // 720p IDR frames reach ~60 KB
+    static const size_t TELLO_PACKET_SIZE = 1460;
+    static const size_t MAX_PARAMETER_SET_SIZE = 64;
+
+    H264Reassembler(size_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE);
+    ~H264Reassembler();
+
+    bool begin();
+    void onFrame(std::function<void(const H264Frame &frame)> callback);
+
+    void push(const uint8_t *data, size_t size, uint32_t nowMs);
+    void markLoss();
+    // Drops the frame being assembled, e.g. when a new recording starts
+    void reset();
+
+    // Latest SPS and PPS as Annex-B (for decoders joining mid-stream); 0 if not seen yet
+    size_t copyParameterSets(uint8_t *out, size_t size) const;
+
+    H264ReassemblerStats stats() const { return _stats; }
+    void printStats() const;
+
+private:
+    static const uint8_t NAL_SLICE = 1;
+    static const uint8_t NAL_IDR = 5;
+    static const uint8_t NAL_SEI = 6;
+    static const uint8_t NAL_SPS = 7;
+    static const uint8_t NAL_PPS = 8;
+    static const uint8_t NAL_AUD = 9;
+
+    size_t _maxFrameSize;
+    uint8_t *_buffer;
+    size_t _length;
+    std::function<void(const H264Frame &frame)> _callback;
+
+    // Start code scanner
+    uint8_t _zeros;            // Zero bytes just before the current position (up to 3 kept)
+    bool _syncing;             // Discarding bytes until the next start code
+    bool _expectStart;         // The previous datagram ended a frame
+    bool _lastPacketFull;
+
+    // NAL unit being parsed
+    size_t _nalStart;          // Offset of its start code in _buffer
+    uint8_t _nalType;
+    bool _pendingHeader;       // Next byte is the NAL header
+    bool _pendingFirstMb;      // Next byte holds first_mb_in_slice
+    bool _nalAtPacketStart;
+
+    // Access unit being assembled
+    bool _hasSlice;
+    bool _keyframe;
+    bool _hasSps;
+    bool _hasPps;
+    bool _complete;
+    uint8_t _nalCount;
+    uint32_t _firstMs;
+    uint32_t _packetMs;        // Arrival of the datagram being pushed
+    uint32_t _sequence;
+
+    uint8_t _sps[MAX_PARAMETER_SET_SIZE];
+    uint8_t _pps[MAX_PARAMETER_SET_SIZE];
+    size_t _spsSize;
+    size_t _ppsSize;
+
+    H264ReassemblerStats _stats;
+
+    void startCode(uint8_t zeros, uint32_t nowMs);
+    void nalHeader(uint8_t header);
+    void firstMbByte(uint8_t value);
+    void finishNal(size_t end);
+    void emit(size_t end, bool truncated);
+    void clearUnit();
+};
+
+#endif
@@ -47,7 +47,8 @@ bool InferenceHandler::connectToServer()
     return false;
 }
 
-String InferenceHandler::makeMultipartRequest(File &file, const char *filename, float confidence, float overlap)
+// read fills the buffer with the next part of the file and returns 0 at its end
+String InferenceHandler::makeMultipartRequest(const char *filename, size_t size, std::function<size_t(uint8_t *, size_t)> read, float confidence, float overlap)
 {
     // Connection is maintained from begin()
     if (!_client.connected()) {
@@ -86,7 +87,7 @@ String InferenceHandler::makeMultipartRequest(File &file, const char *filename,
     requestLength += fileHeader.length();
 
     // File content
-    requestLength += file.size();
+    requestLength += size;
 
     // Closing boundary
     String closing = lineEnd + twoHyphens + boundary + twoHyphens + lineEnd;
@@ -112,7 +113,7 @@ String InferenceHandler::makeMultipartRequest(File &file, const char *filename,
     // Send file in chunks
     uint8_t buffer[1024];
     size_t bytesRead;
-    while ((bytesRead = file.read(buffer, sizeof(buffer))) > 0)
+    while ((bytesRead = read(buffer, sizeof(buffer))) > 0)
     {
         _client.write(buffer, bytesRead);
     }
@@ -158,6 +159,28 @@ float InferenceHandler::calculateRipenessPercentage(const JsonObject &prediction
     return (float)ripeCount / totalObjects * 100.0f;
 }
 
+bool InferenceHandler::parseResponse(const String &response, InferenceResult &result)
+{
+    StaticJsonDocument<1024> doc;
+    DeserializationError error = deserializeJson(doc, response);
+    if (error)
+    {
+        Serial.println("JSON parsing failed");
+        return false;
+    }
+
+    result.frameCount = doc["frame_count"] | 0;
+    result.totalObjects = doc["total_objects"] | 0;
+
+    JsonObject predictions = doc["predictions"];
+    result.ripeCount = predictions["ripe"] | 0;
+    result.unripeCount = predictions["unripe"] | 0;
+    result.greenCount = predictions["green"] | 0;
+
+    result.ripenessPercentage = calculateRipenessPercentage(predictions, result.totalObjects);
+    return true;
+}
+
 bool InferenceHandler::requestInference(const char *filename, float confidence, float overlap, InferenceResult &result)
 {
     int retries = 3;
@@ -168,28 +191,37 @@ bool InferenceHandler::requestInference(const char *filename, float confidence,
             return false;
         }
 
-        String response = makeMultipartRequest(file, filename, confidence, overlap);
+        String response = makeMultipartRequest(filename, file.size(), [&](uint8_t *buffer, size_t size) { return file.read(buffer, size); },
+                                               confidence, overlap);
         file.close();
 
         if (response.length() > 0) {
-            StaticJsonDocument<1024> doc; 
-            DeserializationError error = deserializeJson(doc, response);
-            if (error)
-            {
-                Serial.println("JSON parsing failed");
-                return false;
-            }
+            return parseResponse(response, result);
+        }
 
-            result.frameCount = doc["frame_count"] | 0;
-            result.totalObjects = doc["total_objects"] | 0;
+        Serial.printf("Attempt %d failed, retrying...\n", 4-retries);
+        retries--;
+        delay(1000);
+    }
+
+    Serial.println("All retry attempts failed");
+    return false;
+}
 
-            JsonObject predictions = doc["predictions"];
-            result.ripeCount = predictions["ripe"] | 0;
-            result.unripeCount = predictions["unripe"] | 0;
-            result.greenCount = predictions["green"] | 0;
+bool InferenceHandler::requestInference(const char *name, const uint8_t *data, size_t size, float confidence, float overlap, InferenceResult &result)
+{
+    int retries = 3;
+    while (retries > 0) {
+        size_t offset = 0;
+        String response = makeMultipartRequest(name, size, [&](uint8_t *buffer, size_t bufferSize) {
+            size_t n = min(bufferSize, size - offset);
+            memcpy(buffer, data + offset, n);
+            offset += n;
+            return n;
+        }, confidence, overlap);
 
-            result.ripenessPercentage = calculateRipenessPercentage(predictions, result.totalObjects);
-            return true;
+        if (response.length() > 0) {
+            return parseResponse(response, result);
         }
 
         Serial.printf("Attempt %d failed, retrying...\n", 4-retries);
@@ -6,6 +6,7 @@
 #include "FS.h"
 #include "SD_MMC.h"
 #include <ArduinoJson.h>
+#include <functional>
 
 struct InferenceResult {
     float ripenessPercentage;
@@ -21,6 +22,9 @@ public:
     InferenceHandler(const char* ssid, const char* password, const char* host, int httpsPort);
     bool begin();
     bool requestInference(const char* filename, float confidence, float overlap, InferenceResult& result);
+    // Same for a file held in memory, e.g. a keyframe; name is the filename the server sees
+    // (its extension selects image or video processing)
+    bool requestInference(const char* name, const uint8_t* data, size_t size, float confidence, float overlap, InferenceResult& result);
     void end();
 
 private:
@@ -32,7 +36,8 @@ private:
     WiFiClientSecure _client;
 
     bool connectToServer();
-    String makeMultipartRequest(File& file, const char* filename, float confidence, float overlap);
+    String makeMultipartRequest(const char* filename, size_t size, std::function<size_t(uint8_t*, size_t)> read, float confidence, float overlap);
+    bool parseResponse(const String& response, InferenceResult& result);
     float calculateRipenessPercentage(const JsonObject& predictions, int totalObjects);
 };
 
@@ -0,0 +1,241 @@
+#include "KeyframeForwarder.h"
+
+KeyframeForwarder::KeyframeForwarder(size_t slotSize, size_t slotCount)
+    : _slotSize(slotSize), _slotCount(slotCount), _slots(nullptr), _freeSlots(nullptr), _queuedFrames(nullptr),
+      _setAsideFrames(nullptr), _forwarding(nullptr), _taskHandle(nullptr), _ready(false), _enabled(false), _nextId(1), _statsLock(portMUX_INITIALIZER_UNLOCKED), _stats()
+{
+}
+
+KeyframeForwarder::~KeyframeForwarder()
+{
+    if (_taskHandle != nullptr)
+    {
+        vTaskDelete(_taskHandle);
+    }
+    for (size_t i = 0; _slots && i < _slotCount; i++)
+    {
+        free(_slots[i]);
+    }
+    free(_slots);
+}
+
+bool KeyframeForwarder::begin(bool forward)
+{
+    if (_ready)
+    {
+        return true;
+    }
+
+    if (!psramFound())
+    {
+        _slotCount = min(_slotCount, (size_t)1); // Internal RAM cannot spare the full pool
+    }
+    _slots = (uint8_t **)calloc(_slotCount, sizeof(uint8_t *));
+    _freeSlots = xQueueCreate(_slotCount, sizeof(int16_t));
+    _queuedFrames = xQueueCreate(_slotCount, sizeof(ForwardedKeyframe));
+    _setAsideFrames = xQueueCreate(_slotCount, sizeof(ForwardedKeyframe));
+    _forwarding = xSemaphoreCreateMutex();
+    if (!_slots || !_freeSlots || !_queuedFrames || !_setAsideFrames || !_forwarding)
+    {
+        Serial.println("KeyframeForwarder: out of memory");
+        return false;
+    }
+    for (size_t i = 0; i < _slotCount; i++)
+    {
+        _slots[i] = (uint8_t *)(psramFound() ? ps_malloc(_slotSize) : malloc(_slotSize));
+        if (!_slots[i])
+        {
+            Serial.println("KeyframeForwarder: failed to allocate frame slots");
+            return false;
+        }
+        int16_t slot = i;
+        xQueueSend(_freeSlots, &slot, 0);
+    }
+
+    // Protocol core, below the video tasks: forwarding can wait, the stream cannot
+    if (forward && xTaskCreatePinnedToCore(forwardTask, "KeyframeForwarder", 4096, this, 1, &_taskHandle, 0) != pdPASS)
+    {
+        return false;
+    }
+    _ready = true;
+    return true;
+}
+
+void KeyframeForwarder::setTransport(Transport transport)
+{
+    xSemaphoreTake(_forwarding, portMAX_DELAY);
+    _transport = transport;
+    xSemaphoreGive(_forwarding);
+}
+
+void KeyframeForwarder::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+    if (!enabled && _forwarding != nullptr)
+    {
+        xSemaphoreTake(_forwarding, portMAX_DELAY);
+        xSemaphoreGive(_forwarding);
+    }
+}
+
+bool KeyframeForwarder::offer(const H264Frame &frame, const uint8_t *parameterSets, size_t parameterSetsSize, int waypoint)
+{
+    if (!_ready)
+    {
+        return false;
+    }
+    size_t prefix = frame.hasParameterSets ? 0 : parameterSetsSize;
+    int16_t slot;
+    bool fits = prefix + frame.size <= _slotSize;
+    portENTER_CRITICAL(&_statsLock);
+    _stats.offered++;
+    portEXIT_CRITICAL(&_statsLock);
+    if (!fits || xQueueReceive(_freeSlots, &slot, 0) != pdTRUE)
+    {
+        portENTER_CRITICAL(&_statsLock);
+        _stats.dropped++;
+        portEXIT_CRITICAL(&_statsLock);
+        return false;
+    }
+
+    memcpy(_slots[slot], parameterSets, prefix);
+    memcpy(_slots[slot] + prefix, frame.data, frame.size);
+    ForwardedKeyframe queued = {_nextId++, (int16_t)waypoint, frame.receivedMs, _slots[slot], prefix + frame.size};
+    xQueueSend(_queuedFrames, &queued, 0); // Never full: it holds every slot
+    return true;
+}
+
+int16_t KeyframeForwarder::slotOf(const ForwardedKeyframe &frame) const
+{
+    for (size_t i = 0; i < _slotCount; i++)
+    {
+        if (_slots[i] == frame.data)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void KeyframeForwarder::forwardTask(void *pvParameters)
+{
+    KeyframeForwarder *forwarder = (KeyframeForwarder *)pvParameters;
+    ForwardedKeyframe frame;
+    uint16_t failingId = 0;
+    uint32_t failures = 0;
+    while (true)
+    {
+        if (!forwarder->_enabled || xQueuePeek(forwarder->_queuedFrames, &frame, pdMS_TO_TICKS(100)) != pdTRUE)
+        {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        xSemaphoreTake(forwarder->_forwarding, portMAX_DELAY);
+        // drain() may have taken the frame while this task waited for the lock
+        bool sent = false;
+        bool setAside = false;
+        bool stillQueued = forwarder->_enabled && xQueuePeek(forwarder->_queuedFrames, &frame, 0) == pdTRUE;
+        if (stillQueued && forwarder->_transport)
+        {
+            sent = forwarder->_transport(frame);
+            failures = sent ? 0 : frame.id == failingId ? failures + 1 : 1;
+            failingId = frame.id;
+            if (sent)
+            {
+                int16_t slot = forwarder->slotOf(frame);
+                xQueueReceive(forwarder->_queuedFrames, &frame, 0);
+                xQueueSend(forwarder->_freeSlots, &slot, 0);
+            }
+            else if (failures >= MAX_ATTEMPTS)
+            {
+                // Never full: together the queues hold every slot
+                xQueueReceive(forwarder->_queuedFrames, &frame, 0);
+                xQueueSend(forwarder->_setAsideFrames, &frame, 0);
+                setAside = true;
+            }
+        }
+        xSemaphoreGive(forwarder->_forwarding);
+        if (!stillQueued)
+        {
+            continue;
+        }
+
+        portENTER_CRITICAL(&forwarder->_statsLock);
+        if (sent)
+        {
+            forwarder->_stats.forwarded++;
+        }
+        else
+        {
+            forwarder->_stats.failedAttempts++;
+            forwarder->_stats.setAside += setAside ? 1 : 0;
+        }
+        portEXIT_CRITICAL(&forwarder->_statsLock);
+        if (sent)
+        {
+            Serial.printf("Keyframe #%u of waypoint %d forwarded (%u bytes)\n", frame.id, frame.waypoint, (unsigned)frame.size);
+        }
+        else
+        {
+            if (setAside)
+            {
+                Serial.printf("Keyframe #%u of waypoint %d not forwarded after %u attempts, left for upload\n", frame.id,
+                              frame.waypoint, (unsigned)failures);
+            }
+            vTaskDelay(pdMS_TO_TICKS(RETRY_DELAY_MS)); // The receiver is out of reach, try again later
+        }
+    }
+}
+
+size_t KeyframeForwarder::drain(Transport handler)
+{
+    if (!_ready)
+    {
+        return 0;
+    }
+    size_t handled = 0;
+    size_t failed = 0;
+    ForwardedKeyframe frame;
+    xSemaphoreTake(_forwarding, portMAX_DELAY);
+    // Set-aside frames first, they are the oldest
+    while (xQueueReceive(_setAsideFrames, &frame, 0) == pdTRUE || xQueueReceive(_queuedFrames, &frame, 0) == pdTRUE)
+    {
+        if (handler(frame))
+        {
+            handled++;
+        }
+        else
+        {
+            failed++;
+        }
+        int16_t slot = slotOf(frame);
+        xQueueSend(_freeSlots, &slot, 0);
+    }
+    xSemaphoreGive(_forwarding);
+    portENTER_CRITICAL(&_statsLock);
+    _stats.drained += handled;
+    _stats.dropped += failed;
+    portEXIT_CRITICAL(&_statsLock);
+    return handled;
+}
+
+size_t KeyframeForwarder::pending() const
+{
+    return _queuedFrames != nullptr ? uxQueueMessagesWaiting(_queuedFrames) + uxQueueMessagesWaiting(_setAsideFrames) : 0;
+}
+
+KeyframeForwarderStats KeyframeForwarder::stats() const
+{
+    portENTER_CRITICAL(&_statsLock);
+    KeyframeForwarderStats stats = _stats;
+    portEXIT_CRITICAL(&_statsLock);
+    return stats;
+}
+
+void KeyframeForwarder::printStats() const
+{
+    KeyframeForwarderStats s = stats();
+    Serial.printf("Keyframes: %u offered, %u forwarded in flight, %u dropped, %u failed attempts (%u frames set aside), %u uploaded after landing\n",
+                  s.offered, s.forwarded, s.dropped, s.failedAttempts, s.setAside, s.drained);
+}
@@ -0,0 +1,92 @@
+#ifndef KEYFRAMEFORWARDER_H
+#define KEYFRAMEFORWARDER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "H264Reassembler.h"
+
+// Queues keyframes during a flight and forwards them from a background task, so ripeness
+// results for the first stops arrive while the drone is still flying. offer() copies the
+// frame (with SPS/PPS in front, so it decodes on its own) into a free PSRAM slot and never
+// blocks the video task; with every slot taken, or a frame larger than a slot, the frame is
+// dropped and counted. The slot size is the transport's frame limit. The task forwards the
+// oldest frame through the transport while forwarding is enabled, keeping it queued when the
+// transport fails; after MAX_ATTEMPTS failures the frame is set aside, so it does not hold up
+// the frames behind it. Whatever is left at the end of the flight, set aside or not, is
+// handed to drain(), e.g. to upload it directly once back on the greenhouse network.
+// begin(false) creates no task: the frames only wait for drain(), which makes the forwarder
+// a bounded hand-off from the video task to another one.
+struct ForwardedKeyframe
+{
+    uint16_t id;
+    int16_t waypoint;
+    uint32_t capturedMs;
+    const uint8_t *data;
+    size_t size;
+};
+
+struct KeyframeForwarderStats
+{
+    uint32_t offered;
+    uint32_t dropped;        // No free slot, or larger than a slot
+    uint32_t forwarded;
+    uint32_t failedAttempts;
+    uint32_t setAside;       // Failed MAX_ATTEMPTS times, left for drain()
+    uint32_t drained;
+};
+
+class KeyframeForwarder
+{
+public:
+    typedef std::function<bool(const ForwardedKeyframe &frame)> Transport;
+
+    static const size_t DEFAULT_SLOT_SIZE = H264Reassembler::DEFAULT_MAX_FRAME_SIZE + 2 * H264Reassembler::MAX_PARAMETER_SET_SIZE;
+    static const size_t DEFAULT_SLOT_COUNT = 4;
+    static const uint32_t RETRY_DELAY_MS = 2000;
+    static const uint32_t MAX_ATTEMPTS = 5;
+
+    KeyframeForwarder(size_t slotSize = DEFAULT_SLOT_SIZE, size_t slotCount = DEFAULT_SLOT_COUNT);
+    ~KeyframeForwarder();
+
+    bool begin(bool forward = true);
+    // Called from the forwarding task
+    void setTransport(Transport transport);
+    // The task only forwards while enabled; disabling waits for a frame being forwarded
+    void setEnabled(bool enabled);
+
+    // Video task; parameterSets are put in front of frames that do not carry their own
+    bool offer(const H264Frame &frame, const uint8_t *parameterSets, size_t parameterSetsSize, int waypoint);
+    // Hands the frames not forwarded to handler, oldest first, and frees their slots.
+    // A frame the handler returns false for is dropped too.
+    size_t drain(Transport handler);
+    size_t pending() const;
+
+    KeyframeForwarderStats stats() const;
+    void printStats() const;
+
+private:
+    size_t _slotSize;
+    size_t _slotCount;
+    uint8_t **_slots;
+    QueueHandle_t _freeSlots;
+    QueueHandle_t _queuedFrames;  // ForwardedKeyframe, oldest first
+    QueueHandle_t _setAsideFrames; // Not forwarded any more, for drain()
+    SemaphoreHandle_t _forwarding; // Held while a frame is in the transport
+    TaskHandle_t _taskHandle;
+    bool _ready;
+    Transport _transport;
+    std::atomic<bool> _enabled;
+    uint16_t _nextId;
+
+    mutable portMUX_TYPE _statsLock;
+    KeyframeForwarderStats _stats;
+
+    int16_t slotOf(const ForwardedKeyframe &frame) const;
+    static void forwardTask(void *pvParameters);
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include "KeyframeLink.h"
+
+KeyframeSender *KeyframeSender::_instance = nullptr;
+
+KeyframeSender::KeyframeSender()
+    : _peer(), _active(false), _acked(nullptr), _frameAcked(nullptr), _delivered(false), _awaitedFrame(0), _chunksSent(0),
+      _chunkRetries(0)
+{
+}
+
+KeyframeSender::~KeyframeSender()
+{
+    end();
+    if (_acked != nullptr)
+    {
+        vSemaphoreDelete(_acked);
+        vSemaphoreDelete(_frameAcked);
+    }
+}
+
+bool KeyframeSender::begin(const uint8_t *peerMac)
+{
+    if (_active)
+    {
+        return true;
+    }
+    if (_acked == nullptr)
+    {
+        _acked = xSemaphoreCreateBinary();
+        _frameAcked = xSemaphoreCreateBinary();
+        if (_acked == nullptr || _frameAcked == nullptr)
+        {
+            return false;
+        }
+    }
+    if (esp_now_init() != ESP_OK)
+    {
+        Serial.println("KeyframeSender: ESP-NOW init failed");
+        return false;
+    }
+
+    // Channel 0 follows the station's channel, i.e. the Tello's while connected to it
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, peerMac, ESP_NOW_ETH_ALEN);
+    peerInfo.channel = 0;
+    peerInfo.encrypt = false;
+    peerInfo.ifidx = WIFI_IF_STA;
+    if (!esp_now_is_peer_exist(peerMac) && esp_now_add_peer(&peerInfo) != ESP_OK)
+    {
+        Serial.println("KeyframeSender: failed to add the receiver as peer");
+        esp_now_deinit();
+        return false;
+    }
+    memcpy(_peer, peerMac, ESP_NOW_ETH_ALEN);
+    _instance = this;
+    esp_now_register_send_cb(onSent);
+    esp_now_register_recv_cb(onReceived);
+    _active = true;
+    return true;
+}
+
+void KeyframeSender::end()
+{
+    if (!_active)
+    {
+        return;
+    }
+    esp_now_deinit();
+    _instance = nullptr;
+    _active = false;
+}
+
+void KeyframeSender::onSent(const uint8_t *mac, esp_now_send_status_t status)
+{
+    if (_instance != nullptr)
+    {
+        _instance->_delivered = status == ESP_NOW_SEND_SUCCESS;
+        xSemaphoreGive(_instance->_acked);
+    }
+}
+
+void KeyframeSender::onReceived(const esp_now_recv_info_t *info, const uint8_t *data, int size)
+{
+    KeyframeAck ack;
+    if (_instance == nullptr || size != sizeof(ack) || data[0] != KEYFRAME_ACK_MAGIC)
+    {
+        return;
+    }
+    memcpy(&ack, data, sizeof(ack));
+    if (ack.frameId == _instance->_awaitedFrame)
+    {
+        xSemaphoreGive(_instance->_frameAcked);
+    }
+}
+
+bool KeyframeSender::send(uint16_t frameId, int waypoint, const uint8_t *data, size_t size)
+{
+    size_t count = (size + KEYFRAME_CHUNK_DATA - 1) / KEYFRAME_CHUNK_DATA;
+    if (!_active || size == 0 || size > KEYFRAME_MAX_FRAME_SIZE)
+    {
+        return false;
+    }
+
+    _awaitedFrame = frameId;
+    xSemaphoreTake(_frameAcked, 0);
+    uint8_t packet[ESP_NOW_MAX_DATA_LEN];
+    KeyframeChunkHeader header = {KEYFRAME_CHUNK_MAGIC, 0, frameId, 0, (uint16_t)count, (uint32_t)size, (int16_t)waypoint};
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t offset = i * KEYFRAME_CHUNK_DATA;
+        size_t length = min(KEYFRAME_CHUNK_DATA, size - offset);
+        header.index = i;
+        memcpy(packet, &header, sizeof(header));
+        memcpy(packet + sizeof(header), data + offset, length);
+
+        // One chunk in flight at a time: the send callback reports the receiver's MAC-level ack
+        bool delivered = false;
+        for (int attempt = 0; attempt < CHUNK_ATTEMPTS && !delivered; attempt++)
+        {
+            if (attempt > 0)
+            {
+                _chunkRetries++;
+            }
+            xSemaphoreTake(_acked, 0);
+            if (esp_now_send(_peer, packet, sizeof(header) + length) != ESP_OK)
+            {
+                vTaskDelay(pdMS_TO_TICKS(2)); // Transmit queue full
+                continue;
+            }
+            delivered = xSemaphoreTake(_acked, pdMS_TO_TICKS(ACK_TIMEOUT_MS)) == pdTRUE && _delivered;
+        }
+        if (!delivered)
+        {
+            return false;
+        }
+        _chunksSent++;
+    }
+    return xSemaphoreTake(_frameAcked, pdMS_TO_TICKS(FRAME_ACK_TIMEOUT_MS)) == pdTRUE;
+}
+
+KeyframeAssembler::KeyframeAssembler(size_t maxFrameSize, size_t slotCount)
+    : _maxFrameSize(maxFrameSize), _slotCount(slotCount), _slots(nullptr), _freeSlots(nullptr), _readyFrames(nullptr),
+      _received(nullptr), _tracking(false), _completed(false), _slot(-1), _frameId(0), _waypoint(0), _frameSize(0),
+      _chunkCount(0), _chunksReceived(0), _statsLock(portMUX_INITIALIZER_UNLOCKED), _stats()
+{
+}
+
+KeyframeAssembler::~KeyframeAssembler()
+{
+    for (size_t i = 0; _slots && i < _slotCount; i++)
+    {
+        free(_slots[i]);
+    }
+    free(_slots);
+    free(_received);
+}
+
+bool KeyframeAssembler::begin()
+{
+    if (_slots != nullptr)
+    {
+        return true;
+    }
+    if (!psramFound())
+    {
+        _slotCount = 1; // Internal RAM cannot spare more next to the TLS client
+    }
+    _slots = (uint8_t **)calloc(_slotCount, sizeof(uint8_t *));
+    _received = (uint8_t *)calloc((_maxFrameSize / KEYFRAME_CHUNK_DATA + 8) / 8, 1);
+    _freeSlots = xQueueCreate(_slotCount, sizeof(int16_t));
+    _readyFrames = xQueueCreate(_slotCount, sizeof(Frame));
+    if (!_slots || !_received || !_freeSlots || !_readyFrames)
+    {
+        Serial.println("KeyframeAssembler: out of memory");
+        return false;
+    }
+    for (size_t i = 0; i < _slotCount; i++)
+    {
+        _slots[i] = (uint8_t *)(psramFound() ? ps_malloc(_maxFrameSize) : malloc(_maxFrameSize));
+        if (!_slots[i])
+        {
+            Serial.println("KeyframeAssembler: failed to allocate frame slots");
+            return false;
+        }
+        int16_t slot = i;
+        xQueueSend(_freeSlots, &slot, 0);
+    }
+    return true;
+}
+
+void KeyframeAssembler::startFrame(const KeyframeChunkHeader &header)
+{
+    if (_slot >= 0)
+    {
+        portENTER_CRITICAL(&_statsLock);
+        _stats.framesAbandoned++;
+        portEXIT_CRITICAL(&_statsLock);
+    }
+    _tracking = true;
+    _completed = false;
+    _frameId = header.frameId;
+
+    size_t expected = (header.frameSize + KEYFRAME_CHUNK_DATA - 1) / KEYFRAME_CHUNK_DATA;
+    bool fits = header.frameSize > 0 && header.frameSize <= _maxFrameSize && header.count == expected;
+    if (fits && _slot < 0 && xQueueReceive(_freeSlots, &_slot, 0) != pdTRUE)
+    {
+        _slot = -1;
+    }
+    if (!fits || _slot < 0)
+    {
+        if (_slot >= 0)
+        {
+            xQueueSend(_freeSlots, &_slot, 0);
+            _slot = -1;
+        }
+        portENTER_CRITICAL(&_statsLock);
+        _stats.framesDropped++;
+        portEXIT_CRITICAL(&_statsLock);
+        return;
+    }
+    _waypoint = header.waypoint;
+    _frameSize = header.frameSize;
+    _chunkCount = header.count;
+    _chunksReceived = 0;
+    memset(_received, 0, (_chunkCount + 7) / 8);
+}
+
+KeyframeChunkResult KeyframeAssembler::push(const uint8_t *data, size_t size)
+{
+    KeyframeChunkHeader header;
+    if (size < sizeof(header) || data[0] != KEYFRAME_CHUNK_MAGIC)
+    {
+        return KEYFRAME_NOT_A_CHUNK;
+    }
+    if (_slots == nullptr)
+    {
+        return KEYFRAME_CHUNK_ACCEPTED;
+    }
+    memcpy(&header, data, sizeof(header));
+    portENTER_CRITICAL(&_statsLock);
+    _stats.chunks++;
+    portEXIT_CRITICAL(&_statsLock);
+
+    // A frame that found no free slot gets another chance when it is resent from the start
+    if (!_tracking || header.frameId != _frameId || (_slot < 0 && !_completed && header.index == 0))
+    {
+        startFrame(header);
+    }
+    size_t offset = (size_t)header.index * KEYFRAME_CHUNK_DATA;
+    size_t length = size - sizeof(header);
+    bool duplicate = _completed || (_slot >= 0 && header.index < _chunkCount && (_received[header.index / 8] & (1 << (header.index % 8))));
+    if (duplicate)
+    {
+        portENTER_CRITICAL(&_statsLock);
+        _stats.duplicates++;
+        portEXIT_CRITICAL(&_statsLock);
+        // The sender resends a whole frame when the acknowledgement was lost
+        return _completed && header.index == header.count - 1 ? KEYFRAME_FRAME_COMPLETE : KEYFRAME_CHUNK_ACCEPTED;
+    }
+    if (_slot < 0 || header.index >= _chunkCount || length != min(KEYFRAME_CHUNK_DATA, (size_t)_frameSize - offset))
+    {
+        return KEYFRAME_CHUNK_ACCEPTED; // Dropped frame, or a chunk that does not fit it
+    }
+
+    memcpy(_slots[_slot] + offset, data + sizeof(header), length);
+    _received[header.index / 8] |= 1 << (header.index % 8);
+    if (++_chunksReceived < _chunkCount)
+    {
+        return KEYFRAME_CHUNK_ACCEPTED;
+    }
+
+    Frame frame = {_slot, _frameId, _waypoint, _frameSize, _slots[_slot]};
+    xQueueSend(_readyFrames, &frame, 0); // Never full: it holds every slot
+    _slot = -1;
+    _completed = true;
+    portENTER_CRITICAL(&_statsLock);
+    _stats.frames++;
+    portEXIT_CRITICAL(&_statsLock);
+    return KEYFRAME_FRAME_COMPLETE;
+}
+
+void KeyframeAssembler::acknowledge(const uint8_t *senderMac)
+{
+    if (!esp_now_is_peer_exist(senderMac))
+    {
+        esp_now_peer_info_t peerInfo = {};
+        memcpy(peerInfo.peer_addr, senderMac, ESP_NOW_ETH_ALEN);
+        peerInfo.channel = 0;
+        peerInfo.encrypt = false;
+        peerInfo.ifidx = WIFI_IF_AP;
+        esp_now_add_peer(&peerInfo);
+    }
+    KeyframeAck ack = {KEYFRAME_ACK_MAGIC, 0, _frameId};
+    esp_now_send(senderMac, (const uint8_t *)&ack, sizeof(ack));
+}
+
+bool KeyframeAssembler::take(Frame &frame)
+{
+    return _readyFrames != nullptr && xQueueReceive(_readyFrames, &frame, 0) == pdTRUE;
+}
+
+void KeyframeAssembler::release(const Frame &frame)
+{
+    xQueueSend(_freeSlots, &frame.slot, 0);
+}
+
+KeyframeAssemblerStats KeyframeAssembler::stats() const
+{
+    portENTER_CRITICAL(&_statsLock);
+    KeyframeAssemblerStats stats = _stats;
+    portEXIT_CRITICAL(&_statsLock);
+    return stats;
+}
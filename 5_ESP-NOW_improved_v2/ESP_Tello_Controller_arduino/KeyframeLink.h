@@ -0,0 +1,154 @@
+#ifndef KEYFRAMELINK_H
+#define KEYFRAMELINK_H
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// Tello keyframes over ESP-NOW from the controller to the receiver node, which relays them
+// to the inference server while the drone is still flying. A frame is split into chunks
+// that fit one ESP-NOW packet; every chunk carries the frame's id, size and waypoint, so
+// the receiver can start assembling at any chunk and drop a frame it missed the start of.
+//
+// ESP-NOW only reaches peers on the radio's current channel: while the controller is
+// associated with the Tello, that is the Tello's channel, and the receiver's (set by its
+// own Wi-Fi network) has to match.
+//
+// A radio-level ack only says a chunk reached the receiver, not that it had room for the
+// frame, so the receiver acknowledges every frame it assembled and the sender counts a frame
+// as delivered only then.
+//
+// The same file is used by both sketches: KeyframeSender on the controller,
+// KeyframeAssembler on the receiver.
+
+#define KEYFRAME_CHUNK_MAGIC 0xF7   // Never the first byte of the JSON results on the same link
+#define KEYFRAME_ACK_MAGIC 0xF8
+#define KEYFRAME_MAX_FRAME_SIZE (96 * 1024) // SPS/PPS included; the receiver assembles nothing larger
+
+struct __attribute__((packed)) KeyframeChunkHeader
+{
+    uint8_t magic;
+    uint8_t reserved;
+    uint16_t frameId;
+    uint16_t index;
+    uint16_t count;
+    uint32_t frameSize;
+    int16_t waypoint;
+};
+
+struct __attribute__((packed)) KeyframeAck
+{
+    uint8_t magic;
+    uint8_t reserved;
+    uint16_t frameId;
+};
+
+static const size_t KEYFRAME_CHUNK_DATA = ESP_NOW_MAX_DATA_LEN - sizeof(KeyframeChunkHeader);
+
+enum KeyframeChunkResult : uint8_t
+{
+    KEYFRAME_NOT_A_CHUNK,
+    KEYFRAME_CHUNK_ACCEPTED,     // Or dropped, see the stats
+    KEYFRAME_FRAME_COMPLETE      // The frame is complete (again, for a resent last chunk): acknowledge it
+};
+
+// Controller side. send() blocks the calling task until every chunk was acknowledged by
+// the receiver's radio, retrying each chunk a few times, and the receiver acknowledged
+// the frame.
+class KeyframeSender
+{
+public:
+    static const int CHUNK_ATTEMPTS = 4;
+    static const uint32_t ACK_TIMEOUT_MS = 50;
+    static const uint32_t FRAME_ACK_TIMEOUT_MS = 300;
+
+    KeyframeSender();
+    ~KeyframeSender();
+
+    // Registers the receiver as a peer on the current channel
+    bool begin(const uint8_t *peerMac);
+    void end();
+    bool active() const { return _active; }
+
+    bool send(uint16_t frameId, int waypoint, const uint8_t *data, size_t size);
+
+    uint32_t chunksSent() const { return _chunksSent; }
+    uint32_t chunkRetries() const { return _chunkRetries; }
+
+private:
+    static KeyframeSender *_instance; // ESP-NOW takes a plain function as send callback
+    uint8_t _peer[ESP_NOW_ETH_ALEN];
+    bool _active;
+    SemaphoreHandle_t _acked;
+    SemaphoreHandle_t _frameAcked;
+    volatile bool _delivered;
+    volatile uint16_t _awaitedFrame;
+    uint32_t _chunksSent;
+    uint32_t _chunkRetries;
+
+    static void onSent(const uint8_t *mac, esp_now_send_status_t status);
+    static void onReceived(const esp_now_recv_info_t *info, const uint8_t *data, int size);
+};
+
+struct KeyframeAssemblerStats
+{
+    uint32_t chunks;
+    uint32_t frames;
+    uint32_t framesAbandoned;   // A new frame started before the previous one was complete
+    uint32_t framesDropped;     // No free slot, or too large
+    uint32_t duplicates;
+};
+
+// Receiver side. push() is called from the ESP-NOW receive callback (Wi-Fi task); complete
+// frames are handed to the sketch's loop through a queue of slots.
+class KeyframeAssembler
+{
+public:
+    struct Frame
+    {
+        int16_t slot;
+        uint16_t frameId;
+        int16_t waypoint;
+        uint32_t size;
+        const uint8_t *data;
+    };
+
+    KeyframeAssembler(size_t maxFrameSize, size_t slotCount);
+    ~KeyframeAssembler();
+
+    bool begin();
+    KeyframeChunkResult push(const uint8_t *data, size_t size);
+    // Sends the frame acknowledgement to the sender (after KEYFRAME_FRAME_COMPLETE)
+    void acknowledge(const uint8_t *senderMac);
+    // Next complete frame, without waiting; release() its slot when done with it
+    bool take(Frame &frame);
+    void release(const Frame &frame);
+
+    KeyframeAssemblerStats stats() const;
+
+private:
+    size_t _maxFrameSize;
+    size_t _slotCount;
+    uint8_t **_slots;
+    QueueHandle_t _freeSlots;
+    QueueHandle_t _readyFrames;
+    uint8_t *_received;         // One bit per chunk of the frame being assembled
+
+    bool _tracking;             // _frameId is the frame chunks are arriving for
+    bool _completed;            // and it is complete, later chunks are resent copies
+    int16_t _slot;              // Its slot, -1 when complete or dropped
+    uint16_t _frameId;
+    int16_t _waypoint;
+    uint32_t _frameSize;
+    uint16_t _chunkCount;
+    uint16_t _chunksReceived;
+
+    mutable portMUX_TYPE _statsLock;
+    KeyframeAssemblerStats _stats;
+
+    void startFrame(const KeyframeChunkHeader &header);
+};
+
+#endif
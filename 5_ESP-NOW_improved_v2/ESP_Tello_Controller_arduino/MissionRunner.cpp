@@ -0,0 +1,415 @@
+#include "MissionRunner.h"
+#include "FlightPlanner.h"
+#include <ArduinoJson.h>
+#include <math.h>
+
+#define MISSION_GO_MIN 20                // "go" needs one axis outside -20..20
+#define MISSION_GO_MAX 500
+
+MissionRunner::MissionRunner(TelloESP32 &tello)
+    : _tello(tello), _takeoff(true), _speed(DEFAULT_SPEED), _state(STATE_IDLE), _waypoint(-1), _flying(false),
+      _aborting(false), _recording(false), _x(0), _y(0), _z(0), _heading(0), _stepCount(0), _stepIndex(0),
+      _stepSent(false), _attempt(0), _retryAt(0), _stopUntil(0), _startMs(0), _commandsSent(0), _retries(0)
+{
+}
+
+void MissionRunner::clear()
+{
+    _waypoints.clear();
+    _name = "";
+    _takeoff = true;
+    _speed = DEFAULT_SPEED;
+    _state = STATE_IDLE;
+}
+
+void MissionRunner::setSpeed(int speed)
+{
+    const TelloCommandSpec &spec = telloCommand(TELLO_SPEED);
+    _speed = constrain(speed, spec.minValue, spec.maxValue);
+}
+
+bool MissionRunner::load(fs::FS &fs, const char *path)
+{
+    File file = fs.open(path, FILE_READ);
+    if (!file)
+    {
+        Serial.printf("Mission file %s not found\n", path);
+        return false;
+    }
+    DynamicJsonDocument doc(16384);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error)
+    {
+        Serial.printf("Mission %s: JSON parsing failed (%s)\n", path, error.c_str());
+        return false;
+    }
+
+    clear();
+    _name = doc["name"] | path;
+    _takeoff = doc["takeoff"] | true;
+    setSpeed(doc["speed"] | DEFAULT_SPEED);
+    JsonArray waypoints = doc["waypoints"];
+    for (JsonObject point : waypoints)
+    {
+        MissionWaypoint waypoint;
+        waypoint.x = point["x"] | 0;
+        waypoint.y = point["y"] | 0;
+        waypoint.z = point["z"] | 0;
+        waypoint.heading = point["heading"] | (_waypoints.empty() ? 0 : (int)_waypoints.back().heading);
+        waypoint.capture = point["capture"] | false;
+        waypoint.recordMs = point["record_ms"] | 0;
+        waypoint.holdMs = point["hold_ms"] | 0;
+        _waypoints.push_back(waypoint);
+    }
+    if (_waypoints.empty())
+    {
+        Serial.printf("Mission %s has no waypoints\n", path);
+        return false;
+    }
+    if (doc["optimise"] | false)
+    {
+        optimise();
+    }
+    Serial.printf("Mission \"%s\": %u waypoints at %d cm/s\n", _name.c_str(), (unsigned)_waypoints.size(), _speed);
+    return true;
+}
+
+void MissionRunner::optimise()
+{
+    std::vector<PlanPoint> points;
+    points.reserve(_waypoints.size());
+    for (const MissionWaypoint &waypoint : _waypoints)
+    {
+        bool stop = waypoint.capture || waypoint.recordMs > 0 || waypoint.holdMs > 0;
+        points.push_back({waypoint.x, waypoint.y, waypoint.z, waypoint.heading, stop, stop});
+    }
+
+    PlanTimings timings = {_speed, 90, 1500};
+    FlightPlanner planner(timings);
+    std::vector<int> order = planner.mergePassThrough(points, planner.order(points));
+
+    std::vector<MissionWaypoint> waypoints;
+    waypoints.reserve(order.size());
+    for (int index : order)
+    {
+        MissionWaypoint waypoint = _waypoints[index];
+        // Pass-through waypoints keep the current heading instead of turning
+        if (!points[index].stop)
+        {
+            waypoint.heading = waypoints.empty() ? 0 : waypoints.back().heading;
+        }
+        waypoints.push_back(waypoint);
+    }
+    Serial.printf("Mission optimised: %u of %u waypoints kept\n", (unsigned)waypoints.size(), (unsigned)_waypoints.size());
+    _waypoints.swap(waypoints);
+}
+
+bool MissionRunner::start()
+{
+    if (_waypoints.empty() || running())
+    {
+        return false;
+    }
+    _waypoint = -1;
+    _flying = false;
+    _aborting = false;
+    _recording = false;
+    _x = _y = _z = _heading = 0;
+    _stepCount = 0;
+    _stepIndex = 0;
+    _stepSent = false;
+    _attempt = 0;
+    _retryAt = 0;
+    _startMs = millis();
+    _commandsSent = 0;
+    _retries = 0;
+
+    if (_takeoff)
+    {
+        queue(TELLO_TAKEOFF, nullptr, 0);
+        _steps[0].flying = 1;
+    }
+    _state = STATE_COMMANDS;
+    return true;
+}
+
+void MissionRunner::abort()
+{
+    if (!running() || _aborting)
+    {
+        return;
+    }
+    Serial.println("Mission aborted");
+    _aborting = true;
+    if (_state == STATE_STOP)
+    {
+        planLanding();
+    }
+    else
+    {
+        _stepCount = _stepIndex + (_stepSent ? 1 : 0); // Drop the moves not yet sent
+    }
+}
+
+// Appends a command to the step queue; the pose change is filled in by the caller
+bool MissionRunner::queue(TelloCommandId id, const int *args, uint8_t argCount)
+{
+    if (_stepCount >= MAX_STEPS)
+    {
+        return false;
+    }
+    Step &step = _steps[_stepCount];
+    if (telloFormatCommand(step.command, sizeof(step.command), id, args, argCount) == 0)
+    {
+        return false;
+    }
+    step.dx = step.dy = step.dz = 0;
+    step.turn = 0;
+    step.flying = 0;
+    _stepCount++;
+    return true;
+}
+
+void MissionRunner::planWaypoint(const MissionWaypoint &waypoint)
+{
+    _stepCount = 0;
+    _stepIndex = 0;
+
+    // Displacement in the takeoff frame, turned into the drone's frame for "go"
+    int dx = waypoint.x - _x;
+    int dy = waypoint.y - _y;
+    int dz = waypoint.z - _z;
+    float yaw = _heading * (float)M_PI / 180.0f;
+    int bx = lroundf(dx * cosf(yaw) - dy * sinf(yaw));
+    int by = lroundf(dx * sinf(yaw) + dy * cosf(yaw));
+    int longest = max(abs(bx), max(abs(by), abs(dz)));
+    if (longest > MISSION_GO_MIN)
+    {
+        // Split moves longer than "go" allows into equal legs
+        int legs = (longest + MISSION_GO_MAX - 1) / MISSION_GO_MAX;
+        int doneX = 0, doneY = 0, doneZ = 0, doneBx = 0, doneBy = 0;
+        for (int leg = 1; leg <= legs; leg++)
+        {
+            int legBx = bx * leg / legs - doneBx;
+            int legBy = by * leg / legs - doneBy;
+            int legZ = dz * leg / legs - doneZ;
+            int args[4] = {legBx, legBy, legZ, _speed};
+            if (!queue(TELLO_GO, args, 4))
+            {
+                break;
+            }
+            Step &step = _steps[_stepCount - 1];
+            step.dx = dx * leg / legs - doneX;
+            step.dy = dy * leg / legs - doneY;
+            step.dz = legZ;
+            doneBx += legBx;
+            doneBy += legBy;
+            doneX += step.dx;
+            doneY += step.dy;
+            doneZ += legZ;
+        }
+    }
+    else if (longest > 0)
+    {
+        Serial.printf("Waypoint %d: %d cm move is below the Tello's minimum, skipped\n", _waypoint, longest);
+    }
+
+    int turn = ((waypoint.heading - _heading) % 360 + 540) % 360 - 180;
+    if (turn != 0)
+    {
+        int degrees = abs(turn);
+        if (queue(turn > 0 ? TELLO_CW : TELLO_CCW, &degrees, 1))
+        {
+            _steps[_stepCount - 1].turn = turn;
+        }
+    }
+}
+
+void MissionRunner::planLanding()
+{
+    _stepCount = 0;
+    _stepIndex = 0;
+    _stepSent = false;
+    _attempt = 0;
+    if (_recording)
+    {
+        emit(MISSION_RECORD_STOP);
+        _recording = false;
+    }
+    if (_flying)
+    {
+        queue(TELLO_LAND, nullptr, 0);
+        _steps[0].flying = -1;
+    }
+    _state = STATE_COMMANDS;
+}
+
+void MissionRunner::fail(const char *reason)
+{
+    Serial.printf("Mission failed at waypoint %d: %s\n", _waypoint, reason);
+    if (_aborting || !_flying)
+    {
+        if (_recording)
+        {
+            emit(MISSION_RECORD_STOP);
+            _recording = false;
+        }
+        _state = STATE_FAILED;
+        return;
+    }
+    _aborting = true;
+    planLanding();
+}
+
+void MissionRunner::emit(MissionEvent event)
+{
+    if (_callback)
+    {
+        _callback(event, _waypoint);
+    }
+}
+
+void MissionRunner::beginStop()
+{
+    const MissionWaypoint &waypoint = _waypoints[_waypoint];
+    if (waypoint.capture)
+    {
+        emit(MISSION_CAPTURE);
+    }
+    if (waypoint.recordMs > 0)
+    {
+        emit(MISSION_RECORD_START);
+        _recording = true;
+    }
+    // Measured after the handlers, which may have waited for the video stream
+    _stopUntil = millis() + max(waypoint.recordMs, waypoint.holdMs);
+    _state = STATE_STOP;
+}
+
+void MissionRunner::nextWaypoint()
+{
+    _waypoint++;
+    if (_aborting || _waypoint >= (int)_waypoints.size())
+    {
+        planLanding();
+        return;
+    }
+    planWaypoint(_waypoints[_waypoint]);
+    _stepSent = false;
+    _attempt = 0;
+    _state = STATE_COMMANDS;
+}
+
+// Sends the queued steps one after another; returns true when the queue is done
+bool MissionRunner::updateCommands()
+{
+    while (_stepIndex < _stepCount)
+    {
+        Step &step = _steps[_stepIndex];
+        if (!_stepSent)
+        {
+            if ((long)(millis() - _retryAt) < 0)
+            {
+                return false;
+            }
+            // A video setting begun between ticks is still waiting for its reply
+            if (_tello.isCommandPending())
+            {
+                return false;
+            }
+            // The timeout follows the command's expected duration and the measured round trips
+            if (!_tello.beginCommand(step.command, TelloESP32::TIMEOUT_AUTO, _attempt))
+            {
+                fail("command could not be sent");
+                return false;
+            }
+            _stepSent = true;
+            _commandsSent++;
+            return false;
+        }
+
+        char reply[32];
+        TelloCommandStatus status = _tello.pollCommand(reply, sizeof(reply));
+        if (status == TELLO_COMMAND_PENDING)
+        {
+            return false;
+        }
+        _stepSent = false;
+        if (status == TELLO_COMMAND_REPLIED && strcmp(reply, "ok") == 0)
+        {
+            _x += step.dx;
+            _y += step.dy;
+            _z += step.dz;
+            _heading = ((_heading + step.turn) % 360 + 360) % 360;
+            if (step.flying != 0)
+            {
+                _flying = step.flying > 0;
+            }
+            _attempt = 0;
+            _stepIndex++;
+            continue; // Next command right away
+        }
+
+        Serial.printf("Mission: \"%s\" %s\n", step.command, status == TELLO_COMMAND_REPLIED ? reply : "timed out");
+        if (++_attempt > DEFAULT_RETRIES)
+        {
+            fail(step.command);
+            return false;
+        }
+        _retries++;
+        // A timeout has already waited; an error reply is retried after a short backoff
+        _retryAt = millis() + (status == TELLO_COMMAND_REPLIED ? _tello.getCommandTimings().retryDelayMs(_attempt) : 0);
+        return false;
+    }
+    return true;
+}
+
+bool MissionRunner::update()
+{
+    switch (_state)
+    {
+    case STATE_COMMANDS:
+        if (updateCommands())
+        {
+            if ((_aborting || _waypoint >= (int)_waypoints.size()) && _flying)
+            {
+                planLanding();
+            }
+            else if (_aborting || _waypoint >= (int)_waypoints.size())
+            {
+                _state = _aborting ? STATE_FAILED : STATE_DONE;
+            }
+            else if (_waypoint < 0)
+            {
+                nextWaypoint();
+            }
+            else
+            {
+                beginStop();
+            }
+        }
+        break;
+    case STATE_STOP:
+        if ((long)(millis() - _stopUntil) >= 0)
+        {
+            if (_recording)
+            {
+                emit(MISSION_RECORD_STOP);
+                _recording = false;
+            }
+            nextWaypoint();
+        }
+        break;
+    default:
+        break;
+    }
+    return running();
+}
+
+void MissionRunner::printSummary() const
+{
+    Serial.printf("Mission \"%s\" %s: %d/%u waypoints, %u commands (%u retries) in %lu ms\n", _name.c_str(),
+                  _state == STATE_DONE ? "completed" : "failed", min(_waypoint, (int)_waypoints.size()),
+                  (unsigned)_waypoints.size(), _commandsSent, _retries, millis() - _startMs);
+}
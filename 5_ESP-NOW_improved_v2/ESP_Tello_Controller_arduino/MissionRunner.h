@@ -0,0 +1,142 @@
+#ifndef MISSIONRUNNER_H
+#define MISSIONRUNNER_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "TelloESP32.h"
+#include <functional>
+#include <vector>
+
+// Flies a list of waypoints, loaded from a JSON file on the SD card:
+//
+//   {
+//     "name": "row-1",
+//     "takeoff": true,
+//     "speed": 50,
+//     "waypoints": [
+//       {"x": 0, "y": 0, "z": 50},
+//       {"x": 100, "y": 0, "z": 50, "heading": 90, "record_ms": 5000},
+//       {"x": 100, "y": -80, "z": 50, "capture": true, "hold_ms": 1000}
+//     ]
+//   }
+//
+// With "optimise": true the waypoints are flown in the order FlightPlanner finds shortest,
+// and pass-through waypoints (no actions) on a straight line between their neighbours are
+// dropped; give the heading of every waypoint with actions explicitly in that case.
+//
+// Positions are cm from where the drone took off (x forward, y left, z up, in the takeoff
+// heading) and heading is degrees clockwise from the takeoff heading, kept from the previous
+// waypoint when omitted. Each waypoint is reached with "go" commands in the drone's current
+// frame followed by a turn, then its actions run: capture, record for record_ms, hover for
+// hold_ms.
+//
+// update() is non-blocking and sends the next command as soon as the previous one is
+// acknowledged, so no fixed delays are spent between moves. A command that keeps failing
+// ends the mission, landing first if the drone is flying.
+struct MissionWaypoint
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int16_t heading;
+    bool capture;
+    uint32_t recordMs;
+    uint32_t holdMs;
+};
+
+enum MissionEvent : uint8_t
+{
+    MISSION_RECORD_START,
+    MISSION_RECORD_STOP,
+    MISSION_CAPTURE
+};
+
+class MissionRunner
+{
+public:
+    static const int MAX_STEPS = 8;              // Commands to reach one waypoint
+    static const int DEFAULT_SPEED = 50;         // cm/s
+    static const int DEFAULT_RETRIES = 3;
+
+    MissionRunner(TelloESP32 &tello);
+
+    bool load(fs::FS &fs, const char *path);
+    void clear();
+    void setTakeoff(bool takeoff) { _takeoff = takeoff; }
+    void setSpeed(int speed);
+    // Reorders the waypoints for the shortest flight from the takeoff point (see FlightPlanner)
+    void optimise();
+    void addWaypoint(const MissionWaypoint &waypoint) { _waypoints.push_back(waypoint); }
+    size_t waypointCount() const { return _waypoints.size(); }
+    const String &name() const { return _name; }
+
+    // Called between the mission's commands, so handlers may use the blocking TelloESP32
+    // commands while no other command (a video setting) is pending
+    void onEvent(std::function<void(MissionEvent event, int waypoint)> callback) { _callback = callback; }
+
+    bool start();
+    // Advances the mission; returns false once it has finished or failed
+    bool update();
+    // Stops after the current command and lands
+    void abort();
+
+    bool running() const { return _state != STATE_IDLE && _state != STATE_DONE && _state != STATE_FAILED; }
+    bool succeeded() const { return _state == STATE_DONE; }
+    void printSummary() const;
+
+private:
+    enum State : uint8_t
+    {
+        STATE_IDLE,
+        STATE_COMMANDS,     // Sending the step queue
+        STATE_STOP,         // Running the actions of a waypoint
+        STATE_DONE,
+        STATE_FAILED
+    };
+
+    // One queued command and the pose change it makes once acknowledged
+    struct Step
+    {
+        char command[TELLO_COMMAND_MAX];
+        int16_t dx, dy, dz;      // Takeoff frame
+        int16_t turn;            // Degrees clockwise
+        int8_t flying;           // 1 after takeoff, -1 after land, 0 otherwise
+    };
+
+    TelloESP32 &_tello;
+    std::vector<MissionWaypoint> _waypoints;
+    String _name;
+    bool _takeoff;
+    int _speed;
+    std::function<void(MissionEvent event, int waypoint)> _callback;
+
+    State _state;
+    int _waypoint;           // Index being flown to or stopped at, -1 before the first
+    bool _flying;
+    bool _aborting;
+    bool _recording;
+    int _x, _y, _z, _heading;
+
+    Step _steps[MAX_STEPS];
+    int _stepCount;
+    int _stepIndex;
+    bool _stepSent;
+    int _attempt;
+    unsigned long _retryAt;
+    unsigned long _stopUntil;
+
+    unsigned long _startMs;
+    uint32_t _commandsSent;
+    uint32_t _retries;
+
+    bool queue(TelloCommandId id, const int *args, uint8_t argCount);
+    void planWaypoint(const MissionWaypoint &waypoint);
+    void planLanding();
+    void beginStop();
+    void nextWaypoint();
+    void fail(const char *reason);
+    void emit(MissionEvent event);
+    bool updateCommands();
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "PacketRing.h"
+#include <new>
+
+PacketRing::PacketRing(size_t slotCount, size_t slotSize)
+    : _slotCount(slotCount), _slotSize(slotSize), _data(nullptr), _lengths(nullptr), _slotPacket(nullptr), _head(0)
+{
+    for (int i = 0; i < MAX_CONSUMERS; i++)
+    {
+        _consumers[i].task = nullptr;
+        _consumers[i].next = 1;
+        _consumers[i].packets = 0;
+        _consumers[i].overruns = 0;
+    }
+}
+
+PacketRing::~PacketRing()
+{
+    free(_data);
+    free(_lengths);
+    delete[] _slotPacket;
+}
+
+bool PacketRing::begin()
+{
+    if (_data != nullptr)
+    {
+        return true;
+    }
+    if (!psramFound())
+    {
+        _slotCount = min(_slotCount, (size_t)16); // Internal RAM cannot spare the full ring
+    }
+    _data = (uint8_t *)(psramFound() ? ps_malloc(_slotCount * _slotSize) : malloc(_slotCount * _slotSize));
+    _lengths = (uint16_t *)calloc(_slotCount, sizeof(uint16_t));
+    _slotPacket = new (std::nothrow) std::atomic<uint32_t>[_slotCount];
+    if (!_data || !_lengths || !_slotPacket)
+    {
+        Serial.println("PacketRing: out of memory");
+        return false;
+    }
+    for (size_t i = 0; i < _slotCount; i++)
+    {
+        _slotPacket[i].store(0, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool PacketRing::push(const uint8_t *data, size_t size)
+{
+    if (_data == nullptr || size > _slotSize)
+    {
+        return false;
+    }
+    uint32_t packet = _head.load(std::memory_order_relaxed) + 1;
+    size_t slot = packet % _slotCount;
+
+    // Readers that already hold this slot's old packet number see it change and retry
+    _slotPacket[slot].store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(_data + slot * _slotSize, data, size);
+    _lengths[slot] = size;
+    _slotPacket[slot].store(packet, std::memory_order_release);
+    _head.store(packet, std::memory_order_release);
+
+    for (int i = 0; i < MAX_CONSUMERS; i++)
+    {
+        TaskHandle_t task = _consumers[i].task.load(std::memory_order_acquire);
+        if (task != nullptr)
+        {
+            xTaskNotifyGive(task);
+        }
+    }
+    return true;
+}
+
+int PacketRing::addConsumer(TaskHandle_t task)
+{
+    for (int i = 0; i < MAX_CONSUMERS; i++)
+    {
+        TaskHandle_t expected = nullptr;
+        if (_consumers[i].task.compare_exchange_strong(expected, task))
+        {
+            _consumers[i].next = _head.load(std::memory_order_acquire) + 1;
+            _consumers[i].packets = 0;
+            _consumers[i].overruns = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void PacketRing::removeConsumer(int consumer)
+{
+    _consumers[consumer].task.store(nullptr, std::memory_order_release);
+}
+
+void PacketRing::skipToHead(int consumer)
+{
+    _consumers[consumer].next = _head.load(std::memory_order_acquire) + 1;
+}
+
+size_t PacketRing::read(int consumer, uint8_t *out, size_t size, TickType_t waitTicks)
+{
+    Consumer &reader = _consumers[consumer];
+    while (true)
+    {
+        uint32_t head = _head.load(std::memory_order_acquire);
+        if ((int32_t)(head - reader.next) < 0)
+        {
+            // Nothing new; notifications from packets already read may be pending, so
+            // the head is checked again after every wake-up
+            if (waitTicks == 0 || ulTaskNotifyTake(pdTRUE, waitTicks) == 0)
+            {
+                return 0;
+            }
+            waitTicks = 0;
+            continue;
+        }
+
+        // Lapped: jump to the oldest packet the ring still holds
+        if (head - reader.next >= _slotCount)
+        {
+            uint32_t oldest = head - _slotCount + 1;
+            reader.overruns += oldest - reader.next;
+            reader.next = oldest;
+        }
+
+        size_t slot = reader.next % _slotCount;
+        if (_slotPacket[slot].load(std::memory_order_acquire) != reader.next)
+        {
+            continue; // Overwritten since head was read, the check above catches up
+        }
+        size_t length = _lengths[slot];
+        size_t copied = min(length, size);
+        memcpy(out, _data + slot * _slotSize, copied);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_slotPacket[slot].load(std::memory_order_relaxed) != reader.next)
+        {
+            continue; // Reused while copying
+        }
+        reader.next++;
+        reader.packets++;
+        return copied;
+    }
+}
@@ -0,0 +1,379 @@
+#include "RetentionManager.h"
+
+#define RETENTION_UPLOADED_LIST "/.uploaded"
+#define RETENTION_STEP_MS 50     // Between deletions while over a limit
+#define RETENTION_IDLE_MS 5000   // Between checks while within limits
+
+RetentionManager::RetentionManager(fs::SDMMCFS &card)
+    : _card(card), _freeReserve(0), _scanned(false), _lock(nullptr), _taskHandle(nullptr), _stats()
+{
+}
+
+bool RetentionManager::addFolder(const char *folder, uint64_t quotaBytes)
+{
+    if (_taskHandle != nullptr || _folders.size() >= 255)
+    {
+        return false;
+    }
+    _folders.push_back({String(folder), quotaBytes, 0});
+    return true;
+}
+
+bool RetentionManager::begin()
+{
+    if (_taskHandle != nullptr)
+    {
+        return true;
+    }
+    _lock = xSemaphoreCreateRecursiveMutex();
+    if (_lock == nullptr)
+    {
+        Serial.println("Retention: failed to create lock");
+        return false;
+    }
+    // Lowest priority above idle: only runs when loop() and the network stack are waiting
+    return xTaskCreatePinnedToCore(retentionTask, "Retention", 6144, this, tskIDLE_PRIORITY + 1, &_taskHandle, 0) == pdPASS;
+}
+
+void RetentionManager::pause()
+{
+    if (_lock != nullptr)
+    {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    }
+}
+
+void RetentionManager::resume()
+{
+    if (_lock != nullptr)
+    {
+        xSemaphoreGiveRecursive(_lock);
+    }
+}
+
+// Orders by write time, then by the number in the name (camImg_9.jpg before camImg_10.jpg),
+// since files written before the clock was set all carry the same time
+bool RetentionManager::olderThan(const RetentionArtifact &a, const RetentionArtifact &b)
+{
+    if (a.written != b.written)
+    {
+        return a.written < b.written;
+    }
+    int digitsA = a.name.lastIndexOf('.');
+    int digitsB = b.name.lastIndexOf('.');
+    long numberA = 0, numberB = 0;
+    for (int i = digitsA - 1, scale = 1; i >= 0 && isdigit((unsigned char)a.name[i]); i--, scale *= 10)
+    {
+        numberA += (a.name[i] - '0') * scale;
+    }
+    for (int i = digitsB - 1, scale = 1; i >= 0 && isdigit((unsigned char)b.name[i]); i--, scale *= 10)
+    {
+        numberB += (b.name[i] - '0') * scale;
+    }
+    if (numberA != numberB)
+    {
+        return numberA < numberB;
+    }
+    return a.name < b.name;
+}
+
+int RetentionManager::folderOf(const String &path, String &name) const
+{
+    int slash = path.lastIndexOf('/');
+    String folder = path.substring(0, slash);
+    name = path.substring(slash + 1);
+    for (size_t i = 0; i < _folders.size(); i++)
+    {
+        if (_folders[i].path == folder)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int RetentionManager::findArtifact(uint8_t folder, const String &name) const
+{
+    // Newest first: lookups are nearly always for files of the current cycle
+    for (int i = _artifacts.size() - 1; i >= 0; i--)
+    {
+        if (_artifacts[i].folder == folder && _artifacts[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RetentionManager::insertArtifact(const RetentionArtifact &artifact)
+{
+    auto position = _artifacts.end();
+    while (position != _artifacts.begin() && olderThan(artifact, *(position - 1)))
+    {
+        --position;
+    }
+    _artifacts.insert(position, artifact);
+    _folders[artifact.folder].used += artifact.size;
+    _stats.filesTracked++;
+    _stats.bytesTracked += artifact.size;
+}
+
+// Reads the size and write time before any lock is taken
+static bool readArtifact(fs::SDMMCFS &card, const String &path, RetentionArtifact &artifact)
+{
+    File file = card.open(path, FILE_READ);
+    if (!file)
+    {
+        return false;
+    }
+    artifact.size = file.size();
+    artifact.written = file.getLastWrite();
+    file.close();
+    return true;
+}
+
+void RetentionManager::addFile(const String &path)
+{
+    String name;
+    int folder = folderOf(path, name);
+    if (folder < 0)
+    {
+        return;
+    }
+    RetentionArtifact artifact = {name, 0, 0, (uint8_t)folder, false};
+    if (!readArtifact(_card, path, artifact))
+    {
+        return;
+    }
+
+    pause();
+    if (findArtifact(folder, name) < 0)
+    {
+        insertArtifact(artifact);
+    }
+    resume();
+}
+
+void RetentionManager::markUploaded(const String &path)
+{
+    String name;
+    int folder = folderOf(path, name);
+    if (folder < 0)
+    {
+        return;
+    }
+    // A file the scan has not indexed yet goes in now, or a scan that read the list before
+    // this append would rewrite the list without it
+    RetentionArtifact artifact = {name, 0, 0, (uint8_t)folder, true};
+    bool exists = readArtifact(_card, path, artifact);
+
+    pause();
+    int index = findArtifact(folder, name);
+    if (index >= 0)
+    {
+        _artifacts[index].uploaded = true;
+    }
+    else if (exists)
+    {
+        insertArtifact(artifact);
+    }
+    File list = _card.open(_folders[folder].path + RETENTION_UPLOADED_LIST, FILE_APPEND);
+    if (list)
+    {
+        list.println(name);
+        list.close();
+    }
+    resume();
+}
+
+// Indexes one folder and applies its uploaded list, then rewrites the list without
+// the names of files that no longer exist. The card is read without the lock, which is
+// held only for the merge and the rewrite.
+bool RetentionManager::scanFolder(uint8_t folder)
+{
+    File dir = _card.open(_folders[folder].path);
+    if (!dir || !dir.isDirectory())
+    {
+        return !_card.exists(_folders[folder].path); // Nothing to index yet
+    }
+
+    std::vector<RetentionArtifact> found;
+    File entry = dir.openNextFile();
+    while (entry)
+    {
+        String name = entry.name();
+        name = name.substring(name.lastIndexOf('/') + 1);
+        if (!entry.isDirectory() && !name.startsWith("."))
+        {
+            found.push_back({name, (uint32_t)entry.size(), entry.getLastWrite(), folder, false});
+        }
+        entry.close();
+        entry = dir.openNextFile();
+    }
+    dir.close();
+
+    File list = _card.open(_folders[folder].path + RETENTION_UPLOADED_LIST, FILE_READ);
+    while (list && list.available())
+    {
+        String name = list.readStringUntil('\n');
+        name.trim();
+        for (RetentionArtifact &artifact : found)
+        {
+            if (artifact.name == name)
+            {
+                artifact.uploaded = true;
+                break;
+            }
+        }
+    }
+    list.close();
+
+    pause();
+    for (const RetentionArtifact &artifact : found)
+    {
+        int index = findArtifact(folder, artifact.name);
+        if (index < 0)
+        {
+            insertArtifact(artifact);
+        }
+        else if (artifact.uploaded)
+        {
+            _artifacts[index].uploaded = true;
+        }
+    }
+    writeUploadedList(folder);
+    resume();
+    return true;
+}
+
+void RetentionManager::writeUploadedList(uint8_t folder)
+{
+    File list = _card.open(_folders[folder].path + RETENTION_UPLOADED_LIST, FILE_WRITE);
+    if (!list)
+    {
+        return;
+    }
+    for (const RetentionArtifact &artifact : _artifacts)
+    {
+        if (artifact.folder == folder && artifact.uploaded)
+        {
+            list.println(artifact.name);
+        }
+    }
+    list.close();
+}
+
+// Index of the file to evict next, or -1 when every limit is met. A quota only ever costs
+// uploaded files; a folder whose files are all waiting for upload stays over it.
+int RetentionManager::chooseVictim()
+{
+    for (size_t f = 0; f < _folders.size(); f++)
+    {
+        if (_folders[f].quota == 0 || _folders[f].used <= _folders[f].quota)
+        {
+            continue;
+        }
+        for (size_t i = 0; i < _artifacts.size(); i++)
+        {
+            if (_artifacts[i].folder == f && _artifacts[i].uploaded)
+            {
+                return i;
+            }
+        }
+    }
+
+    if (_freeReserve > 0 && !_artifacts.empty() && _card.totalBytes() - _card.usedBytes() < _freeReserve)
+    {
+        for (size_t i = 0; i < _artifacts.size(); i++)
+        {
+            if (_artifacts[i].uploaded)
+            {
+                return i;
+            }
+        }
+        return 0;
+    }
+    return -1;
+}
+
+bool RetentionManager::evictOne()
+{
+    int victim = chooseVictim();
+    if (victim < 0)
+    {
+        return false;
+    }
+
+    RetentionArtifact artifact = _artifacts[victim];
+    String path = _folders[artifact.folder].path + "/" + artifact.name;
+    if (!_card.remove(path) && _card.exists(path))
+    {
+        Serial.printf("Retention: failed to delete %s\n", path.c_str());
+        return false;
+    }
+    _artifacts.erase(_artifacts.begin() + victim);
+    _folders[artifact.folder].used -= artifact.size;
+    _stats.filesTracked--;
+    _stats.bytesTracked -= artifact.size;
+    _stats.filesEvicted++;
+    _stats.bytesEvicted += artifact.size;
+    if (!artifact.uploaded)
+    {
+        _stats.pendingEvicted++;
+        Serial.printf("Retention: evicted %s before upload\n", path.c_str());
+    }
+    return true;
+}
+
+void RetentionManager::retentionTask(void *pvParameters)
+{
+    RetentionManager *manager = static_cast<RetentionManager *>(pvParameters);
+    uint8_t nextFolder = 0;
+    while (true)
+    {
+        bool busy = false;
+        // Skip this round if a capture cycle holds the card
+        if (manager->_card.cardType() != CARD_NONE && xSemaphoreTakeRecursive(manager->_lock, 0) == pdTRUE)
+        {
+            if (!manager->_scanned)
+            {
+                // One folder per step, the initial scan is the longest piece of work and
+                // takes the lock itself only for the merge
+                xSemaphoreGiveRecursive(manager->_lock);
+                if (manager->scanFolder(nextFolder))
+                {
+                    nextFolder++;
+                }
+                manager->_scanned = nextFolder >= manager->_folders.size();
+                busy = true;
+            }
+            else
+            {
+                busy = manager->evictOne();
+                xSemaphoreGiveRecursive(manager->_lock);
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(busy ? RETENTION_STEP_MS : RETENTION_IDLE_MS));
+    }
+}
+
+RetentionStats RetentionManager::stats()
+{
+    pause();
+    RetentionStats copy = _stats;
+    resume();
+    return copy;
+}
+
+void RetentionManager::printStatus()
+{
+    pause();
+    for (const Folder &folder : _folders)
+    {
+        Serial.printf("Retention: %s uses %llu KB of %llu KB\n", folder.path.c_str(),
+                      (unsigned long long)folder.used / 1024, (unsigned long long)folder.quota / 1024);
+    }
+    Serial.printf("Retention: %u files tracked, %u evicted (%llu KB, %u not uploaded)\n",
+                  _stats.filesTracked, _stats.filesEvicted, (unsigned long long)_stats.bytesEvicted / 1024, _stats.pendingEvicted);
+    resume();
+}
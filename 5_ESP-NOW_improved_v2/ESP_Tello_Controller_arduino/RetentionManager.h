@@ -0,0 +1,106 @@
+#ifndef RETENTIONMANAGER_H
+#define RETENTIONMANAGER_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD_MMC.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <vector>
+
+// Keeps the SD card from filling up. Files in the registered folders are tracked in an
+// in-memory index (size, write time, uploaded flag) and evicted by a low-priority task,
+// one file per step:
+//   - a folder over its quota loses its oldest uploaded file; files not yet uploaded are kept
+//     however far the folder is over its quota;
+//   - when the card has less than the free-space reserve left, the oldest uploaded file of
+//     any folder goes first, then the oldest file of any folder. Only a nearly full card
+//     costs files that were never uploaded.
+// Uploaded flags are persisted in <folder>/.uploaded (one file name per line). Dot files such
+// as the fileIndex counters are never indexed or evicted.
+//
+// The sketch pauses retention while a capture cycle works with the card, so a cycle waits
+// for at most one file deletion or one rewrite of an uploaded list, never for a whole
+// eviction pass. The initial scan walks a folder without the lock and takes it only to
+// merge what it found into the index.
+
+struct RetentionArtifact
+{
+    String name;      // File name within its folder
+    uint32_t size;
+    time_t written;
+    uint8_t folder;   // Index into the registered folders
+    bool uploaded;
+};
+
+struct RetentionStats
+{
+    uint32_t filesTracked;
+    uint64_t bytesTracked;
+    uint32_t filesEvicted;
+    uint64_t bytesEvicted;
+    uint32_t pendingEvicted; // Evicted before they were uploaded
+};
+
+class RetentionManager
+{
+public:
+    RetentionManager(fs::SDMMCFS &card);
+
+    // Register folders before begin(). quotaBytes == 0 disables the folder quota.
+    bool addFolder(const char *folder, uint64_t quotaBytes);
+    void setFreeSpaceReserve(uint64_t bytes) { _freeReserve = bytes; }
+    bool begin();
+
+    // Bookkeeping for files written and uploaded by the sketch, so the folders never need rescanning.
+    // markUploaded() also indexes a file the initial scan has not reached yet.
+    void addFile(const String &path);
+    void markUploaded(const String &path);
+
+    // Hold off eviction while the card is in use; pause() waits for at most one deletion or list rewrite
+    void pause();
+    void resume();
+
+    RetentionStats stats();
+    void printStatus();
+
+private:
+    struct Folder
+    {
+        String path;
+        uint64_t quota;
+        uint64_t used;
+    };
+
+    fs::SDMMCFS &_card;
+    std::vector<Folder> _folders;
+    std::vector<RetentionArtifact> _artifacts; // Oldest first
+    uint64_t _freeReserve;
+    bool _scanned;
+    SemaphoreHandle_t _lock;
+    TaskHandle_t _taskHandle;
+    RetentionStats _stats;
+
+    int folderOf(const String &path, String &name) const;
+    int findArtifact(uint8_t folder, const String &name) const;
+    void insertArtifact(const RetentionArtifact &artifact);
+    bool scanFolder(uint8_t folder);
+    void writeUploadedList(uint8_t folder);
+    int chooseVictim();
+    bool evictOne();
+    static bool olderThan(const RetentionArtifact &a, const RetentionArtifact &b);
+    static void retentionTask(void *pvParameters);
+};
+
+// Pauses retention for the lifetime of the object (covers early returns in loop())
+class RetentionPause
+{
+public:
+    RetentionPause(RetentionManager &manager) : _manager(manager) { _manager.pause(); }
+    ~RetentionPause() { _manager.resume(); }
+
+private:
+    RetentionManager &_manager;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "TelloResponseMatcher.h"
+#include <string.h>
+
+TelloResponseMatcher::TelloResponseMatcher(uint32_t staleWindowMs)
+    : _staleWindowMs(staleWindowMs),
+      _nextSequence(1),
+      _waiting(false),
+      _current(),
+      _abandonedCount(0),
+      _staleDiscarded(0)
+{
+}
+
+TelloReplyKind TelloResponseMatcher::expectedKind(const char *command)
+{
+    size_t len = strlen(command);
+    return len > 0 && command[len - 1] == '?' ? TELLO_REPLY_VALUE : TELLO_REPLY_ACK;
+}
+
+TelloReplyKind TelloResponseMatcher::replyKind(const char *reply)
+{
+    return strcmp(reply, "ok") == 0 || strncmp(reply, "error", 5) == 0 ? TELLO_REPLY_ACK : TELLO_REPLY_VALUE;
+}
+
+// FNV-1a
+uint32_t TelloResponseMatcher::commandHash(const char *command)
+{
+    uint32_t hash = 2166136261u;
+    for (; *command; command++)
+    {
+        hash = (hash ^ (uint8_t)*command) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t TelloResponseMatcher::begin(const char *command, uint32_t nowMs)
+{
+    if (_waiting)
+    {
+        abandon(nowMs);
+    }
+    _current.sequence = _nextSequence++;
+    _current.sentMs = nowMs;
+    _current.windowMs = _staleWindowMs;
+    _current.hash = commandHash(command);
+    _current.kind = expectedKind(command);
+    _waiting = true;
+    return _current.sequence;
+}
+
+void TelloResponseMatcher::abandon(uint32_t nowMs, uint32_t lateWindowMs)
+{
+    if (!_waiting)
+    {
+        return;
+    }
+    _waiting = false;
+    if (lateWindowMs > 0)
+    {
+        _current.windowMs = lateWindowMs;
+    }
+    expire(nowMs);
+    if (_abandonedCount == MAX_ABANDONED)
+    {
+        // Forget the oldest, its reply is the least likely to still arrive
+        memmove(&_abandoned[0], &_abandoned[1], (MAX_ABANDONED - 1) * sizeof(Pending));
+        _abandonedCount--;
+    }
+    _abandoned[_abandonedCount++] = _current;
+}
+
+void TelloResponseMatcher::expire(uint32_t nowMs)
+{
+    int keep = 0;
+    for (int i = 0; i < _abandonedCount; i++)
+    {
+        if (nowMs - _abandoned[i].sentMs < _abandoned[i].windowMs)
+        {
+            _abandoned[keep++] = _abandoned[i];
+        }
+    }
+    _abandonedCount = keep;
+}
+
+// Replies come back in command order: a reply for an abandoned command also settles every
+// abandoned command sent before it
+bool TelloResponseMatcher::consumeAbandoned(TelloReplyKind kind)
+{
+    for (int i = 0; i < _abandonedCount; i++)
+    {
+        if (_abandoned[i].kind == kind)
+        {
+            memmove(&_abandoned[0], &_abandoned[i + 1], (_abandonedCount - i - 1) * sizeof(Pending));
+            _abandonedCount -= i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The current command is a re-send of an abandoned one: whichever copy the reply belongs to,
+// it answers the command. Settles the abandoned copy and everything sent before it.
+bool TelloResponseMatcher::consumeResent()
+{
+    for (int i = _abandonedCount - 1; i >= 0; i--)
+    {
+        if (_abandoned[i].hash == _current.hash)
+        {
+            memmove(&_abandoned[0], &_abandoned[i + 1], (_abandonedCount - i - 1) * sizeof(Pending));
+            _abandonedCount -= i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TelloResponseMatcher::accept(const char *reply, uint32_t receivedMs)
+{
+    expire(receivedMs);
+    TelloReplyKind kind = replyKind(reply);
+
+    // "error" is a valid answer to a query as well
+    bool fitsCurrent = _waiting && (kind == _current.kind || strncmp(reply, "error", 5) == 0);
+    if (fitsCurrent && consumeResent())
+    {
+        _waiting = false;
+        return true;
+    }
+    if (consumeAbandoned(kind) || !fitsCurrent)
+    {
+        _staleDiscarded++;
+        return false;
+    }
+    _waiting = false;
+    return true;
+}
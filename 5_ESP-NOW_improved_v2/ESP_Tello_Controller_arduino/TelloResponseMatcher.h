@@ -0,0 +1,72 @@
+#ifndef TELLORESPONSEMATCHER_H
+#define TELLORESPONSEMATCHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Tello SDK replies carry no request ID, but the drone executes commands in order and a reply
+// is either an acknowledgement ("ok"/"error ...") or a value (answers to "...?" queries).
+// The matcher numbers every command and remembers the ones that timed out: their replies can
+// still arrive, and are attributed to the oldest abandoned command of the same kind instead of
+// being taken as the answer to the current one. Abandoned commands are forgotten after
+// staleWindowMs (or the late window given to abandon()), so a reply lost for good does not
+// swallow later replies forever. A re-send of the very same command is answered by either
+// reply, so a lost command does not make its retries time out in turn.
+// Replies that arrive while no command is waiting (e.g. duplicated datagrams) are fed to
+// accept() before the next command is sent and settle abandoned commands or are dropped.
+//
+// Pure bookkeeping (times are passed in), so it runs unchanged on the host.
+
+enum TelloReplyKind : uint8_t
+{
+    TELLO_REPLY_ACK,
+    TELLO_REPLY_VALUE
+};
+
+class TelloResponseMatcher
+{
+public:
+    static const int MAX_ABANDONED = 8;
+
+    TelloResponseMatcher(uint32_t staleWindowMs = 15000);
+
+    // Registers a new command as the one awaiting a reply and returns its sequence number
+    uint32_t begin(const char *command, uint32_t nowMs);
+    // True when the reply answers the current command (which is then complete)
+    bool accept(const char *reply, uint32_t receivedMs);
+    // The current command timed out; its reply may still come for lateWindowMs after it was
+    // sent (0 for staleWindowMs)
+    void abandon(uint32_t nowMs, uint32_t lateWindowMs = 0);
+
+    bool waiting() const { return _waiting; }
+    uint32_t currentSequence() const { return _current.sequence; }
+    uint32_t staleDiscarded() const { return _staleDiscarded; }
+
+    static TelloReplyKind expectedKind(const char *command);
+    static TelloReplyKind replyKind(const char *reply);
+
+private:
+    struct Pending
+    {
+        uint32_t sequence;
+        uint32_t sentMs;
+        uint32_t windowMs;
+        uint32_t hash;           // Of the command text, to recognise re-sends
+        TelloReplyKind kind;
+    };
+
+    uint32_t _staleWindowMs;
+    uint32_t _nextSequence;
+    bool _waiting;
+    Pending _current;
+    Pending _abandoned[MAX_ABANDONED]; // Oldest first
+    int _abandonedCount;
+    uint32_t _staleDiscarded;
+
+    void expire(uint32_t nowMs);
+    bool consumeAbandoned(TelloReplyKind kind);
+    bool consumeResent();
+    static uint32_t commandHash(const char *command);
+};
+
+#endif
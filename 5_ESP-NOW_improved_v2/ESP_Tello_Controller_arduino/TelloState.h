@@ -0,0 +1,57 @@
+#ifndef TELLOSTATE_H
+#define TELLOSTATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// One Tello state packet. After "command" the drone pushes these to UDP port 8890 about
+// ten times a second as "pitch:0;roll:0;yaw:0;vgx:0;...;agz:-999.00;\r\n"
+// (SDK 2.0 drones prefix mission pad fields, which are ignored).
+struct TelloTelemetry
+{
+    int16_t pitch;          // Degrees
+    int16_t roll;
+    int16_t yaw;
+    int16_t vgx;            // Speed, dm/s
+    int16_t vgy;
+    int16_t vgz;
+    int16_t tempLow;        // Degrees Celsius
+    int16_t tempHigh;
+    int16_t tof;            // Time-of-flight distance, cm
+    int16_t height;         // Height above takeoff, cm
+    uint8_t battery;        // Percent
+    uint16_t motorTime;     // Seconds the motors have run
+    float barometer;        // Barometric altitude, m
+    float agx;              // Acceleration, 0.001 g
+    float agy;
+    float agz;
+    uint32_t receivedMs;    // millis() when the packet arrived
+    uint32_t packets;       // Packets received since the listener started
+};
+
+// Latest telemetry, written by the state task and read by any task without locking.
+// A sequence lock: the writer makes the counter odd while it copies, and readers retry
+// when the counter was odd or changed during their copy. Readers never block the writer,
+// which is the only one allowed to call publish().
+class TelloState
+{
+public:
+    TelloState();
+
+    // Parses one state packet into out; false if no known field was found
+    static bool parse(const char *text, size_t length, TelloTelemetry &out);
+
+    void publish(const TelloTelemetry &telemetry);
+
+    // Copies the latest telemetry; false until the first packet was published
+    bool read(TelloTelemetry &out) const;
+
+    void reset();
+
+private:
+    std::atomic<uint32_t> _sequence;
+    TelloTelemetry _telemetry;
+};
+
+#endif // TELLOSTATE_H
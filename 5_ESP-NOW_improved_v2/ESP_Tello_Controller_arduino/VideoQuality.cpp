@@ -0,0 +1,354 @@
+#include "VideoQuality.h"
+
+// setfps words rather than TelloESP32::FPS_*, which are not yet constructed when this table is
+const VideoQualityLevel VideoQualityController::LEVELS[LEVEL_COUNT] = {
+    {TelloESP32::BITRATE_1MBPS, "low"},
+    {TelloESP32::BITRATE_2MBPS, "low"},
+    {TelloESP32::BITRATE_2MBPS, "middle"},
+    {TelloESP32::BITRATE_3MBPS, "middle"},
+    {TelloESP32::BITRATE_4MBPS, "high"},
+    {TelloESP32::BITRATE_5MBPS, "high"},
+};
+
+// Counters restart at reset() and open(), so a smaller value counts from zero
+static uint32_t delta(uint32_t current, uint32_t &last)
+{
+    uint32_t change = current >= last ? current - last : current;
+    last = current;
+    return change;
+}
+
+static bool sameFps(const char *sent, const char *fps)
+{
+    return sent != nullptr && strcmp(sent, fps) == 0;
+}
+
+VideoQualityController::VideoQualityController(TelloESP32 &tello, const H264Reassembler &reassembler)
+    : _tello(tello), _reassembler(reassembler), _windowMs(WINDOW_MS), _baseProbeDelayMs(PROBE_DELAY_MS), _started(false),
+      _packets(0), _bytes(0), _windowStartMs(0), _lastPackets(0), _lastBytes(0), _lastStream(), _lastRingOverruns(0),
+      _lastWriterDrops(0), _maxBacklog(0), _level(DEFAULT_LEVEL), _bitrateSent(-1), _fpsSent(nullptr),
+      _retryAtMs(0), _inFlight(SETTING_NONE), _inFlightLevel(), _settling(false), _probing(false), _cleanMs(0), _probeDelayMs(PROBE_DELAY_MS), _levelSinceMs(0),
+      _lastHealth(), _total(), _windows(0), _congestedWindows(0), _stepsUp(0), _stepsDown(0), _failedProbes(0), _msAtLevel()
+{
+}
+
+void VideoQualityController::setIntervals(uint32_t windowMs, uint32_t probeDelayMs)
+{
+    _windowMs = windowMs;
+    _baseProbeDelayMs = probeDelayMs;
+    _probeDelayMs = probeDelayMs;
+}
+
+bool VideoQualityController::begin(int level)
+{
+    uint32_t now = millis();
+    _level = constrain(level, 0, LEVEL_COUNT - 1);
+    _bitrateSent = -1;
+    _fpsSent = nullptr;
+    _inFlight = SETTING_NONE;
+    _settling = false;
+    _probing = false;
+    _cleanMs = 0;
+    _probeDelayMs = _baseProbeDelayMs;
+    _levelSinceMs = now;
+    _lastHealth = VideoHealth();
+    _total = VideoHealth();
+    _windows = _congestedWindows = 0;
+    _stepsUp = _stepsDown = _failedProbes = 0;
+    memset(_msAtLevel, 0, sizeof(_msAtLevel));
+    startWindow(now);
+    _started = true;
+
+    bool sent = sendLevel();
+    _retryAtMs = sent ? 0 : now + _windowMs;
+    return sent;
+}
+
+void VideoQualityController::end()
+{
+    if (_started)
+    {
+        while (_inFlight != SETTING_NONE)
+        {
+            delay(10);
+            pollSetting(millis());
+        }
+        uint32_t now = millis();
+        _msAtLevel[_level] += now - _levelSinceMs;
+        _levelSinceMs = now;
+        _started = false;
+    }
+}
+
+void VideoQualityController::recordPacket(size_t size)
+{
+    _packets.fetch_add(1, std::memory_order_relaxed);
+    _bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void VideoQualityController::startWindow(uint32_t nowMs)
+{
+    _windowStartMs = nowMs;
+    _lastPackets = _packets;
+    _lastBytes = _bytes;
+    _lastStream = _reassembler.stats();
+    _lastRingOverruns = _tello.getVideoPacketsDropped();
+    _lastWriterDrops = _sinkProbe ? _sinkProbe().writesRefused : 0;
+    _maxBacklog = 0;
+}
+
+VideoHealth VideoQualityController::closeWindow(uint32_t nowMs)
+{
+    VideoHealth health = {};
+    health.windowMs = nowMs - _windowStartMs;
+    health.packets = delta(_packets, _lastPackets);
+    health.bytes = delta(_bytes, _lastBytes);
+
+    H264ReassemblerStats stream = _reassembler.stats();
+    health.frames = delta(stream.frames, _lastStream.frames);
+    health.damagedFrames = delta(stream.incompleteFrames, _lastStream.incompleteFrames);
+    health.gaps = delta(stream.gaps, _lastStream.gaps);
+    _lastStream = stream;
+
+    health.ringOverruns = delta(_tello.getVideoPacketsDropped(), _lastRingOverruns);
+    if (_sinkProbe)
+    {
+        health.writerDrops = delta(_sinkProbe().writesRefused, _lastWriterDrops);
+    }
+    health.writerBacklog = _maxBacklog;
+    _maxBacklog = 0;
+    _windowStartMs = nowMs;
+    return health;
+}
+
+void VideoQualityController::update()
+{
+    if (!_started)
+    {
+        return;
+    }
+    uint32_t now = millis();
+
+    // The backlog changes within a window, its peak is what matters
+    if (_sinkProbe)
+    {
+        VideoSinkLoad load = _sinkProbe();
+        uint32_t backlog = load.blockCount ? load.blocksQueued * 100 / load.blockCount : 0;
+        _maxBacklog = max(_maxBacklog, backlog);
+    }
+
+    if (now - _windowStartMs >= _windowMs)
+    {
+        VideoHealth health = closeWindow(now);
+        _lastHealth = health;
+        _total.windowMs += health.windowMs;
+        _total.packets += health.packets;
+        _total.bytes += health.bytes;
+        _total.frames += health.frames;
+        _total.damagedFrames += health.damagedFrames;
+        _total.gaps += health.gaps;
+        _total.ringOverruns += health.ringOverruns;
+        _total.writerDrops += health.writerDrops;
+        _total.writerBacklog = max(_total.writerBacklog, health.writerBacklog);
+        _windows++;
+        int previous = _level;
+        judge(health, now);
+        if (_level == previous && _windows % REPORT_EVERY_WINDOWS == 0)
+        {
+            printHealth(health);
+        }
+    }
+
+    // Settings go out one at a time between mission commands, and a failed one is retried a window later
+    bool pending = _bitrateSent != LEVELS[_level].bitrate || !sameFps(_fpsSent, LEVELS[_level].fps);
+    if (_inFlight != SETTING_NONE)
+    {
+        pollSetting(now);
+    }
+    else if (pending && !_tello.isCommandPending() && (int32_t)(now - _retryAtMs) >= 0)
+    {
+        if (!beginSetting())
+        {
+            _retryAtMs = now + _windowMs;
+        }
+    }
+}
+
+void VideoQualityController::judge(const VideoHealth &health, uint32_t nowMs)
+{
+    if (health.packets == 0)
+    {
+        _cleanMs = 0; // Stream not running, nothing to judge
+        return;
+    }
+    if (_settling)
+    {
+        _settling = false;
+        return;
+    }
+
+    bool damaged = health.damagedFrames * 100 > health.frames * MAX_DAMAGED_PERCENT;
+    bool congested = health.ringOverruns > 0 || health.writerDrops > 0 || health.writerBacklog >= BACKLOG_HIGH_PERCENT || damaged;
+    if (congested)
+    {
+        _congestedWindows++;
+        _cleanMs = 0;
+        if (_probing)
+        {
+            _failedProbes++;
+            _probeDelayMs = min(_probeDelayMs * 2, (uint32_t)MAX_PROBE_DELAY_MS);
+        }
+        _probing = false;
+        if (_level > 0)
+        {
+            const char *reason = health.ringOverruns ? "receive ring overrun"
+                                 : health.writerDrops ? "SD writes refused"
+                                 : damaged ? "incomplete frames"
+                                           : "SD backlog";
+            changeLevel(_level - 1, nowMs, reason);
+        }
+        return;
+    }
+
+    if (_probing && nowMs - _levelSinceMs >= _probeDelayMs)
+    {
+        _probing = false; // The step up held
+        _probeDelayMs = _baseProbeDelayMs;
+    }
+    _cleanMs = health.writerBacklog <= BACKLOG_LOW_PERCENT ? _cleanMs + health.windowMs : 0;
+    if (_level < LEVEL_COUNT - 1 && _cleanMs >= _probeDelayMs)
+    {
+        changeLevel(_level + 1, nowMs, "clean stream");
+        _probing = true;
+    }
+}
+
+void VideoQualityController::changeLevel(int level, uint32_t nowMs, const char *reason)
+{
+    Serial.printf("Video quality: level %d -> %d (%d Mbps, fps %s), %s\n", _level, level, LEVELS[level].bitrate,
+                  LEVELS[level].fps, reason);
+    printHealth(_lastHealth);
+    if (level > _level)
+    {
+        _stepsUp++;
+    }
+    else
+    {
+        _stepsDown++;
+    }
+    _msAtLevel[_level] += nowMs - _levelSinceMs;
+    _levelSinceMs = nowMs;
+    _level = level;
+    _cleanMs = 0;
+    _retryAtMs = nowMs;
+}
+
+// Sends only the settings that differ from what the drone has
+bool VideoQualityController::sendLevel()
+{
+    const VideoQualityLevel &target = LEVELS[_level];
+    if (_bitrateSent != target.bitrate)
+    {
+        if (!_tello.setVideoBitrate(target.bitrate))
+        {
+            Serial.printf("Video quality: setbitrate %d failed\n", target.bitrate);
+            return false;
+        }
+        _bitrateSent = target.bitrate;
+    }
+    if (!sameFps(_fpsSent, target.fps))
+    {
+        if (!_tello.setVideoFPS(target.fps))
+        {
+            Serial.printf("Video quality: setfps %s failed\n", target.fps);
+            return false;
+        }
+        _fpsSent = target.fps;
+    }
+    return true;
+}
+
+// Begins the first setting that differs from what the drone has, without waiting for the reply
+bool VideoQualityController::beginSetting()
+{
+    const VideoQualityLevel &target = LEVELS[_level];
+    char command[TELLO_COMMAND_MAX];
+    size_t length;
+    if (_bitrateSent != target.bitrate)
+    {
+        length = telloFormatCommand(command, sizeof(command), TELLO_SETBITRATE, &target.bitrate, 1);
+        _inFlight = SETTING_BITRATE;
+    }
+    else
+    {
+        length = telloFormatCommand(command, sizeof(command), TELLO_SETFPS, target.fps);
+        _inFlight = SETTING_FPS;
+    }
+    _inFlightLevel = target;
+    if (length == 0 || !_tello.beginCommand(command))
+    {
+        Serial.printf("Video quality: %s could not be sent\n", _inFlight == SETTING_BITRATE ? "setbitrate" : "setfps");
+        _inFlight = SETTING_NONE;
+        return false;
+    }
+    return true;
+}
+
+void VideoQualityController::pollSetting(uint32_t nowMs)
+{
+    char reply[32];
+    TelloCommandStatus status = _tello.pollCommand(reply, sizeof(reply));
+    if (status == TELLO_COMMAND_PENDING)
+    {
+        return;
+    }
+    bool bitrate = _inFlight == SETTING_BITRATE;
+    _inFlight = SETTING_NONE;
+    if (status == TELLO_COMMAND_REPLIED && strcmp(reply, "ok") == 0)
+    {
+        if (bitrate)
+        {
+            _bitrateSent = _inFlightLevel.bitrate;
+        }
+        else
+        {
+            _fpsSent = _inFlightLevel.fps;
+        }
+        _settling = true;
+        return;
+    }
+
+    const char *outcome = status == TELLO_COMMAND_REPLIED ? reply : "timed out";
+    if (bitrate)
+    {
+        Serial.printf("Video quality: setbitrate %d %s\n", _inFlightLevel.bitrate, outcome);
+    }
+    else
+    {
+        Serial.printf("Video quality: setfps %s %s\n", _inFlightLevel.fps, outcome);
+    }
+    _retryAtMs = nowMs + _windowMs;
+}
+
+void VideoQualityController::printHealth(const VideoHealth &health) const
+{
+    Serial.printf("Video: %u pkt/s, %u kB/s, %u frames (%u incomplete, %u gaps), %u ring overruns, SD backlog %u%%, %u SD drops\n",
+                  health.packetsPerSecond(), health.bytesPerSecond() / 1024, health.frames, health.damagedFrames, health.gaps,
+                  health.ringOverruns, health.writerBacklog, health.writerDrops);
+}
+
+void VideoQualityController::printSummary() const
+{
+    Serial.printf("Video quality: level %d (%d Mbps, fps %s) at the end, %u steps up, %u down (%u failed probes), %u of %u windows congested\n",
+                  _level, LEVELS[_level].bitrate, LEVELS[_level].fps, _stepsUp, _stepsDown, _failedProbes, _congestedWindows,
+                  _windows);
+    printHealth(_total);
+    for (int i = 0; i < LEVEL_COUNT; i++)
+    {
+        uint32_t ms = _msAtLevel[i] + (_started && i == _level ? millis() - _levelSinceMs : 0);
+        if (ms > 0)
+        {
+            Serial.printf("  level %d (%d Mbps, fps %s): %.1f s\n", i, LEVELS[i].bitrate, LEVELS[i].fps, ms / 1000.0f);
+        }
+    }
+}
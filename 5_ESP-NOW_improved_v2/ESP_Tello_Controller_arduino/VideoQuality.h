@@ -0,0 +1,146 @@
+#ifndef VIDEOQUALITY_H
+#define VIDEOQUALITY_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include "TelloESP32.h"
+#include "H264Reassembler.h"
+
+// Health of the Tello video stream over one measuring window
+struct VideoHealth
+{
+    uint32_t windowMs;
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t frames;
+    uint32_t damagedFrames;  // Incomplete, kept for the decoder to conceal
+    uint32_t gaps;           // Datagrams that did not continue the stream
+    uint32_t ringOverruns;   // Datagrams overwritten in TelloESP32's receive ring
+    uint32_t writerBacklog;  // Most SD blocks queued, percent of the writer's blocks
+    uint32_t writerDrops;    // Writes refused with every SD block queued
+
+    uint32_t packetsPerSecond() const { return windowMs ? (uint64_t)packets * 1000 / windowMs : 0; }
+    uint32_t bytesPerSecond() const { return windowMs ? (uint64_t)bytes * 1000 / windowMs : 0; }
+};
+
+// What the SD writer reports, read on every update()
+struct VideoSinkLoad
+{
+    uint32_t blocksQueued;
+    uint32_t blockCount;
+    uint32_t writesRefused;  // Since the recording was opened
+};
+
+struct VideoQualityLevel
+{
+    int bitrate;             // setbitrate argument, Mbps
+    const char *fps;         // setfps argument
+};
+
+// Steps the Tello's video bitrate and frame rate during a flight, from how the stream
+// arrives here. Every window the counters are compared with the previous ones: datagrams
+// overwritten in the receive ring, writes refused by the SD writer, a writer backlog above
+// BACKLOG_HIGH_PERCENT or more than MAX_DAMAGED_PERCENT incomplete frames step one level
+// down at once. After a probe delay of clean windows with the backlog below
+// BACKLOG_LOW_PERCENT the next level up is tried; each step up that fails doubles the
+// delay (up to MAX_PROBE_DELAY_MS), so a link that cannot carry a level is not probed
+// every few seconds. The window after a change is not judged, the drone's encoder takes
+// that long to follow.
+//
+// recordPacket() is called from the video task, the rest from the task that sends the
+// commands. update() never blocks: it begins setbitrate/setfps with beginCommand() only while
+// no other command is pending and polls for the reply on the following calls, so it can run
+// between MissionRunner ticks (the mission waits while a setting is in flight).
+class VideoQualityController
+{
+public:
+    typedef std::function<VideoSinkLoad()> SinkProbe;
+
+    static const int LEVEL_COUNT = 6;
+    static const VideoQualityLevel LEVELS[LEVEL_COUNT];
+    static const int DEFAULT_LEVEL = 0;             // 1 Mbps at 5 fps, the fixed setting before
+    static const uint32_t WINDOW_MS = 2000;
+    static const uint32_t PROBE_DELAY_MS = 10000;
+    static const uint32_t MAX_PROBE_DELAY_MS = 80000;
+    static const uint32_t MAX_DAMAGED_PERCENT = 5;
+    static const uint32_t BACKLOG_HIGH_PERCENT = 75;
+    static const uint32_t BACKLOG_LOW_PERCENT = 25;
+    static const uint32_t REPORT_EVERY_WINDOWS = 5; // Changes are always reported
+
+    VideoQualityController(TelloESP32 &tello, const H264Reassembler &reassembler);
+
+    // Without a probe only the stream itself is judged
+    void setSinkProbe(SinkProbe probe) { _sinkProbe = probe; }
+    void setIntervals(uint32_t windowMs, uint32_t probeDelayMs);
+
+    // Sends the level with blocking commands, before the stream is started
+    bool begin(int level = DEFAULT_LEVEL);
+    // Waits for a setting still in flight, the command slot is needed after the flight
+    void end();
+    void recordPacket(size_t size);
+    void update();
+
+    int level() const { return _level; }
+    VideoHealth lastHealth() const { return _lastHealth; }
+    void printHealth(const VideoHealth &health) const;
+    void printSummary() const;
+
+private:
+    enum SettingInFlight : uint8_t
+    {
+        SETTING_NONE,
+        SETTING_BITRATE,
+        SETTING_FPS
+    };
+
+    TelloESP32 &_tello;
+    const H264Reassembler &_reassembler;
+    SinkProbe _sinkProbe;
+    uint32_t _windowMs;
+    uint32_t _baseProbeDelayMs;
+    bool _started;
+
+    std::atomic<uint32_t> _packets;
+    std::atomic<uint32_t> _bytes;
+
+    // Counters at the start of the window
+    uint32_t _windowStartMs;
+    uint32_t _lastPackets;
+    uint32_t _lastBytes;
+    H264ReassemblerStats _lastStream;
+    uint32_t _lastRingOverruns;
+    uint32_t _lastWriterDrops;
+    uint32_t _maxBacklog;
+
+    int _level;
+    int _bitrateSent;               // -1 when unknown
+    const char *_fpsSent;
+    uint32_t _retryAtMs;            // After a failed setbitrate/setfps
+    SettingInFlight _inFlight;      // Begun with beginCommand() and not yet answered
+    VideoQualityLevel _inFlightLevel;
+    bool _settling;
+    bool _probing;                  // _level was reached by a step up that has not yet held
+    uint32_t _cleanMs;
+    uint32_t _probeDelayMs;
+    uint32_t _levelSinceMs;
+
+    VideoHealth _lastHealth;
+    VideoHealth _total;
+    uint32_t _windows;
+    uint32_t _congestedWindows;
+    uint32_t _stepsUp;
+    uint32_t _stepsDown;
+    uint32_t _failedProbes;
+    uint32_t _msAtLevel[LEVEL_COUNT];
+
+    void startWindow(uint32_t nowMs);
+    VideoHealth closeWindow(uint32_t nowMs);
+    void judge(const VideoHealth &health, uint32_t nowMs);
+    void changeLevel(int level, uint32_t nowMs, const char *reason);
+    bool sendLevel();
+    bool beginSetting();
+    void pollSetting(uint32_t nowMs);
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include "VideoWriter.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+VideoWriter::VideoWriter(size_t blockSize, size_t blockCount)
+    : _blockSize(blockSize), _blockCount(blockCount), _blocks(nullptr), _freeBlocks(nullptr), _fullBlocks(nullptr),
+      _closed(nullptr), _taskHandle(nullptr), _fd(-1), _open(false), _inWrite(false), _fillBlock(-1), _fillLength(0),
+      _preallocated(0), _statsLock(portMUX_INITIALIZER_UNLOCKED), _stats()
+{
+}
+
+VideoWriter::~VideoWriter()
+{
+    close();
+    if (_taskHandle != nullptr)
+    {
+        vTaskDelete(_taskHandle);
+    }
+    for (size_t i = 0; _blocks && i < _blockCount; i++)
+    {
+        free(_blocks[i]);
+    }
+    free(_blocks);
+}
+
+bool VideoWriter::begin()
+{
+    if (_taskHandle != nullptr)
+    {
+        return true;
+    }
+
+    if (!psramFound())
+    {
+        _blockCount = min(_blockCount, (size_t)2); // Internal RAM cannot spare the full pool
+    }
+    _blocks = (uint8_t **)calloc(_blockCount, sizeof(uint8_t *));
+    _freeBlocks = xQueueCreate(_blockCount, sizeof(int16_t));
+    _fullBlocks = xQueueCreate(_blockCount + 1, sizeof(BlockJob));
+    _closed = xSemaphoreCreateBinary();
+    if (!_blocks || !_freeBlocks || !_fullBlocks || !_closed)
+    {
+        Serial.println("VideoWriter: out of memory");
+        return false;
+    }
+    for (size_t i = 0; i < _blockCount; i++)
+    {
+        _blocks[i] = (uint8_t *)(psramFound() ? ps_malloc(_blockSize) : malloc(_blockSize));
+        if (!_blocks[i])
+        {
+            Serial.println("VideoWriter: failed to allocate buffer blocks");
+            return false;
+        }
+        int16_t block = i;
+        xQueueSend(_freeBlocks, &block, 0);
+    }
+
+    // App core, above loop() so the card is drained while the sketch waits
+    return xTaskCreatePinnedToCore(writerTask, "VideoWriter", 4096, this, 2, &_taskHandle, 1) == pdPASS;
+}
+
+bool VideoWriter::open(const char *path, size_t preallocateBytes)
+{
+    if (_taskHandle == nullptr || _open)
+    {
+        return false;
+    }
+
+    _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0)
+    {
+        Serial.printf("VideoWriter: failed to open %s\n", path);
+        return false;
+    }
+
+    // Seeking past the end of a file opened for writing makes FatFs allocate the cluster
+    // chain now, instead of growing the FAT on every block while packets are arriving
+    _preallocated = 0;
+    if (preallocateBytes > 0 && lseek(_fd, preallocateBytes, SEEK_SET) == (off_t)preallocateBytes)
+    {
+        _preallocated = preallocateBytes;
+    }
+    lseek(_fd, 0, SEEK_SET);
+
+    portENTER_CRITICAL(&_statsLock);
+    _stats = VideoWriterStats();
+    portEXIT_CRITICAL(&_statsLock);
+    _fillBlock = -1;
+    _fillLength = 0;
+    xSemaphoreTake(_closed, 0);
+    _open = true;
+    return true;
+}
+
+// Hands the block being filled to the writer task
+bool VideoWriter::queueFillBlock()
+{
+    if (_fillBlock < 0)
+    {
+        return true;
+    }
+    BlockJob job = {_fillBlock, (uint32_t)_fillLength};
+    _fillBlock = -1;
+    _fillLength = 0;
+    if (xQueueSend(_fullBlocks, &job, 0) != pdTRUE)
+    {
+        return false; // Cannot happen: the queue holds every block plus the close marker
+    }
+
+    UBaseType_t queued = uxQueueMessagesWaiting(_fullBlocks);
+    portENTER_CRITICAL(&_statsLock);
+    _stats.maxBlocksQueued = max(_stats.maxBlocksQueued, (uint32_t)queued);
+    portEXIT_CRITICAL(&_statsLock);
+    return true;
+}
+
+size_t VideoWriter::write(const uint8_t *data, size_t size)
+{
+    _inWrite = true;
+    if (!_open)
+    {
+        _inWrite = false;
+        return 0;
+    }
+
+    // Drop whole packets only, a partial NAL unit would corrupt more than it saves
+    size_t room = (_fillBlock >= 0 ? _blockSize - _fillLength : 0) + uxQueueMessagesWaiting(_freeBlocks) * _blockSize;
+    if (room < size)
+    {
+        portENTER_CRITICAL(&_statsLock);
+        _stats.bytesDropped += size;
+        _stats.packetsDropped++;
+        portEXIT_CRITICAL(&_statsLock);
+        _inWrite = false;
+        return 0;
+    }
+
+    size_t copied = 0;
+    while (copied < size)
+    {
+        if (_fillBlock < 0 && xQueueReceive(_freeBlocks, &_fillBlock, 0) != pdTRUE)
+        {
+            _fillBlock = -1;
+            break;
+        }
+        size_t chunk = min(size - copied, _blockSize - _fillLength);
+        memcpy(_blocks[_fillBlock] + _fillLength, data + copied, chunk);
+        _fillLength += chunk;
+        copied += chunk;
+        if (_fillLength == _blockSize)
+        {
+            queueFillBlock();
+        }
+    }
+
+    portENTER_CRITICAL(&_statsLock);
+    _stats.bytesAccepted += copied;
+    portEXIT_CRITICAL(&_statsLock);
+    _inWrite = false;
+    return copied;
+}
+
+bool VideoWriter::close()
+{
+    if (!_open)
+    {
+        return false;
+    }
+    _open = false;
+
+    // Let a packet that is being copied finish (the producer task may also have been deleted)
+    unsigned long start = millis();
+    while (_inWrite && millis() - start < 100)
+    {
+        delay(1);
+    }
+
+    queueFillBlock();
+    BlockJob marker = {CLOSE_MARKER, 0};
+    xQueueSend(_fullBlocks, &marker, portMAX_DELAY);
+    bool drained = xSemaphoreTake(_closed, pdMS_TO_TICKS(10000)) == pdTRUE;
+    if (!drained)
+    {
+        // The task still writes the queued blocks to _fd: closing it now would send them to
+        // a closed descriptor, or to the next open()'s file if it reuses the number
+        Serial.println("VideoWriter: timed out waiting for the SD card, still draining");
+        xSemaphoreTake(_closed, portMAX_DELAY);
+    }
+
+    VideoWriterStats current = stats();
+    if (_preallocated > current.bytesWritten)
+    {
+        ftruncate(_fd, current.bytesWritten);
+    }
+    fsync(_fd);
+    ::close(_fd);
+    _fd = -1;
+    return drained && current.writeErrors == 0;
+}
+
+void VideoWriter::writerTask(void *pvParameters)
+{
+    VideoWriter *writer = static_cast<VideoWriter *>(pvParameters);
+    BlockJob job;
+    while (true)
+    {
+        if (xQueueReceive(writer->_fullBlocks, &job, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        if (job.block == CLOSE_MARKER)
+        {
+            xSemaphoreGive(writer->_closed);
+            continue;
+        }
+
+        unsigned long started = micros();
+        ssize_t written = ::write(writer->_fd, writer->_blocks[job.block], job.length);
+        uint32_t elapsed = micros() - started;
+
+        portENTER_CRITICAL(&writer->_statsLock);
+        writer->_stats.blockWrites++;
+        writer->_stats.totalWriteMicros += elapsed;
+        writer->_stats.maxWriteMicros = max(writer->_stats.maxWriteMicros, elapsed);
+        if (written == (ssize_t)job.length)
+        {
+            writer->_stats.bytesWritten += job.length;
+        }
+        else
+        {
+            writer->_stats.writeErrors++;
+        }
+        portEXIT_CRITICAL(&writer->_statsLock);
+
+        xQueueSend(writer->_freeBlocks, &job.block, portMAX_DELAY);
+    }
+}
+
+VideoWriterStats VideoWriter::stats() const
+{
+    portENTER_CRITICAL(&_statsLock);
+    VideoWriterStats copy = _stats;
+    portEXIT_CRITICAL(&_statsLock);
+    return copy;
+}
+
+void VideoWriter::printStats() const
+{
+    VideoWriterStats s = stats();
+    Serial.printf("Video: %u bytes written in %u blocks, %u bytes dropped (%u packets), %u write errors\n",
+                  s.bytesWritten, s.blockWrites, s.bytesDropped, s.packetsDropped, s.writeErrors);
+    Serial.printf("SD block write: avg %u us, max %u us, max %u blocks queued\n",
+                  s.blockWrites ? (unsigned)(s.totalWriteMicros / s.blockWrites) : 0, s.maxWriteMicros, s.maxBlocksQueued);
+}
@@ -0,0 +1,81 @@
+#ifndef VIDEOWRITER_H
+#define VIDEOWRITER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// Buffered SD writer for the Tello video stream. Packets are copied into large PSRAM
+// blocks and a background task writes whole blocks, so every SD write is a multiple of
+// the sector size at a block-aligned offset. The file is preallocated when opened and
+// trimmed to the recorded length on close. write() never blocks: when all blocks are
+// waiting for the card, the packet is dropped and counted.
+struct VideoWriterStats
+{
+    uint32_t bytesAccepted;
+    uint32_t bytesWritten;
+    uint32_t bytesDropped;
+    uint32_t packetsDropped;
+    uint32_t blockWrites;
+    uint32_t writeErrors;
+    uint32_t maxWriteMicros;
+    uint64_t totalWriteMicros;
+    uint32_t maxBlocksQueued;
+};
+
+class VideoWriter
+{
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 32 * 1024; // Multiple of the 512-byte sector
+    static const size_t DEFAULT_BLOCK_COUNT = 8;
+
+    VideoWriter(size_t blockSize = DEFAULT_BLOCK_SIZE, size_t blockCount = DEFAULT_BLOCK_COUNT);
+    ~VideoWriter();
+
+    bool begin();
+    // path is a VFS path including the mount point, e.g. "/sdcard/telloVideos/telloVideo_1.h264"
+    bool open(const char *path, size_t preallocateBytes);
+    size_t write(const uint8_t *data, size_t size);
+    // Waits for the queued blocks; false if that took over 10 s or a write failed
+    bool close();
+    bool isOpen() const { return _open; }
+    // Blocks waiting for the SD card, of blockCount()
+    size_t blocksQueued() const { return _fullBlocks != nullptr ? uxQueueMessagesWaiting(_fullBlocks) : 0; }
+    size_t blockCount() const { return _blockCount; }
+
+    VideoWriterStats stats() const;
+    void printStats() const;
+
+private:
+    struct BlockJob
+    {
+        int16_t block; // CLOSE_MARKER to signal the end of the file
+        uint32_t length;
+    };
+    static const int16_t CLOSE_MARKER = -1;
+
+    size_t _blockSize;
+    size_t _blockCount;
+    uint8_t **_blocks;
+    QueueHandle_t _freeBlocks;
+    QueueHandle_t _fullBlocks;
+    SemaphoreHandle_t _closed;
+    TaskHandle_t _taskHandle;
+
+    int _fd;
+    std::atomic<bool> _open;
+    std::atomic<bool> _inWrite;
+    int16_t _fillBlock;
+    size_t _fillLength;
+    size_t _preallocated;
+
+    mutable portMUX_TYPE _statsLock;
+    VideoWriterStats _stats;
+
+    bool queueFillBlock();
+    static void writerTask(void *pvParameters);
+};
+
+#endif
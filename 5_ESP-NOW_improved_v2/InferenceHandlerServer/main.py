@@ -47,6 +47,8 @@ def upload_and_infer():
     try:
         if file.filename.endswith(".h264"):
             frame_count, predictions = process_h264(file_data, confidence, overlap)
+        elif file.filename.endswith(".mp4"):
+            frame_count, predictions = process_h264(file_data, confidence, overlap, suffix=".mp4")
         elif file.filename.lower().endswith(('.png', '.jpg', '.jpeg')):
             frame_count, predictions = process_image(file_data, confidence, overlap)
         else:
@@ -117,18 +119,21 @@ def process_frame(frame_path, confidence=40, overlap=30):
         logging.error(f"Error processing frame {frame_path}: {str(e)}")
         return []
 
-def process_h264(video_data, confidence=40, overlap=30):
+def process_h264(video_data, confidence=40, overlap=30, suffix=".h264"):
     temp_dir = None
     try:
         temp_dir = tempfile.mkdtemp()
-        video_path = os.path.join(temp_dir, "temp.h264")
+        video_path = os.path.join(temp_dir, "temp" + suffix)
         
         with open(video_path, "wb") as f:
             f.write(video_data)
 
-        # FFMPEG command to extract all I-frames
-        cmd = [
-            'ffmpeg',
+        # FFMPEG command to extract all I-frames. The MP4 sample table flags the keyframes,
+        # so the decoder can skip every other frame instead of decoding the whole stream.
+        cmd = ['ffmpeg']
+        if suffix == ".mp4":
+            cmd += ['-skip_frame', 'nokey']
+        cmd += [
             '-i', video_path.replace('\\', '/'),
             '-vf', "select='eq(pict_type,I)'",
             '-vsync', '0',
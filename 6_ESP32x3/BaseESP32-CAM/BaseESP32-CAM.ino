@@ -21,7 +21,9 @@
 #include <Arduino.h>
 #include <SD_MMC.h>
 #include "camFunctions.h"
+#include "fileIndex.h"
 #include "InferenceHandler.h"
+#include "RetentionManager.h"
 #include <esp_now.h>
 #include <WiFi.h>
 #include <vector>
@@ -44,6 +46,11 @@ const float OVERLAP_THRESHOLD = 25.0;    // 25%
 unsigned long lastRunTime;
 const unsigned long RUN_INTERVAL = 60000; // Run every 1 minute
 
+// SD card retention
+const uint64_t CAM_IMAGES_QUOTA = 512ULL * 1024 * 1024; // Camera images kept on the card
+const uint64_t SD_FREE_RESERVE = 256ULL * 1024 * 1024;  // Evict images not yet analysed below this
+RetentionManager retention(SD_MMC);
+
 // ===================================== Inference Configuration =====================================
 // Instance of the InferenceHandler library
 InferenceHandler inferenceHandler(WIFI_SSID, WIFI_PASSWORD, host, httpsPort);
@@ -62,7 +69,6 @@ uint8_t peerMacAddress[6];
 const float RIPENESS_THRESHOLD = 40.0; // Set your desired threshold
 
 // ===================================== Function Prototypes =====================================
-String getNextFilePath(const String &folderName, const String &prefix, const String &extension);
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
 bool findReceiverMac(const char *ssid, uint8_t *macAddress);
 bool initEspNowPeer(const char* ssid);
@@ -77,6 +83,11 @@ void setup() {
         while (1);
     }
     Serial.println("SD Card mounted successfully");
+    retention.addFolder("/camImages", CAM_IMAGES_QUOTA);
+    retention.setFreeSpaceReserve(SD_FREE_RESERVE);
+    if (!retention.begin()) {
+        Serial.println("Retention manager initialization failed");
+    }
     lastRunTime = millis() - RUN_INTERVAL;
 }
 
@@ -87,6 +98,7 @@ void loop() {
 
     if (currentTime - lastRunTime >= RUN_INTERVAL) {
         Serial.println("Starting operation...");
+        RetentionPause retentionPause(retention); // No deletions while this cycle uses the card
 
         // Initialize Camera and capture image section
         if (!initCamera()) {
@@ -98,6 +110,7 @@ void loop() {
             String imagePath = getNextFilePath("/camImages", "camImg_", ".jpg");
             if (captureAndSaveImage(imagePath)) {
                 Serial.println("Image captured and saved to: " + imagePath);
+                retention.addFile(imagePath);
 
                 deinitCamera();
 
@@ -119,6 +132,7 @@ void loop() {
                     Serial.printf("Ripeness Percentage: %.2f%%\n", imageResult.ripenessPercentage);
 
                     ripenessResults.push_back({imagePath, imageResult.ripenessPercentage});
+                    retention.markUploaded(imagePath);
                 }
                 inferenceHandler.end();
             }
@@ -177,36 +191,6 @@ void loop() {
 }
 
 // ===================================== Helper Functions =====================================
-// Retrieves next file path with an auto-incrementing number.
-String getNextFilePath(const String &folderName, const String &prefix, const String &extension) {
-    if (!SD_MMC.exists(folderName)) {
-        SD_MMC.mkdir(folderName);
-        return folderName + "/" + prefix + "1" + extension;
-    }
-
-    File root = SD_MMC.open(folderName);
-    if (!root || !root.isDirectory()) {
-        return folderName + "/" + prefix + "1" + extension;
-    }
-
-    int maxNumber = 0;
-    File file = root.openNextFile();
-
-    while (file) {
-        String fileName = String(file.name());
-        if (fileName.startsWith(prefix) && fileName.endsWith(extension)) {
-            int startIdx = prefix.length();
-            int endIdx = fileName.indexOf(extension);
-            String numStr = fileName.substring(startIdx, endIdx);
-            int currentNum = numStr.toInt();
-            maxNumber = max(maxNumber, currentNum);
-        }
-        file = root.openNextFile();
-    }
-
-    return folderName + "/" + prefix + String(maxNumber + 1) + extension;
-}
-
 // Callback for ESP-NOW data send status.
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
     if (status != ESP_NOW_SEND_SUCCESS) {
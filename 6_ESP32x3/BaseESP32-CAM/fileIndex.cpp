@@ -0,0 +1,130 @@
+#include "fileIndex.h"
+#include <rom/crc.h>
+
+#define FILE_INDEX_MAGIC 0x58444946 // "FIDX"
+
+struct FileIndexSlot
+{
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t nextNumber;
+  uint32_t crc;
+};
+
+static String indexPath(const String &folder, const String &prefix)
+{
+  return folder + "/." + prefix + "idx";
+}
+
+static uint32_t slotCrc(const FileIndexSlot &slot)
+{
+  return crc32_le(0, (const uint8_t *)&slot, offsetof(FileIndexSlot, crc));
+}
+
+static bool readIndex(fs::FS &fs, const String &path, FileIndexSlot &latest)
+{
+  File file = fs.open(path, FILE_READ);
+  if (!file)
+  {
+    return false;
+  }
+  FileIndexSlot slots[2];
+  size_t len = file.read((uint8_t *)slots, sizeof(slots));
+  file.close();
+
+  bool found = false;
+  for (int i = 0; i < 2 && len >= (i + 1) * sizeof(FileIndexSlot); i++)
+  {
+    if (slots[i].magic != FILE_INDEX_MAGIC || slots[i].crc != slotCrc(slots[i]))
+    {
+      continue;
+    }
+    if (!found || (int32_t)(slots[i].sequence - latest.sequence) > 0)
+    {
+      latest = slots[i];
+      found = true;
+    }
+  }
+  return found;
+}
+
+static bool writeIndex(fs::FS &fs, const String &path, uint32_t sequence, uint32_t nextNumber)
+{
+  FileIndexSlot slot = {FILE_INDEX_MAGIC, sequence, nextNumber, 0};
+  slot.crc = slotCrc(slot);
+
+  // Update in place, the other slot keeps the previous value
+  File file = fs.exists(path) ? fs.open(path, "r+") : fs.open(path, FILE_WRITE);
+  if (!file)
+  {
+    return false;
+  }
+  bool ok = file.seek((sequence & 1) * sizeof(FileIndexSlot)) &&
+            file.write((const uint8_t *)&slot, sizeof(slot)) == sizeof(slot);
+  file.close();
+  return ok;
+}
+
+// One-time recovery: highest existing number + 1
+static int scanNextNumber(fs::FS &fs, const String &folder, const String &prefix, const String &extension, int firstNumber)
+{
+  int maxNumber = firstNumber - 1;
+  File root = fs.open(folder);
+  if (!root || !root.isDirectory())
+  {
+    return firstNumber;
+  }
+
+  String entry = root.getNextFileName();
+  while (entry.length() > 0)
+  {
+    String fileName = entry.substring(entry.lastIndexOf('/') + 1);
+    if (fileName.startsWith(prefix) && fileName.endsWith(extension) &&
+        fileName.length() > prefix.length() + extension.length())
+    {
+      int currentNum = fileName.substring(prefix.length(), fileName.length() - extension.length()).toInt();
+      maxNumber = max(maxNumber, currentNum);
+    }
+    entry = root.getNextFileName();
+  }
+  root.close();
+  return maxNumber + 1;
+}
+
+int allocateFileNumber(fs::FS &fs, const String &folder, const String &prefix, const String &extension, int firstNumber)
+{
+  if (!fs.exists(folder))
+  {
+    fs.mkdir(folder);
+  }
+
+  String path = indexPath(folder, prefix);
+  FileIndexSlot latest;
+  uint32_t sequence = 0;
+  int number;
+  if (readIndex(fs, path, latest))
+  {
+    number = latest.nextNumber;
+    sequence = latest.sequence + 1;
+  }
+  else
+  {
+    Serial.printf("File index %s missing or corrupt, rescanning %s\n", path.c_str(), folder.c_str());
+    number = scanNextNumber(fs, folder, prefix, extension, firstNumber);
+  }
+
+  // Persist before the number is used, so a crash can only leave a gap
+  if (!writeIndex(fs, path, sequence, number + 1))
+  {
+    // The index still holds this number: take the next one from the files themselves, so
+    // the file just written under it is not handed out again
+    Serial.printf("Failed to update file index %s, rescanning %s\n", path.c_str(), folder.c_str());
+    number = max(number, scanNextNumber(fs, folder, prefix, extension, firstNumber));
+  }
+  return number;
+}
+
+String getNextFilePath(const String &folderName, const String &prefix, const String &extension)
+{
+  return folderName + "/" + prefix + String(allocateFileNumber(SD_MMC, folderName, prefix, extension)) + extension;
+}
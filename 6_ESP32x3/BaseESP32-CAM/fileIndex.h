@@ -0,0 +1,22 @@
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD_MMC.h"
+
+// Next-number allocation for numbered files (camImg_1.jpg, camImg_2.jpg, ...) without
+// scanning the folder. The next free number is kept in a small metadata file next to the
+// files (<folder>/.<prefix>idx), so it travels with the card. The file holds two CRC-protected
+// slots written alternately: a torn write only loses the newest slot, and the older one never
+// hands out a number whose file could already exist. The folder is scanned when both slots are
+// missing or corrupt, and on every call while the index cannot be written.
+
+// Reserves and returns the next number for <folder>/<prefix><N><extension>.
+// firstNumber is used for an empty folder.
+int allocateFileNumber(fs::FS &fs, const String &folder, const String &prefix, const String &extension, int firstNumber = 1);
+
+// Reserves the next <folder>/<prefix><N><extension> path on the SD card, numbering from 1
+String getNextFilePath(const String &folderName, const String &prefix, const String &extension);
+
+#endif
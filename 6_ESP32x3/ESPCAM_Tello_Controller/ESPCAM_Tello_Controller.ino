@@ -21,10 +21,11 @@
 #include <Arduino.h>
 #include <SD_MMC.h>
 #include "camFunctions.h"
+#include "fileIndex.h"
 #include "InferenceHandler.h"
 #include "TelloESP32.h"
+#include "ResultLog.h"
 #include <esp_now.h>
-#include <vector>
 
 // ===================================== Configuration =====================================
 // Tello drone credentials
@@ -56,12 +57,14 @@ InferenceHandler inferenceHandler(WIFI_SSID, WIFI_PASSWORD, host, httpsPort);
 // Tello drone controller
 TelloESP32 tello;
 
+// Ring of per-image inference results, survives resets
+ResultLog resultLog(SD_MMC, "/flightResults.log");
+
 // ===================================== Operation State =====================================
 // System operation status
 bool operationStarted = false;
 int currentFlightNumber = 0;
-int currentImageNumber = 0;
-std::vector<String> capturedImagePaths;
+int currentImageNumber = 0; // Images of a flight are numbered from 0 without gaps
 
 // ===================================== Function Prototypes =====================================
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
@@ -70,18 +73,22 @@ void initEspNow();
 int getNextFlightNumber();
 void OnDataRecv(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
 void startCommandRecMode();
+String flightImagePath(int flight, int image);
+void analyseFlight(int flight, int firstImage);
+void reportFlight(int flight);
+void resumeFlightAnalysis();
 
 // Callback for image capture
 void onImageCaptured(camera_fb_t *fb) {
   if (!fb) return;
 
-  String imagePath = "/flightImages/flight" + String(currentFlightNumber) + "/img_" + String(currentImageNumber++) + ".jpg";
+  String imagePath = flightImagePath(currentFlightNumber, currentImageNumber);
 
   File file = SD_MMC.open(imagePath.c_str(), FILE_WRITE);
   if (file) {
     file.write(fb->buf, fb->len);
     file.close();
-    capturedImagePaths.push_back(imagePath);
+    currentImageNumber++;
     Serial.println("Captured image: " + imagePath);
   }
 }
@@ -95,6 +102,10 @@ void setup() {
     while (1)
       ;
   }
+  if (!resultLog.begin()) {
+    Serial.println("Result log unavailable, results will not be kept");
+  }
+  resumeFlightAnalysis();
   startCommandRecMode();
 }
 
@@ -136,55 +147,138 @@ void loop() {
   deinitCamera();
 
   // Process captured images and send results
-  if (!capturedImagePaths.empty()) {
-    if (inferenceHandler.begin()) {
-      float totalRipeness = 0.0;
-      int validResults = 0;
-
-      // Process images and calculate average ripeness
-      for (const String &imagePath : capturedImagePaths) {
-        InferenceResult result;
-        if (inferenceHandler.requestInference(imagePath.c_str(), CONFIDENCE_THRESHOLD, OVERLAP_THRESHOLD, result)) {
-          totalRipeness += result.ripenessPercentage;
-          validResults++;
-          Serial.printf("Image %s ripeness: %.2f%%\n", imagePath.c_str(), result.ripenessPercentage);
-        }
-      }
+  analyseFlight(currentFlightNumber, 0);
+  reportFlight(currentFlightNumber);
+
+  WiFi.disconnect();
+  startCommandRecMode();
+}
+
+// ===================================== Flight Results =====================================
+// The images on the card are the list of what a flight captured; the result log records
+// how far their analysis got. A result's imageSequence holds the flight number in the high
+// half and the image number in the low half.
+String flightImagePath(int flight, int image) {
+  return "/flightImages/flight" + String(flight) + "/img_" + String(image) + ".jpg";
+}
 
-      inferenceHandler.end();
+uint32_t flightImageId(int flight, int image) {
+  return ((uint32_t)flight << 16) | (uint16_t)image;
+}
+
+// Runs inference on the flight's images from firstImage on and logs one result per image,
+// with ripeness -1 when the inference failed, so a reset resumes after the last logged image
+void analyseFlight(int flight, int firstImage) {
+  if (!SD_MMC.exists(flightImagePath(flight, firstImage))) {
+    return;
+  }
+  if (!inferenceHandler.begin()) {
+    Serial.println("InferenceHandler initialization failed!");
+    return;
+  }
+  for (int image = firstImage;; image++) {
+    String imagePath = flightImagePath(flight, image);
+    if (!SD_MMC.exists(imagePath)) {
+      break;
+    }
+    ResultRecord record = {};
+    record.timestamp = time(NULL);
+    record.imageSequence = flightImageId(flight, image);
+    record.source = RESULT_SOURCE_TELLO;
+    record.ripeness = -1.0;
+
+    InferenceResult result;
+    if (inferenceHandler.requestInference(imagePath.c_str(), CONFIDENCE_THRESHOLD, OVERLAP_THRESHOLD, result)) {
+      record.totalObjects = result.totalObjects;
+      record.ripeCount = result.ripeCount;
+      record.unripeCount = result.unripeCount;
+      record.greenCount = result.greenCount;
+      record.ripeness = result.ripenessPercentage;
+      Serial.printf("Image %s ripeness: %.2f%%\n", imagePath.c_str(), result.ripenessPercentage);
+    }
+    resultLog.append(record);
+  }
+  inferenceHandler.end();
+}
 
-      // Calculate average ripeness
-      float averageRipeness = validResults > 0 ? totalRipeness / validResults : 0.0;
+// Sends the average ripeness of the flight's unsent results in the log and flags them as sent
+void reportFlight(int flight) {
+  float totalRipeness = 0.0;
+  int validResults = 0;
+  uint32_t newest = 0;
+  for (uint32_t sequence = resultLog.lastSequence();
+       !resultLog.empty() && sequence > resultLog.lastSentSequence() && sequence >= resultLog.firstSequence(); sequence--) {
+    ResultRecord record;
+    if (!resultLog.read(sequence, record) || record.source != RESULT_SOURCE_TELLO || (int)(record.imageSequence >> 16) != flight) {
+      break;
+    }
+    if (newest == 0) {
+      newest = sequence;
+    }
+    if (record.ripeness >= 0.0) {
+      totalRipeness += record.ripeness;
+      validResults++;
+    }
+  }
+  if (newest == 0) {
+    return; // Nothing was analysed
+  }
 
-      // Send results via ESP-NOW
-      initEspNow();
+  // Calculate average ripeness
+  float averageRipeness = validResults > 0 ? totalRipeness / validResults : 0.0;
 
-      // Create results JSON
-      StaticJsonDocument<200> doc;
-      doc["flight_number"] = currentFlightNumber;
-      doc["average_ripeness"] = averageRipeness;
-      doc["images_processed"] = validResults;
+  // Send results via ESP-NOW
+  initEspNow();
 
-      String jsonString;
-      serializeJson(doc, jsonString);
+  // Create results JSON
+  StaticJsonDocument<200> doc;
+  doc["flight_number"] = flight;
+  doc["average_ripeness"] = averageRipeness;
+  doc["images_processed"] = validResults;
 
-      // Send results
-      esp_err_t result = esp_now_send(receiverMacAddress,
-                                      (uint8_t *)jsonString.c_str(),
-                                      jsonString.length());
+  String jsonString;
+  serializeJson(doc, jsonString);
 
-      if (result == ESP_OK) {
-        Serial.println("Results sent successfully");
-      } else {
-        Serial.println("Error sending results");
-      }
+  // Send results
+  esp_err_t result = esp_now_send(receiverMacAddress,
+                                  (uint8_t *)jsonString.c_str(),
+                                  jsonString.length());
 
-      capturedImagePaths.clear();
-    }
+  if (result == ESP_OK) {
+    Serial.println("Results sent successfully");
+    resultLog.markSent(newest);
+  } else {
+    Serial.println("Error sending results");
   }
+}
 
-  WiFi.disconnect();
-  startCommandRecMode();
+// A reset between landing and the report leaves a flight whose images were not all
+// analysed, or whose report was not sent: both are finished at boot. A card from before
+// the result log is not replayed.
+void resumeFlightAnalysis() {
+  ResultRecord newest;
+  if (resultLog.empty() || !resultLog.read(resultLog.lastSequence(), newest) || newest.source != RESULT_SOURCE_TELLO) {
+    return;
+  }
+  int flight = newest.imageSequence >> 16;
+  int nextImage = (newest.imageSequence & 0xFFFF) + 1;
+  bool resumed = false;
+  if (resultLog.lastSentSequence() != resultLog.lastSequence() || SD_MMC.exists(flightImagePath(flight, nextImage))) {
+    Serial.printf("Resuming the analysis of flight %d\n", flight);
+    analyseFlight(flight, nextImage);
+    reportFlight(flight);
+    resumed = true;
+  }
+  // Flights that landed without any logged result
+  for (flight++; SD_MMC.exists(flightImagePath(flight, 0)); flight++) {
+    Serial.printf("Analysing flight %d\n", flight);
+    analyseFlight(flight, 0);
+    reportFlight(flight);
+    resumed = true;
+  }
+  if (resumed) {
+    WiFi.disconnect();
+  }
 }
 
 // ===================================== Helper Functions =====================================
@@ -203,36 +297,6 @@ void startCommandRecMode() {
   Serial.println("ESP-NOW initialized: Waiting for Start command from Base ESP32-Cam..");
 }
 
-// Helper function to get next file path with auto-incrementing number
-String getNextFilePath(const String &folderName, const String &prefix, const String &extension) {
-  if (!SD_MMC.exists(folderName)) {
-    SD_MMC.mkdir(folderName);
-    return folderName + "/" + prefix + "1" + extension;
-  }
-
-  File root = SD_MMC.open(folderName);
-  if (!root || !root.isDirectory()) {
-    return folderName + "/" + prefix + "1" + extension;
-  }
-
-  int maxNumber = 0;
-  File file = root.openNextFile();
-
-  while (file) {
-    String fileName = String(file.name());
-    if (fileName.startsWith(prefix) && fileName.endsWith(extension)) {
-      int startIdx = prefix.length();
-      int endIdx = fileName.indexOf(extension);
-      String numStr = fileName.substring(startIdx, endIdx);
-      int currentNum = numStr.toInt();
-      maxNumber = max(maxNumber, currentNum);
-    }
-    file = root.openNextFile();
-  }
-
-  return folderName + "/" + prefix + String(maxNumber + 1) + extension;
-}
-
 // Helper function to initialize ESP-NOW for data transmission
 void initEspNow() {
   // Disconnect from any existing WiFi
@@ -335,29 +399,5 @@ void OnDataRecv(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, in
 
 // Helper function to get next flight number
 int getNextFlightNumber() {
-  String basePath = "/flightImages";
-  if (!SD_MMC.exists(basePath)) {
-    SD_MMC.mkdir(basePath);
-    return 0;
-  }
-
-  File root = SD_MMC.open(basePath);
-  if (!root || !root.isDirectory()) {
-    return 0;
-  }
-
-  int maxNumber = -1;
-  File file = root.openNextFile();
-
-  while (file) {
-    String fileName = String(file.name());
-    if (fileName.startsWith("flight")) {
-      // Extract number from "flightX" folder name
-      int num = fileName.substring(6).toInt();
-      maxNumber = max(maxNumber, num);
-    }
-    file = root.openNextFile();
-  }
-
-  return maxNumber + 1;
-}
\ No newline at end of file
+  return allocateFileNumber(SD_MMC, "/flightImages", "flight", "", 0);
+}
@@ -0,0 +1,66 @@
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Fixed packet slots (PSRAM when present) between one producer, the video receive task,
+// and up to MAX_CONSUMERS readers (SD writer, uploader, analyser). The producer never waits:
+// it overwrites the oldest slot and publishes the packet number with a release store.
+// Each consumer keeps its own cursor; one that falls more than a ring behind skips to the
+// oldest packet still held and counts the packets it missed as overruns. Slots carry the
+// number of the packet they hold, so a consumer also notices when its slot was reused
+// while it was copying. No locks are taken on either side.
+class PacketRing
+{
+public:
+    static const size_t DEFAULT_SLOT_COUNT = 256; // 512 KB, about 4 s of 1 Mbps video
+    static const size_t DEFAULT_SLOT_SIZE = 2048; // Tello video packets are 1460 bytes
+    static const int MAX_CONSUMERS = 4;
+
+    PacketRing(size_t slotCount = DEFAULT_SLOT_COUNT, size_t slotSize = DEFAULT_SLOT_SIZE);
+    ~PacketRing();
+
+    bool begin();
+    size_t slotSize() const { return _slotSize; }
+
+    // Producer: copies the packet into the next slot and wakes the consumers.
+    // False if the packet is larger than a slot or the ring was not allocated.
+    bool push(const uint8_t *data, size_t size);
+
+    // Registers a consumer starting at the next packet; task is woken by push().
+    // Returns the consumer id, or -1 when all cursors are taken.
+    int addConsumer(TaskHandle_t task = xTaskGetCurrentTaskHandle());
+    void removeConsumer(int consumer);
+    // Moves the consumer's cursor to the next packet, dropping everything unread
+    void skipToHead(int consumer);
+
+    // Copies the consumer's next packet into out, waiting up to waitTicks for one.
+    // Returns its size, or 0 if none arrived.
+    size_t read(int consumer, uint8_t *out, size_t size, TickType_t waitTicks = 0);
+
+    uint32_t packetsPushed() const { return _head.load(std::memory_order_relaxed); }
+    uint32_t packetsRead(int consumer) const { return _consumers[consumer].packets; }
+    uint32_t overruns(int consumer) const { return _consumers[consumer].overruns; }
+
+private:
+    struct Consumer
+    {
+        std::atomic<TaskHandle_t> task;  // nullptr while the cursor is free
+        uint32_t next;                   // Number of the next packet to read
+        uint32_t packets;
+        uint32_t overruns;
+    };
+
+    size_t _slotCount;
+    size_t _slotSize;
+    uint8_t *_data;                      // _slotCount * _slotSize bytes
+    uint16_t *_lengths;
+    std::atomic<uint32_t> *_slotPacket;  // Packet number held by each slot, 0 while it is written
+    std::atomic<uint32_t> _head;         // Number of the last published packet (first is 1)
+    Consumer _consumers[MAX_CONSUMERS];
+};
+
+#endif
@@ -1,6 +1,20 @@
 #include "TelloESP32.h"
 #include <Arduino.h>
 
+#define TELLO_VIDEO_PACKET_MAX 2048      // Tello sends 1460-byte H.264 fragments
+#define TELLO_VIDEO_SOCKET_BUFFER 16384  // lwIP receive buffer (used when CONFIG_LWIP_SO_RCVBUF is set)
+#define TELLO_POLL_MS 100                // Receive tasks check their stop flag this often
+#define TELLO_STATE_PACKET_MAX 256       // State packets are about 150 characters
+#define TELLO_STATE_FRESH_MS 1000        // Older telemetry falls back to a "?" query
+#define TELLO_RC_MIN_HZ 20
+#define TELLO_RC_MAX_HZ 50
+#define TELLO_MAX_EXTENSIONS 3           // Extra waits for a motion command that is still moving
+#define TELLO_MOTION_YAW_DEG 3           // Telemetry changes that count as movement
+#define TELLO_MOTION_HEIGHT_CM 10
+#define TELLO_MOTION_TRAVEL_CM 10
+#define TELLO_MOTION_DONE_PERCENT 50     // Of the commanded change, before a lost reply counts as done
+#define TELLO_TAKEOFF_CLIMB_CM 50        // Takeoff climbs to about 80 cm
+
 //  Constants for video settings
 const std::string TelloESP32::RESOLUTION_480P = "low";
 const std::string TelloESP32::RESOLUTION_720P = "high";
@@ -10,20 +24,134 @@ const std::string TelloESP32::FPS_30 = "high";
 
 // Constructor to initialize member variables
 TelloESP32::TelloESP32()
-    : telloAddr(IPAddress(192, 168, 10, 1)),
+    : commandSocket(-1),
+      videoSocket(-1),
+      stateSocket(-1),
+      telloAddr(IPAddress(192, 168, 10, 1)),
       telloPort(8889),
       localPort(9000),
       videoPort(11111),
+      statePort(8890),
       commandTimeout(500),
       videoStreamTaskHandle(nullptr),
+      videoDispatchTaskHandle(nullptr),
       receiveResponseTaskHandle(nullptr),
+      receiveStateTaskHandle(nullptr),
       connectionMonitorTaskHandle(nullptr),
-      responseSemaphore(xSemaphoreCreateBinary()), // Initialize semaphore
+      rcTaskHandle(nullptr),
+      responseQueue(xQueueCreate(4, sizeof(TelloResponse))),
       connected(false),
-      latestResponse("")
+      receiving(false),
+      streaming(false),
+      videoPacketsReceived(0),
+      videoPacketsDropped(0),
+      commandPending(false),
+      commandStartMs(0),
+      commandTimeoutMs(0),
+      commandAttempt(0),
+      pendingCommand(),
+      motionWatch(false),
+      motionDone(false),
+      motionNow(false),
+      motionExtensions(0),
+      watchPackets(0),
+      watchMs(0),
+      watchYaw(0),
+      watchHeight(0),
+      baseHeight(0),
+      watchAxis(MOTION_NONE),
+      watchTarget(0),
+      watchProgress(0),
+      watchDirX(0),
+      watchDirY(0),
+      rcTarget(0),
+      rcTargetMs(0),
+      rcRunning(false),
+      rcPeriodMs(1000 / 30),
+      rcWatchdogMs(500),
+      rcPacketsSent(0),
+      rcWatchdogStops(0)
 {
 }
 
+// Opens a UDP socket bound to the given local port
+int TelloESP32::openUdpSocket(uint16_t port, int receiveBufferSize)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (receiveBufferSize > 0)
+    {
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Blocks until the socket has a datagram or the timeout expires
+bool TelloESP32::waitReadable(int socket, int timeoutMs)
+{
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socket, &readSet);
+    struct timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    return select(socket + 1, &readSet, nullptr, nullptr, &timeout) > 0;
+}
+
+// The receive tasks clear their handle right before deleting themselves
+void TelloESP32::waitForTaskExit(TaskHandle_t &handle, int timeoutMs)
+{
+    unsigned long startTime = millis();
+    while (*(volatile TaskHandle_t *)&handle != nullptr && millis() - startTime < (unsigned long)timeoutMs)
+    {
+        delay(10);
+    }
+}
+
+// Tasks blocked in select() must not be deleted from outside (lwIP keeps a reference to
+// their wait state), so they are asked to stop and exit within one poll interval
+void TelloESP32::stopReceiving()
+{
+    receiving = false;
+    waitForTaskExit(receiveResponseTaskHandle, 2 * TELLO_POLL_MS);
+    waitForTaskExit(receiveStateTaskHandle, 2 * TELLO_POLL_MS);
+    if (commandSocket >= 0)
+    {
+        close(commandSocket);
+        commandSocket = -1;
+    }
+    if (stateSocket >= 0)
+    {
+        close(stateSocket);
+        stateSocket = -1;
+    }
+}
+
+void TelloESP32::stopStreaming()
+{
+    streaming = false;
+    waitForTaskExit(videoStreamTaskHandle, 2 * TELLO_POLL_MS);
+    waitForTaskExit(videoDispatchTaskHandle, 2 * TELLO_POLL_MS);
+    if (videoSocket >= 0)
+    {
+        close(videoSocket);
+        videoSocket = -1;
+    }
+}
+
 // Connect to Tello drone
 bool TelloESP32::connect(const char *ssid, const char *password, unsigned long timeout_ms)
 {
@@ -46,18 +174,41 @@ bool TelloESP32::connect(const char *ssid, const char *password, unsigned long t
     Serial.println(" Connection established!");
     connected = true;
     
-    if (udp.begin(localPort))
+    commandSocket = openUdpSocket(localPort, 0);
+    if (commandSocket >= 0)
     {
-        // Create the receiveResponse task
+        // Create the receiveResponse task, on the app core away from the WiFi stack.
+        // It sleeps in select() until a response arrives.
+        receiving = true;
         xTaskCreatePinnedToCore(
             TelloESP32::receiveResponseTask,
             "receiveResponseTask",
-            10000,
+            4096,
             this,
-            1,
+            3,
             &receiveResponseTaskHandle,
-            0
+            1
         );
+
+        // State packets start arriving once the drone has accepted "command"
+        stateSocket = openUdpSocket(statePort, 0);
+        if (stateSocket >= 0)
+        {
+            telemetryState.reset();
+            xTaskCreatePinnedToCore(
+                TelloESP32::receiveStateTask,
+                "receiveStateTask",
+                3072,
+                this,
+                2,
+                &receiveStateTaskHandle,
+                1
+            );
+        }
+        else
+        {
+            Serial.println("Failed to open state socket, telemetry will be queried");
+        }
         
         // Create the connection monitor task
         xTaskCreatePinnedToCore(
@@ -71,7 +222,9 @@ bool TelloESP32::connect(const char *ssid, const char *password, unsigned long t
         );
         
         delay(1000); // Increased delay for Tello response
-        return sendCommandWithRetry("command", "ok", 5, 2000, 6000);
+        // The first reply can take seconds while the drone starts its SDK mode; the timeout
+        // backs off from 1 s to 8 s over the attempts
+        return sendCommandWithRetry(telloCommand(TELLO_COMMAND).name, telloCommand(TELLO_COMMAND).expected);
     }
     return false;
 }
@@ -79,17 +232,13 @@ bool TelloESP32::connect(const char *ssid, const char *password, unsigned long t
 // Disconnect from Tello drone
 void TelloESP32::disconnect()
 {
+    stopRCLoop();
     stopVideoStream();
-    udp.stop();
-    videoUdp.stop();
+    stopStreaming();
+    stopReceiving();
     connected = false;
 
     // Clean up tasks if they exist (important to prevent crashes)
-    if (receiveResponseTaskHandle)
-    {
-        vTaskDelete(receiveResponseTaskHandle);
-        receiveResponseTaskHandle = nullptr;
-    }
     if (connectionMonitorTaskHandle)
     {
         vTaskDelete(connectionMonitorTaskHandle);
@@ -98,18 +247,18 @@ void TelloESP32::disconnect()
     WiFi.disconnect(true);  
 }
 
-// Send a command to Tello drone
-void TelloESP32::sendCommand(const std::string &command)
+bool TelloESP32::sendPacket(const char *command, size_t length)
 {
-    Serial.print("Sending command: ");
-    Serial.println(command.c_str());
-    udp.beginPacket(telloAddr, telloPort);
-    udp.write(reinterpret_cast<const uint8_t *>(command.c_str()), command.length());
-    udp.endPacket();
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(telloPort);
+    addr.sin_addr.s_addr = (uint32_t)telloAddr;
+    return commandSocket >= 0 &&
+           sendto(commandSocket, command, length, 0, (struct sockaddr *)&addr, sizeof(addr)) == (int)length;
 }
 
 // Send a command with retries and timeout
-bool TelloESP32::sendCommandWithRetry(const std::string &command, const std::string &expectedResponse, int retries, int delayMs, int timeoutMs)
+bool TelloESP32::sendCommandWithRetry(const char *command, const char *expectedResponse, int retries, int delayMs, int timeoutMs)
 {
     if (!connected)
     {
@@ -117,8 +266,9 @@ bool TelloESP32::sendCommandWithRetry(const std::string &command, const std::str
         return false;
     }
     Serial.print("Sending command: \"");
-    Serial.print(command.c_str());
+    Serial.print(command);
     Serial.print("\" ");
+    char response[sizeof(TelloResponse::text)];
     for (int i = 0; i < retries; ++i)
     {
         if (!connected)
@@ -126,74 +276,366 @@ bool TelloESP32::sendCommandWithRetry(const std::string &command, const std::str
             Serial.println("Not connected to Tello drone!");
             return false;
         }
-        
-        std::string response = sendCommandWithReturn(command, timeoutMs);
-        if (!response.empty())
+        if (i > 0)
+        {
+            commandTimings.onRetry(command);
+        }
+
+        if (sendCommandWithReturn(command, response, sizeof(response), timeoutMs, i))
         {
             Serial.print(" Received response: ");
-            Serial.println(response.c_str());
-            if (response == expectedResponse)
+            Serial.println(response);
+            if (strcmp(response, expectedResponse) == 0)
             {
                 return true; // Desired response achieved
             }
+            // An error reply comes back at once: give the drone a moment before re-sending
+            delay(delayMs == TIMEOUT_AUTO ? commandTimings.retryDelayMs(i) : delayMs);
         }
         else
         {
             Serial.print("Retrying... ");
+            // The timeout already waited (and backs off), so the adaptive path re-sends at once
+            if (delayMs != TIMEOUT_AUTO)
+            {
+                delay(delayMs);
+            }
         }
-        delay(delayMs);
     }
     Serial.println("Command failed after max retries.");
     return false;
 }
 
-std::string TelloESP32::sendCommandWithReturn(const std::string &command, int timeoutMs)
+// Copies the reply into response; false on timeout
+bool TelloESP32::sendCommandWithReturn(const char *command, char *response, size_t responseSize, int timeoutMs, int attempt)
 {
-    latestResponse = "";
-
-    udp.beginPacket(telloAddr, telloPort);
-    udp.write(reinterpret_cast<const uint8_t *>(command.c_str()), command.length());
-    udp.endPacket();
+    settleLateReplies();
+    TelloResponse reply;
+    unsigned long waitMs = timeoutMs == TIMEOUT_AUTO ? commandTimings.timeoutMs(command, attempt) : timeoutMs;
+    startMotionWatch(command);
+    responseMatcher.begin(command, millis());
+    if (!sendPacket(command, strlen(command)))
+    {
+        responseMatcher.abandon(millis());
+        Serial.println(" Failed to send command.");
+        return false;
+    }
 
     unsigned long startTime = millis();
-
-    unsigned long lastDotTime = millis();
-    // Wait for response or timeout
-    while ((millis() - startTime) < timeoutMs)
+    unsigned long lastDotTime = startTime;
+    // Wait for the matching response or timeout, printing a dot every 500 ms
+    while (true)
     {
-        if (xSemaphoreTake(responseSemaphore, pdMS_TO_TICKS(100)) == pdTRUE)
+        unsigned long elapsed = millis() - startTime;
+        if (elapsed >= waitMs)
         {
-            // Received a response
-            return latestResponse;
+            if (!extendMotionWait(command))
+            {
+                break;
+            }
+            waitMs += commandTimings.extensionMs();
+            Serial.print(" (still moving)");
+            continue;
+        }
+        if (xQueueReceive(responseQueue, &reply, pdMS_TO_TICKS(min(waitMs - elapsed, 500UL))) == pdTRUE)
+        {
+            if (responseMatcher.accept(reply.text, reply.receivedMs))
+            {
+                snprintf(response, responseSize, "%s", reply.text);
+                commandTimings.onReply(command, reply.text, reply.receivedMs - startTime, attempt == 0);
+                return true;
+            }
+            Serial.printf(" (discarded stale reply \"%s\")", reply.text);
         }
+        checkMotion();
         if ((millis() - lastDotTime) >= 500)
         {
             Serial.print(".");
             lastDotTime = millis();
         }
-        vTaskDelay(10); // Small delay to yield
+    }
+    responseMatcher.abandon(millis(), commandTimings.lateReplyMs(command));
+    commandTimings.onTimeout(command);
+    if (motionWatch && motionDone)
+    {
+        // The drone flew it: the reply was lost, and sending it again would fly it twice
+        commandTimings.onInferred(command);
+        Serial.print(" Reply lost, the move was seen in telemetry.");
+        snprintf(response, responseSize, "ok");
+        return true;
     }
     Serial.println(" Command timed out.");
-    return ""; // Return empty string if timeout occurs
+    return false;
+}
+
+// Baseline for telling from telemetry whether a motion command is being carried out, and
+// the change it commands: yaw for turns, height for up/down/takeoff/land, distance along
+// the commanded direction for the other moves (go along its larger part)
+void TelloESP32::startMotionWatch(const char *command)
+{
+    TelloTelemetry telemetry;
+    motionWatch = TelloRttEstimator::isMotion(TelloRttEstimator::classify(command)) && freshTelemetry(telemetry);
+    motionDone = false;
+    motionNow = false;
+    motionExtensions = 0;
+    watchAxis = MOTION_NONE;
+    if (!motionWatch)
+    {
+        return;
+    }
+    watchPackets = telemetry.packets;
+    watchMs = telemetry.receivedMs;
+    watchYaw = telemetry.yaw;
+    baseHeight = watchHeight = telemetry.height;
+    watchProgress = 0;
+
+    int args[3] = {};
+    char name[16] = {};
+    int count = sscanf(command, "%15s %d %d %d", name, &args[0], &args[1], &args[2]) - 1;
+    if ((strcmp(name, "cw") == 0 || strcmp(name, "ccw") == 0) && count >= 1)
+    {
+        watchAxis = MOTION_YAW;
+        watchTarget = name[1] == 'w' ? args[0] : -args[0];
+    }
+    else if ((strcmp(name, "up") == 0 || strcmp(name, "down") == 0) && count >= 1)
+    {
+        watchAxis = MOTION_HEIGHT;
+        watchTarget = name[0] == 'u' ? args[0] : -args[0];
+    }
+    else if (strcmp(name, "takeoff") == 0)
+    {
+        watchAxis = MOTION_HEIGHT;
+        watchTarget = TELLO_TAKEOFF_CLIMB_CM;
+    }
+    else if (strcmp(name, "land") == 0 && telemetry.height > 2 * TELLO_MOTION_HEIGHT_CM)
+    {
+        watchAxis = MOTION_HEIGHT;
+        watchTarget = -telemetry.height;
+    }
+    else if (strcmp(name, "go") == 0 && count >= 3)
+    {
+        // x forward, y left, z up
+        float length = sqrtf((float)args[0] * args[0] + (float)args[1] * args[1]);
+        bool horizontal = length > 0 && length >= abs(args[2]);
+        watchAxis = horizontal ? MOTION_TRAVEL : MOTION_HEIGHT;
+        watchTarget = horizontal ? length : args[2];
+        watchDirX = horizontal ? args[0] / length : 0;
+        watchDirY = horizontal ? -args[1] / length : 0;
+    }
+    else if (count >= 1 && (strcmp(name, "forward") == 0 || strcmp(name, "back") == 0 ||
+                            strcmp(name, "left") == 0 || strcmp(name, "right") == 0))
+    {
+        // vgx forward, vgy right
+        watchAxis = MOTION_TRAVEL;
+        watchTarget = args[0];
+        watchDirX = name[0] == 'f' ? 1 : name[0] == 'b' ? -1 : 0;
+        watchDirY = name[0] == 'r' ? 1 : name[0] == 'l' ? -1 : 0;
+    }
+}
+
+// Compares each new state packet with the previous one. Any movement keeps the wait going;
+// the command is only taken as done once the change it commands is seen, in its direction,
+// so drift while hovering does not count.
+void TelloESP32::checkMotion()
+{
+    TelloTelemetry telemetry;
+    if (!motionWatch || !freshTelemetry(telemetry) || telemetry.packets == watchPackets)
+    {
+        return;
+    }
+    motionNow = telemetry.vgx != 0 || telemetry.vgy != 0 || telemetry.vgz != 0 ||
+                abs(telemetry.yaw - watchYaw) >= TELLO_MOTION_YAW_DEG || abs(telemetry.height - watchHeight) >= TELLO_MOTION_HEIGHT_CM;
+
+    float minimum = 0;
+    switch (watchAxis)
+    {
+    case MOTION_YAW:
+        // Summed per packet, so a full turn does not wrap back to zero
+        watchProgress += (telemetry.yaw - watchYaw + 540) % 360 - 180;
+        minimum = TELLO_MOTION_YAW_DEG;
+        break;
+    case MOTION_HEIGHT:
+        watchProgress = telemetry.height - baseHeight;
+        minimum = TELLO_MOTION_HEIGHT_CM;
+        break;
+    case MOTION_TRAVEL:
+        // dm/s over ms, in cm
+        watchProgress += (telemetry.vgx * watchDirX + telemetry.vgy * watchDirY) * (uint32_t)(telemetry.receivedMs - watchMs) / 100.0f;
+        minimum = TELLO_MOTION_TRAVEL_CM;
+        break;
+    default:
+        break;
+    }
+    if (watchAxis != MOTION_NONE)
+    {
+        float needed = max(fabsf(watchTarget) * TELLO_MOTION_DONE_PERCENT / 100, minimum);
+        motionDone = motionDone || (watchTarget < 0 ? -watchProgress : watchProgress) >= needed;
+    }
+    watchPackets = telemetry.packets;
+    watchMs = telemetry.receivedMs;
+    watchYaw = telemetry.yaw;
+    watchHeight = telemetry.height;
+}
+
+bool TelloESP32::extendMotionWait(const char *command)
+{
+    checkMotion();
+    if (!motionWatch || !motionNow || motionExtensions >= TELLO_MAX_EXTENSIONS)
+    {
+        return false;
+    }
+    motionExtensions++;
+    commandTimings.onExtension(command);
+    return true;
+}
+
+void TelloESP32::printCommandStats() const
+{
+    for (int i = 0; i < TELLO_CLASS_COUNT; i++)
+    {
+        TelloCommandClass commandClass = (TelloCommandClass)i;
+        const TelloRttStats &stats = commandTimings.stats(commandClass);
+        if (stats.samples == 0 && stats.timeouts == 0)
+        {
+            continue;
+        }
+        bool ratio = TelloRttEstimator::isMotion(commandClass);
+        Serial.printf("%-9s %5u replies, smoothed %.2f%s (dev %.2f), last %u ms, %u timeouts, %u retries, %u extended, %u inferred\n",
+                      TelloRttEstimator::className(commandClass), (unsigned)stats.samples, stats.smoothed,
+                      ratio ? "x" : " ms", stats.deviation, (unsigned)stats.lastMs, (unsigned)stats.timeouts,
+                      (unsigned)stats.retries, (unsigned)stats.extensions, (unsigned)stats.inferred);
+    }
+}
+
+// Settle replies that came in while nothing was waiting (late or duplicated)
+void TelloESP32::settleLateReplies()
+{
+    TelloResponse reply;
+    while (xQueueReceive(responseQueue, &reply, 0) == pdTRUE)
+    {
+        responseMatcher.accept(reply.text, reply.receivedMs);
+    }
+}
+
+bool TelloESP32::beginCommand(const char *command, int timeoutMs, int attempt)
+{
+    if (!connected || commandPending)
+    {
+        return false;
+    }
+    settleLateReplies();
+    startMotionWatch(command);
+    responseMatcher.begin(command, millis());
+    if (!sendPacket(command, strlen(command)))
+    {
+        responseMatcher.abandon(millis());
+        return false;
+    }
+    if (attempt > 0)
+    {
+        commandTimings.onRetry(command);
+    }
+    snprintf(pendingCommand, sizeof(pendingCommand), "%s", command);
+    commandPending = true;
+    commandAttempt = attempt;
+    commandStartMs = millis();
+    commandTimeoutMs = timeoutMs == TIMEOUT_AUTO ? commandTimings.timeoutMs(command, attempt) : timeoutMs;
+    return true;
+}
+
+TelloCommandStatus TelloESP32::pollCommand(char *reply, size_t replySize)
+{
+    if (!commandPending)
+    {
+        return TELLO_COMMAND_IDLE;
+    }
+    TelloResponse response;
+    while (xQueueReceive(responseQueue, &response, 0) == pdTRUE)
+    {
+        if (responseMatcher.accept(response.text, response.receivedMs))
+        {
+            snprintf(reply, replySize, "%s", response.text);
+            commandTimings.onReply(pendingCommand, response.text, response.receivedMs - commandStartMs, commandAttempt == 0);
+            commandPending = false;
+            return TELLO_COMMAND_REPLIED;
+        }
+    }
+    checkMotion();
+    if (millis() - commandStartMs >= commandTimeoutMs)
+    {
+        if (extendMotionWait(pendingCommand))
+        {
+            commandTimeoutMs += commandTimings.extensionMs();
+            return TELLO_COMMAND_PENDING;
+        }
+        responseMatcher.abandon(millis(), commandTimings.lateReplyMs(pendingCommand));
+        commandTimings.onTimeout(pendingCommand);
+        commandPending = false;
+        if (motionWatch && motionDone)
+        {
+            // Flown but the reply was lost: report it done instead of having it re-sent
+            commandTimings.onInferred(pendingCommand);
+            snprintf(reply, replySize, "ok");
+            return TELLO_COMMAND_REPLIED;
+        }
+        return TELLO_COMMAND_TIMED_OUT;
+    }
+    return TELLO_COMMAND_PENDING;
 }
 
 // Task to receive responses from Tello drone
 void TelloESP32::receiveResponseTask(void *pvParameters)
 {
     TelloESP32 *tello = static_cast<TelloESP32 *>(pvParameters); // Explicitly cast void pointer
-    while (true)
+    TelloResponse response;
+    while (tello->receiving)
+    {
+        if (!waitReadable(tello->commandSocket, TELLO_POLL_MS))
+        {
+            continue;
+        }
+        int len = recv(tello->commandSocket, response.text, sizeof(response.text) - 1, MSG_DONTWAIT);
+        if (len <= 0)
+        {
+            continue;
+        }
+        response.text[len] = '\0';
+        response.receivedMs = millis();
+        // Keep the newest responses if nobody is waiting
+        if (xQueueSend(tello->responseQueue, &response, 0) != pdTRUE)
+        {
+            TelloResponse oldest;
+            xQueueReceive(tello->responseQueue, &oldest, 0);
+            xQueueSend(tello->responseQueue, &response, 0);
+        }
+    }
+    tello->receiveResponseTaskHandle = nullptr;
+    vTaskDelete(NULL);
+}
+
+// Task to parse the state packets into the telemetry snapshot
+void TelloESP32::receiveStateTask(void *pvParameters)
+{
+    TelloESP32 *tello = static_cast<TelloESP32 *>(pvParameters);
+    char packet[TELLO_STATE_PACKET_MAX];
+    TelloTelemetry telemetry = {};
+    while (tello->receiving)
     {
-        char buffer[256]; // Increased buffer size
-        int packetSize = tello->udp.parsePacket();
-        if (packetSize)
+        if (!waitReadable(tello->stateSocket, TELLO_POLL_MS))
+        {
+            continue;
+        }
+        int len = recv(tello->stateSocket, packet, sizeof(packet), MSG_DONTWAIT);
+        // Fields missing from a packet keep their previous value
+        if (len > 0 && TelloState::parse(packet, len, telemetry))
         {
-            tello->udp.read(buffer, packetSize);         // Read up to packetSize bytes
-            buffer[packetSize] = '\0';                   // Null-terminate for string conversion
-            tello->latestResponse = std::string(buffer); // Store it in the member variable
-            xSemaphoreGive(tello->responseSemaphore);    // Signal that a response has been received
+            telemetry.receivedMs = millis();
+            telemetry.packets++;
+            tello->telemetryState.publish(telemetry);
         }
-        vTaskDelay(1); // Yield to other tasks
     }
+    tello->receiveStateTaskHandle = nullptr;
+    vTaskDelete(NULL);
 }
 
 // Task to monitor WiFi connection
@@ -209,15 +651,8 @@ void TelloESP32::connectionMonitorTask(void *pvParameters)
             // Set connection state
             tello->connected = false;
             
-            // Stop UDP communications
-            tello->udp.stop();
-            tello->videoUdp.stop();
-            
             // Stop video streaming if active
-            if (tello->videoStreamTaskHandle != nullptr) {
-                vTaskDelete(tello->videoStreamTaskHandle);
-                tello->videoStreamTaskHandle = nullptr;
-            }
+            tello->stopStreaming();
             
             // Call user callback if registered
             if (tello->connectionLostCallback)
@@ -225,13 +660,9 @@ void TelloESP32::connectionMonitorTask(void *pvParameters)
                 tello->connectionLostCallback();
             }
 
-            // Only receiveResponseTask needs to be stopped
+            // Only the receive tasks need to be stopped
             // Don't stop connection monitor (this task)
-            if (tello->receiveResponseTaskHandle)
-            {
-                vTaskDelete(tello->receiveResponseTaskHandle);
-                tello->receiveResponseTaskHandle = nullptr;
-            }
+            tello->stopReceiving();
 
             Serial.println("Cleanup complete, awaiting reconnection...");
             
@@ -245,59 +676,197 @@ void TelloESP32::connectionMonitorTask(void *pvParameters)
     vTaskDelete(NULL); // Delete this task
 }
 
-// Flight control commands
-bool TelloESP32::takeoff() { return sendCommandWithRetry("takeoff"); }
-bool TelloESP32::land() { return sendCommandWithRetry("land"); }
-bool TelloESP32::up(int cm) { return sendCommandWithRetry("up " + std::to_string(constrain(cm, 20, 500))); }
-bool TelloESP32::down(int cm) { return sendCommandWithRetry("down " + std::to_string(constrain(cm, 20, 500))); }
-bool TelloESP32::left(int cm) { return sendCommandWithRetry("left " + std::to_string(constrain(cm, 20, 500))); }
-bool TelloESP32::right(int cm) { return sendCommandWithRetry("right " + std::to_string(constrain(cm, 20, 500))); }
-bool TelloESP32::forward(int cm) { return sendCommandWithRetry("forward " + std::to_string(constrain(cm, 20, 500))); }
-bool TelloESP32::back(int cm) { return sendCommandWithRetry("back " + std::to_string(constrain(cm, 20, 500))); }
-bool TelloESP32::rotateClockwise(int degrees) { return sendCommandWithRetry("cw " + std::to_string(constrain(degrees, 1, 360))); }
-bool TelloESP32::rotateCounterClockwise(int degrees) { return sendCommandWithRetry("ccw " + std::to_string(constrain(degrees, 1, 360))); }
+// Formats a table command on the stack and sends it until the expected reply arrives
+bool TelloESP32::sendTableCommand(TelloCommandId id, int value)
+{
+    char command[TELLO_COMMAND_MAX];
+    if (telloFormatCommand(command, sizeof(command), id, &value, telloCommand(id).argCount) == 0)
+    {
+        return false;
+    }
+    return sendCommandWithRetry(command, telloCommand(id).expected);
+}
+
+bool TelloESP32::sendTableCommand(TelloCommandId id, const char *word)
+{
+    char command[TELLO_COMMAND_MAX];
+    if (telloFormatCommand(command, sizeof(command), id, word) == 0)
+    {
+        Serial.printf("Invalid argument \"%s\" for %s\n", word, telloCommand(id).name);
+        return false;
+    }
+    return sendCommandWithRetry(command, telloCommand(id).expected);
+}
+
+// Flight control commands, arguments are clamped to the ranges in TELLO_COMMANDS
+bool TelloESP32::takeoff() { return sendTableCommand(TELLO_TAKEOFF, 0); }
+bool TelloESP32::land() { return sendTableCommand(TELLO_LAND, 0); }
+bool TelloESP32::up(int cm) { return sendTableCommand(TELLO_UP, cm); }
+bool TelloESP32::down(int cm) { return sendTableCommand(TELLO_DOWN, cm); }
+bool TelloESP32::left(int cm) { return sendTableCommand(TELLO_LEFT, cm); }
+bool TelloESP32::right(int cm) { return sendTableCommand(TELLO_RIGHT, cm); }
+bool TelloESP32::forward(int cm) { return sendTableCommand(TELLO_FORWARD, cm); }
+bool TelloESP32::back(int cm) { return sendTableCommand(TELLO_BACK, cm); }
+bool TelloESP32::rotateClockwise(int degrees) { return sendTableCommand(TELLO_CW, degrees); }
+bool TelloESP32::rotateCounterClockwise(int degrees) { return sendTableCommand(TELLO_CCW, degrees); }
 bool TelloESP32::flip(char direction)
 {
-    std::string command = "flip ";
-    command += direction;
-    return sendCommandWithRetry(command);
+    char word[2] = {direction, '\0'};
+    return sendTableCommand(TELLO_FLIP, word);
+}
+
+bool TelloESP32::sendRC(int leftRight, int forwardBack, int upDown, int yaw)
+{
+    if (!connected)
+    {
+        return false;
+    }
+    int sticks[4] = {leftRight, forwardBack, upDown, yaw};
+    char command[TELLO_COMMAND_MAX];
+    size_t length = telloFormatCommand(command, sizeof(command), TELLO_RC, sticks, 4);
+    return length > 0 && sendPacket(command, length);
+}
+
+bool TelloESP32::startRCLoop(int hz, int watchdogMs)
+{
+    if (!connected || rcTaskHandle != nullptr)
+    {
+        return false;
+    }
+    rcPeriodMs = 1000 / constrain(hz, TELLO_RC_MIN_HZ, TELLO_RC_MAX_HZ);
+    rcWatchdogMs = max(watchdogMs, 2 * rcPeriodMs);
+    rcTarget = 0;
+    rcTargetMs = millis();
+    rcRunning = true;
+    if (xTaskCreatePinnedToCore(
+            TelloESP32::rcTask,
+            "rcTask",
+            4096, // sendto() through lwIP and the watchdog's Serial.println
+            this,
+            3,
+            &rcTaskHandle,
+            1) != pdPASS)
+    {
+        rcRunning = false;
+        rcTaskHandle = nullptr;
+        Serial.println("Failed to start the rc task");
+        return false;
+    }
+    return true;
+}
+
+void TelloESP32::stopRCLoop()
+{
+    if (rcTaskHandle == nullptr)
+    {
+        return;
+    }
+    rcRunning = false;
+    waitForTaskExit(rcTaskHandle, 2 * rcPeriodMs + TELLO_POLL_MS);
+    sendRC(0, 0, 0, 0);
+}
+
+void TelloESP32::setVelocity(int leftRight, int forwardBack, int upDown, int yaw)
+{
+    uint32_t packed = (uint8_t)(int8_t)constrain(leftRight, -100, 100) |
+                      (uint8_t)(int8_t)constrain(forwardBack, -100, 100) << 8 |
+                      (uint8_t)(int8_t)constrain(upDown, -100, 100) << 16 |
+                      (uint32_t)(uint8_t)(int8_t)constrain(yaw, -100, 100) << 24;
+    rcTargetMs = millis();
+    rcTarget = packed;
+}
+
+// Task to send the target velocity at a fixed rate, hovering when the target goes stale
+void TelloESP32::rcTask(void *pvParameters)
+{
+    TelloESP32 *tello = static_cast<TelloESP32 *>(pvParameters);
+    TickType_t lastWake = xTaskGetTickCount();
+    bool stale = false;
+    while (tello->rcRunning && tello->connected)
+    {
+        uint32_t packed = tello->rcTarget;
+        if (millis() - tello->rcTargetMs > (unsigned long)tello->rcWatchdogMs)
+        {
+            if (!stale)
+            {
+                Serial.println("rc watchdog: no velocity update, hovering");
+                tello->rcWatchdogStops++;
+                stale = true;
+            }
+            packed = 0;
+        }
+        else
+        {
+            stale = false;
+        }
+        if (tello->sendRC((int8_t)packed, (int8_t)(packed >> 8), (int8_t)(packed >> 16), (int8_t)(packed >> 24)))
+        {
+            tello->rcPacketsSent++;
+        }
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(tello->rcPeriodMs));
+    }
+    tello->rcTaskHandle = nullptr;
+    vTaskDelete(NULL);
 }
 
 // Video settings commands
 bool TelloESP32::setVideoBitrate(int bitrate)
 {
-    std::string command = "setbitrate " + std::to_string(bitrate);
-    return sendCommandWithRetry(command);
+    return sendTableCommand(TELLO_SETBITRATE, bitrate);
 }
 
 bool TelloESP32::setVideoFPS(const std::string &fps)
 {
-    std::string command = "setfps " + fps;
-    return sendCommandWithRetry(command);
+    return sendTableCommand(TELLO_SETFPS, fps.c_str());
 }
 
 bool TelloESP32::setVideoResolution(const std::string &resolution)
 {
-    std::string command = "setresolution " + resolution;
-    return sendCommandWithRetry(command);
+    return sendTableCommand(TELLO_SETRESOLUTION, resolution.c_str());
 }
 
 // Start video stream
 bool TelloESP32::startVideoStream()
 {
-    if (sendCommandWithRetry("streamon"))
+    if (sendTableCommand(TELLO_STREAMON, 0))
     {
         if (videoStreamTaskHandle == nullptr)
         { // Check if task already exists
-            videoUdp.begin(videoPort);
+            videoSocket = openUdpSocket(videoPort, TELLO_VIDEO_SOCKET_BUFFER);
+            if (videoSocket < 0)
+            {
+                Serial.println("Failed to open video socket");
+                return false;
+            }
+            if (!videoRing.begin())
+            {
+                close(videoSocket);
+                videoSocket = -1;
+                return false;
+            }
+            videoPacketsReceived = 0;
+            videoPacketsDropped = 0;
+            streaming = true;
+
+            // The dispatch task outranks loop() and registers its cursor as soon as it is
+            // created, before the first packet is received
+            xTaskCreatePinnedToCore(
+                TelloESP32::videoDispatchTask,
+                "videoDispatchTask",
+                8192,
+                this,
+                2,
+                &videoDispatchTaskHandle,
+                1);
+            // Receiving outranks the callback, so a slow consumer loses old packets instead of the socket overflowing
             xTaskCreatePinnedToCore(
                 TelloESP32::videoStreamTask,
                 "videoStreamTask",
-                16384, 
+                4096,
                 this,
-                1,
+                3,
                 &videoStreamTaskHandle,
-                0);
+                1);
         }
         return true;
     }
@@ -307,17 +876,9 @@ bool TelloESP32::startVideoStream()
 // Stop video stream
 bool TelloESP32::stopVideoStream()
 {
-    if (sendCommandWithRetry("streamoff"))
+    if (sendTableCommand(TELLO_STREAMOFF, 0))
     {
-        if (videoStreamTaskHandle != nullptr)
-        {
-            vTaskDelete(videoStreamTaskHandle);
-            videoStreamTaskHandle = nullptr;
-            delay(500);  // Delay for task cleanup
-        }
-        
-        videoUdp.stop();
-        delay(500);  // Delay for UDP cleanup
+        stopStreaming();
         return true;
     }
     return false;
@@ -335,83 +896,158 @@ void TelloESP32::onConnectionLost(std::function<void()> callback)
     connectionLostCallback = callback;
 }
 
-// Task to handle video stream data
+// Task to receive video packets into the video ring
 void TelloESP32::videoStreamTask(void *pvParameters)
 {
     TelloESP32 *tello = static_cast<TelloESP32 *>(pvParameters); // Explicitly cast void pointer
-    while (true)
+    uint8_t buffer[TELLO_VIDEO_PACKET_MAX];
+    while (tello->streaming)
     {
-        uint8_t buffer[5120]; 
-        int packetSize = tello->videoUdp.parsePacket();
-        if (packetSize)
+        if (!waitReadable(tello->videoSocket, TELLO_POLL_MS))
         {
-            int len = tello->videoUdp.read(buffer, packetSize); // Read up to packetSize bytes
-            if (len > 0 && tello->videoStreamCallback)
-            {
-                tello->videoStreamCallback(buffer, len);
-            }
+            continue;
+        }
+        // Drain everything lwIP has queued before sleeping again
+        int len;
+        while ((len = recv(tello->videoSocket, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        {
+            tello->videoPacketsReceived++;
+            tello->videoRing.push(buffer, len);
+        }
+    }
+    tello->videoStreamTaskHandle = nullptr;
+    vTaskDelete(NULL);
+}
+
+// Task to hand buffered video packets to the callback
+void TelloESP32::videoDispatchTask(void *pvParameters)
+{
+    TelloESP32 *tello = static_cast<TelloESP32 *>(pvParameters);
+    uint8_t buffer[TELLO_VIDEO_PACKET_MAX];
+    int consumer = tello->videoRing.addConsumer();
+    while (tello->streaming && consumer >= 0)
+    {
+        size_t len = tello->videoRing.read(consumer, buffer, sizeof(buffer), pdMS_TO_TICKS(TELLO_POLL_MS));
+        tello->videoPacketsDropped = tello->videoRing.overruns(consumer);
+        if (len > 0 && tello->videoStreamCallback)
+        {
+            tello->videoStreamCallback(buffer, len);
         }
-        vTaskDelay(1); // Yield to other tasks
     }
+    if (consumer >= 0)
+    {
+        tello->videoRing.removeConsumer(consumer);
+    }
+    tello->videoDispatchTaskHandle = nullptr;
+    vTaskDelete(NULL);
+}
+
+bool TelloESP32::freshTelemetry(TelloTelemetry &telemetry) const
+{
+    return telemetryState.read(telemetry) && millis() - telemetry.receivedMs < TELLO_STATE_FRESH_MS;
+}
+
+String TelloESP32::query(const char *command)
+{
+    char response[sizeof(TelloResponse::text)];
+    if (!sendCommandWithReturn(command, response, sizeof(response)))
+    {
+        return String();
+    }
+    return String(response);
 }
 
-// Telemetry commands
+// Telemetry commands, formatted like the replies to the matching queries
 String TelloESP32::getBattery()
 {
-    std::string response = sendCommandWithReturn("battery?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        return String(telemetry.battery);
+    }
+    return query("battery?");
 }
 
 String TelloESP32::getSpeed()
 {
-    std::string response = sendCommandWithReturn("speed?");
-    return String(response.c_str());
+    return query("speed?");
 }
 
 String TelloESP32::getTime()
 {
-    std::string response = sendCommandWithReturn("time?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        return String(telemetry.motorTime) + "s";
+    }
+    return query("time?");
 }
 
 String TelloESP32::getHeight()
 {
-    std::string response = sendCommandWithReturn("height?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        return String(telemetry.height / 10) + "dm";
+    }
+    return query("height?");
 }
 
 String TelloESP32::getTemp()
 {
-    std::string response = sendCommandWithReturn("temp?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        return String(telemetry.tempLow) + "~" + String(telemetry.tempHigh) + "C";
+    }
+    return query("temp?");
 }
 
 String TelloESP32::getAttitude()
 {
-    std::string response = sendCommandWithReturn("attitude?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        char text[48];
+        snprintf(text, sizeof(text), "pitch:%d;roll:%d;yaw:%d;", telemetry.pitch, telemetry.roll, telemetry.yaw);
+        return String(text);
+    }
+    return query("attitude?");
 }
 
 String TelloESP32::getBarometer()
 {
-    std::string response = sendCommandWithReturn("baro?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        return String(telemetry.barometer, 2);
+    }
+    return query("baro?");
 }
 
 String TelloESP32::getAcceleration()
 {
-    std::string response = sendCommandWithReturn("acceleration?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "agx:%.2f;agy:%.2f;agz:%.2f;", telemetry.agx, telemetry.agy, telemetry.agz);
+        return String(text);
+    }
+    return query("acceleration?");
 }
 
 String TelloESP32::getTOF()
 {
-    std::string response = sendCommandWithReturn("tof?");
-    return String(response.c_str());
+    TelloTelemetry telemetry;
+    if (freshTelemetry(telemetry))
+    {
+        return String(telemetry.tof * 10) + "mm";
+    }
+    return query("tof?");
 }
 
 String TelloESP32::getWifiSnr()
 {
-    std::string response = sendCommandWithReturn("wifi?");
-    return String(response.c_str());
-}
+    return query("wifi?");
+}
\ No newline at end of file
@@ -2,10 +2,25 @@
 #define TELLOESP32_H
 
 #include <WiFi.h>
-#include <WiFiUdp.h>
+#include "TelloResponseMatcher.h"
+#include "TelloState.h"
+#include "TelloCommands.h"
+#include "TelloRtt.h"
+#include "PacketRing.h"
+#include <lwip/sockets.h>
+#include <freertos/queue.h>
+#include <atomic>
 #include <string>
 #include <functional>
 
+enum TelloCommandStatus : uint8_t
+{
+    TELLO_COMMAND_IDLE,      // No command was begun
+    TELLO_COMMAND_PENDING,
+    TELLO_COMMAND_REPLIED,
+    TELLO_COMMAND_TIMED_OUT
+};
+
 class TelloESP32
 {
 public:
@@ -27,6 +42,39 @@ public:
     bool rotateCounterClockwise(int degrees);
     bool flip(char direction); // 'f' forward 'b' back 'l' left 'r' right
 
+    // Stick input, each -100..100 (clamped). Sent once without waiting: the drone does not
+    // reply to rc, and the next call 20-50 ms later supersedes it. Does not allocate.
+    bool sendRC(int leftRight, int forwardBack, int upDown, int yaw);
+
+    // Continuous stick control: a task sends the target velocity as rc at a fixed rate
+    // (20-50 Hz), without waiting for anything. setVelocity() may be called from any task;
+    // if it is not called for watchdogMs the target drops to zero and the drone hovers.
+    // Leave the loop stopped while move commands or missions are flown.
+    bool startRCLoop(int hz = 30, int watchdogMs = 500);
+    void stopRCLoop();  // Sends a final zero
+    void setVelocity(int leftRight, int forwardBack, int upDown, int yaw);
+    bool rcLoopRunning() const { return rcTaskHandle != nullptr; }
+    uint32_t getRCPacketsSent() const { return rcPacketsSent; }
+    uint32_t getRCWatchdogStops() const { return rcWatchdogStops; }
+
+    // Non-blocking command path for state machines such as MissionRunner: beginCommand() sends
+    // and returns at once, pollCommand() hands over the reply once it has arrived.
+    // One command at a time, not interleaved with the blocking commands.
+    // attempt counts re-sends of the same command, for the timeout backoff.
+    bool beginCommand(const char *command, int timeoutMs = TIMEOUT_AUTO, int attempt = 0);
+    TelloCommandStatus pollCommand(char *reply, size_t replySize);
+    // Blocking commands may be sent while this is false
+    bool isCommandPending() const { return commandPending; }
+
+    // Command timeouts adapt to the measured round trips (see TelloRtt.h). A motion command
+    // that times out while telemetry shows the drone moving is waited for longer, and one
+    // whose commanded change was seen in telemetry (the turn, the climb or descent, the
+    // distance along the move) counts as done rather than being sent again. Flips are never
+    // taken as done.
+    static const int TIMEOUT_AUTO = -1;
+    const TelloRttEstimator &getCommandTimings() const { return commandTimings; }
+    void printCommandStats() const;
+
     // Video stream commands
     bool startVideoStream();
     bool stopVideoStream();
@@ -40,7 +88,20 @@ public:
     void onVideoStreamData(std::function<void(const uint8_t *buffer, size_t size)> callback);
     void onConnectionLost(std::function<void()> callback);
 
-    // Telemetry commands
+    // Video packets overwritten before the callback got to them (since startVideoStream)
+    uint32_t getVideoPacketsReceived() const { return videoPacketsReceived; }
+    uint32_t getVideoPacketsDropped() const { return videoPacketsDropped; }
+
+    // Received video packets, for consumers besides the callback (uploader, analyser).
+    // They register with addConsumer() and read at their own pace; the receive task never waits for them.
+    PacketRing &getVideoRing() { return videoRing; }
+
+    // Latest state packet (pushed by the drone at ~10 Hz); false until one has arrived.
+    // Safe to call from any task, never touches the network.
+    bool getTelemetry(TelloTelemetry &telemetry) const { return telemetryState.read(telemetry); }
+
+    // Telemetry commands, answered from the state stream while it is fresh and
+    // with a "?" query otherwise (wifi? and speed? are not part of the stream)
     String getBattery();
     String getSpeed();
     String getTime();
@@ -66,26 +127,92 @@ public:
     static const std::string FPS_30;
 
 private:
-    WiFiUDP udp;
-    WiFiUDP videoUdp;
+    struct TelloResponse
+    {
+        char text[128];
+        uint32_t receivedMs;
+    };
+
+    int commandSocket;
+    int videoSocket;
+    int stateSocket;
     IPAddress telloAddr;
     uint16_t telloPort;
     uint16_t localPort;
     uint16_t videoPort;
+    uint16_t statePort;
     uint16_t commandTimeout;
     TaskHandle_t videoStreamTaskHandle;
+    TaskHandle_t videoDispatchTaskHandle;
     TaskHandle_t receiveResponseTaskHandle;
+    TaskHandle_t receiveStateTaskHandle;
     TaskHandle_t connectionMonitorTaskHandle;
-    SemaphoreHandle_t responseSemaphore;
-    bool connected;
-    std::string latestResponse;
+    TaskHandle_t rcTaskHandle;
+    QueueHandle_t responseQueue;        // Command responses, filled by receiveResponseTask
+    TelloResponseMatcher responseMatcher; // Pairs responses with commands, used by the sending task only
+    TelloState telemetryState;          // Written by receiveStateTask only
+    TelloRttEstimator commandTimings;   // Used by the sending task only
+    PacketRing videoRing;               // Video packets from videoStreamTask to videoDispatchTask and other consumers
+    volatile bool connected;
+    volatile bool receiving;            // Receive tasks run while set and exit on their own
+    volatile bool streaming;
+    volatile uint32_t videoPacketsReceived;
+    volatile uint32_t videoPacketsDropped;
+    bool commandPending;                // Begun with beginCommand() and not yet answered
+    unsigned long commandStartMs;
+    unsigned long commandTimeoutMs;
+    int commandAttempt;
+    char pendingCommand[TELLO_COMMAND_MAX];
+    enum MotionAxis : uint8_t
+    {
+        MOTION_NONE,                    // Not checked, a lost reply is a timeout
+        MOTION_YAW,
+        MOTION_HEIGHT,
+        MOTION_TRAVEL                   // Velocity integrated along the commanded direction
+    };
+    bool motionWatch;                   // The command being waited for moves the drone
+    bool motionDone;                    // Telemetry showed the commanded change since it was sent
+    bool motionNow;                     // The latest state packet showed movement
+    uint8_t motionExtensions;
+    uint32_t watchPackets;              // State packet last compared
+    uint32_t watchMs;                   // Its receivedMs
+    int16_t watchYaw, watchHeight;
+    int16_t baseHeight;                 // When the command was sent
+    MotionAxis watchAxis;               // What the command changes
+    float watchTarget;                  // By how much, signed: degrees clockwise or cm
+    float watchProgress;                // Change seen so far
+    float watchDirX, watchDirY;         // Direction of a move as a vgx/vgy unit vector
+    std::atomic<uint32_t> rcTarget;     // Four int8_t sticks, so the rc task reads them in one load
+    volatile uint32_t rcTargetMs;       // millis() of the last setVelocity()
+    volatile bool rcRunning;
+    int rcPeriodMs;
+    int rcWatchdogMs;
+    volatile uint32_t rcPacketsSent;
+    volatile uint32_t rcWatchdogStops;
+
+    static int openUdpSocket(uint16_t port, int receiveBufferSize);
+    static bool waitReadable(int socket, int timeoutMs);
+    static void waitForTaskExit(TaskHandle_t &handle, int timeoutMs);
+    void stopReceiving();
+    void stopStreaming();
+    bool freshTelemetry(TelloTelemetry &telemetry) const;
+    void startMotionWatch(const char *command);
+    void checkMotion();
+    bool extendMotionWait(const char *command);
 
-    void sendCommand(const std::string &command);
-    std::string sendCommandWithReturn(const std::string &command, int timeoutMs = 10000);
-    bool sendCommandWithRetry(const std::string &command, const std::string &expectedResponse = "ok", int retries = 5, int delayMs = 1000, int timeoutMs = 10000);
+    bool sendPacket(const char *command, size_t length);
+    void settleLateReplies();
+    bool sendCommandWithReturn(const char *command, char *response, size_t responseSize, int timeoutMs = TIMEOUT_AUTO, int attempt = 0);
+    bool sendCommandWithRetry(const char *command, const char *expectedResponse = "ok", int retries = 5, int delayMs = TIMEOUT_AUTO, int timeoutMs = TIMEOUT_AUTO);
+    bool sendTableCommand(TelloCommandId id, int value);
+    bool sendTableCommand(TelloCommandId id, const char *word);
+    String query(const char *command);
     static void receiveResponseTask(void *pvParameters);
+    static void receiveStateTask(void *pvParameters);
     static void videoStreamTask(void *pvParameters);
+    static void videoDispatchTask(void *pvParameters);
     static void connectionMonitorTask(void *pvParameters);
+    static void rcTask(void *pvParameters);
 
     std::function<void(const uint8_t *buffer, size_t size)> videoStreamCallback;
     std::function<void()> connectionLostCallback;
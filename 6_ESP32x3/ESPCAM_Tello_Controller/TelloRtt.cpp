@@ -0,0 +1,174 @@
+#include "TelloRtt.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RTT_INITIAL_RATIO 2.0f   // Motion takes up to twice the expectation until measured
+#define RTT_MIN_RATIO 0.5f
+#define RTT_MAX_RATIO 4.0f
+
+TelloRttEstimator::TelloRttEstimator()
+    : _stats(), _speed(DEFAULT_SPEED)
+{
+}
+
+// Looks the first word up in TELLO_COMMANDS
+TelloCommandClass TelloRttEstimator::classify(const char *command)
+{
+    size_t length = strcspn(command, " ");
+    if (length > 0 && command[length - 1] == '?')
+    {
+        return TELLO_CLASS_QUERY;
+    }
+    for (const TelloCommandSpec &spec : TELLO_COMMANDS)
+    {
+        if (strlen(spec.name) != length || strncmp(spec.name, command, length) != 0)
+        {
+            continue;
+        }
+        switch (spec.id)
+        {
+        case TELLO_UP:
+        case TELLO_DOWN:
+        case TELLO_LEFT:
+        case TELLO_RIGHT:
+        case TELLO_FORWARD:
+        case TELLO_BACK:
+        case TELLO_GO:
+            return TELLO_CLASS_MOVE;
+        case TELLO_CW:
+        case TELLO_CCW:
+            return TELLO_CLASS_TURN;
+        case TELLO_TAKEOFF:
+        case TELLO_LAND:
+        case TELLO_FLIP:
+            return TELLO_CLASS_MANEUVER;
+        default:
+            return TELLO_CLASS_CONTROL;
+        }
+    }
+    return TELLO_CLASS_CONTROL;
+}
+
+const char *TelloRttEstimator::className(TelloCommandClass commandClass)
+{
+    static const char *const names[TELLO_CLASS_COUNT] = {"control", "query", "move", "turn", "maneuver"};
+    return commandClass < TELLO_CLASS_COUNT ? names[commandClass] : "?";
+}
+
+uint32_t TelloRttEstimator::expectedMs(const char *command) const
+{
+    int args[4] = {};
+    char name[16] = {};
+    int count = sscanf(command, "%15s %d %d %d %d", name, &args[0], &args[1], &args[2], &args[3]) - 1;
+    switch (classify(command))
+    {
+    case TELLO_CLASS_MOVE:
+        if (strcmp(name, "go") == 0 && count == 4 && args[3] > 0)
+        {
+            float length = sqrtf((float)args[0] * args[0] + (float)args[1] * args[1] + (float)args[2] * args[2]);
+            return (uint32_t)(length * 1000 / args[3]);
+        }
+        return count >= 1 ? (uint32_t)abs(args[0]) * 1000 / _speed : 0;
+    case TELLO_CLASS_TURN:
+        return count >= 1 ? (uint32_t)abs(args[0]) * 1000 / YAW_RATE : 0;
+    case TELLO_CLASS_MANEUVER:
+        return strcmp(name, "takeoff") == 0 ? TAKEOFF_MS : strcmp(name, "land") == 0 ? LAND_MS : FLIP_MS;
+    default:
+        return 0;
+    }
+}
+
+uint32_t TelloRttEstimator::classTimeoutMs(TelloCommandClass commandClass) const
+{
+    const TelloRttStats &stats = _stats[commandClass];
+    if (stats.samples == 0)
+    {
+        return INITIAL_TIMEOUT_MS;
+    }
+    float timeout = stats.smoothed + fmaxf(10.0f, 4 * stats.deviation);
+    return timeout < MIN_TIMEOUT_MS ? MIN_TIMEOUT_MS : timeout > MAX_TIMEOUT_MS ? MAX_TIMEOUT_MS : (uint32_t)timeout;
+}
+
+// The round trip part of a motion command, as measured on control commands
+uint32_t TelloRttEstimator::networkTimeoutMs() const
+{
+    return classTimeoutMs(TELLO_CLASS_CONTROL);
+}
+
+uint32_t TelloRttEstimator::timeoutMs(const char *command, int attempt) const
+{
+    TelloCommandClass commandClass = classify(command);
+    uint32_t backoff = attempt <= 0 ? 1 : attempt >= 3 ? MAX_BACKOFF : 1u << attempt;
+    if (!isMotion(commandClass))
+    {
+        return classTimeoutMs(commandClass) * backoff;
+    }
+    const TelloRttStats &stats = _stats[commandClass];
+    float ratio = stats.samples == 0 ? RTT_INITIAL_RATIO : stats.smoothed + 4 * stats.deviation;
+    ratio = fminf(fmaxf(ratio, RTT_MIN_RATIO), RTT_MAX_RATIO);
+    return (uint32_t)(expectedMs(command) * ratio) + networkTimeoutMs() * backoff;
+}
+
+// Queries and control commands are answered at once, so a reply more than a few round trip
+// timeouts late is not coming; a move can still finish up to its slowest expected duration
+uint32_t TelloRttEstimator::lateReplyMs(const char *command) const
+{
+    return (uint32_t)(expectedMs(command) * RTT_MAX_RATIO) + networkTimeoutMs() * MAX_BACKOFF;
+}
+
+uint32_t TelloRttEstimator::retryDelayMs(int attempt) const
+{
+    // Errors come from a drone that is not ready yet (e.g. still settling after a move):
+    // wait a round trip, doubling up to the network timeout
+    const TelloRttStats &control = _stats[TELLO_CLASS_CONTROL];
+    uint32_t delay = control.samples == 0 ? 100 : (uint32_t)control.smoothed;
+    delay = (delay < 100 ? 100 : delay) << (attempt < 0 ? 0 : attempt > 4 ? 4 : attempt);
+    uint32_t limit = networkTimeoutMs();
+    return delay > limit ? limit : delay;
+}
+
+void TelloRttEstimator::update(TelloRttStats &stats, float sample)
+{
+    if (stats.samples++ == 0)
+    {
+        stats.smoothed = sample;
+        stats.deviation = sample / 2;
+        return;
+    }
+    stats.deviation = 0.75f * stats.deviation + 0.25f * fabsf(stats.smoothed - sample);
+    stats.smoothed = 0.875f * stats.smoothed + 0.125f * sample;
+}
+
+void TelloRttEstimator::onReply(const char *command, const char *reply, uint32_t elapsedMs, bool firstAttempt)
+{
+    TelloCommandClass commandClass = classify(command);
+    TelloRttStats &stats = _stats[commandClass];
+    stats.lastMs = elapsedMs;
+    bool ok = strcmp(reply, "ok") == 0;
+
+    int value;
+    if (ok && sscanf(command, "speed %d", &value) == 1 && value > 0)
+    {
+        _speed = value;
+    }
+    // Karn: replies after a re-send may belong to an earlier attempt. Errors come back at
+    // once, without the motion, so they say nothing about motion timing either.
+    if (!firstAttempt || (isMotion(commandClass) && !ok))
+    {
+        return;
+    }
+    if (!isMotion(commandClass))
+    {
+        update(stats, elapsedMs);
+        return;
+    }
+    uint32_t expected = expectedMs(command);
+    if (expected > 0)
+    {
+        const TelloRttStats &control = _stats[TELLO_CLASS_CONTROL];
+        float network = control.samples == 0 ? 0.0f : control.smoothed;
+        update(stats, fmaxf(0.0f, elapsedMs - network) / expected);
+    }
+}
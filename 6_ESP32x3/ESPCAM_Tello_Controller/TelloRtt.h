@@ -0,0 +1,89 @@
+#ifndef TELLORTT_H
+#define TELLORTT_H
+
+#include <stdint.h>
+#include "TelloCommands.h"
+
+// Timeouts for Tello commands from measured round trips, per command class, in the manner
+// of TCP's retransmission timer (RFC 6298): a smoothed value and its mean deviation,
+// timeout = smoothed + 4 * deviation, doubled for every retry of the same command and
+// only sampled from first attempts (a reply after a re-send is ambiguous).
+//
+// Control commands and queries are timed in ms. Motion commands take as long as the move,
+// so for them the expected duration is computed from the command (distance / speed, degrees
+// / yaw rate, fixed times for takeoff and land) and the smoothed value is the ratio of the
+// measured time, less the network round trip, to that expectation. A slower or faster drone
+// than assumed is learnt after a few moves.
+//
+// Plain C++, called from the task that sends the commands.
+enum TelloCommandClass : uint8_t
+{
+    TELLO_CLASS_CONTROL,     // Mode, stream, speed and video settings
+    TELLO_CLASS_QUERY,       // "...?"
+    TELLO_CLASS_MOVE,        // up/down/left/right/forward/back/go
+    TELLO_CLASS_TURN,        // cw/ccw
+    TELLO_CLASS_MANEUVER,    // takeoff/land/flip
+    TELLO_CLASS_COUNT
+};
+
+struct TelloRttStats
+{
+    uint32_t samples;
+    uint32_t timeouts;
+    uint32_t retries;
+    uint32_t extensions;     // Waits extended because the drone was still moving
+    uint32_t inferred;       // Motion commands taken as done from telemetry, their reply lost
+    float smoothed;          // ms, or the duration ratio for motion classes
+    float deviation;
+    uint32_t lastMs;         // Last measured round trip
+};
+
+class TelloRttEstimator
+{
+public:
+    static const uint32_t INITIAL_TIMEOUT_MS = 1000;   // Before the first sample
+    static const uint32_t MIN_TIMEOUT_MS = 300;
+    static const uint32_t MAX_TIMEOUT_MS = 10000;      // Network part, before backoff
+    static const uint32_t MAX_BACKOFF = 8;
+    static const int DEFAULT_SPEED = 50;               // cm/s assumed for axis moves until "speed" is set
+    static const int YAW_RATE = 90;                    // deg/s
+    static const uint32_t TAKEOFF_MS = 5000;
+    static const uint32_t LAND_MS = 4000;
+    static const uint32_t FLIP_MS = 2000;
+
+    TelloRttEstimator();
+
+    static TelloCommandClass classify(const char *command);
+    static bool isMotion(TelloCommandClass commandClass) { return commandClass >= TELLO_CLASS_MOVE; }
+    static const char *className(TelloCommandClass commandClass);
+
+    // How long the drone needs to carry out the command, 0 for non-motion commands
+    uint32_t expectedMs(const char *command) const;
+    // How long to wait for the reply to the given attempt (0 = first send)
+    uint32_t timeoutMs(const char *command, int attempt = 0) const;
+    // Pause before re-sending after an error reply (after a timeout, re-send at once)
+    uint32_t retryDelayMs(int attempt) const;
+    // How long after sending a reply that timed out can still arrive, for TelloResponseMatcher
+    uint32_t lateReplyMs(const char *command) const;
+    // Extra wait when a motion command timed out while the drone was still moving
+    uint32_t extensionMs() const { return networkTimeoutMs(); }
+
+    void onReply(const char *command, const char *reply, uint32_t elapsedMs, bool firstAttempt);
+    void onTimeout(const char *command) { _stats[classify(command)].timeouts++; }
+    void onRetry(const char *command) { _stats[classify(command)].retries++; }
+    void onExtension(const char *command) { _stats[classify(command)].extensions++; }
+    void onInferred(const char *command) { _stats[classify(command)].inferred++; }
+
+    const TelloRttStats &stats(TelloCommandClass commandClass) const { return _stats[commandClass]; }
+    int speed() const { return _speed; }
+
+private:
+    TelloRttStats _stats[TELLO_CLASS_COUNT];
+    int _speed;
+
+    void update(TelloRttStats &stats, float sample);
+    uint32_t networkTimeoutMs() const;
+    uint32_t classTimeoutMs(TelloCommandClass commandClass) const;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "TelloState.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TELLO_STATE_READ_ATTEMPTS 16   // A reader gives up if the writer keeps overtaking it
+
+TelloState::TelloState()
+    : _sequence(0)
+{
+    memset(&_telemetry, 0, sizeof(_telemetry));
+}
+
+bool TelloState::parse(const char *text, size_t length, TelloTelemetry &out)
+{
+    const char *end = text + length;
+    int fields = 0;
+    while (text < end)
+    {
+        const char *colon = (const char *)memchr(text, ':', end - text);
+        if (colon == nullptr)
+        {
+            break;
+        }
+        const char *semicolon = (const char *)memchr(colon, ';', end - colon);
+        if (semicolon == nullptr)
+        {
+            semicolon = end;
+        }
+
+        // Values are short, so they are copied to a terminated buffer for strtol/strtof
+        char value[16];
+        size_t valueLength = semicolon - colon - 1;
+        if (valueLength >= sizeof(value))
+        {
+            valueLength = sizeof(value) - 1;
+        }
+        memcpy(value, colon + 1, valueLength);
+        value[valueLength] = '\0';
+
+        size_t keyLength = colon - text;
+        long number = strtol(value, nullptr, 10);
+        bool known = true;
+#define TELLO_KEY(name) (keyLength == sizeof(name) - 1 && memcmp(text, name, keyLength) == 0)
+        if (TELLO_KEY("pitch")) out.pitch = number;
+        else if (TELLO_KEY("roll")) out.roll = number;
+        else if (TELLO_KEY("yaw")) out.yaw = number;
+        else if (TELLO_KEY("vgx")) out.vgx = number;
+        else if (TELLO_KEY("vgy")) out.vgy = number;
+        else if (TELLO_KEY("vgz")) out.vgz = number;
+        else if (TELLO_KEY("templ")) out.tempLow = number;
+        else if (TELLO_KEY("temph")) out.tempHigh = number;
+        else if (TELLO_KEY("tof")) out.tof = number;
+        else if (TELLO_KEY("h")) out.height = number;
+        else if (TELLO_KEY("bat")) out.battery = number;
+        else if (TELLO_KEY("time")) out.motorTime = number;
+        else if (TELLO_KEY("baro")) out.barometer = strtof(value, nullptr);
+        else if (TELLO_KEY("agx")) out.agx = strtof(value, nullptr);
+        else if (TELLO_KEY("agy")) out.agy = strtof(value, nullptr);
+        else if (TELLO_KEY("agz")) out.agz = strtof(value, nullptr);
+        else known = false;
+#undef TELLO_KEY
+        if (known)
+        {
+            fields++;
+        }
+
+        text = semicolon + 1;
+        // Skip the trailing "\r\n"
+        while (text < end && (*text == '\r' || *text == '\n'))
+        {
+            text++;
+        }
+    }
+    return fields > 0;
+}
+
+void TelloState::publish(const TelloTelemetry &telemetry)
+{
+    uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&_telemetry, &telemetry, sizeof(_telemetry));
+    _sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool TelloState::read(TelloTelemetry &out) const
+{
+    for (int attempt = 0; attempt < TELLO_STATE_READ_ATTEMPTS; attempt++)
+    {
+        uint32_t before = _sequence.load(std::memory_order_acquire);
+        if (before == 0)
+        {
+            return false;
+        }
+        if (before & 1)
+        {
+            continue;
+        }
+        memcpy(&out, &_telemetry, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_sequence.load(std::memory_order_relaxed) == before)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TelloState::reset()
+{
+    _sequence.store(0, std::memory_order_release);
+}
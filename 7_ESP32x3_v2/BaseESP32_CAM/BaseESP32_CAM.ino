@@ -14,10 +14,11 @@
 #include <Arduino.h>
 #include <SD_MMC.h>
 #include "camFunctions.h"
+#include "ImageStore.h"
+#include "ResultLog.h"
 #include "InferenceHandler.h"
 #include <esp_now.h>
 #include <WiFi.h>
-#include <vector>
 #include <ArduinoJson.h>
 
 // ===================================== Configuration =====================================
@@ -32,6 +33,20 @@ const float OVERLAP_THRESHOLD = 25.0;    // Overlap threshold (in %)
 
 const float RIPENESS_THRESHOLD = 40.0;   // Minimum ripeness threshold for action
 
+// Region of the frame that shows the plant rows (pixels, widened to whole JPEG MCUs).
+// Only this part is stored and uploaded; set width/height to 0 to keep the full frame.
+const JpegCropRect CAMERA_ROI = {0, 120, 640, 240};
+
+// Thumbnail gating: full-resolution capture and upload only when the scene has changed
+const float SCENE_CHANGE_THRESHOLD = 6.0;   // Mean change of the coarse luma grid (0-255)
+const float RED_FRACTION_CHANGE = 0.02;     // Change in the share of ripe-looking pixels
+const int MAX_SKIPPED_RUNS = 10;            // Upload anyway after this many skipped runs
+
+const char *NTP_SERVER = "pool.ntp.org";          // Timestamps for stored images and results
+const uint64_t IMAGE_STORE_QUOTA = 4ULL << 30;    // Oldest uploaded segments are deleted above this
+const uint64_t SD_FREE_RESERVE = 256ULL << 20;    // Below this, even segments not yet uploaded go
+const int MAX_RESULTS_PER_MESSAGE = 3;            // Unsent results per ESP-NOW message (250-byte limit)
+
 const char *RECEIVER_SSID = "ESP32_RECEIVER";     // Target ESP32 for transmitting results
 const char *ACTION_RECEIVER_SSID = "TELLO_ESP32_CAM"; // Target ESP32 for command actions
 
@@ -40,11 +55,14 @@ const unsigned long RUN_INTERVAL = 60000; // Interval between operations (in ms)
 
 // ===================================== Global Variables =====================================
 InferenceHandler inferenceHandler(WIFI_SSID, WIFI_PASSWORD, host, httpsPort);
-std::vector<std::pair<String, float>> ripenessResults; // Vector storing <file, ripeness%>
+ImageStore imageStore(SD_MMC, "/camImages");           // Packed capture container on the SD card
+ResultLog resultLog(SD_MMC, "/results.log");          // Ring of inference results, survives resets
 uint8_t peerMacAddress[6];                            // MAC address of the peer device
+ThumbnailStats lastUploadedThumbnail;                  // Thumbnail of the last analysed capture
+bool haveUploadedThumbnail = false;
+int skippedRuns = 0;
 
 // ===================================== Function Prototypes =====================================
-String getNextFilePath(const String &folderName, const String &prefix, const String &extension);
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
 bool findReceiverMac(const char *ssid, uint8_t *macAddress);
 bool initEspNowPeer(const char *ssid);
@@ -59,6 +77,17 @@ void setup() {
     }
     Serial.println("SD Card mounted successfully");
 
+    imageStore.setRetention(IMAGE_STORE_QUOTA, SD_FREE_RESERVE, []() { return SD_MMC.totalBytes() - SD_MMC.usedBytes(); });
+    if (!imageStore.begin()) {
+        Serial.println("Image store initialization failed, Operations halted");
+        while (1);
+    }
+
+    if (!resultLog.begin()) {
+        Serial.println("Result log initialization failed, Operations halted");
+        while (1);
+    }
+
     lastRunTime = millis() - RUN_INTERVAL; // Initialize timer
 }
 
@@ -74,9 +103,29 @@ void loop() {
         } else {
             Serial.println("Camera initialized successfully");
 
-            String imagePath = getNextFilePath("/camImages", "camImg_", ".jpg");
-            if (captureAndSaveImage(imagePath)) {
-                Serial.println("Image captured and saved to: " + imagePath);
+            // ===================================== Thumbnail Gating =====================================
+            ThumbnailStats thumbnail;
+            bool thumbnailValid = setCaptureMode(CAPTURE_THUMBNAIL) && analyzeThumbnail(thumbnail);
+            bool uploadNeeded = true;
+            if (thumbnailValid && haveUploadedThumbnail && skippedRuns < MAX_SKIPPED_RUNS) {
+                float sceneChange = thumbnailDifference(thumbnail, lastUploadedThumbnail);
+                float redChange = fabs(thumbnail.redFraction - lastUploadedThumbnail.redFraction);
+                Serial.printf("Thumbnail: scene change %.1f, red %.1f%% (was %.1f%%)\n",
+                              sceneChange, thumbnail.redFraction * 100.0, lastUploadedThumbnail.redFraction * 100.0);
+                uploadNeeded = sceneChange >= SCENE_CHANGE_THRESHOLD || redChange >= RED_FRACTION_CHANGE;
+            }
+
+            uint32_t imageSequence = 0;
+            if (!uploadNeeded) {
+                skippedRuns++;
+                Serial.println("Scene unchanged since last upload, skipping capture");
+                deinitCamera();
+            } else if (!setCaptureMode(CAPTURE_FULL)) {
+                Serial.println("Failed to switch to full resolution");
+                deinitCamera();
+            } else if (captureAndSaveImage(imageStore, &CAMERA_ROI, &imageSequence)) {
+                Serial.printf("Switched to full resolution in %lu us\n", lastModeSwitchMicros());
+                Serial.printf("Image captured and stored as #%u\n", (unsigned)imageSequence);
                 deinitCamera();
 
                 // ===================================== Inference Handling =====================================
@@ -85,9 +134,13 @@ void loop() {
                     return;
                 }
                 Serial.println("InferenceHandler initialized.");
+                configTime(0, 0, NTP_SERVER); // Syncs in the background, later captures get wall-clock time
 
                 InferenceResult imageResult;
-                if (inferenceHandler.requestInference(imagePath.c_str(), CONFIDENCE_THRESHOLD, OVERLAP_THRESHOLD, imageResult)) {
+                ImageRecordReader image;
+                if (!imageStore.openRecord(imageSequence, image)) {
+                    Serial.println("Stored image not found");
+                } else if (inferenceHandler.requestInference(image, CONFIDENCE_THRESHOLD, OVERLAP_THRESHOLD, imageResult)) {
                     Serial.println("Camera Image Analysis:");
                     Serial.printf("Total Objects: %d\n", imageResult.totalObjects);
                     Serial.printf("Ripe Tomatoes: %d\n", imageResult.ripeCount);
@@ -95,14 +148,31 @@ void loop() {
                     Serial.printf("Green Tomatoes: %d\n", imageResult.greenCount);
                     Serial.printf("Ripeness Percentage: %.2f%%\n", imageResult.ripenessPercentage);
 
-                    ripenessResults.push_back({imagePath, imageResult.ripenessPercentage});
+                    ResultRecord record = {};
+                    record.timestamp = time(NULL);
+                    record.imageSequence = imageSequence;
+                    record.source = RESULT_SOURCE_CAMERA;
+                    record.totalObjects = imageResult.totalObjects;
+                    record.ripeCount = imageResult.ripeCount;
+                    record.unripeCount = imageResult.unripeCount;
+                    record.greenCount = imageResult.greenCount;
+                    record.ripeness = imageResult.ripenessPercentage;
+                    resultLog.append(record);
+                    imageStore.markUploaded(imageSequence);
+
+                    lastUploadedThumbnail = thumbnail;
+                    haveUploadedThumbnail = thumbnailValid;
+                    skippedRuns = 0;
                 }
+                image.close();
                 inferenceHandler.end();
             }
         }
 
         // ===================================== Command and Result Transmission =====================================
-        if (!ripenessResults.empty() && ripenessResults.back().second > RIPENESS_THRESHOLD) {
+        ResultRecord newest;
+        if (resultLog.lastSequence() > resultLog.lastSentSequence() &&
+            resultLog.read(resultLog.lastSequence(), newest) && newest.ripeness > RIPENESS_THRESHOLD) {
             if (initEspNowPeer(ACTION_RECEIVER_SSID)) {
                 StaticJsonDocument<64> doc;
                 doc["COMMAND"] = "Start_Operation";
@@ -112,32 +182,39 @@ void loop() {
                 esp_now_send(peerMacAddress, (uint8_t *)jsonString.c_str(), jsonString.length());
             }
 
-            StaticJsonDocument<1024> doc;
-            JsonArray array = doc.to<JsonArray>();
-
-            for (const auto &result : ripenessResults) {
-                if (!result.first.isEmpty() && result.second >= 0.0) {
-                    JsonObject obj = array.createNestedObject();
-                    obj["file"] = result.first;
-                    obj["ripeness"] = result.second;
-                } else {
-                    Serial.printf("Skipping invalid result: file='%s', ripeness=%.2f\n", result.first.c_str(), result.second);
+            // Oldest unsent results first, one message per batch; a failed send leaves the rest
+            // unsent for the next run
+            bool peerReady = initEspNowPeer(RECEIVER_SSID);
+            ResultRecord unsent[MAX_RESULTS_PER_MESSAGE];
+            size_t unsentCount;
+            while (peerReady && (unsentCount = resultLog.readUnsent(unsent, MAX_RESULTS_PER_MESSAGE)) > 0) {
+                StaticJsonDocument<1024> doc;
+                JsonArray array = doc.to<JsonArray>();
+
+                for (size_t i = 0; i < unsentCount; i++) {
+                    if (unsent[i].ripeness >= 0.0) {
+                        JsonObject obj = array.createNestedObject();
+                        obj["file"] = ImageStore::recordName(unsent[i].imageSequence);
+                        obj["ripeness"] = unsent[i].ripeness;
+                        obj["time"] = unsent[i].timestamp; // Receiver keeps a time-indexed history
+                    } else {
+                        Serial.printf("Skipping invalid result #%u: ripeness=%.2f\n", (unsigned)unsent[i].sequence, unsent[i].ripeness);
+                    }
                 }
-            }
 
-            if (array.size() > 0) {
-                if (initEspNowPeer(RECEIVER_SSID)) {
+                if (array.size() > 0) {
                     String jsonString;
                     serializeJson(doc, jsonString);
-                    if (esp_now_send(peerMacAddress, (uint8_t *)jsonString.c_str(), jsonString.length()) == ESP_OK) {
-                        Serial.println("Results sent successfully");
-                    } else {
+                    if (esp_now_send(peerMacAddress, (uint8_t *)jsonString.c_str(), jsonString.length()) != ESP_OK) {
                         Serial.println("Error sending results");
+                        break;
                     }
+                    Serial.println("Results sent successfully");
+                    delay(20); // ESP-NOW queues only a few frames per peer
+                }
+                if (!resultLog.markSent(unsent[unsentCount - 1].sequence)) {
+                    break;
                 }
-                ripenessResults.clear();
-            } else {
-                Serial.println("No valid results to send");
             }
         } else {
             Serial.println("Ripeness percentage below threshold, no action taken");
@@ -149,35 +226,6 @@ void loop() {
 }
 
 // ===================================== Utility Functions =====================================
-String getNextFilePath(const String &folderName, const String &prefix, const String &extension) {
-    if (!SD_MMC.exists(folderName)) {
-        SD_MMC.mkdir(folderName);
-        return folderName + "/" + prefix + "1" + extension;
-    }
-
-    File root = SD_MMC.open(folderName);
-    if (!root || !root.isDirectory()) {
-        return folderName + "/" + prefix + "1" + extension;
-    }
-
-    int maxNumber = 0;
-    File file = root.openNextFile();
-
-    while (file) {
-        String fileName = String(file.name());
-        if (fileName.startsWith(prefix) && fileName.endsWith(extension)) {
-            int startIdx = prefix.length();
-            int endIdx = fileName.indexOf(extension);
-            String numStr = fileName.substring(startIdx, endIdx);
-            int currentNum = numStr.toInt();
-            maxNumber = max(maxNumber, currentNum);
-        }
-        file = root.openNextFile();
-    }
-
-    return folderName + "/" + prefix + String(maxNumber + 1) + extension;
-}
-
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
     if (status != ESP_NOW_SEND_SUCCESS) {
         Serial.println("Last Packet Send Failed!");
@@ -0,0 +1,544 @@
+#include "ImageStore.h"
+#include <rom/crc.h>
+
+static uint32_t alignUp(uint32_t value)
+{
+    return (value + IMAGE_STORE_ALIGN - 1) & ~(uint32_t)(IMAGE_STORE_ALIGN - 1);
+}
+
+static uint32_t headerCrc(const ImageRecordHeader &header)
+{
+    return crc32_le(0, (const uint8_t *)&header, offsetof(ImageRecordHeader, headerCrc));
+}
+
+// ===================================== ImageRecordReader =====================================
+int ImageRecordReader::read()
+{
+    if (_position >= _length) {
+        return -1;
+    }
+    int c = _file.read();
+    if (c >= 0) {
+        _position++;
+    }
+    return c;
+}
+
+int ImageRecordReader::peek()
+{
+    return _position < _length ? _file.peek() : -1;
+}
+
+size_t ImageRecordReader::readBytes(char *buffer, size_t length)
+{
+    size_t remaining = _length - _position;
+    size_t n = _file.read((uint8_t *)buffer, length < remaining ? length : remaining);
+    _position += n;
+    return n;
+}
+
+bool ImageRecordReader::rewind()
+{
+    _position = 0;
+    return _file && _file.seek(_start);
+}
+
+// ===================================== ImageStore =====================================
+ImageStore::ImageStore(fs::FS &fs, const char *folder)
+    : _fs(fs), _folder(folder), _ready(false), _firstSegment(0), _lastSegment(0), _firstSequence(1),
+      _nextSequence(1), _lastTimestamp(0), _segmentCount(0), _quota(0), _reserve(0), _freeSpace(NULL),
+      _segmentsEvicted(0), _indexCount(0), _writeOffset(0), _recording(false),
+      _recordOffset(0), _recordTimestamp(0), _recordLength(0), _recordCrc(0), _recordFailed(false) {}
+
+String ImageStore::segmentPath(uint32_t segment, const char *extension) const
+{
+    char name[24];
+    snprintf(name, sizeof(name), "/seg_%05u%s", (unsigned)segment, extension);
+    return _folder + name;
+}
+
+String ImageStore::recordName(uint32_t sequence)
+{
+    return "img_" + String(sequence) + ".jpg";
+}
+
+bool ImageStore::begin()
+{
+    end();
+    if (!_fs.exists(_folder) && !_fs.mkdir(_folder)) {
+        Serial.println("ImageStore: failed to create folder");
+        return false;
+    }
+
+    // Only the segment range is needed; this is the one directory listing the store does
+    File root = _fs.open(_folder);
+    if (!root || !root.isDirectory()) {
+        Serial.println("ImageStore: folder is not a directory");
+        return false;
+    }
+    _firstSegment = 0;
+    _lastSegment = 0;
+    _segmentCount = 0;
+    String entry = root.getNextFileName();
+    while (entry.length() > 0) {
+        String name = entry.substring(entry.lastIndexOf('/') + 1);
+        if (name.startsWith("seg_") && name.endsWith(".pak")) {
+            uint32_t segment = name.substring(4, name.length() - 4).toInt();
+            if (segment > 0) {
+                _firstSegment = _firstSegment == 0 ? segment : min(_firstSegment, segment);
+                _lastSegment = max(_lastSegment, segment);
+                _segmentCount++;
+            }
+        }
+        entry = root.getNextFileName();
+    }
+    root.close();
+
+    _firstSequence = 1;
+    _nextSequence = 1;
+    _lastTimestamp = 0;
+    if (_lastSegment > 0) {
+        if (!openSegment(_lastSegment, false)) {
+            return false;
+        }
+        uint32_t recovered = recoverIndex();
+        if (recovered > 0) {
+            Serial.printf("ImageStore: re-indexed %u record(s)\n", (unsigned)recovered);
+        }
+
+        ImageIndexEntry first;
+        _firstSequence = firstEntry(_firstSegment, first) ? first.sequence : _nextSequence;
+    }
+
+    _ready = true;
+    Serial.printf("ImageStore: images %u-%u in %u segment(s) %u-%u\n", (unsigned)_firstSequence,
+                  (unsigned)(_nextSequence - 1), (unsigned)_segmentCount, (unsigned)_firstSegment, (unsigned)_lastSegment);
+    return true;
+}
+
+void ImageStore::setRetention(uint64_t quotaBytes, uint64_t reserveBytes, ImageStoreFreeSpace freeSpace)
+{
+    _quota = quotaBytes;
+    _reserve = reserveBytes;
+    _freeSpace = freeSpace;
+}
+
+void ImageStore::end()
+{
+    _segment.close();
+    _index.close();
+    _recording = false;
+    _ready = false;
+}
+
+bool ImageStore::openSegment(uint32_t segment, bool create)
+{
+    _segment.close();
+    _index.close();
+
+    String pakPath = segmentPath(segment, ".pak");
+    String idxPath = segmentPath(segment, ".idx");
+    if (create) {
+        // Seeking past the end in write mode makes FatFs allocate the whole cluster chain now,
+        // so appends never extend the FAT while a capture is being written
+        File file = _fs.open(pakPath, FILE_WRITE);
+        bool ok = file && file.seek(IMAGE_STORE_SEGMENT_SIZE - 1) && file.write((uint8_t)0) == 1;
+        file.close();
+        File index = _fs.open(idxPath, FILE_WRITE);
+        ok = ok && index;
+        index.close();
+        if (!ok) {
+            Serial.println("ImageStore: failed to preallocate segment");
+            return false;
+        }
+    }
+
+    _segment = _fs.open(pakPath, "r+");
+    _index = _fs.open(idxPath, "r+");
+    if (!_segment || !_index) {
+        Serial.printf("ImageStore: failed to open segment %u\n", (unsigned)segment);
+        _segment.close();
+        _index.close();
+        return false;
+    }
+    _indexCount = _index.size() / sizeof(ImageIndexEntry); // A torn tail entry is overwritten
+    _writeOffset = 0;
+    return true;
+}
+
+bool ImageStore::readEntry(File &index, uint32_t position, ImageIndexEntry &entry)
+{
+    return index && index.seek(position * sizeof(ImageIndexEntry)) &&
+           index.read((uint8_t *)&entry, sizeof(entry)) == sizeof(entry);
+}
+
+bool ImageStore::firstEntry(uint32_t segment, ImageIndexEntry &entry)
+{
+    if (segment == _lastSegment && _index) {
+        return readEntry(_index, 0, entry);
+    }
+    File index = _fs.open(segmentPath(segment, ".idx"), FILE_READ);
+    bool found = readEntry(index, 0, entry);
+    index.close();
+    return found;
+}
+
+uint32_t ImageStore::entryCount(uint32_t segment)
+{
+    if (segment == _lastSegment && _index) {
+        return _indexCount;
+    }
+    File index = _fs.open(segmentPath(segment, ".idx"), FILE_READ);
+    uint32_t count = index ? index.size() / sizeof(ImageIndexEntry) : 0;
+    index.close();
+    return count;
+}
+
+// Sets the append position and sequence from the active segment's index, then indexes any
+// complete records written after the last entry (power lost between header and index update)
+uint32_t ImageStore::recoverIndex()
+{
+    ImageIndexEntry last;
+    uint32_t expected = 0; // 0: no earlier record known, accept the first valid one
+    if (_indexCount > 0 && readEntry(_index, _indexCount - 1, last)) {
+        _writeOffset = alignUp(last.offset + sizeof(ImageRecordHeader) + last.length);
+        expected = last.sequence + 1;
+        _lastTimestamp = last.timestamp;
+    } else {
+        for (uint32_t segment = _lastSegment - 1; segment >= _firstSegment && segment > 0; segment--) {
+            File index = _fs.open(segmentPath(segment, ".idx"), FILE_READ);
+            uint32_t count = index ? index.size() / sizeof(ImageIndexEntry) : 0;
+            bool found = count > 0 && readEntry(index, count - 1, last);
+            index.close();
+            if (found) {
+                expected = last.sequence + 1;
+                _lastTimestamp = last.timestamp;
+                break;
+            }
+        }
+    }
+
+    uint32_t recovered = 0;
+    size_t segmentSize = _segment.size();
+    uint8_t buffer[512];
+    while (_writeOffset + sizeof(ImageRecordHeader) <= segmentSize) {
+        ImageRecordHeader header;
+        if (!_segment.seek(_writeOffset) || _segment.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+            header.magic != IMAGE_RECORD_MAGIC || header.headerCrc != headerCrc(header) ||
+            (expected != 0 && header.sequence != expected) ||
+            _writeOffset + sizeof(header) + header.length > segmentSize) {
+            break;
+        }
+
+        uint32_t crc = 0;
+        size_t remaining = header.length;
+        while (remaining > 0) {
+            size_t n = _segment.read(buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+            if (n == 0) {
+                break;
+            }
+            crc = crc32_le(crc, buffer, n);
+            remaining -= n;
+        }
+        if (remaining > 0 || crc != header.payloadCrc) {
+            break;
+        }
+
+        ImageIndexEntry entry = {header.sequence, header.timestamp, _writeOffset, header.length, 0};
+        _index.seek(_indexCount * sizeof(ImageIndexEntry));
+        if (_index.write((const uint8_t *)&entry, sizeof(entry)) != sizeof(entry)) {
+            break;
+        }
+        _indexCount++;
+        recovered++;
+        expected = header.sequence + 1;
+        _lastTimestamp = header.timestamp;
+        _writeOffset = alignUp(_writeOffset + sizeof(header) + header.length);
+    }
+    _index.flush();
+    _nextSequence = expected != 0 ? expected : 1;
+    return recovered;
+}
+
+bool ImageStore::beginRecord(uint32_t timestamp)
+{
+    if (!_ready || _recording) {
+        return false;
+    }
+    if (_lastSegment == 0 || _writeOffset + IMAGE_STORE_MAX_RECORD > IMAGE_STORE_SEGMENT_SIZE) {
+        makeRoom();
+        uint32_t segment = _lastSegment + 1;
+        if (!openSegment(segment, true)) {
+            return false;
+        }
+        if (_firstSegment == 0) {
+            _firstSegment = segment;
+            _firstSequence = _nextSequence;
+        }
+        _lastSegment = segment;
+        _segmentCount++;
+    }
+
+    _recordOffset = _writeOffset;
+    _recordTimestamp = max(timestamp, _lastTimestamp); // Keeps time lookups binary-searchable
+    _recording = true;
+    return restartRecord();
+}
+
+bool ImageStore::restartRecord()
+{
+    if (!_recording) {
+        return false;
+    }
+    _recordLength = 0;
+    _recordCrc = 0;
+    _recordFailed = !_segment.seek(_recordOffset + sizeof(ImageRecordHeader));
+    return !_recordFailed;
+}
+
+size_t ImageStore::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t ImageStore::write(const uint8_t *buffer, size_t size)
+{
+    if (!_recording || _recordFailed) {
+        return 0;
+    }
+    size_t n = _segment.write(buffer, size);
+    _recordCrc = crc32_le(_recordCrc, buffer, n);
+    _recordLength += n;
+    _recordFailed = n != size;
+    return n;
+}
+
+bool ImageStore::commitRecord(uint32_t *sequence)
+{
+    if (!_recording) {
+        return false;
+    }
+    _recording = false;
+    if (_recordFailed || _recordLength == 0) {
+        return false;
+    }
+
+    ImageRecordHeader header = {IMAGE_RECORD_MAGIC, _nextSequence, _recordTimestamp, (uint32_t)_recordLength, _recordCrc, 0};
+    header.headerCrc = headerCrc(header);
+    if (!_segment.seek(_recordOffset) || _segment.write((const uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+    _segment.flush();
+
+    ImageIndexEntry entry = {header.sequence, header.timestamp, _recordOffset, header.length, 0};
+    if (!_index.seek(_indexCount * sizeof(ImageIndexEntry)) ||
+        _index.write((const uint8_t *)&entry, sizeof(entry)) != sizeof(entry)) {
+        // The record is complete on the card; begin() will index it
+        Serial.println("ImageStore: index update failed");
+    } else {
+        _indexCount++;
+    }
+    _index.flush();
+
+    _writeOffset = alignUp(_recordOffset + sizeof(header) + header.length);
+    _lastTimestamp = header.timestamp;
+    _nextSequence++;
+    if (sequence) {
+        *sequence = header.sequence;
+    }
+    return true;
+}
+
+void ImageStore::abortRecord()
+{
+    _recording = false;
+}
+
+// Binary search over segments (by their first entry), then within the segment's index
+bool ImageStore::locate(uint32_t key, bool byTime, ImageIndexEntry &entry, uint32_t &segment, uint32_t &position)
+{
+    if (!_ready || _firstSegment == 0) {
+        return false;
+    }
+
+    uint32_t low = _firstSegment;
+    uint32_t high = _lastSegment;
+    while (low < high) {
+        uint32_t mid = low + (high - low + 1) / 2;
+        // A segment evicted out of order is skipped for the next one that exists
+        ImageIndexEntry first;
+        uint32_t probe = mid;
+        bool valid = false;
+        while (probe <= high && !(valid = firstEntry(probe, first))) {
+            probe++;
+        }
+        if (valid && (byTime ? first.timestamp : first.sequence) <= key) {
+            low = probe;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    for (segment = low; segment <= _lastSegment; segment++) {
+        File index = segment == _lastSegment ? File() : _fs.open(segmentPath(segment, ".idx"), FILE_READ);
+        File &source = segment == _lastSegment ? _index : index;
+        uint32_t count = entryCount(segment);
+        bool found = false;
+        if (!byTime) {
+            // Sequences are contiguous within a segment
+            ImageIndexEntry first;
+            if (count > 0 && readEntry(source, 0, first) && key >= first.sequence && key - first.sequence < count) {
+                position = key - first.sequence;
+                found = readEntry(source, position, entry) && entry.sequence == key;
+            }
+        } else {
+            uint32_t lo = 0;
+            uint32_t hi = count;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                ImageIndexEntry probe;
+                if (!readEntry(source, mid, probe)) {
+                    break;
+                }
+                if (probe.timestamp < key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            position = lo;
+            found = lo < count && readEntry(source, lo, entry);
+        }
+        index.close();
+        if (found || !byTime) {
+            return found;
+        }
+    }
+    return false;
+}
+
+bool ImageStore::findBySequence(uint32_t sequence, ImageIndexEntry &entry)
+{
+    uint32_t segment, position;
+    return locate(sequence, false, entry, segment, position);
+}
+
+bool ImageStore::findByTime(uint32_t timestamp, ImageIndexEntry &entry)
+{
+    uint32_t segment, position;
+    return locate(timestamp, true, entry, segment, position);
+}
+
+bool ImageStore::openRecord(uint32_t sequence, ImageRecordReader &reader)
+{
+    ImageIndexEntry entry;
+    uint32_t segment, position;
+    if (!locate(sequence, false, entry, segment, position)) {
+        return false;
+    }
+    reader._file = _fs.open(segmentPath(segment, ".pak"), FILE_READ);
+    reader._start = entry.offset + sizeof(ImageRecordHeader);
+    reader._length = entry.length;
+    reader._sequence = entry.sequence;
+    reader._timestamp = entry.timestamp;
+    return reader.rewind();
+}
+
+bool ImageStore::markUploaded(uint32_t sequence)
+{
+    ImageIndexEntry entry;
+    uint32_t segment, position;
+    if (!locate(sequence, false, entry, segment, position)) {
+        return false;
+    }
+    entry.flags |= IMAGE_FLAG_UPLOADED;
+
+    File index = segment == _lastSegment ? File() : _fs.open(segmentPath(segment, ".idx"), "r+");
+    File &target = segment == _lastSegment ? _index : index;
+    bool ok = target.seek(position * sizeof(ImageIndexEntry) + offsetof(ImageIndexEntry, flags)) &&
+              target.write((const uint8_t *)&entry.flags, sizeof(entry.flags)) == sizeof(entry.flags);
+    target.flush();
+    index.close();
+    return ok;
+}
+
+// Images in the segment not yet marked uploaded
+uint32_t ImageStore::pendingUploads(uint32_t segment)
+{
+    File index = _fs.open(segmentPath(segment, ".idx"), FILE_READ);
+    uint32_t count = index ? index.size() / sizeof(ImageIndexEntry) : 0;
+    uint32_t pending = 0;
+    ImageIndexEntry entries[32];
+    for (uint32_t done = 0; done < count;) {
+        uint32_t batch = min(count - done, (uint32_t)(sizeof(entries) / sizeof(entries[0])));
+        if (index.read((uint8_t *)entries, batch * sizeof(ImageIndexEntry)) != batch * sizeof(ImageIndexEntry)) {
+            pending += count - done; // Unreadable entries count as not uploaded
+            break;
+        }
+        for (uint32_t i = 0; i < batch; i++) {
+            pending += !(entries[i].flags & IMAGE_FLAG_UPLOADED);
+        }
+        done += batch;
+    }
+    index.close();
+    return pending;
+}
+
+// Called before a new segment is created; the active segment is never evicted
+void ImageStore::makeRoom()
+{
+    while (_segmentCount > 1) {
+        bool overQuota = _quota > 0 && (uint64_t)(_segmentCount + 1) * IMAGE_STORE_SEGMENT_SIZE > _quota;
+        bool lowSpace = _reserve > 0 && _freeSpace != NULL && _freeSpace() < _reserve + IMAGE_STORE_SEGMENT_SIZE;
+        if (!overQuota && !lowSpace) {
+            return;
+        }
+
+        uint32_t victim = 0;
+        uint32_t oldest = 0;
+        uint32_t pending = 0;
+        for (uint32_t segment = _firstSegment; segment < _lastSegment && victim == 0; segment++) {
+            if (!_fs.exists(segmentPath(segment, ".pak"))) {
+                continue;
+            }
+            if (oldest == 0) {
+                oldest = segment;
+            }
+            if (pendingUploads(segment) == 0) {
+                victim = segment;
+            }
+        }
+        if (victim == 0 && lowSpace) {
+            victim = oldest; // The card is full: captures not yet uploaded are lost
+            pending = oldest != 0 ? pendingUploads(oldest) : 0;
+        }
+        if (victim == 0) {
+            Serial.println("ImageStore: over quota, no fully uploaded segment to evict");
+            return;
+        }
+        if (!removeSegment(victim)) {
+            return;
+        }
+        Serial.printf("ImageStore: evicted segment %u (%s)", (unsigned)victim, overQuota ? "quota" : "free space");
+        Serial.printf(pending > 0 ? ", %u image(s) not uploaded\n" : "\n", (unsigned)pending);
+    }
+}
+
+bool ImageStore::removeSegment(uint32_t segment)
+{
+    if (!_fs.remove(segmentPath(segment, ".pak"))) {
+        Serial.printf("ImageStore: failed to delete segment %u\n", (unsigned)segment);
+        return false;
+    }
+    _fs.remove(segmentPath(segment, ".idx"));
+    _segmentCount--;
+    _segmentsEvicted++;
+    if (segment == _firstSegment) {
+        do {
+            _firstSegment++;
+        } while (_firstSegment < _lastSegment && !_fs.exists(segmentPath(_firstSegment, ".pak")));
+        ImageIndexEntry first;
+        _firstSequence = firstEntry(_firstSegment, first) ? first.sequence : _nextSequence;
+    }
+    return true;
+}
@@ -0,0 +1,147 @@
+#ifndef ImageStore_h
+#define ImageStore_h
+
+#include <Arduino.h>
+#include "FS.h"
+
+// Packed image container: captures are appended as records to preallocated segment files
+// (<folder>/seg_NNNNN.pak) instead of one FAT file each, with a compact fixed-size index per
+// segment (seg_NNNNN.idx). Appends never touch a directory, and lookups binary-search the index.
+//
+// Record: ImageRecordHeader, then `length` payload bytes; records start on 512-byte boundaries.
+// The payload is written first and the header last, so a record only exists once complete.
+// Index entries are appended after the header; begin() re-indexes records the index missed.
+//
+// Old captures go a whole segment at a time, when a new segment is needed (setRetention()):
+// over the quota, the oldest segment whose images are all uploaded is deleted; below the
+// free-space reserve, the oldest segment goes even if it holds images not yet uploaded.
+// Evicting a segment other than the oldest leaves a gap in the numbering, which lookups skip.
+
+#define IMAGE_STORE_SEGMENT_SIZE (32UL * 1024 * 1024) // Preallocated size of each segment
+#define IMAGE_STORE_MAX_RECORD (1024UL * 1024)        // Start a new segment when less is left
+#define IMAGE_STORE_ALIGN 512
+#define IMAGE_RECORD_MAGIC 0x52474D49 // "IMGR"
+
+#define IMAGE_FLAG_UPLOADED 0x01
+
+// Bytes left on the card, for the free-space reserve
+typedef uint64_t (*ImageStoreFreeSpace)();
+
+struct ImageRecordHeader {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t timestamp;  // Unix time in seconds, never decreasing within a store
+    uint32_t length;     // Payload bytes
+    uint32_t payloadCrc; // CRC32 of the payload
+    uint32_t headerCrc;  // CRC32 of the fields above
+};
+
+struct ImageIndexEntry {
+    uint32_t sequence;
+    uint32_t timestamp;
+    uint32_t offset;     // Header offset within the segment
+    uint32_t length;
+    uint32_t flags;      // IMAGE_FLAG_*
+};
+
+// Read-only stream over one record's payload
+class ImageRecordReader : public Stream {
+public:
+    ImageRecordReader() : _start(0), _length(0), _position(0), _sequence(0), _timestamp(0) {}
+    int available() override { return _length - _position; }
+    int read() override;
+    int peek() override;
+    size_t readBytes(char *buffer, size_t length) override;
+    size_t read(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    size_t write(uint8_t) override { return 0; }
+    bool rewind();
+    void close() { _file.close(); }
+    size_t size() const { return _length; }
+    uint32_t sequence() const { return _sequence; }
+    uint32_t timestamp() const { return _timestamp; }
+    operator bool() const { return (bool)_file; }
+
+private:
+    friend class ImageStore;
+    File _file;
+    size_t _start;
+    size_t _length;
+    size_t _position;
+    uint32_t _sequence;
+    uint32_t _timestamp;
+};
+
+class ImageStore : public Print {
+public:
+    ImageStore(fs::FS &fs, const char *folder);
+    bool begin();
+    void end();
+    // 0 disables the quota or the reserve; the default keeps every segment
+    void setRetention(uint64_t quotaBytes, uint64_t reserveBytes = 0, ImageStoreFreeSpace freeSpace = NULL);
+
+    // Appending: beginRecord(), write the payload through this Print, then commitRecord().
+    // restartRecord() drops the payload written so far, abortRecord() drops the record.
+    bool beginRecord(uint32_t timestamp);
+    bool restartRecord();
+    bool commitRecord(uint32_t *sequence = NULL);
+    void abortRecord();
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    size_t recordLength() const { return _recordLength; }
+
+    bool findBySequence(uint32_t sequence, ImageIndexEntry &entry);
+    bool findByTime(uint32_t timestamp, ImageIndexEntry &entry); // First record at or after timestamp
+    bool openRecord(uint32_t sequence, ImageRecordReader &reader);
+    bool markUploaded(uint32_t sequence);
+
+    uint32_t firstSequence() const { return _firstSequence; }
+    uint32_t lastSequence() const { return _nextSequence - 1; }
+    bool empty() const { return _nextSequence == _firstSequence; }
+    uint32_t segmentCount() const { return _segmentCount; }
+    uint32_t segmentsEvicted() const { return _segmentsEvicted; }
+    static String recordName(uint32_t sequence);
+
+private:
+    fs::FS &_fs;
+    String _folder;
+    bool _ready;
+    uint32_t _firstSegment;   // 0 when the store holds no segments
+    uint32_t _lastSegment;
+    uint32_t _firstSequence;
+    uint32_t _nextSequence;
+    uint32_t _lastTimestamp;
+    uint32_t _segmentCount;   // Existing segments, the range may have gaps
+
+    // Retention
+    uint64_t _quota;
+    uint64_t _reserve;
+    ImageStoreFreeSpace _freeSpace;
+    uint32_t _segmentsEvicted;
+
+    // Active segment, kept open between captures
+    File _segment;
+    File _index;
+    uint32_t _indexCount;
+    uint32_t _writeOffset;
+
+    // Record being appended
+    bool _recording;
+    uint32_t _recordOffset;
+    uint32_t _recordTimestamp;
+    size_t _recordLength;
+    uint32_t _recordCrc;
+    bool _recordFailed;
+
+    String segmentPath(uint32_t segment, const char *extension) const;
+    bool openSegment(uint32_t segment, bool create);
+    uint32_t recoverIndex();
+    bool readEntry(File &index, uint32_t position, ImageIndexEntry &entry);
+    uint32_t entryCount(uint32_t segment);
+    bool firstEntry(uint32_t segment, ImageIndexEntry &entry);
+    uint32_t pendingUploads(uint32_t segment);
+    void makeRoom();
+    bool removeSegment(uint32_t segment);
+    bool locate(uint32_t key, bool byTime, ImageIndexEntry &entry, uint32_t &segment, uint32_t &position);
+};
+
+#endif
@@ -47,7 +47,7 @@ bool InferenceHandler::connectToServer()
     return false;
 }
 
-String InferenceHandler::makeMultipartRequest(File &file, const char *filename, float confidence, float overlap)
+String InferenceHandler::makeMultipartRequest(Stream &body, size_t bodyLength, const char *filename, float confidence, float overlap)
 {
     // Connection is maintained from begin()
     if (!_client.connected()) {
@@ -86,7 +86,7 @@ String InferenceHandler::makeMultipartRequest(File &file, const char *filename,
     requestLength += fileHeader.length();
 
     // File content
-    requestLength += file.size();
+    requestLength += bodyLength;
 
     // Closing boundary
     String closing = lineEnd + twoHyphens + boundary + twoHyphens + lineEnd;
@@ -112,7 +112,7 @@ String InferenceHandler::makeMultipartRequest(File &file, const char *filename,
     // Send file in chunks
     uint8_t buffer[1024];
     size_t bytesRead;
-    while ((bytesRead = file.read(buffer, sizeof(buffer))) > 0)
+    while ((bytesRead = body.readBytes((char *)buffer, sizeof(buffer))) > 0)
     {
         _client.write(buffer, bytesRead);
     }
@@ -158,6 +158,28 @@ float InferenceHandler::calculateRipenessPercentage(const JsonObject &prediction
     return (float)ripeCount / totalObjects * 100.0f;
 }
 
+bool InferenceHandler::parseResponse(const String &response, InferenceResult &result)
+{
+    StaticJsonDocument<1024> doc; 
+    DeserializationError error = deserializeJson(doc, response);
+    if (error)
+    {
+        Serial.println("JSON parsing failed");
+        return false;
+    }
+
+    result.frameCount = doc["frame_count"] | 0;
+    result.totalObjects = doc["total_objects"] | 0;
+
+    JsonObject predictions = doc["predictions"];
+    result.ripeCount = predictions["ripe"] | 0;
+    result.unripeCount = predictions["unripe"] | 0;
+    result.greenCount = predictions["green"] | 0;
+
+    result.ripenessPercentage = calculateRipenessPercentage(predictions, result.totalObjects);
+    return true;
+}
+
 bool InferenceHandler::requestInference(const char *filename, float confidence, float overlap, InferenceResult &result)
 {
     int retries = 3;
@@ -168,28 +190,35 @@ bool InferenceHandler::requestInference(const char *filename, float confidence,
             return false;
         }
 
-        String response = makeMultipartRequest(file, filename, confidence, overlap);
+        String response = makeMultipartRequest(file, file.size(), filename, confidence, overlap);
         file.close();
 
         if (response.length() > 0) {
-            StaticJsonDocument<1024> doc; 
-            DeserializationError error = deserializeJson(doc, response);
-            if (error)
-            {
-                Serial.println("JSON parsing failed");
-                return false;
-            }
+            return parseResponse(response, result);
+        }
 
-            result.frameCount = doc["frame_count"] | 0;
-            result.totalObjects = doc["total_objects"] | 0;
+        Serial.printf("Attempt %d failed, retrying...\n", 4-retries);
+        retries--;
+        delay(1000);
+    }
 
-            JsonObject predictions = doc["predictions"];
-            result.ripeCount = predictions["ripe"] | 0;
-            result.unripeCount = predictions["unripe"] | 0;
-            result.greenCount = predictions["green"] | 0;
+    Serial.println("All retry attempts failed");
+    return false;
+}
 
-            result.ripenessPercentage = calculateRipenessPercentage(predictions, result.totalObjects);
-            return true;
+bool InferenceHandler::requestInference(ImageRecordReader &image, float confidence, float overlap, InferenceResult &result)
+{
+    String name = ImageStore::recordName(image.sequence());
+    int retries = 3;
+    while (retries > 0) {
+        if (!image.rewind()) {
+            Serial.println("Failed to read image record");
+            return false;
+        }
+
+        String response = makeMultipartRequest(image, image.size(), name.c_str(), confidence, overlap);
+        if (response.length() > 0) {
+            return parseResponse(response, result);
         }
 
         Serial.printf("Attempt %d failed, retrying...\n", 4-retries);
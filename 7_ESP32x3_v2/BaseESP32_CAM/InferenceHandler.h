@@ -5,6 +5,7 @@
 #include <WiFiClientSecure.h>
 #include "FS.h"
 #include "SD_MMC.h"
+#include "ImageStore.h"
 #include <ArduinoJson.h>
 
 struct InferenceResult {
@@ -21,6 +22,7 @@ public:
     InferenceHandler(const char* ssid, const char* password, const char* host, int httpsPort);
     bool begin();
     bool requestInference(const char* filename, float confidence, float overlap, InferenceResult& result);
+    bool requestInference(ImageRecordReader& image, float confidence, float overlap, InferenceResult& result);
     void end();
 
 private:
@@ -32,7 +34,8 @@ private:
     WiFiClientSecure _client;
 
     bool connectToServer();
-    String makeMultipartRequest(File& file, const char* filename, float confidence, float overlap);
+    String makeMultipartRequest(Stream& body, size_t bodyLength, const char* filename, float confidence, float overlap);
+    bool parseResponse(const String& response, InferenceResult& result);
     float calculateRipenessPercentage(const JsonObject& predictions, int totalObjects);
 };
 
@@ -0,0 +1,144 @@
+#include "ResultLog.h"
+#include <rom/crc.h>
+
+#define RESULT_SCAN_BATCH 16 // Records per read while scanning (one 512-byte sector)
+
+static uint32_t recordCrc(const ResultRecord &record)
+{
+    return crc32_le(0, (const uint8_t *)&record, offsetof(ResultRecord, crc));
+}
+
+ResultLog::ResultLog(fs::FS &fs, const char *path, uint32_t capacity)
+    : _fs(fs), _path(path), _capacity(capacity), _nextSequence(1), _sentThrough(0)
+{
+}
+
+bool ResultLog::validRecord(const ResultRecord &record, uint32_t slot) const
+{
+    return record.sequence != 0 && record.sequence % _capacity == slot && record.crc == recordCrc(record);
+}
+
+bool ResultLog::begin()
+{
+    static_assert(sizeof(ResultRecord) == 32, "ResultRecord must stay 32 bytes, records never straddle a sector");
+
+    if (!_fs.exists(_path)) {
+        // Zero-filled, so no slot can hold a record with a valid CRC
+        File file = _fs.open(_path, FILE_WRITE);
+        if (!file) {
+            Serial.println("Failed to create result log");
+            return false;
+        }
+        uint8_t zeros[RESULT_SCAN_BATCH * sizeof(ResultRecord)] = {0};
+        for (uint32_t slot = 0; slot < _capacity; slot += RESULT_SCAN_BATCH) {
+            size_t n = min((uint32_t)RESULT_SCAN_BATCH, _capacity - slot) * sizeof(ResultRecord);
+            if (file.write(zeros, n) != n) {
+                Serial.println("Failed to preallocate result log");
+                file.close();
+                return false;
+            }
+        }
+        file.close();
+    }
+
+    _file = _fs.open(_path, "r+");
+    if (!_file || _file.size() < _capacity * sizeof(ResultRecord)) {
+        Serial.println("Failed to open result log");
+        return false;
+    }
+
+    // Single pass over the whole ring, bounded by its fixed size
+    uint32_t newest = 0;
+    _sentThrough = 0;
+    ResultRecord batch[RESULT_SCAN_BATCH];
+    _file.seek(0);
+    for (uint32_t slot = 0; slot < _capacity; slot += RESULT_SCAN_BATCH) {
+        size_t count = min((uint32_t)RESULT_SCAN_BATCH, _capacity - slot);
+        if (_file.read((uint8_t *)batch, count * sizeof(ResultRecord)) != count * sizeof(ResultRecord)) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (!validRecord(batch[i], slot + i)) {
+                continue;
+            }
+            newest = max(newest, batch[i].sequence);
+            if (batch[i].flags & RESULT_FLAG_SENT) {
+                _sentThrough = max(_sentThrough, batch[i].sequence);
+            }
+        }
+    }
+    _nextSequence = newest + 1;
+    Serial.printf("Result log: %u records, last #%u, sent through #%u\n",
+                  (unsigned)(_nextSequence - firstSequence()), (unsigned)lastSequence(), (unsigned)_sentThrough);
+    return true;
+}
+
+uint32_t ResultLog::firstSequence() const
+{
+    return _nextSequence > _capacity ? _nextSequence - _capacity : 1;
+}
+
+bool ResultLog::writeRecord(ResultRecord &record)
+{
+    record.crc = recordCrc(record);
+    if (!_file.seek((record.sequence % _capacity) * sizeof(ResultRecord))) {
+        return false;
+    }
+    bool ok = _file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record);
+    _file.flush();
+    return ok;
+}
+
+bool ResultLog::append(ResultRecord &record)
+{
+    if (!_file) {
+        return false;
+    }
+    record.sequence = _nextSequence;
+    record.reserved = 0;
+    if (!writeRecord(record)) {
+        Serial.println("Failed to write result record");
+        return false;
+    }
+    _nextSequence++;
+    return true;
+}
+
+bool ResultLog::read(uint32_t sequence, ResultRecord &record)
+{
+    if (!_file || sequence < firstSequence() || sequence >= _nextSequence) {
+        return false;
+    }
+    if (!_file.seek((sequence % _capacity) * sizeof(ResultRecord)) ||
+        _file.read((uint8_t *)&record, sizeof(record)) != sizeof(record)) {
+        return false;
+    }
+    return validRecord(record, sequence % _capacity) && record.sequence == sequence;
+}
+
+bool ResultLog::markSent(uint32_t sequence)
+{
+    ResultRecord record;
+    if (!read(sequence, record)) {
+        return false;
+    }
+    record.flags |= RESULT_FLAG_SENT;
+    if (!writeRecord(record)) {
+        return false;
+    }
+    _sentThrough = max(_sentThrough, sequence);
+    return true;
+}
+
+size_t ResultLog::readUnsent(ResultRecord *records, size_t maxRecords)
+{
+    uint32_t first = max(_sentThrough + 1, firstSequence());
+    uint32_t end = _nextSequence - first > maxRecords ? first + maxRecords : _nextSequence;
+    size_t count = 0;
+    for (uint32_t sequence = first; sequence < end; sequence++) {
+        if (read(sequence, records[count])) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,68 @@
+#ifndef ResultLog_h
+#define ResultLog_h
+
+#include <Arduino.h>
+#include "FS.h"
+
+// Durable history of inference results: fixed-size CRC-protected records in a preallocated
+// file used as a ring. Record n lives in slot n % capacity, so a write never moves anything
+// and the file never grows. begin() reads the file once (capacity * 32 bytes) to find the
+// newest valid record; a torn write only loses the record being written.
+//
+// Results are sent over ESP-NOW in order, so the unsent ones are always the newest records:
+// everything after the newest record flagged as sent.
+
+#define RESULT_LOG_CAPACITY 4096 // 128 KB on the card
+
+#define RESULT_SOURCE_CAMERA 1
+#define RESULT_SOURCE_TELLO 2
+
+#define RESULT_FLAG_SENT 0x01
+
+struct ResultRecord {
+    uint32_t sequence;
+    uint32_t timestamp;      // Unix time in seconds (time since boot until NTP has synced)
+    uint32_t imageSequence;  // ImageStore record the result belongs to
+    uint8_t source;          // RESULT_SOURCE_*
+    uint8_t flags;           // RESULT_FLAG_*
+    uint16_t totalObjects;
+    uint16_t ripeCount;
+    uint16_t unripeCount;
+    uint16_t greenCount;
+    uint16_t reserved;
+    float ripeness;          // Percent
+    uint32_t crc;            // CRC32 of the fields above
+};
+
+class ResultLog {
+public:
+    ResultLog(fs::FS &fs, const char *path, uint32_t capacity = RESULT_LOG_CAPACITY);
+    bool begin();
+
+    // Fills in record.sequence and record.crc
+    bool append(ResultRecord &record);
+    bool read(uint32_t sequence, ResultRecord &record);
+    bool markSent(uint32_t sequence);
+
+    // Up to maxRecords of the oldest unsent records, oldest first. After markSent() on the
+    // last one, the next call returns the records that follow
+    size_t readUnsent(ResultRecord *records, size_t maxRecords);
+
+    bool empty() const { return _nextSequence == firstSequence(); }
+    uint32_t firstSequence() const;
+    uint32_t lastSequence() const { return _nextSequence - 1; }
+    uint32_t lastSentSequence() const { return _sentThrough; }
+
+private:
+    fs::FS &_fs;
+    String _path;
+    uint32_t _capacity;
+    File _file;
+    uint32_t _nextSequence; // Sequences start at 1
+    uint32_t _sentThrough;
+
+    bool writeRecord(ResultRecord &record);
+    bool validRecord(const ResultRecord &record, uint32_t slot) const;
+};
+
+#endif
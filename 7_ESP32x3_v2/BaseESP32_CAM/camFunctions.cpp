@@ -1,4 +1,11 @@
 #include <camFunctions.h>
+#include "img_converters.h"
+
+static CaptureMode currentMode = CAPTURE_FULL;
+static framesize_t fullFrameSize = FULL_FRAMESIZE;
+static framesize_t thumbnailFrameSize = THUMBNAIL_FRAMESIZE;
+static unsigned long modeSwitchMicros = 0;
+static bool exposureSettled = false; // Since initCamera()
 
 bool initCamera()
 {
@@ -27,7 +34,10 @@ bool initCamera()
   // init with high specs to pre-allocate larger buffers
   if (psramFound())
   {
-    config.frame_size = FRAMESIZE_VGA;
+    // Buffers are allocated for this size; thumbnails reuse them at a smaller window
+    fullFrameSize = FULL_FRAMESIZE;
+    thumbnailFrameSize = THUMBNAIL_FRAMESIZE;
+    config.frame_size = fullFrameSize;
     // FRAMESIZE_UXGA (1600 x 1200)
     // FRAMESIZE_QVGA (320 x 240)
     // FRAMESIZE_CIF (352 x 288)
@@ -35,12 +45,15 @@ bool initCamera()
     // FRAMESIZE_SVGA (800 x 600)
     // FRAMESIZE_XGA (1024 x 768)
     // FRAMESIZE_SXGA (1280 x 1024)
-    config.jpeg_quality = 10; // 10-63 lower number means higher quality
+    config.jpeg_quality = FULL_QUALITY; // 10-63 lower number means higher quality
     config.fb_count = 2;
+    config.grab_mode = CAMERA_GRAB_LATEST; // burst frames must be fresh, not queued
   }
   else
   {
-    config.frame_size = FRAMESIZE_CIF;
+    fullFrameSize = FRAMESIZE_CIF;
+    thumbnailFrameSize = FRAMESIZE_QQVGA;
+    config.frame_size = fullFrameSize;
     config.jpeg_quality = 12;
     config.fb_count = 1;
   }
@@ -76,15 +89,151 @@ bool initCamera()
   s->set_vflip(s, 0);                      // 0 = disable , 1 = enable
   s->set_dcw(s, 1);                        // 0 = disable , 1 = enable
   s->set_colorbar(s, 0);                   // 0 = disable , 1 = enable
+  currentMode = CAPTURE_FULL;
+  exposureSettled = false;
+  return true;
+}
+
+// Decodes a JPEG frame at reduced scale into RGB565 (big endian as produced by the decoder).
+// The caller owns the returned buffer (free()), width and height are set on success.
+static uint8_t *decodeRgb565(const camera_fb_t *fb, jpg_scale_t scale, int &width, int &height)
+{
+  int divider = 1 << scale;
+  width = fb->width / divider;
+  height = fb->height / divider;
+  if (width < 3 || height < 3)
+  {
+    return NULL;
+  }
+
+  size_t pixels = (size_t)width * height;
+  uint8_t *rgb = (uint8_t *)(psramFound() ? ps_malloc(pixels * 2) : malloc(pixels * 2));
+  if (!rgb)
+  {
+    return NULL;
+  }
+  if (!jpg2rgb565(fb->buf, fb->len, rgb, scale))
+  {
+    free(rgb);
+    return NULL;
+  }
+  return rgb;
+}
+
+static inline void rgb565ToRgb(const uint8_t *px, uint32_t &r, uint32_t &g, uint32_t &b)
+{
+  uint16_t c = (px[0] << 8) | px[1];
+  r = (c >> 11) << 3;
+  g = ((c >> 5) & 0x3F) << 2;
+  b = (c & 0x1F) << 3;
+}
+
+static inline uint8_t lumaOf(uint32_t r, uint32_t g, uint32_t b)
+{
+  return (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+// Decodes a JPEG frame at reduced scale into an 8-bit luma image (same ownership as above)
+static uint8_t *decodeLuma(const camera_fb_t *fb, jpg_scale_t scale, int &width, int &height)
+{
+  uint8_t *rgb = decodeRgb565(fb, scale, width, height);
+  if (!rgb)
+  {
+    return NULL;
+  }
+
+  // Convert in place, the luma image is half the size of the RGB565 one
+  size_t pixels = (size_t)width * height;
+  for (size_t i = 0; i < pixels; i++)
+  {
+    uint32_t r, g, b;
+    rgb565ToRgb(rgb + 2 * i, r, g, b);
+    rgb[i] = lumaOf(r, g, b);
+  }
+  return rgb;
+}
+
+static bool meanFrameLuma(const camera_fb_t *fb, float &meanLuma)
+{
+  int width, height;
+  uint8_t *luma = decodeLuma(fb, JPG_SCALE_8X, width, height);
+  if (!luma)
+  {
+    return false;
+  }
+  uint32_t sum = 0;
+  size_t pixels = (size_t)width * height;
+  for (size_t i = 0; i < pixels; i++)
+  {
+    sum += luma[i];
+  }
+  free(luma);
+  meanLuma = (float)sum / pixels;
   return true;
 }
 
-bool captureAndSaveImage(const String &path)
+bool scoreFrame(const camera_fb_t *fb, FrameScore &score)
 {
-  camera_fb_t *fb = NULL;
+  if (!fb || fb->format != PIXFORMAT_JPEG)
+  {
+    return false;
+  }
+
+  int width, height;
+  uint8_t *luma = decodeLuma(fb, JPG_SCALE_4X, width, height);
+  if (!luma)
+  {
+    return false;
+  }
+
+  // Exposure statistics over the whole image
+  uint32_t sum = 0;
+  uint32_t clippedCount = 0;
+  size_t pixels = (size_t)width * height;
+  for (size_t i = 0; i < pixels; i++)
+  {
+    sum += luma[i];
+    if (luma[i] <= 8 || luma[i] >= 247)
+    {
+      clippedCount++;
+    }
+  }
+
+  // Sharpness: mean squared 4-neighbour Laplacian over the interior
+  uint64_t energy = 0;
+  for (int y = 1; y < height - 1; y++)
+  {
+    const uint8_t *row = luma + y * width;
+    for (int x = 1; x < width - 1; x++)
+    {
+      int lap = 4 * row[x] - row[x - 1] - row[x + 1] - row[x - width] - row[x + width];
+      energy += (uint32_t)(lap * lap);
+    }
+  }
+  free(luma);
+
+  score.meanLuma = (float)sum / pixels;
+  score.clipped = (float)clippedCount / pixels;
+  score.sharpness = (float)energy / ((width - 2) * (height - 2));
+
+  // Penalise frames away from mid-grey and frames with crushed or blown areas
+  float exposure = 1.0f - fabsf(score.meanLuma - 128.0f) / 128.0f;
+  score.total = score.sharpness * exposure * (1.0f - score.clipped);
+  return true;
+}
 
-  // Warm-up loop to discard first few frames (makes auto adjustment more stable)
-  for (int i = 0; i < 100; i++)
+// Discards frames until auto exposure / white balance stop moving. Once per initCamera():
+// AE/AWB run in the sensor, and a mode switch only changes its output window, so the
+// thumbnail check and the full-resolution burst of one cycle share the settled exposure.
+static void waitForExposureToSettle()
+{
+  if (exposureSettled)
+  {
+    return;
+  }
+  exposureSettled = true; // Also after a timeout, waiting again would time out as well
+  float previousLuma = -1.0f;
+  for (int i = 0; i < WARMUP_MAX_FRAMES; i++)
   {
     camera_fb_t *fb = esp_camera_fb_get();
     if (!fb)
@@ -92,39 +241,231 @@ bool captureAndSaveImage(const String &path)
       Serial.println("Failed to capture frame");
       continue;
     }
+
+    float luma;
+    bool measured = i >= WARMUP_MIN_FRAMES && meanFrameLuma(fb, luma);
     esp_camera_fb_return(fb);
+    if (!measured)
+    {
+      continue;
+    }
+
+    if (previousLuma >= 0.0f && fabsf(luma - previousLuma) < WARMUP_LUMA_TOLERANCE)
+    {
+      Serial.printf("Exposure settled after %d frames\n", i + 1);
+      return;
+    }
+    previousLuma = luma;
   }
+  Serial.println("Exposure did not settle, continuing with burst");
+}
 
-  // Take a photo
-  fb = esp_camera_fb_get();
+bool setCaptureMode(CaptureMode mode)
+{
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s)
+  {
+    return false;
+  }
+  if (mode == currentMode)
+  {
+    modeSwitchMicros = 0;
+    return true;
+  }
+
+  framesize_t size = mode == CAPTURE_FULL ? fullFrameSize : thumbnailFrameSize;
+  unsigned long start = micros();
+  if (s->set_framesize(s, size) != 0)
+  {
+    Serial.println("Failed to change frame size");
+    return false;
+  }
+  s->set_quality(s, mode == CAPTURE_FULL ? FULL_QUALITY : THUMBNAIL_QUALITY);
+  currentMode = mode;
+
+  // Frames already in flight still have the old geometry, the switch is complete
+  // once the first frame with the new size comes out of the driver
+  for (int i = 0; i < 10; i++)
+  {
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (!fb)
+    {
+      continue;
+    }
+    bool switched = fb->width == resolution[size].width && fb->height == resolution[size].height;
+    esp_camera_fb_return(fb);
+    if (switched)
+    {
+      modeSwitchMicros = micros() - start;
+      return true;
+    }
+  }
+  modeSwitchMicros = micros() - start;
+  Serial.println("Frame size change not observed");
+  return false;
+}
+
+unsigned long lastModeSwitchMicros()
+{
+  return modeSwitchMicros;
+}
+
+bool analyzeThumbnail(ThumbnailStats &stats)
+{
+  waitForExposureToSettle();
+
+  camera_fb_t *fb = esp_camera_fb_get();
   if (!fb)
   {
     Serial.println("Camera capture failed");
     return false;
   }
+  int width, height;
+  uint8_t *rgb = decodeRgb565(fb, currentMode == CAPTURE_THUMBNAIL ? JPG_SCALE_4X : JPG_SCALE_8X, width, height);
+  esp_camera_fb_return(fb);
+  if (!rgb)
+  {
+    return false;
+  }
 
-  // Create directory if it doesn't exist
-  String dir = path.substring(0, path.lastIndexOf('/'));
-  if (!SD_MMC.exists(dir))
+  uint32_t cellSum[THUMB_GRID_W * THUMB_GRID_H] = {0};
+  uint32_t cellCount[THUMB_GRID_W * THUMB_GRID_H] = {0};
+  uint32_t lumaSum = 0;
+  uint32_t redCount = 0;
+  for (int y = 0; y < height; y++)
   {
-    SD_MMC.mkdir(dir);
+    int cellRow = y * THUMB_GRID_H / height * THUMB_GRID_W;
+    for (int x = 0; x < width; x++)
+    {
+      uint32_t r, g, b;
+      rgb565ToRgb(rgb + 2 * (y * width + x), r, g, b);
+      uint8_t luma = lumaOf(r, g, b);
+      int cell = cellRow + x * THUMB_GRID_W / width;
+      cellSum[cell] += luma;
+      cellCount[cell]++;
+      lumaSum += luma;
+      // Ripe tomato red: bright and clearly dominant over green and blue
+      if (r > 90 && 2 * r > 3 * g && 2 * r > 3 * b)
+      {
+        redCount++;
+      }
+    }
   }
+  free(rgb);
 
-  // Save image to SD card
-  File file = SD_MMC.open(path.c_str(), FILE_WRITE);
-  if (!file)
+  size_t pixels = (size_t)width * height;
+  stats.meanLuma = (float)lumaSum / pixels;
+  stats.redFraction = (float)redCount / pixels;
+  for (int i = 0; i < THUMB_GRID_W * THUMB_GRID_H; i++)
+  {
+    stats.grid[i] = cellCount[i] ? cellSum[i] / cellCount[i] : 0;
+  }
+  return true;
+}
+
+float thumbnailDifference(const ThumbnailStats &a, const ThumbnailStats &b)
+{
+  uint32_t total = 0;
+  for (int i = 0; i < THUMB_GRID_W * THUMB_GRID_H; i++)
   {
-    Serial.println("Failed to open file for writing");
+    total += abs((int)a.grid[i] - (int)b.grid[i]);
+  }
+  return (float)total / (THUMB_GRID_W * THUMB_GRID_H);
+}
+
+bool captureAndSaveImage(ImageStore &store, const JpegCropRect *roi, uint32_t *sequence)
+{
+  waitForExposureToSettle();
+
+  // Burst: score every frame and keep a copy of the best one only
+  uint8_t *bestBuf = NULL;
+  size_t bestLen = 0;
+  size_t bestCapacity = 0;
+  FrameScore bestScore = {};
+  int bestIndex = -1;
+
+  for (int i = 0; i < BURST_FRAME_COUNT; i++)
+  {
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (!fb)
+    {
+      Serial.println("Camera capture failed");
+      continue;
+    }
+
+    FrameScore score;
+    if (!scoreFrame(fb, score))
+    {
+      // Unscorable frames are still usable if nothing better comes along
+      score = {};
+    }
+
+    if (bestIndex < 0 || score.total > bestScore.total)
+    {
+      if (fb->len > bestCapacity)
+      {
+        uint8_t *grown = (uint8_t *)(psramFound() ? ps_realloc(bestBuf, fb->len) : realloc(bestBuf, fb->len));
+        if (!grown)
+        {
+          Serial.println("Failed to allocate burst buffer");
+          esp_camera_fb_return(fb);
+          continue;
+        }
+        bestBuf = grown;
+        bestCapacity = fb->len;
+      }
+      memcpy(bestBuf, fb->buf, fb->len);
+      bestLen = fb->len;
+      bestScore = score;
+      bestIndex = i;
+    }
     esp_camera_fb_return(fb);
+  }
+
+  if (bestIndex < 0)
+  {
+    Serial.println("Camera capture failed");
+    free(bestBuf);
     return false;
   }
+  Serial.printf("Burst: kept frame %d/%d (sharpness %.1f, luma %.0f, clipped %.1f%%)\n",
+                bestIndex + 1, BURST_FRAME_COUNT, bestScore.sharpness, bestScore.meanLuma, bestScore.clipped * 100.0f);
 
-  bool success = file.write(fb->buf, fb->len);
-  file.close();
-  esp_camera_fb_return(fb);
+  // Append the image to the store as one record
+  if (!store.beginRecord(time(NULL)))
+  {
+    Serial.println("Failed to start image record");
+    free(bestBuf);
+    return false;
+  }
 
+  // Stream the region of interest straight from the frame into the record
+  bool success = false;
+  if (roi && roi->width > 0 && roi->height > 0)
+  {
+    JpegCropRect applied;
+    success = jpegCropMcu(bestBuf, bestLen, *roi, store, &applied);
+    if (success)
+    {
+      Serial.printf("ROI crop: %ux%u at (%u,%u), %u of %u bytes kept\n", applied.width, applied.height,
+                    applied.x, applied.y, (unsigned)store.recordLength(), (unsigned)bestLen);
+    }
+    else
+    {
+      // Unsupported or corrupt frame, fall back to storing it whole
+      Serial.println("ROI crop failed, saving full frame");
+      store.restartRecord();
+    }
+  }
   if (!success)
   {
+    success = store.write(bestBuf, bestLen) == bestLen;
+  }
+  free(bestBuf);
+
+  if (!success || !store.commitRecord(sequence))
+  {
+    store.abortRecord();
     Serial.println("Write failed");
     return false;
   }
@@ -4,6 +4,8 @@
 #include "esp_camera.h"
 #include "SD_MMC.h"
 #include "FS.h"
+#include "jpegCrop.h"
+#include "ImageStore.h"
 
 #ifndef CAMERA_PINS_H
 #define CAMERA_PINS_H
@@ -27,8 +29,52 @@
 #define PCLK_GPIO_NUM     22
 #endif
 
+// Burst capture settings
+#define BURST_FRAME_COUNT       5   // Frames scored per capture, only the best one is kept
+#define WARMUP_MIN_FRAMES       3   // Frames always discarded after init
+#define WARMUP_MAX_FRAMES      30   // Upper bound while waiting for auto exposure to settle
+#define WARMUP_LUMA_TOLERANCE 2.0f  // Mean luma change (0-255) between frames treated as settled
+
+// Capture modes sharing one initialised driver. The driver sizes its framebuffers for the
+// full mode at init, so a switch only reprograms the sensor output window and JPEG quality.
+enum CaptureMode
+{
+  CAPTURE_THUMBNAIL, // Small frames for cheap on-device checks
+  CAPTURE_FULL       // Inference-quality frames for upload
+};
+
+#define THUMBNAIL_FRAMESIZE FRAMESIZE_QVGA  // FRAMESIZE_QQVGA without PSRAM
+#define THUMBNAIL_QUALITY   12
+#define FULL_FRAMESIZE      FRAMESIZE_VGA   // FRAMESIZE_CIF without PSRAM
+#define FULL_QUALITY        10
+
+#define THUMB_GRID_W 8
+#define THUMB_GRID_H 6
+
+// Result of the on-device thumbnail analysis
+struct ThumbnailStats
+{
+  float meanLuma;                            // 0-255
+  float redFraction;                         // Share of pixels that look like ripe fruit
+  uint8_t grid[THUMB_GRID_W * THUMB_GRID_H]; // Coarse luma layout used for change detection
+};
+
+// Quality score of a single JPEG frame
+struct FrameScore
+{
+  float sharpness; // Mean squared Laplacian of the downscaled luma image
+  float meanLuma;  // Mean luma, 0-255
+  float clipped;   // Fraction of pixels crushed to black or blown to white
+  float total;     // Combined score used to rank burst frames
+};
+
 bool initCamera();
-bool captureAndSaveImage(const String &path);
+bool captureAndSaveImage(ImageStore &store, const JpegCropRect *roi = NULL, uint32_t *sequence = NULL);
+bool scoreFrame(const camera_fb_t *fb, FrameScore &score);
+bool setCaptureMode(CaptureMode mode);
+unsigned long lastModeSwitchMicros();
+bool analyzeThumbnail(ThumbnailStats &stats);
+float thumbnailDifference(const ThumbnailStats &a, const ThumbnailStats &b);
 bool deinitCamera();  
 
 #endif
\ No newline at end of file
@@ -0,0 +1,637 @@
+#include "jpegCrop.h"
+
+#define JPEG_MAX_COMPONENTS 3
+#define JPEG_MAX_SEGMENTS   32
+
+// Canonical Huffman table usable in both directions
+struct HuffTable
+{
+  bool defined;
+  uint8_t lookupLen[256]; // code length for an 8-bit prefix, 0 if the code is longer
+  uint8_t lookupSym[256];
+  int32_t maxCode[17];    // largest code of each length, -1 if none
+  int32_t valOffset[17];  // symbols[valOffset[l] + code] for codes of length l
+  uint8_t symbols[256];
+  uint16_t encCode[256];
+  uint8_t encLen[256];    // 0 if the symbol has no code
+};
+
+struct Component
+{
+  uint8_t id;
+  uint8_t h;
+  uint8_t v;
+  uint8_t dcTable;
+  uint8_t acTable;
+};
+
+struct Segment
+{
+  uint8_t marker;
+  size_t start; // offset of the 0xFF byte
+  size_t len;   // total length including marker and length field
+};
+
+// Reads the entropy-coded segment, removing byte stuffing and stopping at markers
+struct BitReader
+{
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+  uint32_t acc;
+  int bits;
+  int fakeBits;   // zero bits appended after a marker was reached
+  bool atMarker;
+  bool exhausted; // decoder consumed bits past the end of the segment
+
+  void fill()
+  {
+    while (bits <= 24)
+    {
+      uint32_t b = 0;
+      if (!atMarker && pos < len)
+      {
+        b = data[pos];
+        if (b == 0xFF)
+        {
+          uint8_t next = pos + 1 < len ? data[pos + 1] : 0xD9;
+          if (next == 0x00)
+          {
+            pos += 2;
+          }
+          else
+          {
+            atMarker = true;
+            b = 0;
+          }
+        }
+        else
+        {
+          pos++;
+        }
+      }
+      if (atMarker)
+      {
+        fakeBits += 8;
+      }
+      acc |= b << (24 - bits);
+      bits += 8;
+    }
+  }
+
+  uint32_t peek16()
+  {
+    fill();
+    return acc >> 16;
+  }
+
+  void skip(int n)
+  {
+    acc <<= n;
+    bits -= n;
+    if (bits < fakeBits)
+    {
+      exhausted = true;
+      fakeBits = bits;
+    }
+  }
+
+  uint32_t get(int n)
+  {
+    if (n == 0)
+    {
+      return 0;
+    }
+    fill();
+    uint32_t v = acc >> (32 - n);
+    skip(n);
+    return v;
+  }
+
+  // Drops the padding bits before a RSTn marker and steps over the marker
+  bool restart()
+  {
+    acc = 0;
+    bits = 0;
+    fakeBits = 0;
+    atMarker = false;
+    while (pos < len && data[pos] == 0xFF)
+    {
+      pos++;
+    }
+    if (pos >= len || data[pos] < 0xD0 || data[pos] > 0xD7)
+    {
+      return false;
+    }
+    pos++;
+    return true;
+  }
+};
+
+// Writes entropy-coded data with byte stuffing through a small staging buffer
+struct BitWriter
+{
+  Print *out;
+  uint8_t buf[512];
+  size_t used;
+  uint32_t acc;
+  int bits;
+  bool failed;
+
+  void byte(uint8_t b)
+  {
+    buf[used++] = b;
+    if (used == sizeof(buf))
+    {
+      drain();
+    }
+  }
+
+  void drain()
+  {
+    if (used > 0 && out->write(buf, used) != used)
+    {
+      failed = true;
+    }
+    used = 0;
+  }
+
+  void put(uint32_t code, int len)
+  {
+    if (len == 0)
+    {
+      return;
+    }
+    acc = (acc << len) | (code & ((1u << len) - 1));
+    bits += len;
+    while (bits >= 8)
+    {
+      uint8_t b = (uint8_t)(acc >> (bits - 8));
+      bits -= 8;
+      byte(b);
+      if (b == 0xFF)
+      {
+        byte(0x00);
+      }
+    }
+    acc &= (1u << bits) - 1;
+  }
+
+  void raw(const uint8_t *data, size_t len)
+  {
+    drain();
+    if (len > 0 && out->write(data, len) != len)
+    {
+      failed = true;
+    }
+  }
+
+  // Pads the last byte with ones, as required before a marker
+  void finish()
+  {
+    if (bits > 0)
+    {
+      put((1u << (8 - bits)) - 1, 8 - bits);
+    }
+    drain();
+  }
+};
+
+struct CropContext
+{
+  HuffTable dc[4];
+  HuffTable ac[4];
+  Component comps[JPEG_MAX_COMPONENTS];
+  int compCount;
+  uint16_t width;
+  uint16_t height;
+  uint16_t restartInterval;
+  Segment segments[JPEG_MAX_SEGMENTS];
+  int segmentCount;
+  int sofIndex;
+  size_t scanStart; // first byte of entropy-coded data
+};
+
+static uint16_t readU16(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static bool buildTable(HuffTable &t, const uint8_t *counts, const uint8_t *values, int valueCount)
+{
+  memset(&t, 0, sizeof(t));
+  memcpy(t.symbols, values, valueCount);
+
+  int32_t code = 0;
+  int k = 0;
+  for (int l = 1; l <= 16; l++)
+  {
+    t.valOffset[l] = k - code;
+    for (int i = 0; i < counts[l - 1]; i++, k++, code++)
+    {
+      uint8_t sym = values[k];
+      t.encCode[sym] = code;
+      t.encLen[sym] = l;
+      if (l <= 8)
+      {
+        int shift = 8 - l;
+        for (int j = 0; j < (1 << shift); j++)
+        {
+          t.lookupLen[(code << shift) | j] = l;
+          t.lookupSym[(code << shift) | j] = sym;
+        }
+      }
+    }
+    t.maxCode[l] = counts[l - 1] ? code - 1 : -1;
+    if (code > (1 << l))
+    {
+      return false; // over-subscribed table
+    }
+    code <<= 1;
+  }
+  t.defined = true;
+  return true;
+}
+
+static bool decodeSymbol(BitReader &in, const HuffTable &t, uint8_t &sym)
+{
+  uint32_t look = in.peek16();
+  uint8_t len = t.lookupLen[look >> 8];
+  if (len)
+  {
+    sym = t.lookupSym[look >> 8];
+    in.skip(len);
+    return true;
+  }
+  for (int l = 9; l <= 16; l++)
+  {
+    int32_t code = look >> (16 - l);
+    if (code <= t.maxCode[l])
+    {
+      sym = t.symbols[t.valOffset[l] + code];
+      in.skip(l);
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool emitSymbol(BitWriter &out, const HuffTable &t, uint8_t sym)
+{
+  if (!t.encLen[sym])
+  {
+    return false;
+  }
+  out.put(t.encCode[sym], t.encLen[sym]);
+  return true;
+}
+
+static bool parseHeaders(const uint8_t *jpeg, size_t len, CropContext &ctx)
+{
+  if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8)
+  {
+    return false;
+  }
+
+  bool haveSof = false;
+  size_t pos = 2;
+  while (pos + 4 <= len)
+  {
+    if (jpeg[pos] != 0xFF)
+    {
+      return false;
+    }
+    uint8_t marker = jpeg[pos + 1];
+    if (marker == 0xFF)
+    {
+      pos++; // fill byte
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+    {
+      pos += 2; // standalone marker without a length field
+      continue;
+    }
+    size_t segLen = readU16(jpeg + pos + 2);
+    if (segLen < 2 || pos + 2 + segLen > len || ctx.segmentCount == JPEG_MAX_SEGMENTS)
+    {
+      return false;
+    }
+    const uint8_t *p = jpeg + pos + 4;
+    size_t payload = segLen - 2;
+    ctx.segments[ctx.segmentCount] = {marker, pos, segLen + 2};
+
+    switch (marker)
+    {
+    case 0xC0: // baseline
+    case 0xC1: // extended sequential, Huffman
+      if (payload < 6 || p[0] != 8)
+      {
+        return false; // only 8-bit samples
+      }
+      ctx.height = readU16(p + 1);
+      ctx.width = readU16(p + 3);
+      ctx.compCount = p[5];
+      if (ctx.height == 0 || ctx.width == 0 || ctx.compCount < 1 || ctx.compCount > JPEG_MAX_COMPONENTS ||
+          payload < 6 + 3 * (size_t)ctx.compCount)
+      {
+        return false;
+      }
+      for (int i = 0; i < ctx.compCount; i++)
+      {
+        ctx.comps[i].id = p[6 + 3 * i];
+        ctx.comps[i].h = p[7 + 3 * i] >> 4;
+        ctx.comps[i].v = p[7 + 3 * i] & 0x0F;
+        if (ctx.comps[i].h < 1 || ctx.comps[i].h > 4 || ctx.comps[i].v < 1 || ctx.comps[i].v > 4)
+        {
+          return false;
+        }
+      }
+      ctx.sofIndex = ctx.segmentCount;
+      haveSof = true;
+      break;
+
+    case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+    case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+      return false; // progressive, lossless, hierarchical or arithmetic coded
+
+    case 0xC4: // DHT, possibly several tables
+    {
+      size_t off = 0;
+      while (off + 17 <= payload)
+      {
+        uint8_t tc = p[off] >> 4;
+        uint8_t th = p[off] & 0x0F;
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+          total += p[off + 1 + i];
+        }
+        if (tc > 1 || th > 3 || total > 256 || off + 17 + total > payload)
+        {
+          return false;
+        }
+        HuffTable &t = tc == 0 ? ctx.dc[th] : ctx.ac[th];
+        if (!buildTable(t, p + off + 1, p + off + 17, total))
+        {
+          return false;
+        }
+        off += 17 + total;
+      }
+      break;
+    }
+
+    case 0xDD: // DRI
+      if (payload < 2)
+      {
+        return false;
+      }
+      ctx.restartInterval = readU16(p);
+      break;
+
+    case 0xDA: // SOS
+    {
+      if (!haveSof || payload < 1 || p[0] != ctx.compCount || payload < 1 + 2 * (size_t)ctx.compCount + 3)
+      {
+        return false; // only single interleaved scans are supported
+      }
+      for (int i = 0; i < ctx.compCount; i++)
+      {
+        if (p[1 + 2 * i] != ctx.comps[i].id)
+        {
+          return false;
+        }
+        ctx.comps[i].dcTable = p[2 + 2 * i] >> 4;
+        ctx.comps[i].acTable = p[2 + 2 * i] & 0x0F;
+        if (ctx.comps[i].dcTable > 3 || ctx.comps[i].acTable > 3 ||
+            !ctx.dc[ctx.comps[i].dcTable].defined || !ctx.ac[ctx.comps[i].acTable].defined)
+        {
+          return false;
+        }
+      }
+      ctx.segmentCount++;
+      ctx.scanStart = pos + 2 + segLen;
+      return true;
+    }
+
+    default:
+      break;
+    }
+    ctx.segmentCount++;
+    pos += 2 + segLen;
+  }
+  return false;
+}
+
+static bool writeHeaders(const uint8_t *jpeg, const CropContext &ctx, uint16_t width, uint16_t height, BitWriter &out)
+{
+  static const uint8_t soi[2] = {0xFF, 0xD8};
+  out.raw(soi, sizeof(soi));
+  for (int i = 0; i < ctx.segmentCount; i++)
+  {
+    const Segment &seg = ctx.segments[i];
+    if (seg.marker == 0xDD)
+    {
+      continue; // kept MCUs are written without restart markers
+    }
+    if (i == ctx.sofIndex)
+    {
+      // marker(2) length(2) precision(1) height(2) width(2)
+      uint8_t head[9];
+      memcpy(head, jpeg + seg.start, 5);
+      head[5] = height >> 8;
+      head[6] = height & 0xFF;
+      head[7] = width >> 8;
+      head[8] = width & 0xFF;
+      out.raw(head, sizeof(head));
+      out.raw(jpeg + seg.start + 9, seg.len - 9);
+      continue;
+    }
+    out.raw(jpeg + seg.start, seg.len);
+  }
+  return !out.failed;
+}
+
+bool jpegCropMcu(const uint8_t *jpeg, size_t len, const JpegCropRect &roi, Print &out, JpegCropRect *applied)
+{
+  CropContext *ctx = (CropContext *)calloc(1, sizeof(CropContext));
+  if (!ctx)
+  {
+    return false;
+  }
+  if (!parseHeaders(jpeg, len, *ctx))
+  {
+    free(ctx);
+    return false;
+  }
+
+  int hMax = 1, vMax = 1;
+  for (int i = 0; i < ctx->compCount; i++)
+  {
+    hMax = max(hMax, (int)ctx->comps[i].h);
+    vMax = max(vMax, (int)ctx->comps[i].v);
+  }
+  if (ctx->compCount == 1)
+  {
+    // A single component scan is never interleaved: one block per MCU
+    hMax = vMax = 1;
+    ctx->comps[0].h = ctx->comps[0].v = 1;
+  }
+  int mcuW = 8 * hMax;
+  int mcuH = 8 * vMax;
+  int mcusX = (ctx->width + mcuW - 1) / mcuW;
+
+  // Clip the ROI to the image and widen it to the MCU grid
+  int x0 = min((int)roi.x, (int)ctx->width);
+  int y0 = min((int)roi.y, (int)ctx->height);
+  int x1 = min((int)roi.x + (int)roi.width, (int)ctx->width);
+  int y1 = min((int)roi.y + (int)roi.height, (int)ctx->height);
+  if (x1 <= x0 || y1 <= y0)
+  {
+    free(ctx);
+    return false;
+  }
+  int firstCol = x0 / mcuW;
+  int lastCol = (x1 - 1) / mcuW;
+  int firstRow = y0 / mcuH;
+  int lastRow = (y1 - 1) / mcuH;
+  uint16_t outX = firstCol * mcuW;
+  uint16_t outY = firstRow * mcuH;
+  uint16_t outW = min((lastCol + 1) * mcuW, (int)ctx->width) - outX;
+  uint16_t outH = min((lastRow + 1) * mcuH, (int)ctx->height) - outY;
+
+  BitWriter *writer = (BitWriter *)calloc(1, sizeof(BitWriter));
+  if (!writer)
+  {
+    free(ctx);
+    return false;
+  }
+  writer->out = &out;
+
+  bool ok = writeHeaders(jpeg, *ctx, outW, outH, *writer);
+
+  BitReader in = {};
+  in.data = jpeg;
+  in.len = len;
+  in.pos = ctx->scanStart;
+
+  int inPred[JPEG_MAX_COMPONENTS] = {0};
+  int outPred[JPEG_MAX_COMPONENTS] = {0};
+  uint32_t mcuIndex = 0;
+
+  for (int my = 0; ok && my <= lastRow; my++)
+  {
+    for (int mx = 0; ok && mx < mcusX; mx++, mcuIndex++)
+    {
+      if (ctx->restartInterval && mcuIndex > 0 && mcuIndex % ctx->restartInterval == 0)
+      {
+        if (!in.restart())
+        {
+          ok = false;
+          break;
+        }
+        memset(inPred, 0, sizeof(inPred));
+      }
+
+      bool keep = my >= firstRow && mx >= firstCol && mx <= lastCol;
+      for (int c = 0; ok && c < ctx->compCount; c++)
+      {
+        const Component &comp = ctx->comps[c];
+        const HuffTable &dcTab = ctx->dc[comp.dcTable];
+        const HuffTable &acTab = ctx->ac[comp.acTable];
+        int blocks = comp.h * comp.v;
+        for (int b = 0; ok && b < blocks; b++)
+        {
+          // DC coefficient: decode absolute value, re-encode relative to the kept stream
+          uint8_t cat;
+          if (!decodeSymbol(in, dcTab, cat) || cat > 11)
+          {
+            ok = false;
+            break;
+          }
+          int diff = 0;
+          if (cat)
+          {
+            int rawBits = in.get(cat);
+            diff = rawBits < (1 << (cat - 1)) ? rawBits - (1 << cat) + 1 : rawBits;
+          }
+          inPred[c] += diff;
+
+          if (keep)
+          {
+            int outDiff = inPred[c] - outPred[c];
+            outPred[c] = inPred[c];
+            int mag = abs(outDiff);
+            uint8_t outCat = 0;
+            while (mag)
+            {
+              outCat++;
+              mag >>= 1;
+            }
+            if (!emitSymbol(*writer, dcTab, outCat))
+            {
+              ok = false;
+              break;
+            }
+            writer->put(outDiff < 0 ? outDiff + (1 << outCat) - 1 : outDiff, outCat);
+          }
+
+          // AC coefficients are copied symbol by symbol with the same codes
+          for (int k = 1; k < 64;)
+          {
+            uint8_t rs;
+            if (!decodeSymbol(in, acTab, rs))
+            {
+              ok = false;
+              break;
+            }
+            uint8_t run = rs >> 4;
+            uint8_t size = rs & 0x0F;
+            uint32_t rawBits = in.get(size);
+            if (keep)
+            {
+              if (!emitSymbol(*writer, acTab, rs))
+              {
+                ok = false;
+                break;
+              }
+              writer->put(rawBits, size);
+            }
+            if (size == 0)
+            {
+              if (run != 15)
+              {
+                break; // end of block
+              }
+              k += 16;
+            }
+            else
+            {
+              k += run + 1;
+            }
+          }
+          if (in.exhausted)
+          {
+            ok = false;
+          }
+        }
+      }
+    }
+  }
+
+  if (ok)
+  {
+    static const uint8_t eoi[2] = {0xFF, 0xD9};
+    writer->finish();
+    writer->raw(eoi, sizeof(eoi));
+    ok = !writer->failed;
+  }
+
+  if (ok && applied)
+  {
+    *applied = {outX, outY, outW, outH};
+  }
+  free(writer);
+  free(ctx);
+  return ok;
+}
@@ -0,0 +1,23 @@
+#ifndef JPEGCROP_H
+#define JPEGCROP_H
+
+#include <Arduino.h>
+
+// Region of interest in source pixels, widened outwards to whole MCUs before cropping
+struct JpegCropRect
+{
+  uint16_t x;
+  uint16_t y;
+  uint16_t width;
+  uint16_t height;
+};
+
+// Losslessly crops a baseline JPEG to the MCUs covering roi and streams the result to out.
+// Headers are copied (with new dimensions), the entropy-coded data is re-emitted only for
+// the kept MCUs with DC predictions re-based. Nothing is decoded to pixels or re-quantised.
+// Supports baseline/extended Huffman, any sampling factors, restart intervals.
+// Returns false on unsupported or corrupt input; anything already written to out must then
+// be discarded. applied (optional) receives the MCU-aligned rectangle actually kept.
+bool jpegCropMcu(const uint8_t *jpeg, size_t len, const JpegCropRect &roi, Print &out, JpegCropRect *applied = NULL);
+
+#endif
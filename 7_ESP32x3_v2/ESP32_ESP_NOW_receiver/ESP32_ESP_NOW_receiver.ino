@@ -22,11 +22,33 @@
 #include <esp_now.h>
 #include <WiFi.h>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <sys/time.h>
+#include "ResultIndex.h"
 
 // ===================================== Configuration =====================================
 const char* RECEIVER_SSID = "ESP32_RECEIVER";   // Receiver SSID for soft-AP
 const char* RECEIVER_PASSWORD = "123456789";   // Receiver password for soft-AP
 
+// ===================================== Result History =====================================
+// Results are queued by the ESP-NOW callback and stored from loop(), flash writes must not
+// run in the WiFi task. Serial commands:
+//   nodes                              list the nodes that sent results
+//   range <node> <hours>               min/max/average ripeness over the last hours
+//   rollup <node> <minute|hour|day> <n> the last n rollup buckets
+struct ReceivedResult {
+    uint16_t node;           // Last two bytes of the sender's MAC address
+    uint32_t timestamp;
+    float ripeness;
+    uint32_t imageSequence;
+};
+
+ResultIndex resultIndex(LittleFS, "/results");
+QueueHandle_t resultQueue;
+const uint32_t VALID_TIME = 1700000000;        // Clock is considered set after this
+
+void handleSerialCommand(const String& line);
+
 // ===================================== Callback for Receiving Data =====================================
 // Handles data reception, parses JSON, and prints ripeness results.
 void OnDataRecv(const esp_now_recv_info_t *esp_now_info, const uint8_t *incomingData, int len) {
@@ -47,7 +69,24 @@ void OnDataRecv(const esp_now_recv_info_t *esp_now_info, const uint8_t *incoming
     for (JsonObject result : array) {
         const char* file = result["file"];
         float ripeness = result["ripeness"];
+        uint32_t timestamp = result["time"] | 0;
         Serial.printf("File: %s, Ripeness: %.2f%%\n", file, ripeness);
+
+        // No internet on the AP, the clock is taken from the sender
+        if (timestamp >= VALID_TIME && time(NULL) < VALID_TIME) {
+            struct timeval now = {(time_t)timestamp, 0};
+            settimeofday(&now, NULL);
+        }
+        ReceivedResult received = {};
+        received.node = (esp_now_info->src_addr[4] << 8) | esp_now_info->src_addr[5];
+        received.timestamp = timestamp >= VALID_TIME ? timestamp : time(NULL);
+        received.ripeness = ripeness;
+        if (file != NULL) {
+            sscanf(file, "img_%u", &received.imageSequence);
+        }
+        if (xQueueSend(resultQueue, &received, 0) != pdTRUE) {
+            Serial.println("Result queue full, result not stored");
+        }
     }
 }
 
@@ -55,6 +94,11 @@ void OnDataRecv(const esp_now_recv_info_t *esp_now_info, const uint8_t *incoming
 // Initializes Wi-Fi in AP mode and sets up ESP-NOW.
 void setup() {
     Serial.begin(115200);
+
+    resultQueue = xQueueCreate(16, sizeof(ReceivedResult));
+    if (!LittleFS.begin(true) || !resultIndex.begin()) {
+        Serial.println("Result history unavailable");
+    }
     
     // Set device as a Wi-Fi Station and AP
     WiFi.mode(WIFI_AP_STA);
@@ -77,5 +121,60 @@ void setup() {
 // ===================================== Loop Function =====================================
 // Keeps the ESP32 running and ready to receive data.
 void loop() {
+    ReceivedResult received;
+    while (xQueueReceive(resultQueue, &received, 0) == pdTRUE) {
+        if (!resultIndex.append(received.node, received.timestamp, received.ripeness, received.imageSequence)) {
+            Serial.println("Failed to store result");
+        }
+    }
+
+    if (Serial.available()) {
+        handleSerialCommand(Serial.readStringUntil('\n'));
+    }
     delay(10);
 }
+
+// ===================================== Result Queries =====================================
+void handleSerialCommand(const String& line) {
+    char command[8] = "";
+    char level[8] = "";
+    unsigned int node = 0;
+    unsigned int amount = 0;
+    int fields = sscanf(line.c_str(), "%7s %x %7s %u", command, &node, level, &amount);
+
+    if (strcmp(command, "nodes") == 0) {
+        for (size_t i = 0; i < resultIndex.nodeCount(); i++) {
+            ResultSeries* series = resultIndex.seriesAt(i);
+            Serial.printf("Node %04x: %u results, last at %u\n", series->node(), series->sampleCount(), series->lastTime());
+        }
+        return;
+    }
+
+    ResultSeries* series = resultIndex.series(node);
+    if (fields < 2 || series == NULL) {
+        Serial.println("Usage: nodes | range <node> <hours> | rollup <node> <minute|hour|day> <count>");
+        return;
+    }
+    // Queries run up to now, or up to the newest result while the clock is not set
+    uint32_t now = max((uint32_t)time(NULL), series->lastTime());
+
+    if (strcmp(command, "range") == 0 && fields >= 3) {
+        uint32_t hours = strtoul(level, NULL, 10);
+        ResultStats stats;
+        unsigned long start = micros();
+        series->query(now - hours * 3600, now, stats);
+        Serial.printf("Node %04x, last %u h: %u results, min %.2f%%, max %.2f%%, avg %.2f%% (%lu us)\n",
+                      node, hours, stats.count, stats.minRipeness, stats.maxRipeness, stats.avgRipeness, micros() - start);
+    } else if (strcmp(command, "rollup") == 0 && fields == 4) {
+        RollupLevel rollupLevel = strcmp(level, "day") == 0 ? ROLLUP_DAY : strcmp(level, "hour") == 0 ? ROLLUP_HOUR : ROLLUP_MINUTE;
+        ResultRollup buckets[24];
+        amount = min(amount, (unsigned int)24);
+        size_t count = series->readRollups(rollupLevel, now - amount * ResultSeries::rollupWidth(rollupLevel) + 1, now, buckets, amount);
+        for (size_t i = 0; i < count; i++) {
+            Serial.printf("%u: %u results, min %.2f%%, max %.2f%%, avg %.2f%%\n", buckets[i].start, buckets[i].count,
+                          buckets[i].minRipeness, buckets[i].maxRipeness, buckets[i].sumRipeness / buckets[i].count);
+        }
+    } else {
+        Serial.println("Usage: nodes | range <node> <hours> | rollup <node> <minute|hour|day> <count>");
+    }
+}
@@ -0,0 +1,488 @@
+#include "ResultIndex.h"
+#include <rom/crc.h>
+
+static const uint32_t ROLLUP_WIDTHS[ROLLUP_LEVELS] = {60, 3600, 86400};
+static const char *ROLLUP_FILES[ROLLUP_LEVELS] = {"minute.dat", "hour.dat", "day.dat"};
+static const uint32_t ROLLUP_BUCKETS[ROLLUP_LEVELS] = {RESULT_MINUTE_BUCKETS, RESULT_HOUR_BUCKETS, RESULT_DAY_BUCKETS};
+static const uint32_t RING_SAMPLES = RESULT_MAX_BLOCKS * RESULT_BLOCK_SAMPLES;
+
+static uint32_t sampleCrc(const ResultSample &sample)
+{
+    return crc32_le(0, (const uint8_t *)&sample, offsetof(ResultSample, crc));
+}
+
+static void mergeStats(ResultStats &stats, float minRipeness, float maxRipeness, float sum, uint32_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    if (stats.count == 0) {
+        stats.minRipeness = minRipeness;
+        stats.maxRipeness = maxRipeness;
+    } else {
+        stats.minRipeness = min(stats.minRipeness, minRipeness);
+        stats.maxRipeness = max(stats.maxRipeness, maxRipeness);
+    }
+    stats.avgRipeness += sum; // Turned into the average once the query is complete
+    stats.count += count;
+}
+
+// ===================================== ResultSeries =====================================
+ResultSeries::ResultSeries()
+    : _fs(NULL), _node(0), _sampleCount(0), _lastTime(0), _block(), _rollup(), _rollupCount()
+{
+}
+
+uint32_t ResultSeries::rollupWidth(RollupLevel level)
+{
+    return ROLLUP_WIDTHS[level];
+}
+
+uint32_t ResultSeries::sampleOffset(uint32_t index)
+{
+    return index % RING_SAMPLES * sizeof(ResultSample);
+}
+
+uint32_t ResultSeries::blockOffset(uint32_t block)
+{
+    return block % RESULT_MAX_BLOCKS * sizeof(ResultBlockSummary);
+}
+
+uint32_t ResultSeries::rollupOffset(RollupLevel level, uint32_t index)
+{
+    return index % ROLLUP_BUCKETS[level] * sizeof(ResultRollup);
+}
+
+uint32_t ResultSeries::firstRollup(RollupLevel level) const
+{
+    uint32_t total = rollupTotal(level);
+    return total > ROLLUP_BUCKETS[level] ? total - ROLLUP_BUCKETS[level] : 0;
+}
+
+String ResultSeries::path(const char *name) const
+{
+    return _folder + "/" + name;
+}
+
+bool ResultSeries::writeAt(const char *name, uint32_t offset, const void *data, size_t size)
+{
+    String filePath = path(name);
+    File file = _fs->exists(filePath) ? _fs->open(filePath, "r+") : _fs->open(filePath, FILE_WRITE);
+    if (!file) {
+        return false;
+    }
+    bool ok = file.seek(offset) && file.write((const uint8_t *)data, size) == size;
+    file.close();
+    return ok;
+}
+
+bool ResultSeries::readAt(File &file, uint32_t offset, void *data, size_t size)
+{
+    return file.seek(offset) && file.read((uint8_t *)data, size) == size;
+}
+
+bool ResultSeries::begin(fs::FS &fs, const String &folder, uint16_t node)
+{
+    char name[8];
+    snprintf(name, sizeof(name), "/%04x", node);
+    _fs = &fs;
+    _folder = folder + name;
+    _node = node;
+    if (!_fs->exists(_folder) && !_fs->mkdir(_folder)) {
+        Serial.printf("Failed to create %s\n", _folder.c_str());
+        return false;
+    }
+
+    _lastTime = 0;
+    _sampleCount = findSampleCount();
+    rebuildTail();
+    return true;
+}
+
+// The newest block is the one whose first slot holds the highest index. Its samples are
+// followed while each slot holds the next index with a valid CRC, which drops a torn last
+// sample.
+uint32_t ResultSeries::findSampleCount()
+{
+    File samples = _fs->open(path("samples.dat"), FILE_READ);
+    if (!samples) {
+        return 0;
+    }
+    ResultSample sample;
+    uint32_t count = 0;
+    for (uint32_t slot = 0; slot < RING_SAMPLES; slot += RESULT_BLOCK_SAMPLES) {
+        if (readAt(samples, slot * sizeof(sample), &sample, sizeof(sample)) && sample.crc == sampleCrc(sample) &&
+            sample.index % RING_SAMPLES == slot) {
+            count = max(count, sample.index);
+        }
+    }
+    while (readAt(samples, sampleOffset(count), &sample, sizeof(sample)) && sample.crc == sampleCrc(sample) &&
+           sample.index == count) {
+        _lastTime = sample.timestamp;
+        count++;
+    }
+    samples.close();
+    return count;
+}
+
+// Buckets written to the ring, overwritten ones included. Once it is full, the newest is in
+// the slot before the first one that starts earlier than slot 0.
+uint32_t ResultSeries::findRollupCount(File &rollups, RollupLevel level)
+{
+    uint32_t capacity = ROLLUP_BUCKETS[level];
+    uint32_t count = rollups ? rollups.size() / sizeof(ResultRollup) : 0;
+    ResultRollup first, bucket;
+    if (count < capacity || !readAt(rollups, 0, &first, sizeof(first))) {
+        return min(count, capacity);
+    }
+    uint32_t low = 1, high = capacity;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (readAt(rollups, mid * sizeof(bucket), &bucket, sizeof(bucket)) && bucket.start < first.start) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return low == capacity ? capacity : low + capacity;
+}
+
+// Adds a sample to the newest bucket of each rollup. With persist, the bucket is written
+// after every update; otherwise only when it is complete (replay at boot).
+void ResultSeries::rollSample(const ResultSample &sample, RollupLevel level, bool persist)
+{
+    ResultRollup &bucket = _rollup[level];
+    uint32_t start = sample.timestamp - sample.timestamp % ROLLUP_WIDTHS[level];
+    if (bucket.count != 0 && bucket.start != start) {
+        if (!persist) {
+            writeAt(ROLLUP_FILES[level], rollupOffset(level, _rollupCount[level]), &bucket, sizeof(bucket));
+        }
+        _rollupCount[level]++;
+        bucket = ResultRollup();
+    }
+    if (bucket.count == 0) {
+        bucket = {start, 0, sample.ripeness, sample.ripeness, 0};
+    }
+    bucket.count++;
+    bucket.minRipeness = min(bucket.minRipeness, sample.ripeness);
+    bucket.maxRipeness = max(bucket.maxRipeness, sample.ripeness);
+    bucket.sumRipeness += sample.ripeness;
+    if (persist) {
+        writeAt(ROLLUP_FILES[level], rollupOffset(level, _rollupCount[level]), &bucket, sizeof(bucket));
+    }
+}
+
+void ResultSeries::addToBlock(const ResultSample &sample, uint32_t index)
+{
+    if (index % RESULT_BLOCK_SAMPLES == 0) {
+        _block = {sample.timestamp, sample.timestamp, sample.ripeness, sample.ripeness, 0, 0};
+    }
+    _block.lastTime = sample.timestamp;
+    _block.minRipeness = min(_block.minRipeness, sample.ripeness);
+    _block.maxRipeness = max(_block.maxRipeness, sample.ripeness);
+    _block.sumRipeness += sample.ripeness;
+    _block.count++;
+}
+
+// Recomputes the open block and the newest bucket of each rollup from the samples, so an
+// append interrupted between its writes leaves no trace after a reset
+void ResultSeries::rebuildTail()
+{
+    File samples = _fs->open(path("samples.dat"), FILE_READ);
+    ResultSample sample;
+
+    // The block first, the rollup replay points are found through the block summaries
+    uint32_t blockStart = _sampleCount - _sampleCount % RESULT_BLOCK_SAMPLES;
+    _block = ResultBlockSummary();
+    for (uint32_t i = blockStart; samples && i < _sampleCount; i++) {
+        if (!readAt(samples, sampleOffset(i), &sample, sizeof(sample))) {
+            break;
+        }
+        addToBlock(sample, i);
+    }
+    if (_block.count > 0) {
+        writeAt("blocks.dat", blockOffset(blockStart / RESULT_BLOCK_SAMPLES), &_block, sizeof(_block));
+    }
+
+    // A bucket reaching back past the oldest sample kept cannot be rebuilt, the stored one
+    // stays (it misses at most an interrupted append)
+    uint32_t oldestTime = 0;
+    if (firstBlock() > 0 && readAt(samples, sampleOffset(firstSample()), &sample, sizeof(sample))) {
+        oldestTime = sample.timestamp;
+    }
+
+    uint32_t replayFrom[ROLLUP_LEVELS];
+    uint32_t first = _sampleCount;
+    for (int level = 0; level < ROLLUP_LEVELS; level++) {
+        _rollup[level] = ResultRollup();
+        _rollupCount[level] = 0;
+        replayFrom[level] = firstSample();
+        File rollups = _fs->open(path(ROLLUP_FILES[level]), FILE_READ);
+        uint32_t count = findRollupCount(rollups, (RollupLevel)level);
+        ResultRollup last;
+        if (count > 0 && readAt(rollups, rollupOffset((RollupLevel)level, count - 1), &last, sizeof(last))) {
+            _rollupCount[level] = count - 1; // The newest bucket is rebuilt in place
+            if (last.start <= oldestTime) {
+                _rollup[level] = last;
+                replayFrom[level] = _sampleCount;
+            } else {
+                replayFrom[level] = firstSampleAtOrAfter(last.start);
+            }
+        }
+        rollups.close();
+        first = min(first, replayFrom[level]);
+    }
+
+    for (uint32_t i = first; samples && i < _sampleCount; i++) {
+        if (!readAt(samples, sampleOffset(i), &sample, sizeof(sample))) {
+            break;
+        }
+        for (int level = 0; level < ROLLUP_LEVELS; level++) {
+            if (i >= replayFrom[level]) {
+                rollSample(sample, (RollupLevel)level, false);
+            }
+        }
+    }
+    samples.close();
+
+    for (int level = 0; level < ROLLUP_LEVELS; level++) {
+        if (_rollup[level].count > 0) {
+            writeAt(ROLLUP_FILES[level], rollupOffset((RollupLevel)level, _rollupCount[level]), &_rollup[level], sizeof(ResultRollup));
+        }
+    }
+}
+
+bool ResultSeries::append(uint32_t timestamp, float ripeness, uint32_t imageSequence)
+{
+    if (_fs == NULL) {
+        return false;
+    }
+    ResultSample sample = {max(timestamp, _lastTime), ripeness, imageSequence, _sampleCount, 0}; // Keeps the samples sorted
+    sample.crc = sampleCrc(sample);
+    if (!writeAt("samples.dat", sampleOffset(_sampleCount), &sample, sizeof(sample))) {
+        Serial.println("Failed to write result sample");
+        return false;
+    }
+
+    addToBlock(sample, _sampleCount);
+    writeAt("blocks.dat", blockOffset(_sampleCount / RESULT_BLOCK_SAMPLES), &_block, sizeof(_block));
+    _sampleCount++;
+    _lastTime = sample.timestamp;
+
+    for (int level = 0; level < ROLLUP_LEVELS; level++) {
+        rollSample(sample, (RollupLevel)level, true);
+    }
+    return true;
+}
+
+uint32_t ResultSeries::firstBlockEndingAtOrAfter(File &blocks, uint32_t time)
+{
+    uint32_t low = firstBlock(), high = blockCount();
+    ResultBlockSummary summary;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (!readAt(blocks, blockOffset(mid), &summary, sizeof(summary))) {
+            return blockCount();
+        }
+        if (summary.lastTime < time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint32_t ResultSeries::firstSampleAtOrAfter(uint32_t time)
+{
+    File blocks = _fs->open(path("blocks.dat"), FILE_READ);
+    if (!blocks) {
+        return firstSample();
+    }
+    uint32_t block = firstBlockEndingAtOrAfter(blocks, time);
+    blocks.close();
+    if (block >= blockCount()) {
+        return _sampleCount;
+    }
+
+    File samples = _fs->open(path("samples.dat"), FILE_READ);
+    ResultSample sample;
+    uint32_t index = block * RESULT_BLOCK_SAMPLES;
+    for (; samples && index < _sampleCount; index++) {
+        if (!readAt(samples, sampleOffset(index), &sample, sizeof(sample)) || sample.timestamp >= time) {
+            break;
+        }
+    }
+    samples.close();
+    return index;
+}
+
+bool ResultSeries::query(uint32_t from, uint32_t to, ResultStats &stats)
+{
+    stats = ResultStats();
+    if (_fs == NULL || _sampleCount == 0 || to < from) {
+        return _fs != NULL;
+    }
+    File blocks = _fs->open(path("blocks.dat"), FILE_READ);
+    File samples = _fs->open(path("samples.dat"), FILE_READ);
+    if (!blocks || !samples) {
+        return false;
+    }
+
+    ResultBlockSummary summary;
+    uint32_t oldestTime = 0; // Of the samples kept, when older ones were overwritten
+    if (firstBlock() > 0 && readAt(blocks, blockOffset(firstBlock()), &summary, sizeof(summary))) {
+        oldestTime = summary.firstTime;
+    }
+
+    ResultSample block[RESULT_BLOCK_SAMPLES];
+    for (uint32_t k = firstBlockEndingAtOrAfter(blocks, from); k < blockCount(); k++) {
+        if (!readAt(blocks, blockOffset(k), &summary, sizeof(summary)) || summary.firstTime > to) {
+            break;
+        }
+        if (summary.firstTime >= from && summary.lastTime <= to) {
+            mergeStats(stats, summary.minRipeness, summary.maxRipeness, summary.sumRipeness, summary.count);
+            continue;
+        }
+
+        // Block straddles a range end, read its samples
+        uint32_t first = k * RESULT_BLOCK_SAMPLES;
+        uint32_t count = min((uint32_t)RESULT_BLOCK_SAMPLES, _sampleCount - first);
+        if (!readAt(samples, sampleOffset(first), block, count * sizeof(ResultSample))) {
+            break;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (block[i].timestamp >= from && block[i].timestamp <= to) {
+                mergeStats(stats, block[i].ripeness, block[i].ripeness, block[i].ripeness, 1);
+            }
+        }
+    }
+    blocks.close();
+    samples.close();
+    mergeOlderRollups(from, to, oldestTime, stats);
+
+    if (stats.count > 0) {
+        stats.avgRipeness /= stats.count;
+    }
+    return true;
+}
+
+uint32_t ResultSeries::firstRollupEndingAtOrAfter(File &rollups, RollupLevel level, uint32_t time)
+{
+    uint32_t low = firstRollup(level), high = rollupTotal(level);
+    ResultRollup bucket;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (!readAt(rollups, rollupOffset(level, mid), &bucket, sizeof(bucket))) {
+            break;
+        }
+        if (bucket.start + ROLLUP_WIDTHS[level] <= time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+size_t ResultSeries::readRollups(RollupLevel level, uint32_t from, uint32_t to, ResultRollup *buckets, size_t maxBuckets)
+{
+    if (_fs == NULL) {
+        return 0;
+    }
+    File rollups = _fs->open(path(ROLLUP_FILES[level]), FILE_READ);
+    if (!rollups) {
+        return 0;
+    }
+    uint32_t total = rollupTotal(level);
+    size_t stored = 0;
+    for (uint32_t i = firstRollupEndingAtOrAfter(rollups, level, from); i < total && stored < maxBuckets; i++) {
+        if (!readAt(rollups, rollupOffset(level, i), &buckets[stored], sizeof(ResultRollup)) || buckets[stored].start > to) {
+            break;
+        }
+        stored++;
+    }
+    rollups.close();
+    return stored;
+}
+
+// Stands in for the samples overwritten before `before`: whole buckets inside [from, to] that
+// end by then, from the finest level that still has them. Each coarser level covers only what
+// is older than the finer level's oldest bucket, so nothing is counted twice.
+void ResultSeries::mergeOlderRollups(uint32_t from, uint32_t to, uint32_t before, ResultStats &stats)
+{
+    for (int i = 0; i < ROLLUP_LEVELS && from < before; i++) {
+        RollupLevel level = (RollupLevel)i;
+        File rollups = _fs->open(path(ROLLUP_FILES[level]), FILE_READ);
+        if (!rollups) {
+            continue;
+        }
+        uint32_t total = rollupTotal(level);
+        ResultRollup bucket;
+        uint32_t oldest = before;
+        if (firstRollup(level) < total && readAt(rollups, rollupOffset(level, firstRollup(level)), &bucket, sizeof(bucket))) {
+            oldest = min(oldest, bucket.start);
+        }
+        for (uint32_t k = firstRollupEndingAtOrAfter(rollups, level, from); k < total; k++) {
+            if (!readAt(rollups, rollupOffset(level, k), &bucket, sizeof(bucket)) || bucket.start + ROLLUP_WIDTHS[level] > before) {
+                break;
+            }
+            if (bucket.start >= from && bucket.start + ROLLUP_WIDTHS[level] - 1 <= to) {
+                mergeStats(stats, bucket.minRipeness, bucket.maxRipeness, bucket.sumRipeness, bucket.count);
+            }
+        }
+        rollups.close();
+        before = oldest;
+    }
+}
+
+// ===================================== ResultIndex =====================================
+ResultIndex::ResultIndex(fs::FS &fs, const char *folder) : _fs(fs), _folder(folder), _nodeCount(0) {}
+
+bool ResultIndex::begin()
+{
+    if (!_fs.exists(_folder) && !_fs.mkdir(_folder)) {
+        Serial.printf("Failed to create %s\n", _folder.c_str());
+        return false;
+    }
+    File root = _fs.open(_folder);
+    if (!root || !root.isDirectory()) {
+        return false;
+    }
+    File entry = root.openNextFile();
+    while (entry && _nodeCount < RESULT_MAX_NODES) {
+        String name = entry.name();
+        name = name.substring(name.lastIndexOf('/') + 1);
+        bool isDirectory = entry.isDirectory();
+        entry.close();
+        if (isDirectory && _series[_nodeCount].begin(_fs, _folder, (uint16_t)strtoul(name.c_str(), NULL, 16))) {
+            _nodeCount++;
+        }
+        entry = root.openNextFile();
+    }
+    root.close();
+    return true;
+}
+
+ResultSeries *ResultIndex::series(uint16_t node)
+{
+    for (size_t i = 0; i < _nodeCount; i++) {
+        if (_series[i].node() == node) {
+            return &_series[i];
+        }
+    }
+    return NULL;
+}
+
+bool ResultIndex::append(uint16_t node, uint32_t timestamp, float ripeness, uint32_t imageSequence)
+{
+    ResultSeries *target = series(node);
+    if (target == NULL) {
+        if (_nodeCount >= RESULT_MAX_NODES || !_series[_nodeCount].begin(_fs, _folder, node)) {
+            Serial.printf("No room for results from node %04x\n", node);
+            return false;
+        }
+        target = &_series[_nodeCount++];
+    }
+    return target->append(timestamp, ripeness, imageSequence);
+}
@@ -0,0 +1,133 @@
+#ifndef ResultIndex_h
+#define ResultIndex_h
+
+#include <Arduino.h>
+#include "FS.h"
+
+// Time-indexed ripeness history, one series per sending node (<folder>/<node>/).
+//
+// samples.dat  fixed 20-byte ResultSample records, sorted by time (timestamps never decrease)
+// blocks.dat   one ResultBlockSummary per RESULT_BLOCK_SAMPLES samples: time span and
+//              min/max/sum, so range queries binary-search the blocks and only read the
+//              samples of the (at most two) blocks that straddle the range ends
+// minute.dat, hour.dat, day.dat
+//              ResultRollup buckets, updated in place on every append
+//
+// Only fixed-size records are written, so every lookup is a seek to record * size.
+// Every file is a ring: record i of the series is kept in slot i % capacity and overwrites
+// the oldest one. Raw samples are kept for the newest RESULT_MAX_BLOCKS blocks; range queries
+// reaching further back are answered from whole rollup buckets, the coarser levels keeping
+// the longest history.
+
+#define RESULT_BLOCK_SAMPLES 64
+#define RESULT_MAX_BLOCKS 48             // Raw samples kept, in blocks (about 3000)
+#define RESULT_MINUTE_BUCKETS 1440       // A day
+#define RESULT_HOUR_BUCKETS 720          // 30 days
+#define RESULT_DAY_BUCKETS 730           // Two years
+#define RESULT_MAX_NODES 8
+
+struct ResultSample {
+    uint32_t timestamp;      // Unix time in seconds
+    float ripeness;          // Percent
+    uint32_t imageSequence;  // Sender's image record, 0 when unknown
+    uint32_t index;          // Position in the series, finds the newest slot after a reset
+    uint32_t crc;            // CRC32 of the fields above
+};
+
+struct ResultBlockSummary {
+    uint32_t firstTime;
+    uint32_t lastTime;
+    float minRipeness;
+    float maxRipeness;
+    float sumRipeness;
+    uint32_t count;
+};
+
+struct ResultRollup {
+    uint32_t start;          // Bucket start, aligned to the bucket width
+    uint32_t count;
+    float minRipeness;
+    float maxRipeness;
+    float sumRipeness;
+};
+
+struct ResultStats {
+    uint32_t count;
+    float minRipeness;
+    float maxRipeness;
+    float avgRipeness;
+};
+
+enum RollupLevel {
+    ROLLUP_MINUTE,
+    ROLLUP_HOUR,
+    ROLLUP_DAY,
+    ROLLUP_LEVELS
+};
+
+class ResultSeries {
+public:
+    ResultSeries();
+    bool begin(fs::FS &fs, const String &folder, uint16_t node);
+    bool append(uint32_t timestamp, float ripeness, uint32_t imageSequence = 0);
+
+    // Samples with from <= timestamp <= to
+    bool query(uint32_t from, uint32_t to, ResultStats &stats);
+    // Buckets overlapping [from, to], oldest first; returns how many were stored
+    size_t readRollups(RollupLevel level, uint32_t from, uint32_t to, ResultRollup *buckets, size_t maxBuckets);
+
+    uint16_t node() const { return _node; }
+    uint32_t sampleCount() const { return _sampleCount; }     // Since the series was created
+    uint32_t firstSample() const { return firstBlock() * RESULT_BLOCK_SAMPLES; } // Oldest one kept
+    uint32_t lastTime() const { return _lastTime; }
+    static uint32_t rollupWidth(RollupLevel level);
+
+private:
+    fs::FS *_fs;
+    String _folder;
+    uint16_t _node;
+    uint32_t _sampleCount;                   // Also the index of the next sample
+    uint32_t _lastTime;
+    ResultBlockSummary _block;               // Block the next sample goes into
+    ResultRollup _rollup[ROLLUP_LEVELS];     // Newest bucket of each level
+    uint32_t _rollupCount[ROLLUP_LEVELS];    // Index of the newest bucket
+
+    String path(const char *name) const;
+    bool writeAt(const char *name, uint32_t offset, const void *data, size_t size);
+    bool readAt(File &file, uint32_t offset, void *data, size_t size);
+    uint32_t blockCount() const { return (_sampleCount + RESULT_BLOCK_SAMPLES - 1) / RESULT_BLOCK_SAMPLES; }
+    uint32_t firstBlock() const { return blockCount() > RESULT_MAX_BLOCKS ? blockCount() - RESULT_MAX_BLOCKS : 0; }
+    uint32_t rollupTotal(RollupLevel level) const { return _rollupCount[level] + (_rollup[level].count ? 1 : 0); }
+    uint32_t firstRollup(RollupLevel level) const;
+    static uint32_t sampleOffset(uint32_t index);
+    static uint32_t blockOffset(uint32_t block);
+    static uint32_t rollupOffset(RollupLevel level, uint32_t index);
+    uint32_t findSampleCount();
+    uint32_t findRollupCount(File &rollups, RollupLevel level);
+    uint32_t firstBlockEndingAtOrAfter(File &blocks, uint32_t time);
+    uint32_t firstSampleAtOrAfter(uint32_t time);
+    uint32_t firstRollupEndingAtOrAfter(File &rollups, RollupLevel level, uint32_t time);
+    void addToBlock(const ResultSample &sample, uint32_t index);
+    void rollSample(const ResultSample &sample, RollupLevel level, bool persist);
+    void rebuildTail();
+    void mergeOlderRollups(uint32_t from, uint32_t to, uint32_t before, ResultStats &stats);
+};
+
+// Series for every node, created on the first sample from a node
+class ResultIndex {
+public:
+    ResultIndex(fs::FS &fs, const char *folder);
+    bool begin();
+    bool append(uint16_t node, uint32_t timestamp, float ripeness, uint32_t imageSequence = 0);
+    ResultSeries *series(uint16_t node);
+    size_t nodeCount() const { return _nodeCount; }
+    ResultSeries *seriesAt(size_t index) { return index < _nodeCount ? &_series[index] : NULL; }
+
+private:
+    fs::FS &_fs;
+    String _folder;
+    ResultSeries _series[RESULT_MAX_NODES];
+    size_t _nodeCount;
+};
+
+#endif
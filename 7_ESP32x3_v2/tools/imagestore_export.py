@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""Export images from a BaseESP32_CAM image store (copied from the SD card's /camImages).
+
+The store is a set of segment files seg_NNNNN.pak with one index file seg_NNNNN.idx
+each (see ImageStore.h). Records are read through the index; segments whose index is
+missing or short are also scanned record by record, like the device does at boot.
+
+    python3 imagestore_export.py /media/sd/camImages --list
+    python3 imagestore_export.py /media/sd/camImages -o out/ --from-seq 120 --to-seq 140
+    python3 imagestore_export.py /media/sd/camImages -o out/ --since 2024-12-07T06:00
+"""
+
+import argparse
+import datetime
+import os
+import re
+import struct
+import sys
+import zlib
+
+RECORD_MAGIC = 0x52474D49
+HEADER = struct.Struct("<6I")  # magic, sequence, timestamp, length, payloadCrc, headerCrc
+ENTRY = struct.Struct("<5I")   # sequence, timestamp, offset, length, flags
+ALIGN = 512
+FLAG_UPLOADED = 0x01
+
+
+def align_up(value):
+    return (value + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def read_header(pak, offset):
+    pak.seek(offset)
+    raw = pak.read(HEADER.size)
+    if len(raw) < HEADER.size:
+        return None
+    fields = HEADER.unpack(raw)
+    if fields[0] != RECORD_MAGIC or zlib.crc32(raw[:-4]) != fields[5]:
+        return None
+    return fields
+
+
+def segment_records(folder, segment):
+    """Yields (sequence, timestamp, offset, length, flags) for every complete record."""
+    pak_path = os.path.join(folder, f"seg_{segment:05d}.pak")
+    idx_path = os.path.join(folder, f"seg_{segment:05d}.idx")
+    entries = []
+    if os.path.exists(idx_path):
+        with open(idx_path, "rb") as idx:
+            data = idx.read()
+        entries = [ENTRY.unpack_from(data, i) for i in range(0, len(data) - ENTRY.size + 1, ENTRY.size)]
+    yield from entries
+
+    # Records written after the last index update
+    if entries:
+        offset = align_up(entries[-1][2] + HEADER.size + entries[-1][3])
+        expected = entries[-1][0] + 1
+    else:
+        offset, expected = 0, None
+    size = os.path.getsize(pak_path)
+    with open(pak_path, "rb") as pak:
+        while offset + HEADER.size <= size:
+            header = read_header(pak, offset)
+            if header is None or (expected is not None and header[1] != expected):
+                break
+            if offset + HEADER.size + header[3] > size:
+                break
+            if zlib.crc32(pak.read(header[3])) != header[4]:
+                break
+            yield (header[1], header[2], offset, header[3], 0)
+            expected = header[1] + 1
+            offset = align_up(offset + HEADER.size + header[3])
+
+
+def read_payload(folder, segment, offset, length):
+    with open(os.path.join(folder, f"seg_{segment:05d}.pak"), "rb") as pak:
+        header = read_header(pak, offset)
+        if header is None or header[3] != length:
+            raise ValueError(f"bad record header at segment {segment} offset {offset}")
+        payload = pak.read(length)
+    if zlib.crc32(payload) != header[4]:
+        raise ValueError(f"CRC mismatch for image #{header[1]}")
+    return payload
+
+
+def parse_time(text):
+    if text.isdigit():
+        return int(text)
+    return int(datetime.datetime.fromisoformat(text).timestamp())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("folder", help="copy of the store folder (e.g. /camImages)")
+    parser.add_argument("-o", "--output", help="directory to write img_<seq>_<time>.jpg files to")
+    parser.add_argument("--list", action="store_true", help="list records instead of exporting")
+    parser.add_argument("--from-seq", type=int, default=0)
+    parser.add_argument("--to-seq", type=int, default=2**32 - 1)
+    parser.add_argument("--since", type=parse_time, default=0, help="unix time or ISO date")
+    parser.add_argument("--until", type=parse_time, default=2**32 - 1, help="unix time or ISO date")
+    parser.add_argument("--not-uploaded", action="store_true", help="only images never uploaded")
+    args = parser.parse_args()
+
+    segments = sorted(int(m.group(1)) for m in
+                      (re.fullmatch(r"seg_(\d+)\.pak", name) for name in os.listdir(args.folder)) if m)
+    if not segments:
+        sys.exit(f"No segments found in {args.folder}")
+    if not args.list and not args.output:
+        parser.error("either --list or --output is required")
+    if args.output:
+        os.makedirs(args.output, exist_ok=True)
+
+    exported = 0
+    for segment in segments:
+        for sequence, timestamp, offset, length, flags in segment_records(args.folder, segment):
+            if not (args.from_seq <= sequence <= args.to_seq and args.since <= timestamp <= args.until):
+                continue
+            if args.not_uploaded and flags & FLAG_UPLOADED:
+                continue
+            when = datetime.datetime.fromtimestamp(timestamp).strftime("%Y%m%d_%H%M%S")
+            if args.list:
+                state = "uploaded" if flags & FLAG_UPLOADED else "pending"
+                print(f"#{sequence:<8} {when}  {length:>8} bytes  seg {segment} @ {offset}  {state}")
+                continue
+            try:
+                payload = read_payload(args.folder, segment, offset, length)
+            except ValueError as error:
+                print(f"Skipping: {error}", file=sys.stderr)
+                continue
+            with open(os.path.join(args.output, f"img_{sequence}_{when}.jpg"), "wb") as out:
+                out.write(payload)
+            exported += 1
+
+    if not args.list:
+        print(f"Exported {exported} image(s) to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,469 @@
+#include "esp_camera.h"
+#include "simJpeg.h"
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+const resolution_info_t resolution[] = {
+    {96, 96, ASPECT_RATIO_1X1},     // 96x96
+    {160, 120, ASPECT_RATIO_4X3},   // QQVGA
+    {176, 144, ASPECT_RATIO_5X4},   // QCIF
+    {240, 176, ASPECT_RATIO_4X3},   // HQVGA
+    {240, 240, ASPECT_RATIO_1X1},   // 240x240
+    {320, 240, ASPECT_RATIO_4X3},   // QVGA
+    {400, 296, ASPECT_RATIO_4X3},   // CIF
+    {480, 320, ASPECT_RATIO_3X2},   // HVGA
+    {640, 480, ASPECT_RATIO_4X3},   // VGA
+    {800, 600, ASPECT_RATIO_4X3},   // SVGA
+    {1024, 768, ASPECT_RATIO_4X3},  // XGA
+    {1280, 720, ASPECT_RATIO_16X9}, // HD
+    {1280, 1024, ASPECT_RATIO_5X4}, // SXGA
+    {1600, 1200, ASPECT_RATIO_4X3}, // UXGA
+};
+
+// The driver gives up on a frame buffer after this long
+static const unsigned long FB_GET_TIMEOUT_MS = 4000;
+
+static SimCameraConfig simConfig;
+static SimCameraStats stats = {0, 0, 0, 0, 0, 0};
+static std::vector<std::string> frameFiles;
+
+static bool initialized = false;
+static sensor_t sensor;
+static camera_grab_mode_t grabMode = CAMERA_GRAB_WHEN_EMPTY;
+static size_t fbCount = 1;
+static size_t outstanding = 0;
+
+// Sensor clock: frame i completes at streamStartUs + (i + 1) * periodUs
+static uint64_t streamStartUs = 0;
+static uint64_t periodUs = 80000;
+static int64_t lastTakenIndex = -1;
+static int64_t sizeChangeIndex = 0;
+static framesize_t previousSize = FRAMESIZE_VGA;
+static uint32_t sceneIndex = 0;
+
+void simCameraConfigure(const SimCameraConfig &config)
+{
+    simConfig = config;
+    frameFiles.clear();
+    if (simConfig.frameDir.empty())
+    {
+        return;
+    }
+    DIR *dir = opendir(simConfig.frameDir.c_str());
+    if (!dir)
+    {
+        fprintf(stderr, "[sim] camera: cannot open frame directory %s, using synthetic frames\n", simConfig.frameDir.c_str());
+        return;
+    }
+    while (struct dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        std::string lower = name;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        size_t dot = lower.rfind('.');
+        if (dot != std::string::npos && (lower.substr(dot) == ".jpg" || lower.substr(dot) == ".jpeg"))
+        {
+            frameFiles.push_back(simConfig.frameDir + "/" + name);
+        }
+    }
+    closedir(dir);
+    std::sort(frameFiles.begin(), frameFiles.end());
+    printf("[sim] camera: replaying %zu JPEG frames from %s\n", frameFiles.size(), simConfig.frameDir.c_str());
+}
+
+const SimCameraStats &simCameraStats()
+{
+    return stats;
+}
+
+// ---- Scene generation ----------------------------------------------------------
+
+static uint32_t noiseState = 1;
+
+static inline uint8_t clampByte(float v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+static int noise(int amplitude)
+{
+    noiseState = noiseState * 1103515245 + 12345;
+    return (int)((noiseState >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+// Plant rows with tomatoes that ripen from scene to scene
+static void synthesizeScene(uint32_t scene, int width, int height, std::vector<uint8_t> &rgb)
+{
+    rgb.resize((size_t)width * height * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float leaf = 0.5f + 0.5f * sinf(x * 0.05f + y * 0.03f) * cosf(y * 0.07f - x * 0.02f);
+            uint8_t *px = &rgb[((size_t)y * width + x) * 3];
+            px[0] = clampByte(40 + 30 * leaf);
+            px[1] = clampByte(90 + 80 * leaf);
+            px[2] = clampByte(35 + 20 * leaf);
+        }
+    }
+
+    const int tomatoes = 12;
+    float ripeShare = fmodf(scene * 0.15f, 1.0f);
+    for (int t = 0; t < tomatoes; t++)
+    {
+        float cx = (0.1f + 0.8f * ((t * 37) % 100) / 100.0f) * width;
+        float cy = (0.3f + 0.4f * ((t * 61) % 100) / 100.0f) * height;
+        float radius = (0.03f + 0.02f * (t % 3)) * width;
+        bool ripe = t < ripeShare * tomatoes;
+        uint8_t r = ripe ? 200 : 120;
+        uint8_t g = ripe ? 40 : 170;
+        uint8_t b = ripe ? 35 : 60;
+        for (int y = std::max(0, (int)(cy - radius)); y < std::min(height, (int)(cy + radius + 1)); y++)
+        {
+            for (int x = std::max(0, (int)(cx - radius)); x < std::min(width, (int)(cx + radius + 1)); x++)
+            {
+                float d = hypotf(x - cx, y - cy) / radius;
+                if (d <= 1.0f)
+                {
+                    float shade = 1.0f - 0.35f * d;
+                    uint8_t *px = &rgb[((size_t)y * width + x) * 3];
+                    px[0] = clampByte(r * shade);
+                    px[1] = clampByte(g * shade);
+                    px[2] = clampByte(b * shade);
+                }
+            }
+        }
+    }
+}
+
+static bool loadSceneRgb(uint32_t scene, int width, int height, std::vector<uint8_t> &rgb, int &sourceWidth, int &sourceHeight)
+{
+    if (frameFiles.empty())
+    {
+        synthesizeScene(scene, width, height, rgb);
+        sourceWidth = width;
+        sourceHeight = height;
+        return true;
+    }
+
+    std::ifstream in(frameFiles[scene % frameFiles.size()], std::ios::binary);
+    std::vector<uint8_t> jpeg((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    int denom = 1;
+    int fullWidth, fullHeight;
+    if (!simJpegDimensions(jpeg.data(), jpeg.size(), fullWidth, fullHeight))
+    {
+        return false;
+    }
+    while (denom < 8 && fullWidth / (denom * 2) >= width && fullHeight / (denom * 2) >= height)
+    {
+        denom *= 2;
+    }
+    return simJpegDecode(jpeg.data(), jpeg.size(), denom, rgb, sourceWidth, sourceHeight);
+}
+
+// Resamples to the sensor window and applies exposure gain and sensor noise
+static void developFrame(const std::vector<uint8_t> &source, int sourceWidth, int sourceHeight,
+                         int width, int height, float gain, std::vector<uint8_t> &out)
+{
+    out.resize((size_t)width * height * 3);
+    for (int y = 0; y < height; y++)
+    {
+        int sy = (int)((int64_t)y * sourceHeight / height);
+        for (int x = 0; x < width; x++)
+        {
+            int sx = (int)((int64_t)x * sourceWidth / width);
+            const uint8_t *src = &source[((size_t)sy * sourceWidth + sx) * 3];
+            uint8_t *dst = &out[((size_t)y * width + x) * 3];
+            int n = noise(2);
+            for (int c = 0; c < 3; c++)
+            {
+                dst[c] = clampByte(src[c] * gain + n);
+            }
+        }
+    }
+}
+
+static bool renderFrame(int64_t index, framesize_t size, std::vector<uint8_t> &jpeg)
+{
+    int width = resolution[size].width;
+    int height = resolution[size].height;
+    int framesSinceInit = (int)index;
+    float gain = 1.0f;
+    if (framesSinceInit < simConfig.exposureRampFrames)
+    {
+        gain = 0.55f + 0.45f * framesSinceInit / simConfig.exposureRampFrames;
+    }
+
+    uint32_t scene = simConfig.advancePerFrame ? sceneIndex + (uint32_t)index : sceneIndex;
+    noiseState = scene * 7919u + (uint32_t)index * 104729u + 1;
+
+    if (!frameFiles.empty() && gain == 1.0f)
+    {
+        // Pass recorded frames through untouched when they already match the window
+        std::ifstream in(frameFiles[scene % frameFiles.size()], std::ios::binary);
+        std::vector<uint8_t> raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        int fileWidth, fileHeight;
+        if (simJpegDimensions(raw.data(), raw.size(), fileWidth, fileHeight) && fileWidth == width && fileHeight == height)
+        {
+            jpeg.swap(raw);
+            return true;
+        }
+    }
+
+    std::vector<uint8_t> source, developed;
+    int sourceWidth, sourceHeight;
+    if (!loadSceneRgb(scene, width, height, source, sourceWidth, sourceHeight))
+    {
+        return false;
+    }
+    developFrame(source, sourceWidth, sourceHeight, width, height, gain, developed);
+    stats.framesTranscoded++;
+    return simJpegEncode(developed.data(), width, height, simJpegQualityFromSensor(sensor.status.quality), jpeg);
+}
+
+// ---- Sensor control ------------------------------------------------------------
+
+static int64_t latestCompletedIndex()
+{
+    uint64_t now = micros();
+    if (now < streamStartUs + periodUs)
+    {
+        return -1;
+    }
+    return (int64_t)((now - streamStartUs) / periodUs) - 1;
+}
+
+static int setFramesize(sensor_t *s, framesize_t framesize)
+{
+    if (framesize >= FRAMESIZE_INVALID)
+    {
+        return -1;
+    }
+    // The frame being read out finishes at the old window
+    int64_t inFlight = latestCompletedIndex() + 1;
+    previousSize = inFlight < sizeChangeIndex ? previousSize : s->status.framesize;
+    sizeChangeIndex = inFlight + 1;
+    s->status.framesize = framesize;
+    delay(5); // SCCB register writes
+    return 0;
+}
+
+static int setQuality(sensor_t *s, int quality)
+{
+    s->status.quality = quality;
+    return 0;
+}
+
+static int setPixformat(sensor_t *s, pixformat_t pixformat)
+{
+    s->pixformat = pixformat;
+    return pixformat == PIXFORMAT_JPEG ? 0 : -1;
+}
+
+static int setGainceiling(sensor_t *s, gainceiling_t gainceiling)
+{
+    s->status.gainceiling = gainceiling;
+    return 0;
+}
+
+#define SIM_SENSOR_SETTER(name, field)     \
+    static int name(sensor_t *s, int value) \
+    {                                       \
+        s->status.field = value;            \
+        return 0;                           \
+    }
+
+SIM_SENSOR_SETTER(setContrast, contrast)
+SIM_SENSOR_SETTER(setBrightness, brightness)
+SIM_SENSOR_SETTER(setSaturation, saturation)
+SIM_SENSOR_SETTER(setSharpness, sharpness)
+SIM_SENSOR_SETTER(setDenoise, denoise)
+SIM_SENSOR_SETTER(setColorbar, colorbar)
+SIM_SENSOR_SETTER(setWhitebal, awb)
+SIM_SENSOR_SETTER(setGainCtrl, agc)
+SIM_SENSOR_SETTER(setExposureCtrl, aec)
+SIM_SENSOR_SETTER(setHmirror, hmirror)
+SIM_SENSOR_SETTER(setVflip, vflip)
+SIM_SENSOR_SETTER(setAec2, aec2)
+SIM_SENSOR_SETTER(setAwbGain, awb_gain)
+SIM_SENSOR_SETTER(setAgcGain, agc_gain)
+SIM_SENSOR_SETTER(setAecValue, aec_value)
+SIM_SENSOR_SETTER(setSpecialEffect, special_effect)
+SIM_SENSOR_SETTER(setWbMode, wb_mode)
+SIM_SENSOR_SETTER(setAeLevel, ae_level)
+SIM_SENSOR_SETTER(setDcw, dcw)
+SIM_SENSOR_SETTER(setBpc, bpc)
+SIM_SENSOR_SETTER(setWpc, wpc)
+SIM_SENSOR_SETTER(setRawGma, raw_gma)
+SIM_SENSOR_SETTER(setLenc, lenc)
+
+// ---- Driver API ----------------------------------------------------------------
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+    if (initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    delay(simConfig.initMs);
+    if (simConfig.failInit)
+    {
+        return ESP_ERR_CAMERA_NOT_DETECTED;
+    }
+    if (config->pixel_format != PIXFORMAT_JPEG || config->frame_size >= FRAMESIZE_INVALID)
+    {
+        return ESP_ERR_CAMERA_NOT_SUPPORTED;
+    }
+
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.pixformat = config->pixel_format;
+    sensor.xclk_freq_hz = config->xclk_freq_hz;
+    sensor.status.framesize = config->frame_size;
+    sensor.status.quality = config->jpeg_quality;
+    sensor.set_pixformat = setPixformat;
+    sensor.set_framesize = setFramesize;
+    sensor.set_contrast = setContrast;
+    sensor.set_brightness = setBrightness;
+    sensor.set_saturation = setSaturation;
+    sensor.set_sharpness = setSharpness;
+    sensor.set_denoise = setDenoise;
+    sensor.set_gainceiling = setGainceiling;
+    sensor.set_quality = setQuality;
+    sensor.set_colorbar = setColorbar;
+    sensor.set_whitebal = setWhitebal;
+    sensor.set_gain_ctrl = setGainCtrl;
+    sensor.set_exposure_ctrl = setExposureCtrl;
+    sensor.set_hmirror = setHmirror;
+    sensor.set_vflip = setVflip;
+    sensor.set_aec2 = setAec2;
+    sensor.set_awb_gain = setAwbGain;
+    sensor.set_agc_gain = setAgcGain;
+    sensor.set_aec_value = setAecValue;
+    sensor.set_special_effect = setSpecialEffect;
+    sensor.set_wb_mode = setWbMode;
+    sensor.set_ae_level = setAeLevel;
+    sensor.set_dcw = setDcw;
+    sensor.set_bpc = setBpc;
+    sensor.set_wpc = setWpc;
+    sensor.set_raw_gma = setRawGma;
+    sensor.set_lenc = setLenc;
+
+    grabMode = config->grab_mode;
+    fbCount = config->fb_count > 0 ? config->fb_count : 1;
+    outstanding = 0;
+    periodUs = (uint64_t)(1000000.0f / (simConfig.fps > 0 ? simConfig.fps : 1.0f));
+    streamStartUs = micros();
+    lastTakenIndex = -1;
+    sizeChangeIndex = 0;
+    previousSize = config->frame_size;
+    initialized = true;
+    stats.inits++;
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit()
+{
+    if (!initialized)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (outstanding > 0)
+    {
+        printf("[sim] camera: deinit with %zu frame buffer(s) not returned\n", outstanding);
+    }
+    initialized = false;
+    if (!simConfig.advancePerFrame)
+    {
+        sceneIndex++;
+    }
+    else
+    {
+        sceneIndex += (uint32_t)(lastTakenIndex + 1);
+    }
+    return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get()
+{
+    if (!initialized)
+    {
+        return NULL;
+    }
+    if (outstanding >= fbCount)
+    {
+        delay(FB_GET_TIMEOUT_MS);
+        stats.getTimeouts++;
+        printf("[sim] camera: Failed to get the frame on time!\n");
+        return NULL;
+    }
+
+    int64_t latest = latestCompletedIndex();
+    int64_t index;
+    if (grabMode == CAMERA_GRAB_LATEST)
+    {
+        index = std::max(lastTakenIndex + 1, latest);
+    }
+    else
+    {
+        // Buffers stop filling once full, so old frames are still queued
+        index = std::max(lastTakenIndex + 1, latest - (int64_t)fbCount + 1);
+    }
+    if (index > latest)
+    {
+        uint64_t ready = streamStartUs + (uint64_t)(index + 1) * periodUs;
+        simSleepMicros(ready - micros());
+    }
+    stats.framesSkipped += (uint32_t)(index - lastTakenIndex - 1);
+    lastTakenIndex = index;
+
+    framesize_t size = index < sizeChangeIndex ? previousSize : sensor.status.framesize;
+    std::vector<uint8_t> jpeg;
+    if (!renderFrame(index, size, jpeg))
+    {
+        printf("[sim] camera: failed to render frame %lld\n", (long long)index);
+        return NULL;
+    }
+    delay(simConfig.latencyMs);
+
+    camera_fb_t *fb = (camera_fb_t *)calloc(1, sizeof(camera_fb_t));
+    fb->buf = (uint8_t *)malloc(jpeg.size());
+    memcpy(fb->buf, jpeg.data(), jpeg.size());
+    fb->len = jpeg.size();
+    fb->width = resolution[size].width;
+    fb->height = resolution[size].height;
+    fb->format = PIXFORMAT_JPEG;
+    uint64_t capturedUs = streamStartUs + (uint64_t)(index + 1) * periodUs;
+    fb->timestamp.tv_sec = capturedUs / 1000000;
+    fb->timestamp.tv_usec = capturedUs % 1000000;
+
+    outstanding++;
+    stats.framesDelivered++;
+    stats.bytesDelivered += fb->len;
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+    if (!fb)
+    {
+        return;
+    }
+    free(fb->buf);
+    free(fb);
+    if (outstanding > 0)
+    {
+        outstanding--;
+    }
+}
+
+sensor_t *esp_camera_sensor_get()
+{
+    return initialized ? &sensor : NULL;
+}
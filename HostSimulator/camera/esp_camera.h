@@ -0,0 +1,136 @@
+#ifndef HOST_ESP_CAMERA_H
+#define HOST_ESP_CAMERA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <string>
+#include "esp32-hal.h"
+#include "sensor.h"
+
+typedef enum
+{
+    LEDC_TIMER_0 = 0,
+    LEDC_TIMER_1,
+    LEDC_TIMER_2,
+    LEDC_TIMER_3
+} ledc_timer_t;
+
+typedef enum
+{
+    LEDC_CHANNEL_0 = 0,
+    LEDC_CHANNEL_1,
+    LEDC_CHANNEL_2,
+    LEDC_CHANNEL_3,
+    LEDC_CHANNEL_4,
+    LEDC_CHANNEL_5,
+    LEDC_CHANNEL_6,
+    LEDC_CHANNEL_7
+} ledc_channel_t;
+
+typedef enum
+{
+    CAMERA_GRAB_WHEN_EMPTY,
+    CAMERA_GRAB_LATEST
+} camera_grab_mode_t;
+
+typedef enum
+{
+    CAMERA_FB_IN_PSRAM,
+    CAMERA_FB_IN_DRAM
+} camera_fb_location_t;
+
+typedef struct
+{
+    int pin_pwdn;
+    int pin_reset;
+    int pin_xclk;
+    union
+    {
+        int pin_sccb_sda;
+        int pin_sscb_sda;
+    };
+    union
+    {
+        int pin_sccb_scl;
+        int pin_sscb_scl;
+    };
+    int pin_d7;
+    int pin_d6;
+    int pin_d5;
+    int pin_d4;
+    int pin_d3;
+    int pin_d2;
+    int pin_d1;
+    int pin_d0;
+    int pin_vsync;
+    int pin_href;
+    int pin_pclk;
+
+    int xclk_freq_hz;
+    ledc_timer_t ledc_timer;
+    ledc_channel_t ledc_channel;
+
+    pixformat_t pixel_format;
+    framesize_t frame_size;
+    int jpeg_quality;
+    size_t fb_count;
+    camera_fb_location_t fb_location;
+    camera_grab_mode_t grab_mode;
+    int sccb_i2c_port;
+} camera_config_t;
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t len;
+    size_t width;
+    size_t height;
+    pixformat_t format;
+    struct timeval timestamp;
+} camera_fb_t;
+
+#define ESP_ERR_CAMERA_BASE 0x20000
+#define ESP_ERR_CAMERA_NOT_DETECTED (ESP_ERR_CAMERA_BASE + 1)
+#define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
+#define ESP_ERR_CAMERA_FAILED_TO_SET_OUT_FORMAT (ESP_ERR_CAMERA_BASE + 3)
+#define ESP_ERR_CAMERA_NOT_SUPPORTED (ESP_ERR_CAMERA_BASE + 4)
+
+esp_err_t esp_camera_init(const camera_config_t *config);
+esp_err_t esp_camera_deinit();
+camera_fb_t *esp_camera_fb_get();
+void esp_camera_fb_return(camera_fb_t *fb);
+sensor_t *esp_camera_sensor_get();
+
+// ---- Simulator configuration -------------------------------------------------
+// Frames come from a directory of JPEGs (sorted by name, looped) or, when no
+// directory is set, from a synthetic greenhouse scene. Each camera session
+// shows the next scene (or every frame does, with advancePerFrame). Frames are produced on
+// the sensor clock at `fps`; each esp_camera_fb_get() additionally costs
+// `latencyMs` (DMA/transfer). Frames that do not match the configured frame
+// size, or that fall in the auto-exposure ramp after init, are transcoded.
+struct SimCameraConfig
+{
+    std::string frameDir;
+    float fps = 12.5f;
+    unsigned long latencyMs = 30;
+    unsigned long initMs = 250;
+    int exposureRampFrames = 4;
+    bool advancePerFrame = false;
+    bool failInit = false;
+};
+
+struct SimCameraStats
+{
+    uint32_t inits;
+    uint32_t framesDelivered;
+    uint32_t framesSkipped;     // Sensor frames overwritten before anyone took them
+    uint32_t framesTranscoded;
+    uint32_t getTimeouts;
+    uint64_t bytesDelivered;
+};
+
+void simCameraConfigure(const SimCameraConfig &config);
+const SimCameraStats &simCameraStats();
+
+#endif
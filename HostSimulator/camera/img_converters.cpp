@@ -0,0 +1,82 @@
+#include "img_converters.h"
+#include "simJpeg.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t *out, jpg_scale_t scale)
+{
+    int sourceWidth, sourceHeight;
+    std::vector<uint8_t> rgb;
+    int width, height;
+    if (!simJpegDimensions(src, src_len, sourceWidth, sourceHeight) ||
+        !simJpegDecode(src, src_len, 1 << scale, rgb, width, height))
+    {
+        return false;
+    }
+
+    // The ESP decoder truncates partial blocks where libjpeg rounds up
+    int outWidth = sourceWidth >> scale;
+    int outHeight = sourceHeight >> scale;
+    for (int y = 0; y < outHeight; y++)
+    {
+        for (int x = 0; x < outWidth; x++)
+        {
+            const uint8_t *px = &rgb[((size_t)y * width + x) * 3];
+            uint16_t c = ((px[0] & 0xF8) << 8) | ((px[1] & 0xFC) << 3) | (px[2] >> 3);
+            uint8_t *dst = out + ((size_t)y * outWidth + x) * 2;
+            dst[0] = c >> 8;
+            dst[1] = c & 0xFF;
+        }
+    }
+    return true;
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t **out, size_t *out_len)
+{
+    size_t pixels = (size_t)width * height;
+    std::vector<uint8_t> rgb(pixels * 3);
+    if (format == PIXFORMAT_RGB565 && src_len >= pixels * 2)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            uint16_t c = (src[2 * i] << 8) | src[2 * i + 1];
+            rgb[3 * i] = (c >> 11) << 3;
+            rgb[3 * i + 1] = ((c >> 5) & 0x3F) << 2;
+            rgb[3 * i + 2] = (c & 0x1F) << 3;
+        }
+    }
+    else if (format == PIXFORMAT_GRAYSCALE && src_len >= pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = src[i];
+        }
+    }
+    else if (format == PIXFORMAT_RGB888 && src_len >= pixels * 3)
+    {
+        memcpy(rgb.data(), src, pixels * 3);
+    }
+    else
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> jpeg;
+    if (!simJpegEncode(rgb.data(), width, height, quality, jpeg))
+    {
+        return false;
+    }
+    *out = (uint8_t *)malloc(jpeg.size());
+    if (!*out)
+    {
+        return false;
+    }
+    memcpy(*out, jpeg.data(), jpeg.size());
+    *out_len = jpeg.size();
+    return true;
+}
+
+bool frame2jpg(camera_fb_t *fb, uint8_t quality, uint8_t **out, size_t *out_len)
+{
+    return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
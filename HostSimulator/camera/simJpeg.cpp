@@ -0,0 +1,129 @@
+#include "simJpeg.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+
+struct SimJpegError
+{
+    jpeg_error_mgr base;
+    jmp_buf escape;
+};
+
+static void onJpegError(j_common_ptr cinfo)
+{
+    longjmp(((SimJpegError *)cinfo->err)->escape, 1);
+}
+
+static void onJpegMessage(j_common_ptr cinfo, int level)
+{
+    (void)cinfo;
+    (void)level;
+}
+
+bool simJpegDecode(const uint8_t *jpeg, size_t len, int scaleDenom, std::vector<uint8_t> &rgb, int &width, int &height)
+{
+    jpeg_decompress_struct cinfo;
+    SimJpegError error;
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = onJpegError;
+    error.base.emit_message = onJpegMessage;
+    if (setjmp(error.escape))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, len);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scaleDenom;
+    jpeg_start_decompress(&cinfo);
+
+    width = cinfo.output_width;
+    height = cinfo.output_height;
+    rgb.resize((size_t)width * height * 3);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = rgb.data() + (size_t)cinfo.output_scanline * width * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+bool simJpegDimensions(const uint8_t *jpeg, size_t len, int &width, int &height)
+{
+    jpeg_decompress_struct cinfo;
+    SimJpegError error;
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = onJpegError;
+    error.base.emit_message = onJpegMessage;
+    if (setjmp(error.escape))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, len);
+    bool ok = jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK;
+    width = cinfo.image_width;
+    height = cinfo.image_height;
+    jpeg_destroy_decompress(&cinfo);
+    return ok;
+}
+
+bool simJpegEncode(const uint8_t *rgb, int width, int height, int quality, std::vector<uint8_t> &jpeg)
+{
+    jpeg_compress_struct cinfo;
+    SimJpegError error;
+    unsigned char *out = nullptr;
+    unsigned long outLen = 0;
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = onJpegError;
+    error.base.emit_message = onJpegMessage;
+    if (setjmp(error.escape))
+    {
+        jpeg_destroy_compress(&cinfo);
+        free(out);
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &outLen);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    // OV2640 output: baseline 4:2:2, no restart markers
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = (JSAMPROW)(rgb + (size_t)cinfo.next_scanline * width * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    jpeg.assign(out, out + outLen);
+    free(out);
+    return true;
+}
+
+int simJpegQualityFromSensor(int sensorQuality)
+{
+    int quality = 100 - sensorQuality * 3 / 2;
+    return quality < 5 ? 5 : (quality > 95 ? 95 : quality);
+}
@@ -0,0 +1,16 @@
+#ifndef HOST_SIM_JPEG_H
+#define HOST_SIM_JPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// libjpeg helpers shared by the camera and img_converters shims (RGB888, row-major)
+bool simJpegDecode(const uint8_t *jpeg, size_t len, int scaleDenom, std::vector<uint8_t> &rgb, int &width, int &height);
+bool simJpegDimensions(const uint8_t *jpeg, size_t len, int &width, int &height);
+bool simJpegEncode(const uint8_t *rgb, int width, int height, int quality, std::vector<uint8_t> &jpeg);
+
+// esp32-camera quality (0-63, lower is better) to an approximately equivalent libjpeg quality
+int simJpegQualityFromSensor(int sensorQuality);
+
+#endif
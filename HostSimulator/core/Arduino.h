@@ -0,0 +1,39 @@
+/*
+ * Host (Linux) subset of the ESP32 Arduino core used by the simulator builds.
+ * Only what the sketches in this repository call is provided.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+#include "esp32-hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+using std::max;
+using std::min;
+
+#define HIGH 1
+#define LOW 0
+
+#define F(string_literal) (string_literal)
+
+template <typename T, typename L, typename H>
+inline T constrain(T amt, L low, H high)
+{
+    return amt < low ? low : (amt > high ? high : amt);
+}
+
+#endif
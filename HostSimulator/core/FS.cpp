@@ -0,0 +1,293 @@
+#include "FS.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+SimFsStats simFsStats = {0, 0, 0};
+
+namespace fs
+{
+
+class FileImpl
+{
+public:
+    std::string virtualPath;
+    std::string hostPath;
+    std::string fileName;
+    std::string openMode;
+    FILE *file = nullptr;
+    bool directory = false;
+    std::vector<std::string> entries;
+    size_t nextEntry = 0;
+    FS *owner = nullptr;
+
+    ~FileImpl()
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+    }
+};
+
+static std::string baseName(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+size_t File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+    if (!_p || !_p->file)
+    {
+        return 0;
+    }
+    size_t n = fwrite(buf, 1, size, _p->file);
+    simFsStats.bytesWritten += n;
+    return n;
+}
+
+int File::available()
+{
+    if (!_p || !_p->file)
+    {
+        return 0;
+    }
+    long pos = ftell(_p->file);
+    return (int)(size() - pos);
+}
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek()
+{
+    if (!_p || !_p->file)
+    {
+        return -1;
+    }
+    int c = fgetc(_p->file);
+    if (c != EOF)
+    {
+        ungetc(c, _p->file);
+    }
+    return c == EOF ? -1 : c;
+}
+
+void File::flush()
+{
+    if (_p && _p->file)
+    {
+        fflush(_p->file);
+    }
+}
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+    if (!_p || !_p->file)
+    {
+        return 0;
+    }
+    size_t n = fread(buf, 1, size, _p->file);
+    simFsStats.bytesRead += n;
+    return n;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!_p || !_p->file)
+    {
+        return false;
+    }
+    int whence = mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END);
+    return fseek(_p->file, pos, whence) == 0;
+}
+
+size_t File::position() const
+{
+    return _p && _p->file ? (size_t)ftell(_p->file) : 0;
+}
+
+size_t File::size() const
+{
+    if (!_p || !_p->file)
+    {
+        return 0;
+    }
+    fflush(_p->file);
+    struct stat st;
+    return fstat(fileno(_p->file), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+bool File::setBufferSize(size_t size)
+{
+    return _p && _p->file && setvbuf(_p->file, nullptr, _IOFBF, size) == 0;
+}
+
+void File::close()
+{
+    if (_p && _p->file)
+    {
+        fclose(_p->file);
+        _p->file = nullptr;
+    }
+    _p.reset();
+}
+
+File::operator bool() const
+{
+    return _p && (_p->file || _p->directory);
+}
+
+time_t File::getLastWrite()
+{
+    struct stat st;
+    return _p && stat(_p->hostPath.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+const char *File::path() const
+{
+    return _p ? _p->virtualPath.c_str() : nullptr;
+}
+
+const char *File::name() const
+{
+    return _p ? _p->fileName.c_str() : nullptr;
+}
+
+bool File::isDirectory()
+{
+    return _p && _p->directory;
+}
+
+File File::openNextFile(const char *mode)
+{
+    if (!_p || !_p->directory || _p->nextEntry >= _p->entries.size())
+    {
+        return File();
+    }
+    std::string child = _p->virtualPath;
+    if (child.empty() || child.back() != '/')
+    {
+        child += '/';
+    }
+    child += _p->entries[_p->nextEntry++];
+    return _p->owner->open(child.c_str(), mode);
+}
+
+String File::getNextFileName()
+{
+    if (!_p || !_p->directory || _p->nextEntry >= _p->entries.size())
+    {
+        return String();
+    }
+    std::string child = _p->virtualPath;
+    if (child.empty() || child.back() != '/')
+    {
+        child += '/';
+    }
+    return String(child + _p->entries[_p->nextEntry++]);
+}
+
+void File::rewindDirectory()
+{
+    if (_p)
+    {
+        _p->nextEntry = 0;
+    }
+}
+
+std::string FS::hostPath(const char *path) const
+{
+    std::string p = path ? path : "/";
+    if (p.empty() || p[0] != '/')
+    {
+        p = "/" + p;
+    }
+    return _root + p;
+}
+
+File FS::open(const char *path, const char *mode, const bool create)
+{
+    std::string host = hostPath(path);
+    auto impl = std::make_shared<FileImpl>();
+    impl->virtualPath = path;
+    impl->hostPath = host;
+    impl->fileName = baseName(path);
+    impl->openMode = mode;
+    impl->owner = this;
+
+    struct stat st;
+    bool found = stat(host.c_str(), &st) == 0;
+    if (found && S_ISDIR(st.st_mode))
+    {
+        DIR *dir = opendir(host.c_str());
+        if (!dir)
+        {
+            return File();
+        }
+        while (struct dirent *entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..")
+            {
+                impl->entries.push_back(name);
+            }
+        }
+        closedir(dir);
+        std::sort(impl->entries.begin(), impl->entries.end());
+        impl->directory = true;
+        return File(impl);
+    }
+
+    if (!found && mode[0] == 'r' && !create)
+    {
+        return File();
+    }
+    impl->file = fopen(host.c_str(), mode);
+    if (!impl->file)
+    {
+        return File();
+    }
+    simFsStats.filesOpened++;
+    return File(impl);
+}
+
+bool FS::exists(const char *path)
+{
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path)
+{
+    return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo)
+{
+    return ::rename(hostPath(pathFrom).c_str(), hostPath(pathTo).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path)
+{
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+bool FS::rmdir(const char *path)
+{
+    return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+} // namespace fs
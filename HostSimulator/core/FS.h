@@ -0,0 +1,103 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <memory>
+#include <string>
+#include <time.h>
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+namespace fs
+{
+
+class FileImpl;
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+
+// Arduino File over a host file or directory (copyable handle, like the ESP32 core)
+class File : public Stream
+{
+public:
+    File(FileImplPtr p = FileImplPtr()) : _p(p) {}
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t read(uint8_t *buf, size_t size);
+    size_t readBytes(char *buffer, size_t length) override { return read((uint8_t *)buffer, length); }
+
+    bool seek(uint32_t pos, SeekMode mode);
+    bool seek(uint32_t pos) { return seek(pos, SeekSet); }
+    size_t position() const;
+    size_t size() const;
+    bool setBufferSize(size_t size);
+    void close();
+    operator bool() const;
+    time_t getLastWrite();
+    const char *path() const;
+    const char *name() const;
+
+    bool isDirectory();
+    File openNextFile(const char *mode = FILE_READ);
+    String getNextFileName();
+    void rewindDirectory();
+
+    using Print::write;
+
+private:
+    FileImplPtr _p;
+};
+
+// Filesystem rooted at a host directory; paths are the sketch's absolute paths
+class FS
+{
+public:
+    FS() {}
+    void setRoot(const std::string &hostRoot) { _root = hostRoot; }
+    const std::string &root() const { return _root; }
+    std::string hostPath(const char *path) const;
+
+    File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+    File open(const String &path, const char *mode = FILE_READ, const bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *pathFrom, const char *pathTo);
+    bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+    bool mkdir(const char *path);
+    bool mkdir(const String &path) { return mkdir(path.c_str()); }
+    bool rmdir(const char *path);
+    bool rmdir(const String &path) { return rmdir(path.c_str()); }
+
+protected:
+    std::string _root = ".";
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+// Byte counters over every FS instance, reported by the simulator
+struct SimFsStats
+{
+    uint64_t bytesWritten;
+    uint64_t bytesRead;
+    uint32_t filesOpened;
+};
+extern SimFsStats simFsStats;
+
+#endif
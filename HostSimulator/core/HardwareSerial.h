@@ -0,0 +1,24 @@
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include "Stream.h"
+
+// Serial mapped to stdout (and a non-blocking stdin for sketches that read commands)
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    void flush() override;
+    operator bool() const { return true; }
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+#include "Arduino.h"
+
+class IPAddress
+{
+public:
+    IPAddress() : IPAddress(0, 0, 0, 0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _octets{a, b, c, d} {}
+    uint8_t operator[](int index) const { return _octets[index]; }
+    // Network byte order, as in the ESP32 core
+    operator uint32_t() const
+    {
+        uint32_t address;
+        memcpy(&address, _octets, sizeof(address));
+        return address;
+    }
+    String toString() const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _octets[0], _octets[1], _octets[2], _octets[3]);
+        return String(buf);
+    }
+
+private:
+    uint8_t _octets[4];
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include "SD_MMC.h"
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <errno.h>
+
+fs::SDMMCFS SD_MMC;
+
+bool fs::SDMMCFS::begin(const char *mountpoint, bool mode1bit, bool format_if_mount_failed)
+{
+    (void)mountpoint;
+    (void)mode1bit;
+    (void)format_if_mount_failed;
+    if (::mkdir(_root.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        return false;
+    }
+    _mounted = true;
+    return true;
+}
+
+uint64_t fs::SDMMCFS::cardSize()
+{
+    return totalBytes();
+}
+
+uint64_t fs::SDMMCFS::totalBytes()
+{
+    struct statvfs st;
+    return statvfs(_root.c_str(), &st) == 0 ? (uint64_t)st.f_blocks * st.f_frsize : 0;
+}
+
+uint64_t fs::SDMMCFS::usedBytes()
+{
+    struct statvfs st;
+    return statvfs(_root.c_str(), &st) == 0 ? (uint64_t)(st.f_blocks - st.f_bfree) * st.f_frsize : 0;
+}
@@ -0,0 +1,37 @@
+#ifndef HOST_SD_MMC_H
+#define HOST_SD_MMC_H
+
+#include "FS.h"
+
+typedef enum
+{
+    CARD_NONE,
+    CARD_MMC,
+    CARD_SD,
+    CARD_SDHC,
+    CARD_UNKNOWN
+} sdcard_type_t;
+
+namespace fs
+{
+
+// SD card backed by a local directory (simulator option --sd)
+class SDMMCFS : public FS
+{
+public:
+    bool begin(const char *mountpoint = "/sdcard", bool mode1bit = false, bool format_if_mount_failed = false);
+    void end() { _mounted = false; }
+    sdcard_type_t cardType() { return _mounted ? CARD_SDHC : CARD_NONE; }
+    uint64_t cardSize();
+    uint64_t totalBytes();
+    uint64_t usedBytes();
+
+private:
+    bool _mounted = false;
+};
+
+} // namespace fs
+
+extern fs::SDMMCFS SD_MMC;
+
+#endif
@@ -0,0 +1,223 @@
+#include "WString.h"
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+template <typename T>
+static std::string formatInteger(T value, unsigned char base)
+{
+    if (base == 10)
+    {
+        return std::to_string(value);
+    }
+    bool negative = value < 0;
+    unsigned long long magnitude = negative ? (unsigned long long)(-(long long)value) : (unsigned long long)value;
+    std::string digits;
+    do
+    {
+        unsigned d = magnitude % base;
+        digits.insert(digits.begin(), (char)(d < 10 ? '0' + d : 'a' + d - 10));
+        magnitude /= base;
+    } while (magnitude);
+    return negative ? "-" + digits : digits;
+}
+
+static std::string formatFloat(double value, unsigned int decimalPlaces)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+    return buf;
+}
+
+String::String(const char *cstr) : _str(cstr ? cstr : "") {}
+String::String(const std::string &str) : _str(str) {}
+String::String(char c) : _str(1, c) {}
+String::String(unsigned char value, unsigned char base) : _str(formatInteger((unsigned)value, base)) {}
+String::String(int value, unsigned char base) : _str(formatInteger(value, base)) {}
+String::String(unsigned int value, unsigned char base) : _str(formatInteger(value, base)) {}
+String::String(long value, unsigned char base) : _str(formatInteger(value, base)) {}
+String::String(unsigned long value, unsigned char base) : _str(formatInteger(value, base)) {}
+String::String(long long value, unsigned char base) : _str(formatInteger(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : _str(formatInteger(value, base)) {}
+String::String(float value, unsigned int decimalPlaces) : _str(formatFloat(value, decimalPlaces)) {}
+String::String(double value, unsigned int decimalPlaces) : _str(formatFloat(value, decimalPlaces)) {}
+
+String &String::operator=(const char *cstr)
+{
+    _str = cstr ? cstr : "";
+    return *this;
+}
+
+bool String::reserve(unsigned int size)
+{
+    _str.reserve(size);
+    return true;
+}
+
+bool String::concat(const String &str) { _str += str._str; return true; }
+bool String::concat(const char *cstr) { if (cstr) _str += cstr; return cstr != nullptr; }
+bool String::concat(const char *cstr, unsigned int length) { if (cstr) _str.append(cstr, length); return cstr != nullptr; }
+bool String::concat(char c) { _str += c; return true; }
+bool String::concat(int value) { _str += std::to_string(value); return true; }
+bool String::concat(unsigned int value) { _str += std::to_string(value); return true; }
+bool String::concat(long value) { _str += std::to_string(value); return true; }
+bool String::concat(unsigned long value) { _str += std::to_string(value); return true; }
+bool String::concat(float value) { _str += formatFloat(value, 2); return true; }
+bool String::concat(double value) { _str += formatFloat(value, 2); return true; }
+
+bool String::equalsIgnoreCase(const String &other) const
+{
+    return _str.size() == other._str.size() &&
+           std::equal(_str.begin(), _str.end(), other._str.begin(),
+                      [](char a, char b) { return tolower((unsigned char)a) == tolower((unsigned char)b); });
+}
+
+bool String::startsWith(const String &prefix) const
+{
+    return _str.compare(0, prefix._str.size(), prefix._str) == 0;
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const
+{
+    return offset <= _str.size() && _str.compare(offset, prefix._str.size(), prefix._str) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    return _str.size() >= suffix._str.size() &&
+           _str.compare(_str.size() - suffix._str.size(), suffix._str.size(), suffix._str) == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+    return index < _str.size() ? _str[index] : 0;
+}
+
+void String::setCharAt(unsigned int index, char c)
+{
+    if (index < _str.size())
+    {
+        _str[index] = c;
+    }
+}
+
+char &String::operator[](unsigned int index)
+{
+    static char dummy;
+    if (index >= _str.size())
+    {
+        dummy = 0;
+        return dummy;
+    }
+    return _str[index];
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const
+{
+    size_t pos = _str.find(c, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+    size_t pos = _str.find(str._str, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const
+{
+    size_t pos = _str.rfind(c);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String &str) const
+{
+    size_t pos = _str.rfind(str._str);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int beginIndex) const
+{
+    return substring(beginIndex, length());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+    if (beginIndex > endIndex)
+    {
+        std::swap(beginIndex, endIndex);
+    }
+    if (beginIndex >= _str.size())
+    {
+        return String();
+    }
+    endIndex = std::min<unsigned int>(endIndex, _str.size());
+    return String(_str.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::replace(const String &find, const String &replace)
+{
+    if (find._str.empty())
+    {
+        return;
+    }
+    size_t pos = 0;
+    while ((pos = _str.find(find._str, pos)) != std::string::npos)
+    {
+        _str.replace(pos, find._str.size(), replace._str);
+        pos += replace._str.size();
+    }
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index < _str.size())
+    {
+        _str.erase(index, count);
+    }
+}
+
+void String::toLowerCase()
+{
+    for (char &c : _str)
+    {
+        c = (char)tolower((unsigned char)c);
+    }
+}
+
+void String::toUpperCase()
+{
+    for (char &c : _str)
+    {
+        c = (char)toupper((unsigned char)c);
+    }
+}
+
+void String::trim()
+{
+    size_t begin = _str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+    {
+        _str.clear();
+        return;
+    }
+    size_t end = _str.find_last_not_of(" \t\r\n");
+    _str = _str.substr(begin, end - begin + 1);
+}
+
+long String::toInt() const { return atol(_str.c_str()); }
+float String::toFloat() const { return (float)atof(_str.c_str()); }
+double String::toDouble() const { return atof(_str.c_str()); }
+
+String operator+(const String &lhs, const String &rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, const char *rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const char *lhs, const String &rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, char rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, int rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, unsigned int rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, long rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, unsigned long rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, float rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String &lhs, double rhs) { String s(lhs); s.concat(rhs); return s; }
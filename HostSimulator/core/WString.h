@@ -0,0 +1,108 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <stddef.h>
+#include <string>
+
+// Arduino String backed by std::string
+class String
+{
+public:
+    String(const char *cstr = "");
+    String(const std::string &str);
+    String(const String &other) = default;
+    String(String &&other) = default;
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned int decimalPlaces = 2);
+    explicit String(double value, unsigned int decimalPlaces = 2);
+
+    String &operator=(const String &other) = default;
+    String &operator=(String &&other) = default;
+    String &operator=(const char *cstr);
+
+    const char *c_str() const { return _str.c_str(); }
+    unsigned int length() const { return (unsigned int)_str.size(); }
+    bool isEmpty() const { return _str.empty(); }
+    bool reserve(unsigned int size);
+
+    bool concat(const String &str);
+    bool concat(const char *cstr);
+    bool concat(const char *cstr, unsigned int length);
+    bool concat(char c);
+    bool concat(int value);
+    bool concat(unsigned int value);
+    bool concat(long value);
+    bool concat(unsigned long value);
+    bool concat(float value);
+    bool concat(double value);
+
+    template <typename T>
+    String &operator+=(const T &rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+
+    bool equals(const String &other) const { return _str == other._str; }
+    bool equals(const char *cstr) const { return _str == (cstr ? cstr : ""); }
+    bool equalsIgnoreCase(const String &other) const;
+    int compareTo(const String &other) const { return _str.compare(other._str); }
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *rhs) const { return equals(rhs); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *rhs) const { return !equals(rhs); }
+    bool operator<(const String &rhs) const { return _str < rhs._str; }
+    bool operator>(const String &rhs) const { return _str > rhs._str; }
+
+    bool startsWith(const String &prefix) const;
+    bool startsWith(const String &prefix, unsigned int offset) const;
+    bool endsWith(const String &suffix) const;
+
+    char charAt(unsigned int index) const;
+    void setCharAt(unsigned int index, char c);
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index);
+
+    int indexOf(char c, unsigned int fromIndex = 0) const;
+    int indexOf(const String &str, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char c) const;
+    int lastIndexOf(const String &str) const;
+
+    String substring(unsigned int beginIndex) const;
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(const String &find, const String &replace);
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+    const std::string &str() const { return _str; }
+
+private:
+    std::string _str;
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, char rhs);
+String operator+(const String &lhs, int rhs);
+String operator+(const String &lhs, unsigned int rhs);
+String operator+(const String &lhs, long rhs);
+String operator+(const String &lhs, unsigned long rhs);
+String operator+(const String &lhs, float rhs);
+String operator+(const String &lhs, double rhs);
+
+#endif
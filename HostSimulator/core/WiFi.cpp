@@ -0,0 +1,136 @@
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+struct SimNetwork
+{
+    std::string ssid;
+    std::string bssid;
+};
+
+static std::vector<SimNetwork> networks;
+static std::vector<SimNetwork> scanResults;
+static unsigned long connectDelayMs = 500;
+
+void simWiFiAddNetwork(const std::string &ssid, const std::string &bssid)
+{
+    networks.push_back({ssid, bssid});
+}
+
+void simWiFiSetConnectDelay(unsigned long ms)
+{
+    connectDelayMs = ms;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase)
+{
+    (void)passphrase;
+    if (_mode == WIFI_MODE_NULL || _mode == WIFI_MODE_AP)
+    {
+        _mode = _mode == WIFI_MODE_AP ? WIFI_MODE_APSTA : WIFI_MODE_STA;
+    }
+    _ssid = ssid ? ssid : "";
+    _connectStart = millis();
+    _connecting = true;
+    return WL_DISCONNECTED;
+}
+
+wl_status_t WiFiClass::status()
+{
+    if (!_connecting)
+    {
+        return WL_DISCONNECTED;
+    }
+    return millis() - _connectStart >= connectDelayMs ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifioff)
+{
+    _connecting = false;
+    if (wifioff)
+    {
+        _mode = WIFI_MODE_NULL;
+    }
+    return true;
+}
+
+bool WiFiClass::mode(wifi_mode_t mode)
+{
+    _mode = mode;
+    return true;
+}
+
+int16_t WiFiClass::scanNetworks()
+{
+    // A real active scan takes roughly 120 ms per channel
+    delay(1500);
+    scanResults = networks;
+    return (int16_t)scanResults.size();
+}
+
+String WiFiClass::SSID(uint8_t index)
+{
+    return index < scanResults.size() ? String(scanResults[index].ssid) : String();
+}
+
+String WiFiClass::SSID()
+{
+    return status() == WL_CONNECTED ? String(_ssid) : String();
+}
+
+String WiFiClass::BSSIDstr(uint8_t index)
+{
+    return index < scanResults.size() ? String(scanResults[index].bssid) : String();
+}
+
+int32_t WiFiClass::RSSI(uint8_t index)
+{
+    return index < scanResults.size() ? -50 - 5 * (int32_t)index : 0;
+}
+
+int32_t WiFiClass::channel(uint8_t index)
+{
+    return index < scanResults.size() ? 1 : 0;
+}
+
+int32_t WiFiClass::channel()
+{
+    return 1;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+String WiFiClass::macAddress()
+{
+    return "24:0A:C4:00:00:01";
+}
+
+bool WiFiClass::softAP(const char *ssid, const char *passphrase, int channel, int ssid_hidden, int max_connection)
+{
+    (void)ssid;
+    (void)passphrase;
+    (void)channel;
+    (void)ssid_hidden;
+    (void)max_connection;
+    _mode = _mode == WIFI_MODE_STA ? WIFI_MODE_APSTA : WIFI_MODE_AP;
+    return true;
+}
+
+bool WiFiClass::softAPdisconnect(bool wifioff)
+{
+    _mode = wifioff ? WIFI_MODE_NULL : WIFI_MODE_STA;
+    return true;
+}
+
+IPAddress WiFiClass::softAPIP()
+{
+    return IPAddress(192, 168, 4, 1);
+}
+
+String WiFiClass::softAPmacAddress()
+{
+    return "24:0A:C4:00:00:02";
+}
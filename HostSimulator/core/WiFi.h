@@ -0,0 +1,82 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA
+} wifi_mode_t;
+
+#define WIFI_OFF WIFI_MODE_NULL
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP WIFI_MODE_AP
+#define WIFI_AP_STA WIFI_MODE_APSTA
+
+typedef enum
+{
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP = 1
+} wifi_interface_t;
+
+// Station/AP control. Association succeeds after a configurable delay; scans
+// return the networks registered with simWiFiAddNetwork() (--network SSID=MAC).
+class WiFiClass
+{
+public:
+    wl_status_t begin(const char *ssid, const char *passphrase = NULL);
+    wl_status_t status();
+    bool disconnect(bool wifioff = false);
+    bool mode(wifi_mode_t mode);
+    wifi_mode_t getMode() { return _mode; }
+    bool isConnected() { return status() == WL_CONNECTED; }
+
+    int16_t scanNetworks();
+    String SSID(uint8_t index);
+    String SSID();
+    String BSSIDstr(uint8_t index);
+    int32_t RSSI(uint8_t index);
+    int32_t channel(uint8_t index);
+    int32_t channel(); // Every simulated network is on channel 1
+    void scanDelete() {}
+
+    IPAddress localIP();
+    String macAddress();
+
+    bool softAP(const char *ssid, const char *passphrase = NULL, int channel = 1, int ssid_hidden = 0, int max_connection = 4);
+    bool softAPdisconnect(bool wifioff = false);
+    IPAddress softAPIP();
+    String softAPmacAddress();
+
+private:
+    wifi_mode_t _mode = WIFI_MODE_NULL;
+    std::string _ssid;
+    unsigned long _connectStart = 0;
+    bool _connecting = false;
+};
+
+extern WiFiClass WiFi;
+
+// Simulator configuration
+void simWiFiAddNetwork(const std::string &ssid, const std::string &bssid);
+void simWiFiSetConnectDelay(unsigned long ms);
+
+#endif
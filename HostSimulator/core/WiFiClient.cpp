@@ -0,0 +1,193 @@
+#include "WiFiClient.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+SimNetStats simNetStats = {0, 0, 0, 0};
+
+static std::string endpointHost = "127.0.0.1";
+static uint16_t endpointPort = 5000;
+
+void simNetSetEndpoint(const std::string &host, uint16_t port)
+{
+    endpointHost = host;
+    endpointPort = port;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    (void)host;
+    (void)port;
+    stop();
+
+    struct addrinfo hints = {};
+    struct addrinfo *result = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string service = std::to_string(endpointPort);
+    if (getaddrinfo(endpointHost.c_str(), service.c_str(), &hints, &result) != 0)
+    {
+        simNetStats.connectFailures++;
+        return 0;
+    }
+
+    _fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (_fd < 0 || ::connect(_fd, result->ai_addr, result->ai_addrlen) != 0)
+    {
+        freeaddrinfo(result);
+        stop();
+        simNetStats.connectFailures++;
+        return 0;
+    }
+    freeaddrinfo(result);
+    _peerClosed = false;
+    simNetStats.connects++;
+    return 1;
+}
+
+size_t WiFiClient::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size)
+{
+    if (_fd < 0)
+    {
+        return 0;
+    }
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t n = send(_fd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            _peerClosed = true;
+            break;
+        }
+        sent += n;
+    }
+    simNetStats.bytesSent += sent;
+    return sent;
+}
+
+// The sketch polls available()/read() against millis(). In fast mode millis()
+// is virtual, so give the real peer a little wall-clock time on every empty poll.
+bool WiFiClient::waitReadable(int timeoutMs)
+{
+    if (_fd < 0 || _peerClosed)
+    {
+        return false;
+    }
+    struct pollfd pfd = {_fd, POLLIN, 0};
+    return poll(&pfd, 1, timeoutMs) > 0 && (pfd.revents & (POLLIN | POLLHUP));
+}
+
+int WiFiClient::available()
+{
+    if (_peeked >= 0)
+    {
+        return 1;
+    }
+    if (_fd < 0)
+    {
+        return 0;
+    }
+    int pending = 0;
+    if (waitReadable(simFastMode() ? 5 : 0))
+    {
+        uint8_t c;
+        ssize_t n = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0)
+        {
+            _peerClosed = true;
+            return 0;
+        }
+        pending = n > 0 ? 1 : 0;
+    }
+    return pending;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    size_t count = 0;
+    if (_peeked >= 0)
+    {
+        buf[count++] = (uint8_t)_peeked;
+        _peeked = -1;
+    }
+    if (count < size && available())
+    {
+        ssize_t n = recv(_fd, buf + count, size - count, MSG_DONTWAIT);
+        if (n > 0)
+        {
+            count += n;
+            simNetStats.bytesReceived += n;
+        }
+        else if (n == 0)
+        {
+            _peerClosed = true;
+        }
+    }
+    return count > 0 ? (int)count : -1;
+}
+
+int WiFiClient::peek()
+{
+    if (_peeked < 0)
+    {
+        _peeked = read();
+    }
+    return _peeked;
+}
+
+void WiFiClient::stop()
+{
+    if (_fd >= 0)
+    {
+        close(_fd);
+        _fd = -1;
+    }
+    _peeked = -1;
+    _peerClosed = false;
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (_fd < 0)
+    {
+        return 0;
+    }
+    if (_peeked >= 0)
+    {
+        return 1;
+    }
+    if (!_peerClosed)
+    {
+        uint8_t c;
+        ssize_t n = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0)
+        {
+            _peerClosed = true;
+        }
+    }
+    // Like the ESP32 core, report connected while unread data remains
+    return !_peerClosed || available() ? 1 : 0;
+}
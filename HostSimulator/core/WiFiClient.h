@@ -0,0 +1,52 @@
+#ifndef HOST_WIFICLIENT_H
+#define HOST_WIFICLIENT_H
+
+#include <string>
+#include "Arduino.h"
+
+// Plain TCP client on host sockets. Every connect() is redirected to the
+// endpoint set with simNetSetEndpoint() (--inference host:port), so sketches
+// can keep their production host names and ports.
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() {}
+    virtual ~WiFiClient() { stop(); }
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient &operator=(const WiFiClient &) = delete;
+
+    virtual int connect(const char *host, uint16_t port);
+    virtual int connect(const char *host, uint16_t port, int32_t timeout) { (void)timeout; return connect(host, port); }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size);
+    int peek() override;
+    void flush() override {}
+    void stop();
+    uint8_t connected();
+    operator bool() { return connected(); }
+
+    using Print::write;
+
+protected:
+    int _fd = -1;
+    int _peeked = -1;
+    bool _peerClosed = false;
+
+    bool waitReadable(int timeoutMs);
+};
+
+struct SimNetStats
+{
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    uint32_t connects;
+    uint32_t connectFailures;
+};
+extern SimNetStats simNetStats;
+
+void simNetSetEndpoint(const std::string &host, uint16_t port);
+
+#endif
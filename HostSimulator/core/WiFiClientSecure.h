@@ -0,0 +1,16 @@
+#ifndef HOST_WIFICLIENTSECURE_H
+#define HOST_WIFICLIENTSECURE_H
+
+#include "WiFiClient.h"
+
+// TLS is not simulated: the secure client talks plain TCP to the simulator
+// endpoint (the mock inference server speaks HTTP).
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setInsecure() {}
+    void setCACert(const char *rootCA) { (void)rootCA; }
+    void setHandshakeTimeout(unsigned long handshake_timeout) { (void)handshake_timeout; }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "Arduino.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> virtualOffsetUs(0);
+static std::atomic<bool> fastMode(false);
+
+static uint64_t elapsedMicros()
+{
+    auto real = std::chrono::steady_clock::now() - clockStart;
+    return std::chrono::duration_cast<std::chrono::microseconds>(real).count() + virtualOffsetUs.load();
+}
+
+unsigned long millis() { return (unsigned long)(elapsedMicros() / 1000); }
+unsigned long micros() { return (unsigned long)elapsedMicros(); }
+void delay(unsigned long ms) { simSleepMicros((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { simSleepMicros(us); }
+void yield() { std::this_thread::yield(); }
+
+void simSleepMicros(uint64_t us)
+{
+    if (fastMode)
+    {
+        virtualOffsetUs += us;
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void simSetFastMode(bool fast) { fastMode = fast; }
+bool simFastMode() { return fastMode; }
+
+void configTime(long, int, const char *, const char *, const char *) {}
+
+bool psramFound() { return true; }
+void *ps_malloc(size_t size) { return malloc(size); }
+void *ps_calloc(size_t n, size_t size) { return calloc(n, size); }
+void *ps_realloc(void *ptr, size_t size) { return realloc(ptr, size); }
+
+void EspClass::restart()
+{
+    printf("[sim] ESP.restart() called, exiting\n");
+    exit(2);
+}
+
+uint32_t EspClass::getFreeHeap() { return 320 * 1024; }
+uint32_t EspClass::getFreePsram() { return 4 * 1024 * 1024; }
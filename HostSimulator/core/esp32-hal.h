@@ -0,0 +1,47 @@
+#ifndef HOST_ESP32_HAL_H
+#define HOST_ESP32_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_TIMEOUT 0x107
+
+// Simulated time. In fast mode delay() and device latencies advance a virtual
+// clock instead of sleeping, so long RUN_INTERVALs replay in milliseconds.
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void simSleepMicros(uint64_t us);
+void simSetFastMode(bool fast);
+bool simFastMode();
+
+// The host clock is already set, so SNTP configuration is a no-op
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+
+// PSRAM is always "present" on the host
+bool psramFound();
+void *ps_malloc(size_t size);
+void *ps_calloc(size_t n, size_t size);
+void *ps_realloc(void *ptr, size_t size);
+
+class EspClass
+{
+public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getFreePsram();
+};
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,107 @@
+#include "esp_now.h"
+#include <string.h>
+#include <vector>
+
+SimEspNowStats simEspNowStats = {0, 0};
+
+static bool initialized = false;
+static esp_now_send_cb_t sendCallback = nullptr;
+static std::vector<esp_now_peer_info_t> peers;
+
+static std::vector<esp_now_peer_info_t>::iterator findPeer(const uint8_t *peer_addr)
+{
+    for (auto it = peers.begin(); it != peers.end(); ++it)
+    {
+        if (memcmp(it->peer_addr, peer_addr, ESP_NOW_ETH_ALEN) == 0)
+        {
+            return it;
+        }
+    }
+    return peers.end();
+}
+
+esp_err_t esp_now_init()
+{
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit()
+{
+    initialized = false;
+    peers.clear();
+    sendCallback = nullptr;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    if (!initialized)
+    {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    sendCallback = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    (void)cb;
+    return initialized ? ESP_OK : ESP_ERR_ESPNOW_NOT_INIT;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (!initialized)
+    {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (!peer)
+    {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (findPeer(peer->peer_addr) != peers.end())
+    {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+    peers.push_back(*peer);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    auto it = findPeer(peer_addr);
+    if (it == peers.end())
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    peers.erase(it);
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    return findPeer(peer_addr) != peers.end();
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    if (!initialized)
+    {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (!data || len > ESP_NOW_MAX_DATA_LEN || findPeer(peer_addr) == peers.end())
+    {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    printf("[sim] esp_now_send %02X:%02X:%02X:%02X:%02X:%02X (%zu bytes): %.*s\n",
+           peer_addr[0], peer_addr[1], peer_addr[2], peer_addr[3], peer_addr[4], peer_addr[5],
+           len, (int)len, (const char *)data);
+    simEspNowStats.packetsSent++;
+    simEspNowStats.bytesSent += len;
+    if (sendCallback)
+    {
+        sendCallback(peer_addr, ESP_NOW_SEND_SUCCESS);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,235 @@
+#include "Arduino.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+struct SimTask
+{
+    pthread_t thread;
+    std::string name;
+    TaskFunction_t code;
+    void *parameters;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+};
+
+struct SimQueue
+{
+    size_t length;
+    size_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+    std::mutex lock;
+    std::condition_variable changed;
+};
+
+static thread_local SimTask *currentTask = nullptr;
+
+// Tasks run with cancellation disabled and only act on vTaskDelete() from another task
+// here, never inside the C++ runtime (unwinding a condition variable wait terminates)
+static void cancellationPoint()
+{
+    int state;
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
+    pthread_testcancel();
+    pthread_setcancelstate(state, nullptr);
+}
+
+// Waits on cv until ready() or the timeout, checking for cancellation in between
+template <typename Ready>
+static bool waitFor(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks, Ready ready)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+    while (!ready())
+    {
+        if (ticks != portMAX_DELAY && std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+        // Short slices so that pthread_cancel() is acted on promptly
+        cv.wait_for(lock, std::chrono::milliseconds(10));
+        lock.unlock();
+        cancellationPoint();
+        lock.lock();
+    }
+    return true;
+}
+
+static void *taskEntry(void *argument)
+{
+    SimTask *task = static_cast<SimTask *>(argument);
+    currentTask = task;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+    task->code(task->parameters);
+    return nullptr;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t, void *parameters, UBaseType_t,
+                                   TaskHandle_t *createdTask, BaseType_t)
+{
+    SimTask *task = new SimTask();
+    task->name = name ? name : "";
+    task->code = code;
+    task->parameters = parameters;
+    if (createdTask)
+    {
+        *createdTask = task;
+    }
+    if (pthread_create(&task->thread, nullptr, taskEntry, task) != 0)
+    {
+        if (createdTask)
+        {
+            *createdTask = nullptr;
+        }
+        delete task;
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *createdTask)
+{
+    return xTaskCreatePinnedToCore(code, name, stackDepth, parameters, priority, createdTask, tskNO_AFFINITY);
+}
+
+// The SimTask is not freed: other tasks may still hold the handle, as they may on the device
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr || task == currentTask)
+    {
+        pthread_exit(nullptr);
+    }
+    pthread_cancel(task->thread);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    // The loop() thread and other plain threads get a handle on first use
+    if (currentTask == nullptr)
+    {
+        currentTask = new SimTask();
+        currentTask->thread = pthread_self();
+        currentTask->name = "main";
+    }
+    return currentTask;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    cancellationPoint();
+    delay(ticks);
+    cancellationPoint();
+}
+
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t period)
+{
+    TickType_t wake = *previousWakeTime + period;
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(wake - now) > 0)
+    {
+        vTaskDelay(wake - now);
+    }
+    *previousWakeTime = wake;
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return (TickType_t)millis();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifications++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    SimTask *task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->lock);
+    waitFor(task->notified, lock, ticksToWait, [task] { return task->notifications > 0; });
+    uint32_t count = task->notifications;
+    if (count > 0)
+    {
+        task->notifications = clearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    SimQueue *queue = new SimQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue] { return queue->items.size() < queue->length; }))
+    {
+        return errQUEUE_FULL;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+    lock.unlock();
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue] { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    memcpy(buffer, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    lock.unlock();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue] { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    memcpy(buffer, queue->items.front().data(), queue->itemSize);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->items.clear();
+    }
+    queue->changed.notify_all();
+    return pdPASS;
+}
@@ -0,0 +1,23 @@
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+// lwIP's BSD socket API is the POSIX one. Datagrams to addresses registered with
+// simSocketsRedirect() go to another host instead, so code that talks to a device at a
+// fixed address (the Tello at 192.168.10.1) can be pointed at a simulator.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Addresses in network byte order, as IPAddress converts them
+void simSocketsRedirect(uint32_t from, uint32_t to);
+
+ssize_t simSendto(int sock, const void *data, size_t size, int flags, const struct sockaddr *to, socklen_t toLength);
+#define sendto simSendto
+
+#endif
@@ -0,0 +1,32 @@
+#include "lwip/sockets.h"
+#include <map>
+#include <mutex>
+
+#undef sendto
+
+static std::map<uint32_t, uint32_t> redirects;
+static std::mutex redirectLock;
+
+void simSocketsRedirect(uint32_t from, uint32_t to)
+{
+    std::lock_guard<std::mutex> guard(redirectLock);
+    redirects[from] = to;
+}
+
+ssize_t simSendto(int sock, const void *data, size_t size, int flags, const struct sockaddr *to, socklen_t toLength)
+{
+    if (to != nullptr && to->sa_family == AF_INET && toLength >= sizeof(struct sockaddr_in))
+    {
+        struct sockaddr_in target = *(const struct sockaddr_in *)to;
+        {
+            std::lock_guard<std::mutex> guard(redirectLock);
+            auto redirect = redirects.find(target.sin_addr.s_addr);
+            if (redirect != redirects.end())
+            {
+                target.sin_addr.s_addr = redirect->second;
+            }
+        }
+        return sendto(sock, data, size, flags, (const struct sockaddr *)&target, sizeof(target));
+    }
+    return sendto(sock, data, size, flags, to, toLength);
+}
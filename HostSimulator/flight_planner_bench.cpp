@@ -0,0 +1,217 @@
+// Benchmarks FlightPlanner on synthetic greenhouse layouts. For every layout it compares
+//   axis     the points in the order they were listed, one axis at a time, facing each move
+//   go       the points in the order they were listed, one command per leg (no reordering)
+//   planned  FlightPlanner::plan (reordered, pass-through points merged, one command per leg)
+// and prints the command count, distance, turning and the estimated flight time.
+//
+//   ./build/flight_planner_bench --rows 6 --plants 12 --spacing 40 --seed 1
+//   ./build/flight_planner_bench --speed 30 --overhead-ms 2000 --dump planned
+//
+// --dump prints the commands of one method for the first layout, as they would be sent.
+
+#include "FlightPlanner.h"
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+
+struct Options
+{
+    int rows = 6;          // Plant rows along x, aisles between them
+    int plants = 12;       // Plants per row
+    int spacing = 40;      // cm between plants
+    int rowPitch = 120;    // cm between rows
+    int height = 80;       // Capture height above the takeoff point
+    unsigned seed = 1;
+    PlanTimings timings = {50, 90, 1500};
+    std::string dump;
+};
+
+struct Layout
+{
+    std::string name;
+    std::vector<PlanPoint> points;
+};
+
+static PlanPoint capture(int x, int y, int z, int heading)
+{
+    return PlanPoint{x, y, z, heading, true, true};
+}
+
+// One capture per plant, facing the plant from the aisle on its right (heading 270 = left)
+static std::vector<PlanPoint> plantCaptures(const Options &options)
+{
+    std::vector<PlanPoint> points;
+    for (int row = 0; row < options.rows; row++)
+    {
+        for (int plant = 0; plant < options.plants; plant++)
+        {
+            points.push_back(capture(60 + plant * options.spacing, row * options.rowPitch + 50, options.height, 270));
+        }
+    }
+    return points;
+}
+
+static std::vector<Layout> layouts(const Options &options)
+{
+    std::mt19937 random(options.seed);
+    std::vector<Layout> result;
+
+    // Listed row by row, every row from the door end (as a spreadsheet of plants would be)
+    result.push_back({"rows", plantCaptures(options)});
+
+    // The same plants in the order they were registered
+    Layout shuffled = {"rows-shuffled", plantCaptures(options)};
+    std::shuffle(shuffled.points.begin(), shuffled.points.end(), random);
+    result.push_back(shuffled);
+
+    // Alternating sides: both neighbouring rows are filmed from each aisle
+    Layout sides = {"both-sides", {}};
+    for (int row = 0; row < options.rows; row++)
+    {
+        for (int plant = 0; plant < options.plants; plant++)
+        {
+            int x = 60 + plant * options.spacing;
+            int aisle = (row / 2) * 2 * options.rowPitch + options.rowPitch;
+            sides.points.push_back(capture(x, aisle, options.height, row % 2 ? 90 : 270));
+        }
+    }
+    result.push_back(sides);
+
+    // A survey path sampled every 20 cm along each aisle, capturing every fourth sample
+    Layout survey = {"survey-path", {}};
+    int length = 60 + (options.plants - 1) * options.spacing;
+    for (int row = 0; row < options.rows; row++)
+    {
+        int y = row * options.rowPitch + 50;
+        for (int x = 0, sample = 0; x <= length; x += 20, sample++)
+        {
+            int along = row % 2 ? length - x : x;
+            bool stop = sample % 4 == 0;
+            survey.points.push_back(PlanPoint{along, y, options.height, 270, stop, stop});
+        }
+    }
+    result.push_back(survey);
+
+    // Spot checks at random plants and heights, without a required heading
+    Layout spots = {"spot-checks", {}};
+    std::uniform_int_distribution<int> rowOf(0, options.rows - 1), plantOf(0, options.plants - 1), heightOf(0, 2);
+    for (int i = 0; i < options.rows * options.plants / 3; i++)
+    {
+        spots.points.push_back(PlanPoint{60 + plantOf(random) * options.spacing, rowOf(random) * options.rowPitch + 50,
+                                         40 + heightOf(random) * 60, 0, false, true});
+    }
+    result.push_back(spots);
+    return result;
+}
+
+static double cpuMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void dump(const std::vector<PlanCommand> &commands)
+{
+    char text[TELLO_COMMAND_MAX];
+    for (const PlanCommand &command : commands)
+    {
+        if (telloFormatCommand(text, sizeof(text), command.id, command.args, command.argCount))
+        {
+            printf("  %-24s%s\n", text, command.point >= 0 ? "<- point" : "");
+        }
+        else
+        {
+            printf("  (rejected %s)\n", telloCommand(command.id).name);
+        }
+    }
+}
+
+static void report(const char *layout, size_t points, const char *method, const PlanEstimate &estimate, double planMs)
+{
+    printf("%-14s %6zu  %-8s %8d %9.1f %10d %9.1f %9.2f\n", layout, points, method, estimate.commands,
+           estimate.distanceCm / 100.0f, estimate.turnDegrees, estimate.flightMs / 1000.0f, planMs);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--rows") && hasValue)
+            options.rows = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--plants") && hasValue)
+            options.plants = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--spacing") && hasValue)
+            options.spacing = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--row-pitch") && hasValue)
+            options.rowPitch = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && hasValue)
+            options.seed = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--speed") && hasValue)
+            options.timings.speed = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--yaw-rate") && hasValue)
+            options.timings.yawRate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--overhead-ms") && hasValue)
+            options.timings.commandOverheadMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--dump") && hasValue)
+            options.dump = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--rows N] [--plants N] [--spacing CM] [--row-pitch CM] [--seed N]\n"
+                            "          [--speed CM/S] [--yaw-rate DEG/S] [--overhead-ms MS] [--dump axis|go|planned]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (options.rows < 1 || options.plants < 1 || options.spacing < FlightPlanner::MIN_MOVE || options.timings.speed < 10 ||
+        options.timings.speed > 100 || options.timings.yawRate < 1)
+    {
+        fprintf(stderr, "Invalid layout or timings\n");
+        return 2;
+    }
+
+    FlightPlanner planner(options.timings);
+    printf("%-14s %6s  %-8s %8s %9s %10s %9s %9s\n", "layout", "points", "method", "commands", "dist (m)", "turn (deg)",
+           "est (s)", "plan (ms)");
+
+    bool first = true;
+    for (const Layout &layout : layouts(options))
+    {
+        std::vector<int> listed(layout.points.size());
+        for (size_t i = 0; i < listed.size(); i++)
+        {
+            listed[i] = i;
+        }
+
+        std::vector<PlanCommand> axis = planner.axisByAxis(layout.points);
+        std::vector<PlanCommand> legs = planner.commands(layout.points, listed);
+        double start = cpuMs();
+        std::vector<PlanCommand> planned = planner.plan(layout.points);
+        double planMs = cpuMs() - start;
+
+        PlanEstimate axisEstimate = planner.estimate(axis);
+        PlanEstimate plannedEstimate = planner.estimate(planned);
+        report(layout.name.c_str(), layout.points.size(), "axis", axisEstimate, 0);
+        report(layout.name.c_str(), layout.points.size(), "go", planner.estimate(legs), 0);
+        report(layout.name.c_str(), layout.points.size(), "planned", plannedEstimate, planMs);
+        printf("%-14s %6s  %-8s %7.0f%% %8.0f%% %10s %8.0f%%\n\n", "", "", "saved",
+               100.0 * (axisEstimate.commands - plannedEstimate.commands) / axisEstimate.commands,
+               100.0 * (axisEstimate.distanceCm - plannedEstimate.distanceCm) / axisEstimate.distanceCm, "",
+               100.0 * ((double)axisEstimate.flightMs - plannedEstimate.flightMs) / axisEstimate.flightMs);
+
+        if (first && !options.dump.empty())
+        {
+            printf("%s commands for %s:\n", options.dump.c_str(), layout.name.c_str());
+            dump(options.dump == "axis" ? axis : options.dump == "go" ? legs : planned);
+            printf("\n");
+        }
+        first = false;
+    }
+    return 0;
+}
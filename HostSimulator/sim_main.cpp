@@ -0,0 +1,191 @@
+/*
+ * Host entry point: runs an Arduino sketch's setup()/loop() against the
+ * simulated camera, SD card, Wi-Fi and ESP-NOW, and reports per-cycle timing.
+ * A "cycle" is one loop() call that initialised the camera.
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "SD_MMC.h"
+#include "WiFi.h"
+#include "WiFiClient.h"
+#include "esp_camera.h"
+#include "esp_now.h"
+
+void setup();
+void loop();
+
+struct CycleReport
+{
+    unsigned long virtualMs;
+    double wallMs;
+    uint32_t frames;
+    uint32_t transcoded;
+    uint64_t sdBytes;
+    uint64_t netBytes;
+};
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --frames DIR          replay JPEGs from DIR (sorted, looped); synthetic scene if omitted\n"
+           "  --per-frame           advance the replayed scene every frame instead of every camera session\n"
+           "  --fps N               sensor frame rate (default 12.5)\n"
+           "  --latency MS          extra latency per esp_camera_fb_get (default 30)\n"
+           "  --init-ms MS          esp_camera_init duration (default 250)\n"
+           "  --sd DIR              host directory backing SD_MMC (default ./sdcard)\n"
+           "  --inference HOST:PORT endpoint for every TCP connect (default 127.0.0.1:5000)\n"
+           "  --network SSID=MAC    add a scannable network (repeatable)\n"
+           "  --cycles N            stop after N camera cycles (default 3)\n"
+           "  --duration-ms MS      stop after MS of simulated time\n"
+           "  --fast                virtual clock: delays and latencies do not sleep\n",
+           argv0);
+}
+
+int main(int argc, char **argv)
+{
+    SimCameraConfig camera;
+    std::string sdRoot = "./sdcard";
+    std::vector<std::pair<std::string, std::string>> networks;
+    unsigned long cycles = 3;
+    unsigned long durationMs = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool takesValue = arg != "--fast" && arg != "--per-frame" && arg != "--help";
+        if (takesValue && !value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+        if (arg == "--frames")
+            camera.frameDir = value;
+        else if (arg == "--per-frame")
+            camera.advancePerFrame = true;
+        else if (arg == "--fps")
+            camera.fps = atof(value);
+        else if (arg == "--latency")
+            camera.latencyMs = strtoul(value, nullptr, 10);
+        else if (arg == "--init-ms")
+            camera.initMs = strtoul(value, nullptr, 10);
+        else if (arg == "--sd")
+            sdRoot = value;
+        else if (arg == "--cycles")
+            cycles = strtoul(value, nullptr, 10);
+        else if (arg == "--duration-ms")
+            durationMs = strtoul(value, nullptr, 10);
+        else if (arg == "--fast")
+            simSetFastMode(true);
+        else if (arg == "--inference")
+        {
+            std::string endpoint = value;
+            size_t colon = endpoint.rfind(':');
+            if (colon == std::string::npos)
+            {
+                fprintf(stderr, "--inference expects HOST:PORT\n");
+                return 1;
+            }
+            simNetSetEndpoint(endpoint.substr(0, colon), (uint16_t)atoi(endpoint.c_str() + colon + 1));
+        }
+        else if (arg == "--network")
+        {
+            std::string entry = value;
+            size_t eq = entry.find('=');
+            if (eq == std::string::npos)
+            {
+                fprintf(stderr, "--network expects SSID=MAC\n");
+                return 1;
+            }
+            networks.push_back({entry.substr(0, eq), entry.substr(eq + 1)});
+        }
+        else
+        {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+        if (takesValue)
+        {
+            i++;
+        }
+    }
+
+    if (networks.empty())
+    {
+        // Peers the greenhouse sketches look for
+        networks.push_back({"ESP32_RECEIVER", "24:0A:C4:11:22:01"});
+        networks.push_back({"TELLO_ESP32_CAM", "24:0A:C4:11:22:02"});
+    }
+    for (const auto &network : networks)
+    {
+        simWiFiAddNetwork(network.first, network.second);
+    }
+    SD_MMC.setRoot(sdRoot);
+    simCameraConfigure(camera);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    std::vector<CycleReport> reports;
+    unsigned long start = millis();
+    setup();
+
+    while (reports.size() < cycles && (durationMs == 0 || millis() - start < durationMs))
+    {
+        uint32_t initsBefore = simCameraStats().inits;
+        uint32_t framesBefore = simCameraStats().framesDelivered;
+        uint32_t transcodedBefore = simCameraStats().framesTranscoded;
+        uint64_t sdBefore = simFsStats.bytesWritten;
+        uint64_t netBefore = simNetStats.bytesSent + simNetStats.bytesReceived;
+        unsigned long virtualStart = millis();
+        auto wallStart = std::chrono::steady_clock::now();
+
+        loop();
+
+        if (simCameraStats().inits != initsBefore)
+        {
+            CycleReport report;
+            report.virtualMs = millis() - virtualStart;
+            report.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+            report.frames = simCameraStats().framesDelivered - framesBefore;
+            report.transcoded = simCameraStats().framesTranscoded - transcodedBefore;
+            report.sdBytes = simFsStats.bytesWritten - sdBefore;
+            report.netBytes = simNetStats.bytesSent + simNetStats.bytesReceived - netBefore;
+            reports.push_back(report);
+        }
+        else
+        {
+            delay(1);
+        }
+    }
+
+    printf("\n[sim] ===== Report =====\n");
+    printf("[sim] cycle  device_ms  host_ms  frames  transcoded  sd_bytes  net_bytes\n");
+    unsigned long totalVirtual = 0;
+    double totalWall = 0;
+    for (size_t i = 0; i < reports.size(); i++)
+    {
+        const CycleReport &r = reports[i];
+        printf("[sim] %5zu  %9lu  %7.1f  %6u  %10u  %8llu  %9llu\n", i + 1, r.virtualMs, r.wallMs, r.frames,
+               r.transcoded, (unsigned long long)r.sdBytes, (unsigned long long)r.netBytes);
+        totalVirtual += r.virtualMs;
+        totalWall += r.wallMs;
+    }
+    if (!reports.empty())
+    {
+        printf("[sim] mean   %9.1f  %7.1f\n", (double)totalVirtual / reports.size(), totalWall / reports.size());
+    }
+    const SimCameraStats &cam = simCameraStats();
+    printf("[sim] camera: %u inits, %u frames (%u skipped, %u transcoded, %u timeouts), %llu bytes\n", cam.inits,
+           cam.framesDelivered, cam.framesSkipped, cam.framesTranscoded, cam.getTimeouts, (unsigned long long)cam.bytesDelivered);
+    printf("[sim] sd: %llu bytes written, %llu bytes read, %u files opened\n", (unsigned long long)simFsStats.bytesWritten,
+           (unsigned long long)simFsStats.bytesRead, simFsStats.filesOpened);
+    printf("[sim] net: %u connects (%u failed), %llu bytes sent, %llu bytes received\n", simNetStats.connects,
+           simNetStats.connectFailures, (unsigned long long)simNetStats.bytesSent, (unsigned long long)simNetStats.bytesReceived);
+    printf("[sim] esp-now: %u packets, %llu bytes\n", simEspNowStats.packetsSent, (unsigned long long)simEspNowStats.bytesSent);
+    return 0;
+}
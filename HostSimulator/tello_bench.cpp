@@ -0,0 +1,306 @@
+// Runs the controller's TelloESP32 (compiled unchanged against the host core, FreeRTOS and
+// socket shims) against tools/tello_sim.py and measures:
+//   - command round-trip time, through the same retry/matching path the sketch uses
+//   - telemetry from the state stream
+//   - video: datagrams and frames received, through PacketRing and H264Reassembler, and
+//     with the simulator's synthetic stream, what was lost on the way
+//   - optionally a mission (MissionRunner) from a JSON file
+//   - optionally the video muxed to fragmented MP4 (Fmp4Muxer), for tools/mp4_check.py
+//   - optionally the bitrate and frame rate adapted to the link (VideoQualityController),
+//     with 1 s windows and a 4 s probe delay so it settles within a short run
+// and prints the adaptive command timings (TelloRtt.h) at the end.
+//
+//   python3 tools/tello_sim.py --time-scale 0.1 --jitter-ms 5 --loss 0.01 &
+//   ./build/tello_bench --sim 127.0.0.1 --commands 200 --video-s 10
+//   ./build/tello_bench --mission /missions/mission.json --sd ./sdcard
+//   ./build/tello_bench --video-s 10 --mp4 ./build/tello.mp4
+//   ./build/tello_bench --video-s 40 --adaptive   (simulator with --link-mbps 2.5 --link-queue-kb 256)
+//
+// Exits with 1 if a command failed, no telemetry or video arrived, or more video
+// datagrams were lost than --max-video-loss (percent) allows.
+
+#include "Arduino.h"
+#include "SD_MMC.h"
+#include "TelloESP32.h"
+#include "H264Reassembler.h"
+#include "Fmp4Muxer.h"
+#include "VideoQuality.h"
+#include "MissionRunner.h"
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const uint8_t SIM_SEI_UUID[16] = {'T', 'E', 'L', 'L', 'O', 'S', 'I', 'M', 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48};
+
+struct Options
+{
+    std::string sim = "127.0.0.1";
+    int commands = 100;
+    int videoSeconds = 10;
+    std::string mission;
+    std::string sd = "./sdcard";
+    double maxVideoLoss = 100.0;
+    std::string mp4;
+    bool adaptive = false;
+};
+
+// Loss accounting against the simulator's SEI (frame number, datagrams sent before the
+// frame), anchored on complete frames, whose last datagram is the one that delivered them
+struct SimFrameCounters
+{
+    std::mutex lock;
+    uint32_t pushed = 0;          // Datagrams handed to the reassembler
+    bool seen = false;
+    uint32_t firstFrame = 0;
+    uint32_t firstSentEnd = 0;    // Datagrams sent up to the end of the first complete frame
+    uint32_t firstPushed = 0;
+    uint32_t lastFrame = 0;
+    uint32_t lastSentEnd = 0;
+    uint32_t lastPushed = 0;
+    uint32_t intactFrames = 0;    // Complete frames after the first one
+};
+
+static bool parseSimSei(const H264Frame &frame, uint32_t &number, uint32_t &datagrams)
+{
+    static const uint8_t header[] = {0x00, 0x00, 0x01, 0x06, 0x05, 0x20};
+    const uint8_t *end = frame.data + frame.size;
+    const uint8_t *found = std::search(frame.data, end, header, header + sizeof(header));
+    if (found == end || end - found < (ptrdiff_t)(sizeof(header) + 32) ||
+        memcmp(found + sizeof(header), SIM_SEI_UUID, sizeof(SIM_SEI_UUID)) != 0)
+    {
+        return false;
+    }
+    char hex[17] = {};
+    memcpy(hex, found + sizeof(header) + 16, 16);
+    std::string text(hex);
+    number = strtoul(text.substr(0, 8).c_str(), nullptr, 16);
+    datagrams = strtoul(text.substr(8, 8).c_str(), nullptr, 16);
+    return true;
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [--sim ADDRESS] [--commands N] [--video-s S] [--max-video-loss PERCENT]\n"
+           "          [--mission PATH --sd DIR] [--mp4 PATH] [--adaptive]\n",
+           program);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sim" && hasValue)
+            options.sim = argv[++i];
+        else if (arg == "--commands" && hasValue)
+            options.commands = atoi(argv[++i]);
+        else if (arg == "--video-s" && hasValue)
+            options.videoSeconds = atoi(argv[++i]);
+        else if (arg == "--max-video-loss" && hasValue)
+            options.maxVideoLoss = atof(argv[++i]);
+        else if (arg == "--mission" && hasValue)
+            options.mission = argv[++i];
+        else if (arg == "--sd" && hasValue)
+            options.sd = argv[++i];
+        else if (arg == "--mp4" && hasValue)
+            options.mp4 = argv[++i];
+        else if (arg == "--adaptive")
+            options.adaptive = true;
+        else
+        {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 2;
+        }
+    }
+
+    struct in_addr simAddress;
+    if (inet_pton(AF_INET, options.sim.c_str(), &simAddress) != 1)
+    {
+        printf("Invalid simulator address %s\n", options.sim.c_str());
+        return 2;
+    }
+    simSocketsRedirect((uint32_t)IPAddress(192, 168, 10, 1), simAddress.s_addr);
+    simWiFiSetConnectDelay(0);
+
+    TelloESP32 tello;
+    if (!tello.connect("TELLO-SIM", ""))
+    {
+        printf("No answer to \"command\" from %s:8889\n", options.sim.c_str());
+        return 1;
+    }
+    bool failed = false;
+
+    // Command round trips: speed? is never answered from telemetry
+    std::vector<double> rttMs;
+    int commandFailures = 0;
+    for (int i = 0; i < options.commands; i++)
+    {
+        unsigned long start = micros();
+        String reply = tello.getSpeed();
+        double elapsed = (micros() - start) / 1000.0;
+        if (reply.length() == 0 || reply.startsWith("error"))
+        {
+            commandFailures++;
+            continue;
+        }
+        rttMs.push_back(elapsed);
+    }
+    std::sort(rttMs.begin(), rttMs.end());
+    if (!rttMs.empty())
+    {
+        auto percentile = [&](double p) { return rttMs[std::min(rttMs.size() - 1, (size_t)(p * rttMs.size()))]; };
+        printf("Commands: %zu/%d answered, rtt min %.1f ms, median %.1f ms, p95 %.1f ms, max %.1f ms\n", rttMs.size(),
+               options.commands, rttMs.front(), percentile(0.5), percentile(0.95), rttMs.back());
+    }
+    else
+    {
+        printf("Commands: none of %d answered\n", options.commands);
+    }
+    failed |= commandFailures > 0;
+
+    TelloTelemetry telemetry;
+    if (tello.getTelemetry(telemetry))
+    {
+        printf("Telemetry: %u state packets, battery %d%%, height %d cm\n", (unsigned)telemetry.packets,
+               telemetry.battery, telemetry.height);
+    }
+    else
+    {
+        printf("Telemetry: no state packets\n");
+        failed = true;
+    }
+
+    // Video through the same path as the sketch: ring -> dispatch task -> reassembler
+    if (options.videoSeconds > 0)
+    {
+        H264Reassembler reassembler;
+        SimFrameCounters counters;
+        if (!reassembler.begin())
+        {
+            printf("Reassembler buffer allocation failed\n");
+            return 1;
+        }
+        Fmp4Muxer muxer;
+        FILE *mp4 = nullptr;
+        if (!options.mp4.empty())
+        {
+            mp4 = fopen(options.mp4.c_str(), "wb");
+            if (mp4 == nullptr || !muxer.begin())
+            {
+                printf("Cannot write %s\n", options.mp4.c_str());
+                return 1;
+            }
+            muxer.start([mp4](const uint8_t *data, size_t size) { return fwrite(data, 1, size, mp4); });
+        }
+        reassembler.onFrame([&](const H264Frame &frame) {
+            muxer.addFrame(frame);
+            uint32_t number, datagrams;
+            if (!frame.complete || !parseSimSei(frame, number, datagrams))
+            {
+                return;
+            }
+            uint32_t sentEnd = datagrams + (frame.size + H264Reassembler::TELLO_PACKET_SIZE - 1) / H264Reassembler::TELLO_PACKET_SIZE;
+            std::lock_guard<std::mutex> guard(counters.lock);
+            if (!counters.seen)
+            {
+                counters.seen = true;
+                counters.firstFrame = number;
+                counters.firstSentEnd = sentEnd;
+                counters.firstPushed = counters.pushed;
+            }
+            else
+            {
+                counters.intactFrames++;
+            }
+            counters.lastFrame = number;
+            counters.lastSentEnd = sentEnd;
+            counters.lastPushed = counters.pushed;
+        });
+        VideoQualityController quality(tello, reassembler);
+        quality.setIntervals(1000, 4000);
+        uint32_t ringDropped = 0;
+        tello.onVideoStreamData([&](const uint8_t *buffer, size_t size) {
+            quality.recordPacket(size);
+            if (tello.getVideoPacketsDropped() != ringDropped)
+            {
+                ringDropped = tello.getVideoPacketsDropped();
+                reassembler.markLoss();
+            }
+            {
+                std::lock_guard<std::mutex> guard(counters.lock);
+                counters.pushed++;
+            }
+            reassembler.push(buffer, size, millis());
+        });
+        if (options.adaptive && !quality.begin())
+        {
+            printf("Video: setbitrate/setfps failed\n");
+            failed = true;
+        }
+        if (!tello.startVideoStream())
+        {
+            printf("Video: streamon failed\n");
+            return 1;
+        }
+        unsigned long videoStart = millis();
+        while (millis() - videoStart < options.videoSeconds * 1000UL)
+        {
+            quality.update();
+            delay(20);
+        }
+        quality.end();
+        tello.stopVideoStream();
+        delay(200);
+        if (mp4 != nullptr)
+        {
+            failed |= !muxer.finish();
+            fclose(mp4);
+            muxer.printStats();
+        }
+
+        if (options.adaptive)
+        {
+            quality.printSummary();
+        }
+        H264ReassemblerStats stats = reassembler.stats();
+        printf("Video: %u datagrams received, %u dropped in the ring, %u frames (%u keyframes, %u incomplete)\n",
+               (unsigned)tello.getVideoPacketsReceived(), (unsigned)tello.getVideoPacketsDropped(), (unsigned)stats.frames,
+               (unsigned)stats.keyframes, (unsigned)stats.incompleteFrames);
+        failed |= stats.frames == 0;
+
+        std::lock_guard<std::mutex> guard(counters.lock);
+        if (counters.seen && counters.lastFrame > counters.firstFrame)
+        {
+            uint32_t framesSent = counters.lastFrame - counters.firstFrame;
+            uint32_t datagramsSent = counters.lastSentEnd - counters.firstSentEnd;
+            uint32_t received = std::min(datagramsSent, counters.lastPushed - counters.firstPushed);
+            double loss = datagramsSent ? 100.0 * (datagramsSent - received) / datagramsSent : 0;
+            printf("Video: %u of %u frames intact, %.2f%% of %u datagrams lost\n", (unsigned)counters.intactFrames,
+                   (unsigned)framesSent, loss, (unsigned)datagramsSent);
+            failed |= loss > options.maxVideoLoss;
+        }
+    }
+
+    if (!options.mission.empty())
+    {
+        SD_MMC.setRoot(options.sd);
+        MissionRunner mission(tello);
+        if (!SD_MMC.begin() || !mission.load(SD_MMC, options.mission.c_str()) || !mission.start())
+        {
+            return 1;
+        }
+        while (mission.update())
+        {
+            delay(20);
+        }
+        mission.printSummary();
+        failed |= !mission.succeeded();
+    }
+
+    tello.printCommandStats();
+    tello.disconnect();
+    return failed ? 1 : 0;
+}
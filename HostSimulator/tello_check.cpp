@@ -0,0 +1,148 @@
+// Drives TelloResponseMatcher over real UDP against tools/tello_sim.py --tagged and
+// checks that every accepted reply belongs to the command it was matched to. Mirrors the
+// loop in TelloESP32::sendCommandWithReturn (drain, begin, send, wait, abandon on timeout).
+// The sequence takes off and lands, so the simulator accepts the moves; run it with
+// --time-scale 0 so that only the injected delays hold replies back.
+//
+//   python3 tools/tello_sim.py --time-scale 0 --tagged --delay-every 4 --duplicate-every 3 &
+//   ./build/tello_check --commands 200 --timeout-ms 1000 --gap-ms 20
+//
+// --gap-ms is the pause between commands (the controller logs and paces its commands);
+// duplicates arriving within it are settled before the next command is sent.
+//
+// --naive replays the previous behaviour (first reply after the send wins) for comparison.
+
+#include "TelloResponseMatcher.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint32_t nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000u + ts.tv_nsec / 1000000u;
+}
+
+// Receives one datagram within timeoutMs; returns false on timeout
+static bool receiveReply(int sock, int timeoutMs, std::string &reply)
+{
+    struct pollfd fd = {sock, POLLIN, 0};
+    if (poll(&fd, 1, timeoutMs) <= 0)
+    {
+        return false;
+    }
+    char buffer[256];
+    ssize_t len = recv(sock, buffer, sizeof(buffer) - 1, 0);
+    if (len <= 0)
+    {
+        return false;
+    }
+    buffer[len] = '\0';
+    reply = buffer;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 8889;
+    int commands = 100;
+    int timeoutMs = 1000;
+    int gapMs = 20;
+    bool naive = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--commands") && i + 1 < argc)
+            commands = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--timeout-ms") && i + 1 < argc)
+            timeoutMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gap-ms") && i + 1 < argc)
+            gapMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--naive"))
+            naive = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--port N] [--commands N] [--timeout-ms N] [--gap-ms N] [--naive]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in tello = {};
+    tello.sin_family = AF_INET;
+    tello.sin_port = htons(port);
+    tello.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    static const char *SEQUENCE[] = {"command", "takeoff", "battery?", "forward 20", "height?", "cw 90", "speed?", "land", "time?"};
+    const int sequenceLength = sizeof(SEQUENCE) / sizeof(SEQUENCE[0]);
+    TelloResponseMatcher matcher;
+    int correct = 0, wrong = 0, timeouts = 0;
+
+    for (int n = 0; n < commands; n++)
+    {
+        const char *command = SEQUENCE[n % sequenceLength];
+        std::string reply;
+        usleep(gapMs * 1000);
+        if (naive)
+        {
+            while (receiveReply(sock, 0, reply))
+            {
+            }
+        }
+        else
+        {
+            while (receiveReply(sock, 0, reply))
+            {
+                matcher.accept(reply.c_str(), nowMs());
+            }
+            matcher.begin(command, nowMs());
+        }
+        sendto(sock, command, strlen(command), 0, (struct sockaddr *)&tello, sizeof(tello));
+
+        uint32_t start = nowMs();
+        bool answered = false;
+        while (!answered && nowMs() - start < (uint32_t)timeoutMs)
+        {
+            if (!receiveReply(sock, timeoutMs - (nowMs() - start), reply))
+            {
+                continue;
+            }
+            answered = naive || matcher.accept(reply.c_str(), nowMs());
+        }
+        if (!answered)
+        {
+            if (!naive)
+            {
+                matcher.abandon(nowMs());
+            }
+            timeouts++;
+            continue;
+        }
+
+        // Tagged answers name their query; acknowledgements must be "ok"
+        std::string expected = command;
+        bool match = expected.back() == '?' ? reply.rfind(expected.substr(0, expected.size() - 1) + ":", 0) == 0 : reply == "ok";
+        if (match)
+        {
+            correct++;
+        }
+        else
+        {
+            wrong++;
+            printf("#%d %s: got \"%s\"\n", n, command, reply.c_str());
+        }
+    }
+
+    printf("%s: %d commands, %d correct, %d wrong, %d timed out, %u stale replies discarded\n",
+           naive ? "naive" : "matcher", commands, correct, wrong, timeouts, matcher.staleDiscarded());
+    close(sock);
+    return wrong == 0 ? 0 : 1;
+}
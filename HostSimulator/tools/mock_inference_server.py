@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Stand-in for the inference server's /infer endpoint, for host simulation runs.
+
+Speaks plain HTTP/1.1 with keep-alive (the simulated WiFiClientSecure does not
+do TLS). Accepts the same multipart upload as InferenceHandlerServer/main.py and
+answers with the same JSON shape. Predictions are derived from a hash of the
+uploaded bytes, so identical images always produce identical results.
+
+    python3 tools/mock_inference_server.py --port 5000 --delay 0.4
+"""
+
+import argparse
+import hashlib
+import json
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+class InferHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    delay = 0.0
+    requests = 0
+
+    def do_POST(self):
+        if self.path != "/infer":
+            self.send_error(404)
+            return
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+        InferHandler.requests += 1
+
+        digest = hashlib.sha256(body).digest()
+        ripe, unripe, green = digest[0] % 8, digest[1] % 6, digest[2] % 5
+        result = {
+            "frame_count": 1,
+            "total_objects": ripe + unripe + green,
+            "predictions": {"ripe": ripe, "unripe": unripe, "green": green},
+        }
+        time.sleep(self.delay)
+
+        payload = json.dumps(result).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+        print(f"#{InferHandler.requests}: {length} bytes uploaded -> {result}", flush=True)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=5000)
+    parser.add_argument("--delay", type=float, default=0.0, help="seconds of simulated inference time")
+    args = parser.parse_args()
+
+    InferHandler.delay = args.delay
+    server = ThreadingHTTPServer((args.host, args.port), InferHandler)
+    print(f"Mock inference server on http://{args.host}:{args.port}/infer", flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
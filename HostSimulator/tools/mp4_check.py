@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""Checks a fragmented MP4 written by Fmp4Muxer, without a decoder.
+
+Walks the boxes and verifies that:
+  - ftyp and moov come first, with one avc1 track whose avcC holds an SPS and a PPS,
+    and an mvex (the samples are all in fragments)
+  - every moof is followed by its mdat, sequence numbers increase, the trun data offset
+    and sample sizes cover the mdat exactly, and each sample is a list of length-prefixed
+    NAL units (no start codes or AUDs, and no SPS/PPS repeating the ones in avcC; differing
+    ones, after the bitrate or frame rate changed, stay in the samples)
+  - samples flagged as sync hold an IDR slice, and every fragment's tfdt continues the
+    previous one
+  - the mfra index, when present, points at moofs whose sync sample has the indexed time
+
+--truncate also cuts the file at a number of places, as power loss would, and checks that
+every fragment before the cut is still read.
+
+    python3 tools/mp4_check.py ./build/tello.mp4 --truncate
+"""
+
+import argparse
+import random
+import struct
+import sys
+
+NON_SYNC_BIT = 0x00010000
+
+
+class Mp4Error(Exception):
+    pass
+
+
+def boxes(data, start, end):
+    """(type, payload start, box end) of the boxes in data[start:end]; stops at a box that
+    does not fit, as a reader of a cut file would."""
+    offset = start
+    while offset + 8 <= end:
+        size, kind = struct.unpack(">I4s", data[offset:offset + 8])
+        header = 8
+        if size == 1:
+            if offset + 16 > end:
+                return
+            size = struct.unpack(">Q", data[offset + 8:offset + 16])[0]
+            header = 16
+        if size < header or offset + size > end:
+            return
+        yield kind.decode("latin-1"), offset + header, offset + size
+        offset += size
+
+
+def child(data, start, end, path):
+    """Payload range of the box at path (e.g. "trak/mdia") inside data[start:end]."""
+    for name in path.split("/"):
+        for kind, payload, box_end in boxes(data, start, end):
+            if kind == name:
+                start, end = payload, box_end
+                break
+        else:
+            raise Mp4Error(f"missing {name} box")
+    return start, end
+
+
+def parse_moov(data, start, end):
+    trak = child(data, start, end, "trak")
+    stsd = child(data, *trak, "mdia/minf/stbl/stsd")
+    entries = list(boxes(data, stsd[0] + 8, stsd[1]))
+    if len(entries) != 1 or entries[0][0] != "avc1":
+        raise Mp4Error("sample description is not a single avc1 entry")
+    _, payload, avc1_end = entries[0]
+    width, height = struct.unpack(">HH", data[payload + 24:payload + 28])
+    avcc_start, avcc_end = child(data, payload + 78, avc1_end, "avcC")
+    avcc = data[avcc_start:avcc_end]
+    if avcc[0] != 1 or avcc[4] & 3 != 3 or avcc[5] & 0x1F != 1:
+        raise Mp4Error("avcC is not version 1 with 4-byte lengths and one SPS")
+    sps_size = struct.unpack(">H", avcc[6:8])[0]
+    pps_count = avcc[8 + sps_size]
+    if pps_count != 1 or avcc[8] & 0x1F != 7:
+        raise Mp4Error("avcC does not hold an SPS and a PPS")
+    pps_size = struct.unpack(">H", avcc[9 + sps_size:11 + sps_size])[0]
+    described = {avcc[8:8 + sps_size], avcc[11 + sps_size:11 + sps_size + pps_size]}
+    child(data, start, end, "mvex/trex")
+    return width, height, described
+
+
+def parse_fragment(data, moof_start, moof_payload, moof_end, mdat_payload, mdat_end, described):
+    mfhd = child(data, moof_payload, moof_end, "mfhd")
+    sequence = struct.unpack(">I", data[mfhd[0] + 4:mfhd[0] + 8])[0]
+    traf = child(data, moof_payload, moof_end, "traf")
+    tfhd = child(data, *traf, "tfhd")
+    if struct.unpack(">I", data[tfhd[0]:tfhd[0] + 4])[0] & 0x020000 == 0:
+        raise Mp4Error("tfhd without default-base-is-moof")
+    tfdt = child(data, *traf, "tfdt")
+    version = data[tfdt[0]]
+    decode_time = struct.unpack(">Q" if version == 1 else ">I", data[tfdt[0] + 4:tfdt[0] + (12 if version == 1 else 8)])[0]
+
+    trun = child(data, *traf, "trun")
+    flags = struct.unpack(">I", data[trun[0]:trun[0] + 4])[0] & 0xFFFFFF
+    if flags != 0x000701:
+        raise Mp4Error(f"unexpected trun flags {flags:06x}")
+    count, data_offset = struct.unpack(">Ii", data[trun[0] + 4:trun[0] + 12])
+    samples = [struct.unpack(">III", data[trun[0] + 12 + 12 * i:trun[0] + 24 + 12 * i]) for i in range(count)]
+
+    offset = moof_start + data_offset
+    if offset != mdat_payload:
+        raise Mp4Error(f"fragment {sequence}: data offset does not point at the mdat payload")
+    for number, (duration, size, sample_flags) in enumerate(samples, 1):
+        if duration == 0:
+            raise Mp4Error(f"fragment {sequence}: sample {number} has no duration")
+        nal_types = []
+        repeated = False
+        position = offset
+        while position < offset + size:
+            length = struct.unpack(">I", data[position:position + 4])[0]
+            if length == 0 or position + 4 + length > offset + size:
+                raise Mp4Error(f"fragment {sequence}: sample {number} has a bad NAL length")
+            nal_types.append(data[position + 4] & 0x1F)
+            repeated |= data[position + 4:position + 4 + length] in described
+            position += 4 + length
+        if 9 in nal_types or repeated:
+            raise Mp4Error(f"fragment {sequence}: sample {number} holds an AUD or the described parameter sets")
+        sync = sample_flags & NON_SYNC_BIT == 0
+        if sync and 5 not in nal_types:
+            raise Mp4Error(f"fragment {sequence}: sync sample {number} has no IDR slice")
+        offset += size
+    if offset != mdat_end:
+        raise Mp4Error(f"fragment {sequence}: samples do not fill the mdat")
+    return sequence, decode_time, samples
+
+
+def parse(data, strict=True):
+    """Returns a summary dict; with strict False, stops quietly where a cut file ends."""
+    top = list(boxes(data, 0, len(data)))
+    if len(top) < 2 or top[0][0] != "ftyp" or top[1][0] != "moov":
+        raise Mp4Error("file does not start with ftyp and moov")
+    width, height, described = parse_moov(data, top[1][1], top[1][2])
+
+    summary = {"width": width, "height": height, "fragments": [], "samples": 0, "sync": 0, "gaps": 0,
+               "duration": 0, "index": None}
+    next_time = None
+    previous_sequence = 0
+    i = 2
+    while i < len(top):
+        kind, payload, end = top[i]
+        if kind == "moof":
+            if i + 1 >= len(top) or top[i + 1][0] != "mdat":
+                if strict:
+                    raise Mp4Error("moof without mdat")
+                break
+            sequence, decode_time, samples = parse_fragment(data, payload - 8, payload, end, top[i + 1][1], top[i + 1][2],
+                                                             described)
+            if sequence <= previous_sequence:
+                raise Mp4Error(f"fragment sequence {sequence} after {previous_sequence}")
+            if next_time is not None and decode_time != next_time:
+                if decode_time < next_time:
+                    raise Mp4Error(f"fragment {sequence} starts before the previous one ends")
+                summary["gaps"] += 1   # A fragment dropped by the writer
+            previous_sequence = sequence
+            duration = sum(s[0] for s in samples)
+            next_time = decode_time + duration
+            summary["fragments"].append((payload - 8, decode_time, samples))
+            summary["samples"] += len(samples)
+            summary["sync"] += sum(1 for s in samples if s[2] & NON_SYNC_BIT == 0)
+            summary["duration"] = next_time
+            i += 2
+        elif kind == "mfra":
+            summary["index"] = check_index(data, payload, end, summary["fragments"])
+            i += 1
+        else:
+            i += 1
+    return summary
+
+
+def check_index(data, start, end, fragments):
+    tfra = child(data, start, end, "tfra")
+    version = data[tfra[0]]
+    if version != 1 or struct.unpack(">I", data[tfra[0] + 8:tfra[0] + 12])[0] & 0x3F != 0:
+        raise Mp4Error("tfra is not version 1 with one-byte numbers")
+    count = struct.unpack(">I", data[tfra[0] + 12:tfra[0] + 16])[0]
+    by_offset = {offset: (time, samples) for offset, time, samples in fragments}
+    for i in range(count):
+        entry = tfra[0] + 16 + 19 * i
+        time, moof_offset = struct.unpack(">QQ", data[entry:entry + 16])
+        sample = data[entry + 18]
+        if moof_offset not in by_offset:
+            raise Mp4Error(f"index entry {i} does not point at a moof")
+        fragment_time, samples = by_offset[moof_offset]
+        if not 1 <= sample <= len(samples) or samples[sample - 1][2] & NON_SYNC_BIT:
+            raise Mp4Error(f"index entry {i} does not point at a sync sample")
+        if fragment_time + sum(s[0] for s in samples[:sample - 1]) != time:
+            raise Mp4Error(f"index entry {i} has the wrong time")
+    mfro = child(data, start, end, "mfro")
+    if struct.unpack(">I", data[mfro[0] + 4:mfro[0] + 8])[0] != end - start + 8:
+        raise Mp4Error("mfro size does not match the mfra")
+    return count
+
+
+def check_truncated(data, summary, cuts, seed):
+    """Every fragment that ends before the cut must still be read."""
+    header_end = summary["fragments"][0][0] if summary["fragments"] else len(data)
+    rng = random.Random(seed)
+    for _ in range(cuts):
+        cut = rng.randrange(header_end, len(data))
+        expected = 0
+        for offset, _, samples in summary["fragments"]:
+            mdat_end = offset + struct.unpack(">I", data[offset:offset + 4])[0]
+            mdat_end += struct.unpack(">I", data[mdat_end:mdat_end + 4])[0]
+            if mdat_end <= cut:
+                expected += 1
+        cut_summary = parse(data[:cut], strict=False)
+        if len(cut_summary["fragments"]) != expected:
+            raise Mp4Error(f"cut at {cut}: {len(cut_summary['fragments'])} fragments read, {expected} expected")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("path")
+    parser.add_argument("--truncate", action="store_true", help="also check copies cut at random places")
+    parser.add_argument("--cuts", type=int, default=50)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    data = open(args.path, "rb").read()
+    try:
+        summary = parse(data)
+        if not summary["fragments"]:
+            raise Mp4Error("no fragments")
+        if args.truncate:
+            check_truncated(data, summary, args.cuts, args.seed)
+    except Mp4Error as error:
+        print(f"{args.path}: {error}")
+        return 1
+
+    print(f"{args.path}: {summary['width']}x{summary['height']}, {len(summary['fragments'])} fragments, "
+          f"{summary['samples']} samples ({summary['sync']} sync), {summary['duration'] / 90000:.2f} s, "
+          f"{summary['gaps']} gaps, "
+          + (f"{summary['index']} index entries" if summary["index"] is not None else "no index")
+          + (f", {args.cuts} cuts read back" if args.truncate else ""))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,516 @@
+#!/usr/bin/env python3
+"""Tello SDK 2.0 simulator: command port, state stream and H.264 video over UDP.
+
+Commands arrive on --port (8889) and are answered to the sender, once "command" has put
+the drone in SDK mode. The drone runs one command at a time: a move is answered when it
+has been flown (distance / speed, scaled by --time-scale), and commands arriving meanwhile
+wait for it. Replies can be delayed (--latency-ms, --jitter-ms), lost (--loss) and
+duplicated (--duplicate). rc sets stick velocities and gets no reply; without any command
+for --idle-land-s a flying drone lands, like the real one.
+
+For reply-matching tests the faults can also be injected deterministically, on every Nth
+command: --delay-every holds back that reply and the ones after it by --delay-ms,
+--duplicate-every sends it twice, --drop-every never answers it. With --tagged, queries are
+answered "<query>:<n>" (e.g. "battery:7", n counting commands) so a client can check that
+each answer belongs to the query it was matched to.
+
+State packets go to the sender's --state-port (8890) at --state-hz. After "streamon" an
+H.264 elementary stream is sent to --video-port (11111): one access unit per frame period,
+split into 1460-byte datagrams with a shorter last one, as the drone does. The stream is
+a prerecorded Annex-B file (--video, looped) or synthetic frames sized for the bitrate
+(setbitrate / --bitrate-kbps) with SPS/PPS and an IDR every --gop frames. Synthetic frames
+open with an SEI (user data "TELLOSIM", frame number and datagrams sent before it, as hex)
+so a receiver can count what was lost. Datagrams are paced at --link-mbps, and
+--video-loss drops some. With --link-queue-kb the drone buffers only that much ahead of the
+link: a stream above the link rate loses datagrams, as over a weak Wi-Fi link, instead of
+falling behind.
+
+    python3 tools/tello_sim.py --latency-ms 5 --jitter-ms 3 --loss 0.02 --duplicate 0.02
+    python3 tools/tello_sim.py --time-scale 0.1 --video ./flight.h264 --fps 30
+    python3 tools/tello_sim.py --link-mbps 2.5 --link-queue-kb 64
+    python3 tools/tello_sim.py --time-scale 0 --tagged --delay-every 4 --delay-ms 1500 --duplicate-every 3
+
+Ctrl-C (or SIGTERM) prints what was received and sent.
+"""
+
+import argparse
+import heapq
+import math
+import os
+import random
+import signal
+import socket
+import sys
+import threading
+import time
+
+PACKET_SIZE = 1460
+SEI_UUID = b"TELLOSIM" + bytes(range(0x41, 0x49))  # user_data_unregistered id, no zero bytes
+
+TAKEOFF_HEIGHT = 80   # cm
+TAKEOFF_S = 5.0
+LAND_S = 4.0
+FLIP_S = 2.0
+YAW_RATE = 90.0       # deg/s for cw/ccw
+MOVE_OVERHEAD_S = 0.5  # Acceleration and braking of every move
+RC_SPEED = 100.0      # cm/s at full stick
+RC_YAW_RATE = 100.0   # deg/s at full stick
+FPS_WORDS = {"low": 5, "middle": 15, "high": 30}
+
+MOVES = {"up": (0, 0, 1), "down": (0, 0, -1), "left": (0, 1, 0), "right": (0, -1, 0),
+         "forward": (1, 0, 0), "back": (-1, 0, 0)}
+
+
+def parse_int(text):
+    try:
+        return int(text)
+    except ValueError:
+        return None
+
+
+class Drone:
+    """Pose and flight state. Poses are (x, y, z, yaw) in cm and degrees in the takeoff
+    frame (x forward, y left, yaw clockwise); scheduled moves are interpolated."""
+
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.sdk = False
+        self.flying = False
+        self.speed = 50
+        self.battery = 100.0
+        self.flight_time = 0.0
+        self.pose = (0.0, 0.0, 0.0, 0.0)
+        self.motions = []          # (start, end, from pose, to pose), in order
+        self.busy_until = 0.0
+        self.sticks = (0, 0, 0, 0)
+        self.last_command = time.monotonic()
+        self.streaming = False
+        self.fps = args.fps
+        self.bitrate_kbps = args.bitrate_kbps
+        self.landings = 0
+
+    def planned_pose(self):
+        return self.motions[-1][3] if self.motions else self.pose
+
+    def pose_at(self, now):
+        """Current pose; finished motions are folded into self.pose."""
+        while self.motions and self.motions[0][1] <= now:
+            self.pose = self.motions.pop(0)[3]
+        if self.motions and self.motions[0][0] <= now:
+            start, end, before, after = self.motions[0]
+            f = (now - start) / (end - start) if end > start else 1.0
+            return tuple(b + (a - b) * f for b, a in zip(before, after))
+        return self.pose
+
+    def velocity_at(self, now):
+        """Velocity of the running motion in cm/s, in the body frame (forward, right, up)."""
+        self.pose_at(now)
+        if not self.motions or self.motions[0][0] > now or self.motions[0][1] <= self.motions[0][0]:
+            return 0.0, 0.0, 0.0
+        start, end, before, after = self.motions[0]
+        wx, wy, wz = ((a - b) / (end - start) for b, a in zip(before[:3], after[:3]))
+        a = math.radians(before[3])
+        return wx * math.cos(a) - wy * math.sin(a), -(wx * math.sin(a) + wy * math.cos(a)), wz
+
+    def schedule(self, now, seconds, target, flying=None):
+        """Queues a motion behind the running ones; returns its end time."""
+        start = max(now, self.busy_until)
+        end = start + seconds * self.args.time_scale
+        self.motions.append((start, end, self.planned_pose(), target))
+        self.busy_until = end
+        if flying is not None:
+            self.flying = flying
+        return end
+
+    def execute(self, command, now):
+        """Returns (reply or None, time the reply is due)."""
+        words = command.split()
+        if not words:
+            return None, now
+        name, values = words[0], words[1:]
+        self.last_command = now
+        if name == "command":
+            self.sdk = True
+            return "ok", max(now, self.busy_until)
+        if not self.sdk:
+            return None, now   # Ignored until SDK mode, as on the drone
+        if name == "rc":
+            sticks = [parse_int(v) for v in values]
+            if len(sticks) == 4 and all(s is not None and -100 <= s <= 100 for s in sticks):
+                self.sticks = tuple(sticks)
+            return None, now
+        if name.endswith("?"):
+            return self.query(name, now), max(now, self.busy_until)
+
+        x, y, z, yaw = self.planned_pose()
+        if name == "takeoff":
+            if self.flying:
+                return "error", now
+            return "ok", self.schedule(now, TAKEOFF_S, (x, y, TAKEOFF_HEIGHT, yaw), flying=True)
+        if name == "land":
+            if not self.flying:
+                return "error", now
+            self.sticks = (0, 0, 0, 0)
+            self.landings += 1
+            return "ok", self.schedule(now, LAND_S, (x, y, 0.0, yaw), flying=False)
+        if name == "emergency":
+            x, y, z, yaw = self.pose_at(now)
+            self.motions.clear()
+            self.pose = (x, y, 0.0, yaw)
+            self.flying = False
+            self.busy_until = now
+            self.sticks = (0, 0, 0, 0)
+            return "ok", now
+        if name in ("streamon", "streamoff"):
+            self.streaming = name == "streamon"
+            return "ok", max(now, self.busy_until)
+        if name == "speed":
+            value = parse_int(values[0]) if len(values) == 1 else None
+            if value is None or not 10 <= value <= 100:
+                return "out of range", now
+            self.speed = value
+            return "ok", max(now, self.busy_until)
+        if name == "setbitrate":
+            value = parse_int(values[0]) if len(values) == 1 else None
+            if value is None or not 0 <= value <= 5:
+                return "out of range", now
+            self.bitrate_kbps = value * 1000 if value else self.args.bitrate_kbps
+            return "ok", max(now, self.busy_until)
+        if name == "setfps":
+            if len(values) != 1 or values[0] not in FPS_WORDS:
+                return "error", now
+            self.fps = FPS_WORDS[values[0]]
+            return "ok", max(now, self.busy_until)
+        if name == "setresolution":
+            return ("ok" if values in (["low"], ["high"]) else "error"), max(now, self.busy_until)
+
+        # Motion commands need a flying drone
+        if name in MOVES or name in ("cw", "ccw", "go", "flip"):
+            if not self.flying:
+                return "error Not joystick", now
+        if name in MOVES:
+            value = parse_int(values[0]) if len(values) == 1 else None
+            if value is None or not 20 <= value <= 500:
+                return "out of range", now
+            fx, fy, fz = MOVES[name]
+            dx, dy = self.to_world(fx * value, fy * value, yaw)
+            return "ok", self.schedule(now, MOVE_OVERHEAD_S + value / self.speed, (x + dx, y + dy, max(0.0, z + fz * value), yaw))
+        if name in ("cw", "ccw"):
+            value = parse_int(values[0]) if len(values) == 1 else None
+            if value is None or not 1 <= value <= 360:
+                return "out of range", now
+            turned = yaw + (value if name == "cw" else -value)
+            return "ok", self.schedule(now, MOVE_OVERHEAD_S + value / YAW_RATE, (x, y, z, turned))
+        if name == "go":
+            parts = [parse_int(v) for v in values]
+            if len(parts) != 4 or None in parts:
+                return "error", now
+            bx, by, bz, speed = parts
+            if not all(-500 <= v <= 500 for v in (bx, by, bz)) or not 10 <= speed <= 100:
+                return "out of range", now
+            if max(abs(bx), abs(by), abs(bz)) <= 20:
+                return "error", now
+            dx, dy = self.to_world(bx, by, yaw)
+            length = math.sqrt(bx * bx + by * by + bz * bz)
+            return "ok", self.schedule(now, MOVE_OVERHEAD_S + length / speed, (x + dx, y + dy, max(0.0, z + bz), yaw))
+        if name == "flip":
+            if values not in (["f"], ["b"], ["l"], ["r"]):
+                return "error", now
+            return "ok", self.schedule(now, FLIP_S, (x, y, z, yaw))
+        return f"unknown command: {name}", now
+
+    @staticmethod
+    def to_world(bx, by, yaw):
+        a = math.radians(yaw)
+        return bx * math.cos(a) + by * math.sin(a), -bx * math.sin(a) + by * math.cos(a)
+
+    def query(self, name, now):
+        x, y, z, yaw = self.pose_at(now)
+        values = {
+            "battery?": f"{int(self.battery)}", "speed?": f"{self.speed:.1f}", "time?": f"{int(self.flight_time)}s",
+            "height?": f"{int(z / 10)}dm", "temp?": "62~65C", "attitude?": f"pitch:0;roll:0;yaw:{self.yaw_text(yaw)};",
+            "baro?": f"{100 + z / 100:.2f}", "acceleration?": "agx:1.00;agy:-3.00;agz:-998.00;",
+            "tof?": f"{int(z * 10) if self.flying else 100}mm", "wifi?": "90", "sdk?": "20", "sn?": "0TQZHSIMULATOR",
+        }
+        return values.get(name, "error")
+
+    @staticmethod
+    def yaw_text(yaw):
+        return int((yaw + 180) % 360 - 180)
+
+    def tick(self, now, dt):
+        """Advances rc motion, flight time, battery and the idle landing."""
+        if self.flying and now >= self.busy_until and any(self.sticks):
+            lr, fb, ud, turn = self.sticks
+            x, y, z, yaw = self.pose_at(now)
+            dx, dy = self.to_world(fb / 100 * RC_SPEED * dt, lr / 100 * RC_SPEED * dt, yaw)
+            self.pose = (x + dx, y + dy, max(20.0, z + ud / 100 * RC_SPEED * dt), yaw + turn / 100 * RC_YAW_RATE * dt)
+        if self.flying:
+            self.flight_time += dt
+            self.battery = max(0.0, self.battery - dt * 100 / 600)  # ~10 minutes of flight
+            if self.args.idle_land_s and now - self.last_command > self.args.idle_land_s and now >= self.busy_until:
+                print("No command received, landing", flush=True)
+                self.execute("land", now)
+
+    def state_packet(self, now):
+        x, y, z, yaw = self.pose_at(now)
+        lr, fb, ud, _ = self.sticks if self.flying else (0, 0, 0, 0)
+        forward, right, up = self.velocity_at(now)   # dm/s on the drone, vgz positive down
+        height = int(z)
+        return (f"mid:-1;x:0;y:0;z:0;mpry:0,0,0;pitch:0;roll:0;yaw:{self.yaw_text(yaw)};"
+                f"vgx:{fb // 10 + int(forward / 10)};vgy:{lr // 10 + int(right / 10)};vgz:{-ud // 10 - int(up / 10)};"
+                f"templ:62;temph:65;"
+                f"tof:{height + 10 if self.flying else 10};h:{height};bat:{int(self.battery)};"
+                f"baro:{100 + z / 100:.2f};time:{int(self.flight_time)};agx:1.00;agy:-3.00;agz:-998.00;\r\n")
+
+
+def split_nals(data):
+    """Annex-B bytes -> list of NAL units with their start codes."""
+    starts = []
+    i = 0
+    while True:
+        i = data.find(b"\x00\x00\x01", i)
+        if i < 0:
+            break
+        starts.append(i - 1 if i > 0 and data[i - 1] == 0 else i)
+        i += 3
+    return [data[s:e] for s, e in zip(starts, starts[1:] + [len(data)])]
+
+
+def access_units(data):
+    """Groups NAL units into frames: a new one starts at SPS/PPS/SEI/AUD or at a slice
+    with first_mb_in_slice == 0 once the current frame has a slice (H.264 7.4.1.2.3)."""
+    frames, current, has_slice = [], [], False
+    for nal in split_nals(data):
+        body = nal.lstrip(b"\x00")[1:]
+        if not body:
+            continue
+        kind = body[0] & 0x1F
+        first_mb_zero = len(body) > 1 and body[1] & 0x80
+        if has_slice and (kind in (6, 7, 8, 9) or (kind in (1, 5) and first_mb_zero)):
+            frames.append(b"".join(current))
+            current, has_slice = [], False
+        current.append(nal)
+        has_slice = has_slice or kind in (1, 5)
+    if current:
+        frames.append(b"".join(current))
+    return frames
+
+
+class SyntheticStream:
+    """Frames of the requested size with random slice data (no zero bytes, so no start
+    code emulation)."""
+
+    SPS = b"\x00\x00\x00\x01\x67\x4d\x40\x28\xda\x03\xc0\x5b\x90"  # Main profile 960x720, as the drone's
+    PPS = b"\x00\x00\x00\x01\x68\xee\x3c\x80"
+
+    POOL_SIZE = 1 << 20
+
+    def __init__(self, gop, seed):
+        self.gop = gop
+        self.random = random.Random(seed)
+        self.pool = bytes(b % 255 + 1 for b in self.random.randbytes(self.POOL_SIZE))
+        self.frame = 0
+
+    def next(self, average_size, datagrams_sent):
+        keyframe = self.frame % self.gop == 0
+        # IDR frames are about four times a P frame, keeping the average per GOP
+        p_size = average_size * self.gop / (self.gop + 3)
+        size = int((4 * p_size if keyframe else p_size) * self.random.uniform(0.8, 1.2))
+        user_data = SEI_UUID + f"{self.frame:08x}{datagrams_sent:08x}".encode()
+        sei = b"\x00\x00\x00\x01\x06\x05" + bytes([len(user_data)]) + user_data + b"\x80"
+        header = b"\x00\x00\x00\x01" + (b"\x65" if keyframe else b"\x41") + b"\x88"
+        size = min(max(16, size), self.POOL_SIZE)
+        offset = self.random.randrange(0, self.POOL_SIZE - size + 1)
+        payload = self.pool[offset:offset + size]
+        frame = (self.SPS + self.PPS if keyframe else b"") + sei + header + payload
+        if len(frame) % PACKET_SIZE == 0:
+            frame += b"\x80"   # Keep the last datagram short
+        self.frame += 1
+        return frame
+
+
+class Simulator:
+    def __init__(self, args):
+        self.args = args
+        self.random = random.Random(args.seed)
+        self.drone = Drone(args)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind((args.host, args.port))
+        self.out = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.client = None
+        self.pending = []          # (due, sequence, reply, address)
+        self.pending_lock = threading.Condition()
+        self.sequence = 0
+        self.held_until = 0.0      # Replies are not sent before a --delay-every reply
+        self.stats = {"commands": 0, "replies": 0, "replies lost": 0, "duplicates": 0, "rc": 0,
+                      "state packets": 0, "frames": 0, "datagrams": 0, "datagrams lost": 0,
+                      "datagrams overflowed": 0, "video bytes": 0}
+        self.frames = access_units(open(args.video, "rb").read()) if args.video else None
+        if self.frames is not None and not self.frames:
+            sys.exit(f"No H.264 access units in {args.video}")
+        self.synthetic = SyntheticStream(args.gop, args.seed)
+
+    def send_later(self, reply, address, due):
+        with self.pending_lock:
+            self.sequence += 1
+            heapq.heappush(self.pending, (due, self.sequence, reply, address))
+            self.pending_lock.notify()
+
+    def reply_loop(self):
+        while True:
+            with self.pending_lock:
+                while not self.pending or self.pending[0][0] > time.monotonic():
+                    timeout = self.pending[0][0] - time.monotonic() if self.pending else None
+                    self.pending_lock.wait(timeout)
+                _, _, reply, address = heapq.heappop(self.pending)
+            self.sock.sendto(reply.encode(), address)
+
+    def command_loop(self):
+        args = self.args
+        while True:
+            data, address = self.sock.recvfrom(2048)
+            now = time.monotonic()
+            command = data.decode(errors="replace").strip()
+            with self.drone.lock:
+                self.client = address[0]
+                reply, due = self.drone.execute(command, now)
+            if command.startswith("rc "):
+                self.stats["rc"] += 1
+                continue
+            self.stats["commands"] += 1
+            count = self.stats["commands"]
+            if args.tagged and reply is not None and command.endswith("?"):
+                reply = f"{command[:-1]}:{count}"
+            if args.verbose:
+                print(f"{command!r} -> {reply!r} in {(due - now) * 1000:.0f} ms", flush=True)
+            if reply is None:
+                continue
+            lost = self.random.random() < args.loss
+            if lost or (args.drop_every and count % args.drop_every == 0):
+                self.stats["replies lost"] += 1
+                continue
+            due += (args.latency_ms + self.random.uniform(0, args.jitter_ms)) / 1000.0
+            if args.delay_every and count % args.delay_every == 0:
+                due += args.delay_ms / 1000.0
+                self.held_until = due
+            due = max(due, self.held_until)
+            self.send_later(reply, address, due)
+            self.stats["replies"] += 1
+            if self.random.random() < args.duplicate:
+                self.send_later(reply, address, due + self.random.uniform(0, args.jitter_ms + 1) / 1000.0)
+                self.stats["duplicates"] += 1
+            elif args.duplicate_every and count % args.duplicate_every == 0:
+                self.send_later(reply, address, due + args.duplicate_gap_ms / 1000.0)
+                self.stats["duplicates"] += 1
+
+    def state_loop(self):
+        period = 1.0 / self.args.state_hz
+        last = time.monotonic()
+        next_send = last
+        while True:
+            next_send += period
+            time.sleep(max(0.0, next_send - time.monotonic()))
+            now = time.monotonic()
+            with self.drone.lock:
+                self.drone.tick(now, now - last)
+                packet = self.drone.state_packet(now) if self.drone.sdk and self.client else None
+                client = self.client
+            last = now
+            if packet:
+                self.out.sendto(packet.encode(), (client, self.args.state_port))
+                self.stats["state packets"] += 1
+
+    def video_loop(self):
+        args = self.args
+        index = 0
+        next_frame = time.monotonic()
+        link_free = next_frame   # When the link has sent what was queued
+        queue_s = args.link_queue_kb * 1024 * 8 / (args.link_mbps * 1e6)
+        while True:
+            with self.drone.lock:
+                streaming, client = self.drone.streaming and self.client, self.client
+                fps, bitrate_kbps = self.drone.fps, self.drone.bitrate_kbps
+            if not streaming:
+                time.sleep(0.05)
+                next_frame = link_free = time.monotonic()
+                continue
+            if self.frames is not None:
+                frame = self.frames[index % len(self.frames)]
+                index += 1
+            else:
+                frame = self.synthetic.next(bitrate_kbps * 1000 / 8 / fps, self.stats["datagrams"])
+            produced = next_frame if queue_s else time.monotonic()
+            for offset in range(0, len(frame), PACKET_SIZE):
+                self.stats["datagrams"] += 1
+                # Paced at the link rate: a frame does not arrive faster than Wi-Fi carries it
+                start = max(link_free, produced)
+                if queue_s and start - produced > queue_s:
+                    self.stats["datagrams overflowed"] += 1
+                    continue
+                link_free = start + min(PACKET_SIZE, len(frame) - offset) * 8 / (args.link_mbps * 1e6)
+                if self.random.random() < args.video_loss:
+                    self.stats["datagrams lost"] += 1
+                    continue
+                self.out.sendto(frame[offset:offset + PACKET_SIZE], (client, args.video_port))
+                time.sleep(max(0.0, link_free - time.monotonic()))
+            self.stats["frames"] += 1
+            self.stats["video bytes"] += len(frame)
+            next_frame += 1.0 / fps
+            time.sleep(max(0.0, next_frame - time.monotonic()))
+
+    def report(self):
+        print("Tello simulator: " + ", ".join(f"{key} {value}" for key, value in self.stats.items()), flush=True)
+
+    def run(self):
+        for loop in (self.reply_loop, self.state_loop, self.video_loop):
+            threading.Thread(target=loop, daemon=True).start()
+        print(f"Tello simulator on {self.args.host}:{self.args.port}", flush=True)
+        self.command_loop()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1", help="address to listen on")
+    parser.add_argument("--port", type=int, default=8889, help="command port")
+    parser.add_argument("--state-port", type=int, default=8890, help="client port for state packets")
+    parser.add_argument("--video-port", type=int, default=11111, help="client port for video")
+    parser.add_argument("--latency-ms", type=float, default=5.0, help="added to every reply")
+    parser.add_argument("--jitter-ms", type=float, default=0.0, help="random extra reply delay, up to this")
+    parser.add_argument("--loss", type=float, default=0.0, help="probability that a reply is not sent")
+    parser.add_argument("--duplicate", type=float, default=0.0, help="probability that a reply is sent twice")
+    parser.add_argument("--delay-every", type=int, default=0, help="delay every Nth reply and the ones after it")
+    parser.add_argument("--delay-ms", type=float, default=1500.0)
+    parser.add_argument("--duplicate-every", type=int, default=0, help="send every Nth reply twice")
+    parser.add_argument("--duplicate-gap-ms", type=float, default=1.0)
+    parser.add_argument("--drop-every", type=int, default=0, help="never answer every Nth command")
+    parser.add_argument("--tagged", action="store_true", help="answer queries with <query>:<n>")
+    parser.add_argument("--time-scale", type=float, default=1.0, help="factor on flight times (0 = instant)")
+    parser.add_argument("--idle-land-s", type=float, default=15.0, help="land after this long without commands (0 = never)")
+    parser.add_argument("--state-hz", type=float, default=10.0)
+    parser.add_argument("--video", help="Annex-B H.264 file to stream instead of synthetic frames")
+    parser.add_argument("--fps", type=int, default=30)
+    parser.add_argument("--bitrate-kbps", type=int, default=2000, help="synthetic stream bitrate (setbitrate 0)")
+    parser.add_argument("--gop", type=int, default=30, help="synthetic frames per IDR")
+    parser.add_argument("--link-mbps", type=float, default=20.0, help="rate video datagrams are sent at")
+    parser.add_argument("--video-loss", type=float, default=0.0, help="probability that a video datagram is dropped")
+    parser.add_argument("--link-queue-kb", type=float, default=0.0,
+                        help="video buffered ahead of the link, beyond it datagrams are dropped (0 = unlimited)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--verbose", action="store_true", help="log every command")
+    args = parser.parse_args()
+
+    simulator = Simulator(args)
+
+    def stop(*_):
+        simulator.report()
+        os._exit(0)
+
+    signal.signal(signal.SIGINT, stop)
+    signal.signal(signal.SIGTERM, stop)
+    simulator.run()
+
+
+if __name__ == "__main__":
+    main()